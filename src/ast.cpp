@@ -70,6 +70,42 @@ void IfStmt::accept(Visitor* visitor) {
     visitor->visit(this);
 }
 
+void ParallelForStmt::accept(Visitor* visitor) {
+    visitor->visit(this);
+}
+
+void SpawnExpr::accept(Visitor* visitor) {
+    visitor->visit(this);
+}
+
+void SyncStmt::accept(Visitor* visitor) {
+    visitor->visit(this);
+}
+
+void ChannelExpr::accept(Visitor* visitor) {
+    visitor->visit(this);
+}
+
+void GoStmt::accept(Visitor* visitor) {
+    visitor->visit(this);
+}
+
+void ForInStmt::accept(Visitor* visitor) {
+    visitor->visit(this);
+}
+
+void MatchStmt::accept(Visitor* visitor) {
+    visitor->visit(this);
+}
+
+void YieldStmt::accept(Visitor* visitor) {
+    visitor->visit(this);
+}
+
+void BenchStmt::accept(Visitor* visitor) {
+    visitor->visit(this);
+}
+
 void WhileStmt::accept(Visitor* visitor) {
     visitor->visit(this);
 }
@@ -89,6 +125,13 @@ void BlockStmt::addStatement(std::unique_ptr<Stmt> stmt) {
     }
 }
 
+const Attribute* FunctionDecl::getAttribute(const std::string& attributeName) const {
+    for (const auto& attribute : attributes) {
+        if (attribute.name.value == attributeName) return &attribute;
+    }
+    return nullptr;
+}
+
 void FunctionDecl::setBody(std::unique_ptr<BlockStmt> b) {
     if (b) {
         b->setParent(this);
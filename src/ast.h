@@ -7,6 +7,8 @@
 #include "token.h"
 #include "visitor.h"
 
+struct ConstValue;  // Compile-time value, see const_evaluator.h
+
 // Location information for AST nodes
 struct Location {
     int line;
@@ -27,6 +29,19 @@ struct Type {
         
     bool isDynamicArray() const { return isArray && arraySize < 0; }
     bool isFixedArray() const { return isArray && arraySize >= 0; }
+
+    // Channel types are named after their element type, e.g. 'chan<int>'
+    static Type channel(const std::string& element) { return Type("chan<" + element + ">"); }
+    bool isChannel() const { return name.compare(0, 5, "chan<") == 0; }
+    Type channelElement() const { return Type(name.substr(5, name.size() - 6)); }
+
+    // Atomic types likewise carry their value type, e.g. 'atomic<int>'
+    static Type atomic(const std::string& value) { return Type("atomic<" + value + ">"); }
+    bool isAtomic() const { return name.compare(0, 7, "atomic<") == 0; }
+    Type atomicValue() const { return Type(name.substr(7, name.size() - 8)); }
+
+    // 'bits[N]' packs N bools into 64-bit words; its elements read as bool
+    bool isBits() const { return name == "bits"; }
 };
 
 // Base AST node class
@@ -152,6 +167,7 @@ class CallExpr : public Expr {
 public:
     Token name;
     std::vector<std::unique_ptr<Expr>> arguments;
+    std::shared_ptr<ConstValue> constValue;  // Set when a const fn call was folded
     
     CallExpr(const Token& n, std::vector<std::unique_ptr<Expr>> args)
         : Expr(Location(n)), name(n), arguments(std::move(args)) {}
@@ -178,6 +194,30 @@ public:
 };
 
 // Statement nodes
+// 'spawn f(args)': the call may run on another worker. Its result is stored
+// into the assignment target once the call completes, which 'sync' waits for.
+class SpawnExpr : public Expr {
+public:
+    Token keyword;
+    std::unique_ptr<CallExpr> call;
+
+    SpawnExpr(const Token& kw, std::unique_ptr<CallExpr> c)
+        : Expr(Location(kw)), keyword(kw), call(std::move(c)) {}
+    void accept(Visitor* visitor) override;
+};
+
+// 'chan<T>(capacity)': creates a bounded channel of T values
+class ChannelExpr : public Expr {
+public:
+    Token keyword;
+    Type type;  // The channel type, e.g. chan<int>
+    std::unique_ptr<Expr> capacity;
+
+    ChannelExpr(const Token& kw, const Type& t, std::unique_ptr<Expr> cap)
+        : Expr(Location(kw)), keyword(kw), type(t), capacity(std::move(cap)) {}
+    void accept(Visitor* visitor) override;
+};
+
 class ExprStmt : public Stmt {
 public:
     std::unique_ptr<Expr> expr;
@@ -192,6 +232,9 @@ public:
     Token name;
     Type type;
     std::unique_ptr<Expr> initializer;
+    bool isConst = false;                    // Declared with 'const'
+    bool isThreadLocal = false;              // Top-level 'threadlocal var'
+    std::shared_ptr<ConstValue> constValue;  // Evaluated during semantic analysis
     
     VarDeclStmt(const Token& n, const Type& t, std::unique_ptr<Expr> init, const Token& varToken)
         : Stmt(Location(varToken)), name(n), type(t), initializer(std::move(init)) {}
@@ -232,6 +275,116 @@ public:
     void accept(Visitor* visitor) override;
 };
 
+// One 'reduce(op: variable)' clause of a parallel loop
+struct Reduction {
+    Token op;        // '+', '*', 'min' or 'max'
+    Token variable;
+
+    Reduction(const Token& o, const Token& v) : op(o), variable(v) {}
+};
+
+// 'parallel for i in start..end reduce(+: total) { ... }'. Iterations run
+// concurrently; each reduction variable gets a private accumulator per worker.
+class ParallelForStmt : public Stmt {
+public:
+    Token variable;
+    std::unique_ptr<Expr> start;
+    std::unique_ptr<Expr> end;
+    std::vector<Reduction> reductions;
+    std::unique_ptr<BlockStmt> body;
+
+    ParallelForStmt(const Token& var, std::unique_ptr<Expr> s, std::unique_ptr<Expr> e,
+                    std::vector<Reduction> reds, std::unique_ptr<BlockStmt> b, const Token& parallelToken)
+        : Stmt(Location(parallelToken)), variable(var), start(std::move(s)), end(std::move(e)),
+          reductions(std::move(reds)), body(std::move(b)) {}
+    void accept(Visitor* visitor) override;
+};
+
+// 'sync': waits for every call spawned so far by the current function
+class SyncStmt : public Stmt {
+public:
+    explicit SyncStmt(const Token& syncToken) : Stmt(Location(syncToken)) {}
+    void accept(Visitor* visitor) override;
+};
+
+// 'go f(args);': runs the call on a new thread. The program waits for these
+// threads before exiting.
+class GoStmt : public Stmt {
+public:
+    Token keyword;
+    std::unique_ptr<CallExpr> call;
+
+    GoStmt(const Token& kw, std::unique_ptr<CallExpr> c)
+        : Stmt(Location(kw)), keyword(kw), call(std::move(c)) {}
+    void accept(Visitor* visitor) override;
+};
+
+// 'for v in channel { ... }': runs the body for every value received until
+// the channel is closed and drained
+class ForInStmt : public Stmt {
+public:
+    Token variable;
+    std::unique_ptr<Expr> source;  // A channel, or a call to a generator function
+    std::unique_ptr<BlockStmt> body;
+    bool generator = false;        // Set by semantic analysis when source is a generator call
+
+    ForInStmt(const Token& var, std::unique_ptr<Expr> src, std::unique_ptr<BlockStmt> b, const Token& forToken)
+        : Stmt(Location(forToken)), variable(var), source(std::move(src)), body(std::move(b)) {}
+    void accept(Visitor* visitor) override;
+};
+
+// One pattern of a match arm: a constant, or the half-open range 'value..end'
+struct MatchPattern {
+    std::unique_ptr<Expr> value;
+    std::unique_ptr<Expr> end;  // Set for ranges
+};
+
+// 'p1, p2 => { ... }', or '_ => { ... }' when patterns is empty
+struct MatchArm {
+    std::vector<MatchPattern> patterns;
+    std::unique_ptr<BlockStmt> body;
+    std::vector<int64_t> values;  // Case values, filled in by semantic analysis
+
+    bool isWildcard() const { return patterns.empty(); }
+};
+
+// 'match subject { 1 => { ... } 2, 3 => { ... } _ => { ... } }' on an int or
+// bool subject. Lowered to a single LLVM switch.
+class MatchStmt : public Stmt {
+public:
+    Token keyword;
+    std::unique_ptr<Expr> subject;
+    std::vector<MatchArm> arms;
+
+    MatchStmt(const Token& kw, std::unique_ptr<Expr> s, std::vector<MatchArm> a)
+        : Stmt(Location(kw)), keyword(kw), subject(std::move(s)), arms(std::move(a)) {}
+    void accept(Visitor* visitor) override;
+};
+
+// 'yield value;' hands the next element of a generator to its loop
+class YieldStmt : public Stmt {
+public:
+    Token keyword;
+    std::unique_ptr<Expr> value;
+
+    YieldStmt(const Token& kw, std::unique_ptr<Expr> v)
+        : Stmt(Location(kw)), keyword(kw), value(std::move(v)) {}
+    void accept(Visitor* visitor) override;
+};
+
+// 'bench "name" { ... }' times the block with warmup and calibrated batches;
+// the runtime reports the results when the program exits
+class BenchStmt : public Stmt {
+public:
+    Token keyword;
+    Token name;
+    std::unique_ptr<BlockStmt> body;
+
+    BenchStmt(const Token& kw, const Token& n, std::unique_ptr<BlockStmt> b)
+        : Stmt(Location(kw)), keyword(kw), name(n), body(std::move(b)) {}
+    void accept(Visitor* visitor) override;
+};
+
 class ReturnStmt : public Stmt {
 public:
     Token keyword;
@@ -251,6 +404,14 @@ struct Parameter {
         : name(n), type(t) {}
 };
 
+// Function attribute such as '@memo' or '@memo(256)'
+struct Attribute {
+    Token name;
+    std::vector<Token> arguments;
+
+    explicit Attribute(const Token& n) : name(n) {}
+};
+
 // Function declaration
 class FunctionDecl : public ASTNode {
 public:
@@ -258,6 +419,16 @@ public:
     Type returnType;
     std::vector<Parameter> parameters;
     std::unique_ptr<BlockStmt> body;
+    bool isConst = false;  // 'const fn': evaluable at compile time
+    std::vector<std::string> typeParameters;  // Non-empty for generic functions
+    std::vector<Token> templateTokens;        // Source of a generic, re-parsed per instantiation
+    std::vector<Attribute> attributes;
+    int memoCapacity = 0;  // Cache entries for '@memo' functions, set by semantic analysis
+    bool spawns = false;   // Contains 'spawn', so returns wait for outstanding calls
+    bool isGenerator = false;  // 'fn gen T': yields a sequence of T, consumed by 'for ... in'
+
+    bool isGeneric() const { return !typeParameters.empty(); }
+    const Attribute* getAttribute(const std::string& attributeName) const;
     
     FunctionDecl(const Token& n, const Type& rt,
                 std::vector<Parameter> params,
@@ -274,6 +445,7 @@ public:
 class Program : public ASTNode {
 public:
     std::vector<std::unique_ptr<FunctionDecl>> functions;
+    std::vector<std::unique_ptr<VarDeclStmt>> globals;  // Top-level var/const declarations
     
     Program(std::vector<std::unique_ptr<FunctionDecl>> funcs, const Token& startToken)
         : ASTNode(Location(startToken)), functions(std::move(funcs)) {}
@@ -0,0 +1,872 @@
+#include "ast_cache.h"
+#include "const_evaluator.h"
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/xxhash.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+namespace Lei {
+
+namespace {
+
+// Bumped whenever the AST, the symbol table or this encoding changes
+constexpr uint32_t FormatVersion = 3;
+constexpr char Magic[8] = { 'L', 'E', 'I', 'A', 'S', 'T', '\0', '\0' };
+
+// File layout: Header, stringCount + 1 string offsets, the string bytes
+// padded to a word, then wordCount words of nodes and symbols
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t stringCount;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint64_t stringBytes;
+    uint64_t wordCount;
+    uint64_t checksum;  // Of everything after the header
+};
+
+enum class Tag : uint32_t {
+    Null, Number, String, Bool, Variable, ArrayAccess, Binary, Unary, TypeName, Assign, Call,
+    ArrayInit, ArrayAlloc, Spawn, Channel, ExprStmt, VarDecl, Block, If, While, ParallelFor,
+    Sync, Go, ForIn, Match, Yield, Bench, Return, Function
+};
+
+// Constant arrays are written once; later references point back to them
+constexpr uint32_t NoConstant = 0;
+constexpr uint32_t InlineConstant = 1;
+constexpr uint32_t SharedArray = 2;
+
+class AstWriter : public Visitor {
+public:
+    std::vector<uint32_t> words;
+    std::vector<std::string> strings;
+
+    void word(uint32_t value) { words.push_back(value); }
+    void int64(int64_t value) {
+        word(static_cast<uint32_t>(static_cast<uint64_t>(value)));
+        word(static_cast<uint32_t>(static_cast<uint64_t>(value) >> 32));
+    }
+    void real(double value) {
+        int64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        int64(bits);
+    }
+
+    void string(const std::string& text) {
+        auto found = interned.find(text);
+        if (found == interned.end()) {
+            found = interned.emplace(text, static_cast<uint32_t>(strings.size())).first;
+            strings.push_back(text);
+        }
+        word(found->second);
+    }
+
+    void location(const Location& loc) {
+        word(static_cast<uint32_t>(loc.line));
+        word(static_cast<uint32_t>(loc.column));
+    }
+
+    void token(const Token& token) {
+        word(token.type);
+        string(token.value);
+        word(static_cast<uint32_t>(token.line));
+        word(static_cast<uint32_t>(token.column));
+    }
+
+    void type(const Type& type) {
+        string(type.name);
+        word(type.isArray);
+        word(static_cast<uint32_t>(type.arraySize));
+    }
+
+    void constant(const ConstValue& value) {
+        word(static_cast<uint32_t>(value.kind));
+        switch (value.kind) {
+            case ConstValue::Kind::INT:    int64(value.intValue); break;
+            case ConstValue::Kind::FLOAT:  real(value.floatValue); break;
+            case ConstValue::Kind::BOOL:   word(value.boolValue); break;
+            case ConstValue::Kind::STRING: string(value.stringValue); break;
+            case ConstValue::Kind::ARRAY: {
+                auto shared = arrays.find(value.array.get());
+                if (shared != arrays.end()) {
+                    word(SharedArray);
+                    word(shared->second);
+                    break;
+                }
+                arrays.emplace(value.array.get(), static_cast<uint32_t>(arrays.size()));
+                word(InlineConstant);
+                word(value.array->frozen);
+                word(static_cast<uint32_t>(value.array->elements.size()));
+                for (const ConstValue& element : value.array->elements) {
+                    constant(element);
+                }
+                break;
+            }
+        }
+    }
+
+    void optionalConstant(const std::shared_ptr<ConstValue>& value) {
+        word(value ? InlineConstant : NoConstant);
+        if (value) constant(*value);
+    }
+
+    void node(ASTNode* node) {
+        if (node) node->accept(this);
+        else word(static_cast<uint32_t>(Tag::Null));
+    }
+
+    void begin(Tag tag, ASTNode* node) {
+        word(static_cast<uint32_t>(tag));
+        location(node->loc);
+    }
+
+    void symbols(const SymbolTable& table) {
+        const auto& globals = table.getScopes().front()->getSymbols();
+        word(static_cast<uint32_t>(globals.size()));
+        for (const auto& entry : globals) {
+            const Symbol& symbol = *entry.second;
+            word(static_cast<uint32_t>(symbol.kind));
+            string(symbol.name);
+            type(symbol.type);
+            word(static_cast<uint32_t>(symbol.line));
+            word(static_cast<uint32_t>(symbol.column));
+            word(symbol.isConstant);
+            optionalConstant(symbol.constValue);
+            if (symbol.kind == Symbol::Kind::FUNCTION) {
+                const auto& function = static_cast<const FunctionSymbol&>(symbol);
+                word(function.isConst);
+                word(function.isBuiltin);
+                parameters(function.parameters);
+            }
+        }
+    }
+
+    void parameters(const std::vector<Parameter>& parameters) {
+        word(static_cast<uint32_t>(parameters.size()));
+        for (const Parameter& parameter : parameters) {
+            token(parameter.name);
+            type(parameter.type);
+        }
+    }
+
+    void visit(Program* node) override {
+        location(node->loc);
+        word(static_cast<uint32_t>(node->functions.size()));
+        for (const auto& function : node->functions) visit(function.get());
+        word(static_cast<uint32_t>(node->globals.size()));
+        for (const auto& global : node->globals) visit(global.get());
+    }
+
+    void visit(FunctionDecl* node) override {
+        begin(Tag::Function, node);
+        token(node->name);
+        type(node->returnType);
+        parameters(node->parameters);
+        this->node(node->body.get());
+        word(node->isConst);
+        word(static_cast<uint32_t>(node->typeParameters.size()));
+        for (const auto& name : node->typeParameters) string(name);
+        word(static_cast<uint32_t>(node->templateTokens.size()));
+        for (const auto& templateToken : node->templateTokens) token(templateToken);
+        word(static_cast<uint32_t>(node->attributes.size()));
+        for (const auto& attribute : node->attributes) {
+            token(attribute.name);
+            word(static_cast<uint32_t>(attribute.arguments.size()));
+            for (const auto& argument : attribute.arguments) token(argument);
+        }
+        word(static_cast<uint32_t>(node->memoCapacity));
+        word(node->spawns);
+        word(node->isGenerator);
+    }
+
+    void visit(NumberExpr* node) override { begin(Tag::Number, node); token(node->token); word(node->isFloat); }
+    void visit(StringExpr* node) override { begin(Tag::String, node); token(node->token); }
+    void visit(BoolExpr* node) override { begin(Tag::Bool, node); token(node->token); word(node->value); }
+    void visit(VariableExpr* node) override { begin(Tag::Variable, node); token(node->name); }
+
+    void visit(ArrayAccessExpr* node) override {
+        begin(Tag::ArrayAccess, node);
+        this->node(node->array.get());
+        this->node(node->index.get());
+    }
+
+    void visit(BinaryExpr* node) override {
+        begin(Tag::Binary, node);
+        this->node(node->left.get());
+        token(node->op);
+        this->node(node->right.get());
+    }
+
+    void visit(UnaryExpr* node) override {
+        begin(Tag::Unary, node);
+        token(node->op);
+        this->node(node->expr.get());
+    }
+
+    void visit(TypeExpr* node) override { begin(Tag::TypeName, node); type(node->type); }
+
+    void visit(AssignExpr* node) override {
+        begin(Tag::Assign, node);
+        this->node(node->target.get());
+        token(node->op);
+        this->node(node->value.get());
+    }
+
+    void visit(CallExpr* node) override {
+        begin(Tag::Call, node);
+        token(node->name);
+        word(static_cast<uint32_t>(node->arguments.size()));
+        for (const auto& argument : node->arguments) this->node(argument.get());
+        optionalConstant(node->constValue);
+    }
+
+    void visit(ArrayInitExpr* node) override {
+        begin(Tag::ArrayInit, node);
+        word(static_cast<uint32_t>(node->elements.size()));
+        for (const auto& element : node->elements) this->node(element.get());
+        int64(static_cast<int64_t>(node->inferredSize));
+    }
+
+    void visit(ArrayAllocExpr* node) override {
+        begin(Tag::ArrayAlloc, node);
+        type(node->elementType);
+        this->node(node->size.get());
+    }
+
+    void visit(SpawnExpr* node) override {
+        begin(Tag::Spawn, node);
+        token(node->keyword);
+        this->node(node->call.get());
+    }
+
+    void visit(ChannelExpr* node) override {
+        begin(Tag::Channel, node);
+        token(node->keyword);
+        type(node->type);
+        this->node(node->capacity.get());
+    }
+
+    void visit(ExprStmt* node) override { begin(Tag::ExprStmt, node); this->node(node->expr.get()); }
+
+    void visit(VarDeclStmt* node) override {
+        begin(Tag::VarDecl, node);
+        token(node->name);
+        type(node->type);
+        this->node(node->initializer.get());
+        word(node->isConst);
+        word(node->isThreadLocal);
+        optionalConstant(node->constValue);
+    }
+
+    void visit(BlockStmt* node) override {
+        begin(Tag::Block, node);
+        word(static_cast<uint32_t>(node->statements.size()));
+        for (const auto& statement : node->statements) this->node(statement.get());
+    }
+
+    void visit(IfStmt* node) override {
+        begin(Tag::If, node);
+        this->node(node->condition.get());
+        this->node(node->thenBranch.get());
+        this->node(node->elseBranch.get());
+    }
+
+    void visit(WhileStmt* node) override {
+        begin(Tag::While, node);
+        this->node(node->condition.get());
+        this->node(node->body.get());
+    }
+
+    void visit(ParallelForStmt* node) override {
+        begin(Tag::ParallelFor, node);
+        token(node->variable);
+        this->node(node->start.get());
+        this->node(node->end.get());
+        word(static_cast<uint32_t>(node->reductions.size()));
+        for (const auto& reduction : node->reductions) {
+            token(reduction.op);
+            token(reduction.variable);
+        }
+        this->node(node->body.get());
+    }
+
+    void visit(SyncStmt* node) override { begin(Tag::Sync, node); }
+
+    void visit(GoStmt* node) override {
+        begin(Tag::Go, node);
+        token(node->keyword);
+        this->node(node->call.get());
+    }
+
+    void visit(ForInStmt* node) override {
+        begin(Tag::ForIn, node);
+        token(node->variable);
+        this->node(node->source.get());
+        this->node(node->body.get());
+        word(node->generator);
+    }
+
+    void visit(MatchStmt* node) override {
+        begin(Tag::Match, node);
+        token(node->keyword);
+        this->node(node->subject.get());
+        word(static_cast<uint32_t>(node->arms.size()));
+        for (const auto& arm : node->arms) {
+            word(static_cast<uint32_t>(arm.patterns.size()));
+            for (const auto& pattern : arm.patterns) {
+                this->node(pattern.value.get());
+                this->node(pattern.end.get());
+            }
+            this->node(arm.body.get());
+            word(static_cast<uint32_t>(arm.values.size()));
+            for (int64_t value : arm.values) int64(value);
+        }
+    }
+
+    void visit(YieldStmt* node) override {
+        begin(Tag::Yield, node);
+        token(node->keyword);
+        this->node(node->value.get());
+    }
+
+    void visit(BenchStmt* node) override {
+        begin(Tag::Bench, node);
+        token(node->keyword);
+        token(node->name);
+        this->node(node->body.get());
+    }
+
+    void visit(ReturnStmt* node) override {
+        begin(Tag::Return, node);
+        token(node->keyword);
+        this->node(node->value.get());
+    }
+
+private:
+    std::unordered_map<std::string, uint32_t> interned;
+    std::unordered_map<const ConstArray*, uint32_t> arrays;
+};
+
+// Rebuilds nodes from the word stream. Every read is bounds checked; the
+// first malformed value sets 'failed' and the whole entry is discarded.
+class AstReader {
+public:
+    bool failed = false;
+
+    AstReader(const char* words, size_t wordCount, std::vector<llvm::StringRef> strings)
+        : data(words), count(wordCount), strings(std::move(strings)) {}
+
+    bool atEnd() const { return position == count; }
+
+    uint32_t word() {
+        if (position >= count) {
+            failed = true;
+            return 0;
+        }
+        uint32_t value;
+        std::memcpy(&value, data + position++ * sizeof(uint32_t), sizeof(value));
+        return value;
+    }
+
+    int integer() { return static_cast<int>(word()); }
+    bool flag() { return word() != 0; }
+
+    int64_t int64() {
+        uint64_t low = word();
+        uint64_t high = word();
+        return static_cast<int64_t>(low | high << 32);
+    }
+
+    double real() {
+        int64_t bits = int64();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Element counts are bounded by the words left, so a corrupt count
+    // cannot reserve unbounded memory
+    uint32_t count32() {
+        uint32_t value = word();
+        if (value > count - std::min(position, count)) failed = true;
+        return failed ? 0 : value;
+    }
+
+    std::string string() {
+        uint32_t index = word();
+        if (index >= strings.size()) {
+            failed = true;
+            return std::string();
+        }
+        return strings[index].str();
+    }
+
+    Location location() {
+        int line = integer();
+        return Location(line, integer());
+    }
+
+    Token token() {
+        uint32_t type = word();
+        if (type > ERROR) failed = true;
+        std::string value = string();
+        int line = integer();
+        return Token(static_cast<TokenType>(type), value, line, integer());
+    }
+
+    Type type() {
+        std::string name = string();
+        bool isArray = flag();
+        return Type(name, isArray, integer());
+    }
+
+    ConstValue constant() {
+        ConstValue value;
+        uint32_t kind = word();
+        switch (static_cast<ConstValue::Kind>(kind)) {
+            case ConstValue::Kind::INT:    return ConstValue::makeInt(int64());
+            case ConstValue::Kind::FLOAT:  return ConstValue::makeFloat(real());
+            case ConstValue::Kind::BOOL:   return ConstValue::makeBool(flag());
+            case ConstValue::Kind::STRING: return ConstValue::makeString(string());
+            case ConstValue::Kind::ARRAY: {
+                value.kind = ConstValue::Kind::ARRAY;
+                if (word() == SharedArray) {
+                    uint32_t index = word();
+                    if (index >= arrays.size()) {
+                        failed = true;
+                        return value;
+                    }
+                    value.array = arrays[index];
+                    return value;
+                }
+                value.array = std::make_shared<ConstArray>();
+                arrays.push_back(value.array);
+                value.array->frozen = flag();
+                uint32_t size = count32();
+                for (uint32_t i = 0; i < size && !failed; i++) {
+                    value.array->elements.push_back(constant());
+                }
+                return value;
+            }
+        }
+        failed = true;
+        return value;
+    }
+
+    std::shared_ptr<ConstValue> optionalConstant() {
+        if (word() == NoConstant) return nullptr;
+        return std::make_shared<ConstValue>(constant());
+    }
+
+    std::vector<Parameter> parameters() {
+        std::vector<Parameter> parameters;
+        uint32_t size = count32();
+        for (uint32_t i = 0; i < size && !failed; i++) {
+            Token name = token();
+            parameters.emplace_back(name, type());
+        }
+        return parameters;
+    }
+
+    // Reads a node that must be of type T (or null)
+    template <typename T>
+    std::unique_ptr<T> node() {
+        std::unique_ptr<ASTNode> read = anyNode();
+        if (!read) return nullptr;
+        if (auto* typed = dynamic_cast<T*>(read.get())) {
+            read.release();
+            return std::unique_ptr<T>(typed);
+        }
+        failed = true;
+        return nullptr;
+    }
+
+    std::unique_ptr<Program> program() {
+        Token start = at(location());
+        std::vector<std::unique_ptr<FunctionDecl>> functions;
+        uint32_t functionCount = count32();
+        for (uint32_t i = 0; i < functionCount && !failed; i++) {
+            auto function = node<FunctionDecl>();
+            if (!function) failed = true;
+            functions.push_back(std::move(function));
+        }
+        auto program = std::make_unique<Program>(std::move(functions), start);
+        uint32_t globalCount = count32();
+        for (uint32_t i = 0; i < globalCount && !failed; i++) {
+            auto global = node<VarDeclStmt>();
+            if (!global) failed = true;
+            program->globals.push_back(std::move(global));
+        }
+        return program;
+    }
+
+    void symbols(SymbolTable& table) {
+        table.reset();
+        uint32_t size = count32();
+        for (uint32_t i = 0; i < size && !failed; i++) {
+            uint32_t kind = word();
+            std::string name = string();
+            Type symbolType = type();
+            int line = integer();
+            int column = integer();
+            bool isConstant = flag();
+            std::shared_ptr<ConstValue> constValue = optionalConstant();
+
+            Symbol* symbol = nullptr;
+            if (kind == static_cast<uint32_t>(Symbol::Kind::FUNCTION)) {
+                bool isConst = flag();
+                bool isBuiltin = flag();
+                std::vector<Parameter> functionParameters = parameters();
+                if (failed || !table.declareFunction(name, symbolType, functionParameters)) break;
+                FunctionSymbol* function = table.resolveFunction(name);
+                function->isConst = isConst;
+                function->isBuiltin = isBuiltin;
+                symbol = function;
+            } else if (kind == static_cast<uint32_t>(Symbol::Kind::VARIABLE)) {
+                if (failed || !table.declare(name, symbolType)) break;
+                symbol = table.resolveGlobal(name);
+            } else {
+                break;
+            }
+            symbol->line = line;
+            symbol->column = column;
+            symbol->isConstant = isConstant;
+            symbol->constValue = std::move(constValue);
+        }
+        if (table.getScopes().front()->getSymbols().size() != size) failed = true;
+    }
+
+private:
+    const char* data;
+    size_t count;
+    size_t position = 0;
+    std::vector<llvm::StringRef> strings;
+    std::vector<std::shared_ptr<ConstArray>> arrays;
+
+    // Node constructors take their location from a token
+    static Token at(const Location& loc) { return Token(END, "", loc.line, loc.column); }
+
+    std::vector<std::unique_ptr<Expr>> expressions() {
+        std::vector<std::unique_ptr<Expr>> list;
+        uint32_t size = count32();
+        for (uint32_t i = 0; i < size && !failed; i++) {
+            list.push_back(node<Expr>());
+        }
+        return list;
+    }
+
+    std::unique_ptr<ASTNode> anyNode() {
+        Tag tag = static_cast<Tag>(word());
+        if (tag == Tag::Null || failed) return nullptr;
+        Location loc = location();
+        std::unique_ptr<ASTNode> read = make(tag, loc);
+        if (read) read->loc = loc;
+        else failed = true;
+        return failed ? nullptr : std::move(read);
+    }
+
+    std::unique_ptr<ASTNode> make(Tag tag, const Location& loc) {
+        switch (tag) {
+            case Tag::Number: {
+                Token value = token();
+                return std::make_unique<NumberExpr>(value, flag());
+            }
+            case Tag::String:
+                return std::make_unique<StringExpr>(token());
+            case Tag::Bool: {
+                Token value = token();
+                return std::make_unique<BoolExpr>(value, flag());
+            }
+            case Tag::Variable:
+                return std::make_unique<VariableExpr>(token());
+            case Tag::ArrayAccess: {
+                auto array = node<Expr>();
+                auto index = node<Expr>();
+                return std::make_unique<ArrayAccessExpr>(std::move(array), std::move(index), at(loc));
+            }
+            case Tag::Binary: {
+                auto left = node<Expr>();
+                Token op = token();
+                return std::make_unique<BinaryExpr>(std::move(left), op, node<Expr>());
+            }
+            case Tag::Unary: {
+                Token op = token();
+                return std::make_unique<UnaryExpr>(op, node<Expr>());
+            }
+            case Tag::TypeName:
+                return std::make_unique<TypeExpr>(type(), at(loc));
+            case Tag::Assign: {
+                auto target = node<Expr>();
+                Token op = token();
+                return std::make_unique<AssignExpr>(std::move(target), op, node<Expr>());
+            }
+            case Tag::Call: {
+                Token name = token();
+                auto call = std::make_unique<CallExpr>(name, expressions());
+                call->constValue = optionalConstant();
+                return call;
+            }
+            case Tag::ArrayInit: {
+                auto init = std::make_unique<ArrayInitExpr>(expressions(), at(loc));
+                init->inferredSize = static_cast<size_t>(int64());
+                return init;
+            }
+            case Tag::ArrayAlloc: {
+                Type elementType = type();
+                return std::make_unique<ArrayAllocExpr>(elementType, node<Expr>(), at(loc));
+            }
+            case Tag::Spawn: {
+                Token keyword = token();
+                return std::make_unique<SpawnExpr>(keyword, node<CallExpr>());
+            }
+            case Tag::Channel: {
+                Token keyword = token();
+                Type channelType = type();
+                return std::make_unique<ChannelExpr>(keyword, channelType, node<Expr>());
+            }
+            case Tag::ExprStmt:
+                return std::make_unique<ExprStmt>(node<Expr>(), at(loc));
+            case Tag::VarDecl: {
+                Token name = token();
+                Type varType = type();
+                auto decl = std::make_unique<VarDeclStmt>(name, varType, node<Expr>(), at(loc));
+                decl->isConst = flag();
+                decl->isThreadLocal = flag();
+                decl->constValue = optionalConstant();
+                return decl;
+            }
+            case Tag::Block: {
+                std::vector<std::unique_ptr<Stmt>> statements;
+                uint32_t size = count32();
+                for (uint32_t i = 0; i < size && !failed; i++) {
+                    statements.push_back(node<Stmt>());
+                }
+                return std::make_unique<BlockStmt>(std::move(statements), at(loc));
+            }
+            case Tag::If: {
+                auto condition = node<Expr>();
+                auto thenBranch = node<Stmt>();
+                auto elseBranch = node<Stmt>();
+                return std::make_unique<IfStmt>(std::move(condition), std::move(thenBranch),
+                                                std::move(elseBranch), at(loc));
+            }
+            case Tag::While: {
+                auto condition = node<Expr>();
+                return std::make_unique<WhileStmt>(std::move(condition), node<Stmt>(), at(loc));
+            }
+            case Tag::ParallelFor: {
+                Token variable = token();
+                auto start = node<Expr>();
+                auto end = node<Expr>();
+                std::vector<Reduction> reductions;
+                uint32_t size = count32();
+                for (uint32_t i = 0; i < size && !failed; i++) {
+                    Token op = token();
+                    reductions.emplace_back(op, token());
+                }
+                return std::make_unique<ParallelForStmt>(variable, std::move(start), std::move(end),
+                                                         std::move(reductions), node<BlockStmt>(), at(loc));
+            }
+            case Tag::Sync:
+                return std::make_unique<SyncStmt>(at(loc));
+            case Tag::Go: {
+                Token keyword = token();
+                return std::make_unique<GoStmt>(keyword, node<CallExpr>());
+            }
+            case Tag::ForIn: {
+                Token variable = token();
+                auto source = node<Expr>();
+                auto forIn = std::make_unique<ForInStmt>(variable, std::move(source), node<BlockStmt>(), at(loc));
+                forIn->generator = flag();
+                return forIn;
+            }
+            case Tag::Match: {
+                Token keyword = token();
+                auto subject = node<Expr>();
+                std::vector<MatchArm> arms;
+                uint32_t armCount = count32();
+                for (uint32_t i = 0; i < armCount && !failed; i++) {
+                    MatchArm arm;
+                    uint32_t patternCount = count32();
+                    for (uint32_t j = 0; j < patternCount && !failed; j++) {
+                        MatchPattern pattern;
+                        pattern.value = node<Expr>();
+                        pattern.end = node<Expr>();
+                        arm.patterns.push_back(std::move(pattern));
+                    }
+                    arm.body = node<BlockStmt>();
+                    uint32_t valueCount = count32();
+                    for (uint32_t j = 0; j < valueCount && !failed; j++) {
+                        arm.values.push_back(int64());
+                    }
+                    arms.push_back(std::move(arm));
+                }
+                return std::make_unique<MatchStmt>(keyword, std::move(subject), std::move(arms));
+            }
+            case Tag::Yield: {
+                Token keyword = token();
+                return std::make_unique<YieldStmt>(keyword, node<Expr>());
+            }
+            case Tag::Bench: {
+                Token keyword = token();
+                Token name = token();
+                return std::make_unique<BenchStmt>(keyword, name, node<BlockStmt>());
+            }
+            case Tag::Return: {
+                Token keyword = token();
+                return std::make_unique<ReturnStmt>(keyword, node<Expr>());
+            }
+            case Tag::Function:
+                return function(loc);
+            default:
+                return nullptr;
+        }
+    }
+
+    std::unique_ptr<FunctionDecl> function(const Location& loc) {
+        Token name = token();
+        Type returnType = type();
+        std::vector<Parameter> functionParameters = parameters();
+        auto body = node<BlockStmt>();
+        auto function = std::make_unique<FunctionDecl>(name, returnType, std::move(functionParameters),
+                                                       std::move(body), at(loc));
+        function->isConst = flag();
+        uint32_t typeParameterCount = count32();
+        for (uint32_t i = 0; i < typeParameterCount && !failed; i++) {
+            function->typeParameters.push_back(string());
+        }
+        uint32_t templateCount = count32();
+        for (uint32_t i = 0; i < templateCount && !failed; i++) {
+            function->templateTokens.push_back(token());
+        }
+        uint32_t attributeCount = count32();
+        for (uint32_t i = 0; i < attributeCount && !failed; i++) {
+            Attribute attribute(token());
+            uint32_t argumentCount = count32();
+            for (uint32_t j = 0; j < argumentCount && !failed; j++) {
+                attribute.arguments.push_back(token());
+            }
+            function->attributes.push_back(std::move(attribute));
+        }
+        function->memoCapacity = integer();
+        function->spawns = flag();
+        function->isGenerator = flag();
+        return function;
+    }
+};
+
+uint64_t hashSource(const std::string& source) {
+    return llvm::xxHash64(llvm::StringRef(source));
+}
+
+} // namespace
+
+std::string AstCache::entryPath(const std::string& source) const {
+    return directory + "/" + llvm::utohexstr(hashSource(source)) + ".leiast";
+}
+
+std::unique_ptr<Program> AstCache::load(const std::string& source, SymbolTable& symbols) const {
+    // Large files are mapped rather than read
+    auto file = llvm::MemoryBuffer::getFile(entryPath(source), /*IsText=*/false,
+                                            /*RequiresNullTerminator=*/false);
+    if (!file) return nullptr;
+    llvm::StringRef bytes = (*file)->getBuffer();
+
+    Header header;
+    if (bytes.size() < sizeof(header)) return nullptr;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != FormatVersion ||
+        header.sourceHash != hashSource(source) || header.sourceSize != source.size()) {
+        return nullptr;
+    }
+
+    // Offsets, strings and words must exactly fill the file
+    uint64_t offsetsSize = (static_cast<uint64_t>(header.stringCount) + 1) * sizeof(uint32_t);
+    uint64_t stringsSize = (header.stringBytes + 3) / 4 * 4;
+    uint64_t available = bytes.size() - sizeof(header);
+    if (header.wordCount > available / sizeof(uint32_t) ||
+        offsetsSize + stringsSize + header.wordCount * sizeof(uint32_t) != available) {
+        return nullptr;
+    }
+
+    if (llvm::xxHash64(bytes.drop_front(sizeof(header))) != header.checksum) return nullptr;
+
+    const char* offsets = bytes.data() + sizeof(header);
+    const char* stringData = offsets + offsetsSize;
+    std::vector<llvm::StringRef> strings;
+    strings.reserve(header.stringCount);
+    uint32_t previous = 0;
+    for (uint32_t i = 0; i <= header.stringCount; i++) {
+        uint32_t offset;
+        std::memcpy(&offset, offsets + i * sizeof(uint32_t), sizeof(offset));
+        if (offset < previous || offset > header.stringBytes) return nullptr;
+        if (i > 0) strings.emplace_back(stringData + previous, offset - previous);
+        previous = offset;
+    }
+
+    AstReader reader(stringData + stringsSize, header.wordCount, std::move(strings));
+    auto program = reader.program();
+    if (!reader.failed) reader.symbols(symbols);
+    if (reader.failed || !reader.atEnd()) {
+        symbols.reset();
+        return nullptr;
+    }
+    return program;
+}
+
+void AstCache::store(const std::string& source, Program& program, const SymbolTable& symbols) const {
+    AstWriter writer;
+    writer.visit(&program);
+    writer.symbols(symbols);
+
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = FormatVersion;
+    header.stringCount = static_cast<uint32_t>(writer.strings.size());
+    header.sourceHash = hashSource(source);
+    header.sourceSize = source.size();
+    header.wordCount = writer.words.size();
+
+    std::vector<uint32_t> offsets;
+    std::string stringData;
+    offsets.push_back(0);
+    for (const auto& text : writer.strings) {
+        stringData += text;
+        offsets.push_back(static_cast<uint32_t>(stringData.size()));
+    }
+    header.stringBytes = stringData.size();
+    stringData.resize((stringData.size() + 3) / 4 * 4, '\0');
+
+    std::string payload(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    payload += stringData;
+    payload.append(reinterpret_cast<const char*>(writer.words.data()), writer.words.size() * sizeof(uint32_t));
+    header.checksum = llvm::xxHash64(payload);
+
+    if (llvm::sys::fs::create_directories(directory)) return;
+
+    // Written aside and renamed, so a concurrent load never sees half a file
+    std::string path = entryPath(source);
+    std::string temporary = path + "." + std::to_string(llvm::sys::Process::getProcessId()) + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(payload.data(), payload.size());
+        if (!out) {
+            out.close();
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+    }
+}
+
+} // namespace Lei
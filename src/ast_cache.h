@@ -0,0 +1,39 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include "ast.h"
+#include "symbol_table.h"
+#include <memory>
+#include <string>
+
+namespace Lei {
+
+// On-disk cache of analyzed programs, so compiling unchanged source again
+// starts directly at code generation.
+//
+// Each entry is a file named after a hash of the source holding the AST with
+// everything semantic analysis filled in (generic instances, folded constants,
+// match values) and the global scope of the symbol table. Strings are
+// interned into one table and nodes are a flat stream of 32-bit words in
+// pre-order, so loading is a single mapping of the file followed by one pass
+// that rebuilds the nodes. Unreadable or stale entries count as misses.
+class AstCache {
+public:
+    explicit AstCache(std::string directory) : directory(std::move(directory)) {}
+
+    // Returns the cached program for 'source' and replaces the contents of
+    // 'symbols' with its global scope, or null when there is no valid entry
+    std::unique_ptr<Program> load(const std::string& source, SymbolTable& symbols) const;
+
+    // Saves an analyzed program; failures only mean the next load misses
+    void store(const std::string& source, Program& program, const SymbolTable& symbols) const;
+
+private:
+    std::string directory;
+
+    std::string entryPath(const std::string& source) const;
+};
+
+} // namespace Lei
+
+#endif // AST_CACHE_H
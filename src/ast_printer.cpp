@@ -33,6 +33,9 @@ void ASTPrinter::visit(TypeExpr* node) {
 void ASTPrinter::visit(Program* node) {
     writeLine("Program");
     indent++;
+    for (const auto& global : node->globals) {
+        global->accept(this);
+    }
     for (const auto& function : node->functions) {
         function->accept(this);
     }
@@ -40,9 +43,26 @@ void ASTPrinter::visit(Program* node) {
 }
 
 void ASTPrinter::visit(FunctionDecl* node) {
-    writeLine("Function: " + node->name.value);
+    writeLine((node->isConst ? "Const Function: " : node->isGenerator ? "Generator Function: " : "Function: ") +
+              node->name.value);
     indent++;
+    for (const auto& attribute : node->attributes) {
+        std::string arguments;
+        for (const auto& argument : attribute.arguments) {
+            arguments += (arguments.empty() ? "" : ", ") + argument.value;
+        }
+        writeLine("Attribute: @" + attribute.name.value +
+                  (arguments.empty() ? "" : "(" + arguments + ")"));
+    }
     writeLine("Return Type: " + formatType(node->returnType));
+    if (node->isGeneric()) {
+        std::string params;
+        for (const auto& param : node->typeParameters) {
+            if (!params.empty()) params += ", ";
+            params += param;
+        }
+        writeLine("Type Parameters: " + params);
+    }
     
     if (!node->parameters.empty()) {
         writeLine("Parameters:");
@@ -164,6 +184,20 @@ void ASTPrinter::visit(ArrayAllocExpr* node) {
     indent--;
 }
 
+void ASTPrinter::visit(SpawnExpr* node) {
+    writeLine("Spawn:");
+    indent++;
+    node->call->accept(this);
+    indent--;
+}
+
+void ASTPrinter::visit(ChannelExpr* node) {
+    writeLine("Channel: " + node->type.name);
+    indent++;
+    node->capacity->accept(this);
+    indent--;
+}
+
 void ASTPrinter::visit(ExprStmt* node) {
     writeLine("Expression Statement:");
     indent++;
@@ -172,9 +206,12 @@ void ASTPrinter::visit(ExprStmt* node) {
 }
 
 void ASTPrinter::visit(VarDeclStmt* node) {
-    writeLine("Variable Declaration: " + node->name.value);
+    writeLine((node->isConst ? "Constant Declaration: " : "Variable Declaration: ") + node->name.value);
     indent++;
     writeLine("Type: " + formatType(node->type));
+    if (node->isThreadLocal) {
+        writeLine("Thread Local");
+    }
     if (node->initializer) {
         writeLine("Initializer:");
         indent++;
@@ -227,6 +264,86 @@ void ASTPrinter::visit(WhileStmt* node) {
     indent--;
 }
 
+void ASTPrinter::visit(MatchStmt* node) {
+    writeLine("Match Statement:");
+    indent++;
+    writeLine("Subject:");
+    indent++;
+    node->subject->accept(this);
+    indent--;
+    for (const auto& arm : node->arms) {
+        writeLine(arm.isWildcard() ? "Default Arm:" : "Arm:");
+        indent++;
+        for (const auto& pattern : arm.patterns) {
+            pattern.value->accept(this);
+            if (pattern.end) {
+                writeLine("Up To:");
+                pattern.end->accept(this);
+            }
+        }
+        arm.body->accept(this);
+        indent--;
+    }
+    indent--;
+}
+
+void ASTPrinter::visit(ParallelForStmt* node) {
+    writeLine("Parallel For Statement: " + node->variable.value);
+    indent++;
+    writeLine("Range:");
+    indent++;
+    node->start->accept(this);
+    node->end->accept(this);
+    indent--;
+    for (const auto& reduction : node->reductions) {
+        writeLine("Reduction: " + reduction.op.value + ": " + reduction.variable.value);
+    }
+    writeLine("Body:");
+    indent++;
+    node->body->accept(this);
+    indent--;
+    indent--;
+}
+
+void ASTPrinter::visit(SyncStmt*) {
+    writeLine("Sync Statement");
+}
+
+void ASTPrinter::visit(GoStmt* node) {
+    writeLine("Go Statement:");
+    indent++;
+    node->call->accept(this);
+    indent--;
+}
+
+void ASTPrinter::visit(ForInStmt* node) {
+    writeLine("For In Statement: " + node->variable.value);
+    indent++;
+    writeLine(node->generator ? "Generator:" : "Channel:");
+    indent++;
+    node->source->accept(this);
+    indent--;
+    writeLine("Body:");
+    indent++;
+    node->body->accept(this);
+    indent--;
+    indent--;
+}
+
+void ASTPrinter::visit(YieldStmt* node) {
+    writeLine("Yield Statement");
+    indent++;
+    node->value->accept(this);
+    indent--;
+}
+
+void ASTPrinter::visit(BenchStmt* node) {
+    writeLine("Bench Statement: " + node->name.value);
+    indent++;
+    node->body->accept(this);
+    indent--;
+}
+
 void ASTPrinter::visit(ReturnStmt* node) {
     writeLine("Return Statement");
     if (node->value) {
@@ -25,11 +25,20 @@ public:
     void visit(CallExpr* node) override;
     void visit(ArrayInitExpr* node) override;
     void visit(ArrayAllocExpr* node) override;
+    void visit(SpawnExpr* node) override;
+    void visit(ChannelExpr* node) override;
     void visit(ExprStmt* node) override;
     void visit(VarDeclStmt* node) override;
     void visit(BlockStmt* node) override;
     void visit(IfStmt* node) override;
     void visit(WhileStmt* node) override;
+    void visit(ParallelForStmt* node) override;
+    void visit(SyncStmt* node) override;
+    void visit(GoStmt* node) override;
+    void visit(ForInStmt* node) override;
+    void visit(MatchStmt* node) override;
+    void visit(YieldStmt* node) override;
+    void visit(BenchStmt* node) override;
     void visit(ReturnStmt* node) override;
     void visit(TypeExpr* node) override;
 
@@ -7,10 +7,27 @@
 
 
 #include "codegen_visitor.h"
+#include "metrics.h"
+#include <llvm/Analysis/TargetLibraryInfo.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/BinaryFormat/Dwarf.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/Coroutines/CoroCleanup.h>
+#include <llvm/Transforms/Coroutines/CoroEarly.h>
+#include <llvm/Transforms/Coroutines/CoroElide.h>
+#include <llvm/Transforms/Coroutines/CoroSplit.h>
+#include <llvm/Transforms/IPO/Inliner.h>
+#include <llvm/Transforms/Scalar/EarlyCSE.h>
+#include <llvm/Transforms/Scalar/SimplifyCFG.h>
+#include <llvm/Transforms/Scalar/SROA.h>
+#include <algorithm>
+#include <functional>
 
 void CodegenVisitor::reportError(const std::string& message, const Location& loc) {
     std::string context;
@@ -24,18 +41,13 @@ void CodegenVisitor::reportError(const std::string& message, const Location& loc
         loc.column,
         message + context
     );
-    
-    // Print current compilation state for debugging
-    if (module) {
-        std::string state;
-        llvm::raw_string_ostream stateStream(state);
-        module->print(stateStream, nullptr);
-        errorHandler.error(
-            ErrorLevel::CODEGEN,
-            loc.line,
-            loc.column,
-            "Current module state:\n" + state
-        );
+}
+
+// The module is printed once per failed compilation, and only on request
+void CodegenVisitor::dumpFailedModule() {
+    if (dumpModuleOnError && module) {
+        llvm::errs() << "; Module state at failure\n";
+        module->print(llvm::errs(), nullptr);
     }
 }
  
@@ -58,13 +70,24 @@ std::unique_ptr<llvm::Module> CodegenVisitor::generateModule(Program* program, c
             errorHandler.error(ErrorLevel::CODEGEN, 0, 0, "Failed to create LLVM module");
             return nullptr;
         }
+        if (!sampleSource.empty()) {
+            beginDebugInfo();
+        }
 
         // Declare runtime functions first
         declareRuntimeFunctions();
 
         // Generate code for the program
         program->accept(this);
+        if (errorHandler.hasErrors(ErrorLevel::CODEGEN)) {
+            dumpFailedModule();
+            return nullptr;
+        }
     
+        if (debugBuilder) {
+            finishDebugInfo();
+        }
+
         // Verify the module
         std::string error;
         llvm::raw_string_ostream errorStream(error);
@@ -74,9 +97,14 @@ std::unique_ptr<llvm::Module> CodegenVisitor::generateModule(Program* program, c
                 0, 0,
                 "Module verification failed: " + error
             );
+            dumpFailedModule();
             return nullptr;
         }
 
+        if (hasGenerators) {
+            lowerCoroutines();
+        }
+
         return std::move(module);
     } catch (const std::exception& e) {
         errorHandler.error(
@@ -96,58 +124,138 @@ llvm::Value* CodegenVisitor::generateAlloca(llvm::Function* function, const std:
 }
 
 
+// Generic templates are only emitted through their instances, and const fns
+// returning arrays are only ever evaluated during semantic analysis
+static bool hasRuntimeBody(FunctionDecl* func) {
+    return !func->isGeneric() && !(func->isConst && func->returnType.isArray);
+}
+
 void CodegenVisitor::visit(Program* node) {
     if (!node) {
         reportError("Null program node", Location());
         return;
     }
 
+    if (!declareProgram(node)) {
+        return;
+    }
+
+    // Second pass: generate function bodies
 
-    // First pass: declare all functions
     for (const auto& func : node->functions) {
-        if (!func) continue;
-        
-        
-        auto symbol = symbolTable.resolveFunction(func->name.value);
-        if (!symbol) {
-            reportError("Function symbol not found: " + func->name.value, func->loc);
-            continue;
-        }
+        if (!func || !hasRuntimeBody(func.get())) continue;
+        func->accept(this);
+    }
+}
 
-        // Create function type
-        std::vector<llvm::Type*> paramTypes;
-        for (const auto& param : func->parameters) {
-            if (auto paramType = typeHelper.getLLVMType(param.type)) {
-                paramTypes.push_back(paramType);
-            } else {
-                reportError("Invalid parameter type in function: " + func->name.value, func->loc);
-                return;
-            }
+// First pass: declare all functions, then emit the globals, so bodies can be
+// generated in any order
+bool CodegenVisitor::declareProgram(Program* node) {
+    for (const auto& func : node->functions) {
+        if (!func || !hasRuntimeBody(func.get())) continue;
+        if (!declareFunction(func.get())) {
+            return false;
         }
+    }
 
-        llvm::Type* returnType = typeHelper.getLLVMType(func->returnType);
-        if (!returnType) {
-            reportError("Invalid return type for function: " + func->name.value, func->loc);
-            return;
-        }
+    // Globals are emitted before function bodies so every function can reference them
+    for (const auto& global : node->globals) {
+        global->accept(this);
+    }
+    return true;
+}
 
-        llvm::FunctionType* funcType = llvm::FunctionType::get(returnType, paramTypes, false);
-        llvm::Function* function = llvm::Function::Create(
-            funcType, llvm::Function::ExternalLinkage, func->name.value, module.get()
-        );
+bool CodegenVisitor::declareFunction(FunctionDecl* func) {
+    if (!hasRuntimeBody(func)) return true;
+
+    auto symbol = symbolTable.resolveFunction(func->name.value);
+    if (!symbol) {
+        reportError("Function symbol not found: " + func->name.value, func->loc);
+        return true;
+    }
 
-        // Store LLVM function in symbol table
-        symbol->llvmFunction = function;
+    // Create function type
+    std::vector<llvm::Type*> paramTypes;
+    for (const auto& param : func->parameters) {
+        if (auto paramType = typeHelper.getLLVMType(param.type)) {
+            paramTypes.push_back(paramType);
+        } else {
+            reportError("Invalid parameter type in function: " + func->name.value, func->loc);
+            return false;
+        }
     }
 
+    // A generator call returns the handle of its suspended coroutine
+    llvm::Type* returnType = func->isGenerator ? llvm::Type::getInt8PtrTy(context)
+                                               : typeHelper.getLLVMType(func->returnType);
+    if (!returnType) {
+        reportError("Invalid return type for function: " + func->name.value, func->loc);
+        return false;
+    }
 
-    // Second pass: generate function bodies
+    llvm::FunctionType* funcType = llvm::FunctionType::get(returnType, paramTypes, false);
+    llvm::Function* function = llvm::Function::Create(
+        funcType, llvm::Function::ExternalLinkage, func->name.value, module.get()
+    );
 
-    for (const auto& func : node->functions) {
-        if (!func) continue;
-        func->accept(this);
+    // Store LLVM function in symbol table
+    symbol->llvmFunction = function;
+    return true;
+}
+
+llvm::Module* CodegenVisitor::beginModule(Program* declarations, const std::string& moduleName) {
+    module = std::make_unique<llvm::Module>(moduleName, context);
+    if (!sampleSource.empty()) {
+        beginDebugInfo();
+    }
+    declareRuntimeFunctions();
+    if (!declareProgram(declarations) || errorHandler.hasErrors(ErrorLevel::CODEGEN)) {
+        dumpFailedModule();
+        return nullptr;
+    }
+    return module.get();
+}
+
+bool CodegenVisitor::emitFunction(FunctionDecl* function) {
+    try {
+        if (hasRuntimeBody(function)) {
+            function->accept(this);
+        }
+    } catch (const std::exception& e) {
+        errorHandler.error(
+            ErrorLevel::CODEGEN,
+            0, 0,
+            std::string("Internal error during code generation: ") + e.what()
+        );
+    }
+    if (errorHandler.hasErrors(ErrorLevel::CODEGEN)) {
+        dumpFailedModule();
+        return false;
     }
+    return true;
 }
+
+std::unique_ptr<llvm::Module> CodegenVisitor::finishModule() {
+    if (debugBuilder) {
+        finishDebugInfo();
+    }
+    std::string error;
+    llvm::raw_string_ostream errorStream(error);
+    if (llvm::verifyModule(*module, &errorStream)) {
+        errorHandler.error(
+            ErrorLevel::CODEGEN,
+            0, 0,
+            "Module verification failed: " + error
+        );
+        dumpFailedModule();
+        return nullptr;
+    }
+    if (hasGenerators) {
+        lowerCoroutines();
+    }
+    return std::move(module);
+}
+
 void CodegenVisitor::visit(FunctionDecl* node) {
     // Get or create the function
     llvm::Function* function = module->getFunction(node->name.value);
@@ -173,7 +281,8 @@ void CodegenVisitor::visit(FunctionDecl* node) {
             paramTypes.push_back(paramType);
         }
 
-        llvm::Type* returnType = typeHelper.getLLVMType(node->returnType);
+        llvm::Type* returnType = node->isGenerator ? llvm::Type::getInt8PtrTy(context)
+                                                   : typeHelper.getLLVMType(node->returnType);
         if (!returnType) {
             reportError("Invalid return type", node->loc);
             return;
@@ -188,10 +297,39 @@ void CodegenVisitor::visit(FunctionDecl* node) {
         );
     }
 
+    // A memoized function keeps its name for the caching wrapper, so recursive
+    // calls also go through the cache; the body is emitted into 'name.impl'
+    if (node->memoCapacity > 0) {
+        llvm::Function* impl = llvm::Function::Create(
+            function->getFunctionType(),
+            llvm::Function::InternalLinkage,
+            node->name.value + ".impl",
+            module.get()
+        );
+        emitMemoWrapper(node, function, impl);
+        function = impl;
+    }
+
     // Set current function and create entry block
     currentFunction = function;
     llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", function);
     builder->SetInsertPoint(entry);
+    if (debugBuilder) {
+        setStatementLocation(node->loc.line);
+    }
+
+    // Every return waits for spawned calls, so the group must exist before the first one
+    spawnGroup = nullptr;
+    if (node->spawns) {
+        getSpawnGroup();
+    }
+
+    generator = GeneratorFrame();
+    activeGenerators.clear();
+    if (node->isGenerator) {
+        generator.promise = generateAlloca(function, "gen.promise", typeHelper.getLLVMType(node->returnType));
+        emitGeneratorPrologue();
+    }
 
     // Handle parameters
     symbolTable.enterScope();
@@ -224,11 +362,24 @@ void CodegenVisitor::visit(FunctionDecl* node) {
         ++argIt;
     }
 
+    // Generators are left out: their entry block belongs to the coroutine setup
+    if (profileCalls && !node->isGenerator) {
+        builder->CreateAtomicRMW(llvm::AtomicRMWInst::Add, getMetricSlot("calls." + node->name.value, Lei::Metrics::COUNTER),
+                                 builder->getInt64(1), llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
+    }
+
     // Generate function body
     node->body->accept(this);
 
     // Add return if needed
-    if (!builder->GetInsertBlock()->getTerminator()) {
+    if (node->isGenerator) {
+        if (!builder->GetInsertBlock()->getTerminator()) {
+            emitSync();
+            builder->CreateBr(generator.finalSuspend);
+        }
+        emitGeneratorEpilogue();
+    } else if (!builder->GetInsertBlock()->getTerminator()) {
+        emitSync();
         if (node->returnType.name == "void") {
             builder->CreateRetVoid();
         } else {
@@ -238,6 +389,8 @@ void CodegenVisitor::visit(FunctionDecl* node) {
 
     symbolTable.exitScope();
     currentFunction = nullptr;
+    spawnGroup = nullptr;
+    generator = GeneratorFrame();
 }
 
 
@@ -252,22 +405,32 @@ void CodegenVisitor::visit(NumberExpr* node) {
 
 
 void CodegenVisitor::visit(StringExpr* node) {
+    lastValue = getStringConstant(node->token.value);
+}
+
+llvm::Constant* CodegenVisitor::getStringConstant(const std::string& value) {
     // Check if we've already created this string constant
-    auto it = stringConstants.find(node->token.value);
+    auto it = stringConstants.find(value);
     if (it != stringConstants.end()) {
-        lastValue = it->second;
-        return;
+        return llvm::cast<llvm::Constant>(it->second);
     }
 
-    // Create a new global string constant with proper null termination
-    llvm::Constant* strConstant = builder->CreateGlobalStringPtr(
-        node->token.value,
-        "str",
-        0  // No constant alignment
+    // Create a new global string constant with proper null termination.
+    // Built without the IRBuilder so constants can be materialized outside functions.
+    llvm::Constant* data = llvm::ConstantDataArray::getString(context, value, true);
+    auto* global = new llvm::GlobalVariable(
+        *module, data->getType(), true, llvm::GlobalValue::PrivateLinkage, data, "str"
     );
-    
-    stringConstants[node->token.value] = strConstant;
-    lastValue = strConstant;
+    global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    global->setAlignment(llvm::MaybeAlign(1));
+
+    llvm::Constant* zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), 0);
+    llvm::Constant* strConstant = llvm::ConstantExpr::getInBoundsGetElementPtr(
+        data->getType(), global, llvm::ArrayRef<llvm::Constant*>{zero, zero}
+    );
+
+    stringConstants[value] = strConstant;
+    return strConstant;
 }
 
 void CodegenVisitor::visit(BoolExpr* node) {
@@ -282,9 +445,15 @@ void CodegenVisitor::visit(VariableExpr* node) {
         return;
     }
 
+    // Scalar constants are used directly; constant arrays are globals
+    if (symbol->isConstant && !symbol->type.isArray) {
+        lastValue = symbol->llvmValue;
+        return;
+    }
+
     // For arrays, return the address directly without loading
     llvm::Type* type = symbol->llvmValue->getType()->getPointerElementType();
-    if (type->isArrayTy() || (type->isPointerTy() && !isAssignmentTarget)) {
+    if (type->isArrayTy() || (type->isPointerTy() && !symbol->type.isChannel() && !isAssignmentTarget)) {
         lastValue = symbol->llvmValue;
         return;
     }
@@ -298,6 +467,11 @@ void CodegenVisitor::visit(VariableExpr* node) {
 }
 
 void CodegenVisitor::visit(BinaryExpr* node) {
+    if (node->op.type == AND || node->op.type == OR) {
+        emitShortCircuit(node);
+        return;
+    }
+
     node->left->accept(this);
     llvm::Value* left = lastValue;
 
@@ -376,20 +550,50 @@ void CodegenVisitor::visit(BinaryExpr* node) {
                 builder->CreateICmpSGT(left, right, "gttmp");
             break;
 
-        case AND:
-            lastValue = builder->CreateAnd(left, right, "andtmp");
-            break;
-
-        case OR:
-            lastValue = builder->CreateOr(left, right, "ortmp");
-            break;
-
         default:
             reportError("Unknown binary operator", node->loc);
             lastValue = nullptr;
     }
 }
 
+// '&&' and '||' evaluate the right operand only when the left one does not
+// already decide the result
+void CodegenVisitor::emitShortCircuit(BinaryExpr* node) {
+    bool isAnd = node->op.type == AND;
+
+    node->left->accept(this);
+    llvm::Value* left = lastValue;
+    if (!left) return;
+
+    llvm::Function* func = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* leftBB = builder->GetInsertBlock();
+    llvm::BasicBlock* rightBB = llvm::BasicBlock::Create(context, isAnd ? "and.rhs" : "or.rhs", func);
+    llvm::BasicBlock* mergeBB = llvm::BasicBlock::Create(context, isAnd ? "and.end" : "or.end", func);
+
+    if (isAnd) {
+        builder->CreateCondBr(left, rightBB, mergeBB);
+    } else {
+        builder->CreateCondBr(left, mergeBB, rightBB);
+    }
+
+    builder->SetInsertPoint(rightBB);
+    node->right->accept(this);
+    llvm::Value* right = lastValue;
+    // The right operand may have added blocks of its own
+    llvm::BasicBlock* rightEndBB = builder->GetInsertBlock();
+    builder->CreateBr(mergeBB);
+
+    builder->SetInsertPoint(mergeBB);
+    if (!right) {
+        lastValue = nullptr;
+        return;
+    }
+    llvm::PHINode* result = builder->CreatePHI(builder->getInt1Ty(), 2, isAnd ? "andtmp" : "ortmp");
+    result->addIncoming(isAnd ? builder->getFalse() : builder->getTrue(), leftBB);
+    result->addIncoming(right, rightEndBB);
+    lastValue = result;
+}
+
 void CodegenVisitor::visit(UnaryExpr* node) {
     node->expr->accept(this);
     llvm::Value* operand = lastValue;
@@ -419,12 +623,29 @@ void CodegenVisitor::visit(UnaryExpr* node) {
 }
 
 void CodegenVisitor::visit(ArrayAccessExpr* node) {
+    // Packed bits have no element address; writes go through emitBitsStore
+    if (isBitsArray(node->array.get())) {
+        llvm::Value* word = nullptr;
+        llvm::Value* mask = nullptr;
+        locateBit(node, word, mask);
+        if (!word) {
+            lastValue = nullptr;
+            return;
+        }
+        llvm::Value* bits = builder->CreateAnd(builder->CreateLoad(builder->getInt64Ty(), word), mask);
+        lastValue = builder->CreateICmpNE(bits, builder->getInt64(0), "bit");
+        return;
+    }
+
     // Generate code for the array base
     node->array->accept(this);
     llvm::Value* arrayBase = lastValue;
 
-    // Generate code for the index
+    // Generate code for the index; it is an rvalue even inside an assignment target
+    bool wasAssignmentTarget = isAssignmentTarget;
+    isAssignmentTarget = false;
     node->index->accept(this);
+    isAssignmentTarget = wasAssignmentTarget;
     llvm::Value* index = lastValue;
 
     if (!arrayBase || !index) {
@@ -454,9 +675,10 @@ void CodegenVisitor::visit(ArrayAccessExpr* node) {
 
     llvm::Value* elementPtr = nullptr;
     
-    if (auto* allocaInst = llvm::dyn_cast<llvm::AllocaInst>(arrayBase)) {
-        llvm::Type* allocatedType = allocaInst->getAllocatedType();
-        
+    // Array storage is a local alloca, a global table or a captured local
+    llvm::Type* allocatedType = getVariableStorageType(arrayBase);
+
+    if (allocatedType) {
         if (allocatedType->isArrayTy()) {
             // Static array case
             llvm::Value* zero = llvm::ConstantInt::get(context, llvm::APInt(32, 0));
@@ -521,14 +743,31 @@ void CodegenVisitor::declareRuntimeFunctions() {
     declareFunction("strcmp", llvm::Type::getInt32Ty(context), {llvm::Type::getInt8PtrTy(context), llvm::Type::getInt8PtrTy(context)});
     declareFunction("strcpy", llvm::Type::getInt8PtrTy(context), {llvm::Type::getInt8PtrTy(context), llvm::Type::getInt8PtrTy(context)});
     declareFunction("strcat", llvm::Type::getInt8PtrTy(context), {llvm::Type::getInt8PtrTy(context), llvm::Type::getInt8PtrTy(context)});
-    declareFunction("pow", llvm::Type::getDoubleTy(context), {llvm::Type::getDoubleTy(context), llvm::Type::getDoubleTy(context)});
-    declareFunction("sqrt", llvm::Type::getDoubleTy(context), {llvm::Type::getDoubleTy(context)});
     declareFunction("toupper", llvm::Type::getInt32Ty(context), {llvm::Type::getInt32Ty(context)});
     declareFunction("tolower", llvm::Type::getInt32Ty(context), {llvm::Type::getInt32Ty(context)});
     declareFunction("atoi", llvm::Type::getInt32Ty(context), {llvm::Type::getInt8PtrTy(context)});
     declareFunction("atof", llvm::Type::getDoubleTy(context), {llvm::Type::getInt8PtrTy(context)});
     declareFunction("itoa", llvm::Type::getInt8PtrTy(context), {llvm::Type::getInt32Ty(context), llvm::Type::getInt8PtrTy(context), llvm::Type::getInt32Ty(context)});
 
+    // Parallel runtime (runtime.h)
+    llvm::Type* rangeBodyTy = llvm::FunctionType::get(voidTy, {int8PtrTy, int32Ty, int32Ty, int32Ty}, false);
+    declareFunction("lei_parallel_workers", int32Ty, {});
+    declareFunction("lei_parallel_for", voidTy, {int32Ty, int32Ty, rangeBodyTy->getPointerTo(), int8PtrTy});
+    llvm::Type* taskBodyTy = llvm::FunctionType::get(voidTy, {int8PtrTy}, false);
+    declareFunction("lei_spawn", voidTy, {int64Ty->getPointerTo(), taskBodyTy->getPointerTo(), int8PtrTy, int64Ty});
+    declareFunction("lei_sync", voidTy, {int64Ty->getPointerTo()});
+    declareFunction("lei_chan_new", int8PtrTy, {int32Ty});
+    declareFunction("lei_chan_send", voidTy, {int8PtrTy, int64Ty});
+    declareFunction("lei_chan_recv", int64Ty, {int8PtrTy});
+    declareFunction("lei_chan_recv_batch", int32Ty, {int8PtrTy, int64Ty->getPointerTo(), int32Ty});
+    declareFunction("lei_chan_close", voidTy, {int8PtrTy});
+    declareFunction("lei_go", voidTy, {taskBodyTy->getPointerTo(), int8PtrTy, int64Ty});
+    declareFunction("lei_now_ns", doubleTy, {});
+    declareFunction("lei_bench_begin", int8PtrTy, {int8PtrTy});
+    declareFunction("lei_bench_next", int64Ty, {int8PtrTy});
+    declareFunction("lei_metric_slot", int64Ty->getPointerTo(), {int8PtrTy, int32Ty});
+    declareFunction("lei_metric_observe", voidTy, {int64Ty->getPointerTo(), doubleTy});
+
     llvm::Type* filePtr = llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0);
     module->getOrInsertGlobal("stdin", filePtr);
 
@@ -547,6 +786,13 @@ void CodegenVisitor::visit(CallExpr* node) {
         return;
     }
 
+    // Calls folded during semantic analysis become constants
+    if (node->constValue) {
+        auto* funcSymbol = symbolTable.resolveFunction(node->name.value);
+        lastValue = materializeConstant(*node->constValue, funcSymbol->type);
+        return;
+    }
+
     // First check if this is a built-in function
     lastValue = handleBuiltinFunction(node);
     if (lastValue) {
@@ -560,6 +806,12 @@ void CodegenVisitor::visit(CallExpr* node) {
 
 
 llvm::Value* CodegenVisitor::handleBuiltinFunction(CallExpr* node) {
+    // A function of the program that shadows a builtin is called like any other
+    FunctionSymbol* declared = symbolTable.resolveFunction(node->name.value);
+    if (declared && declared->llvmFunction) {
+        return nullptr;
+    }
+
     // A simpler approach to handle built-in functions
     if (node->name.value == "print") {
         generatePrintCall(node);
@@ -588,6 +840,26 @@ llvm::Value* CodegenVisitor::handleBuiltinFunction(CallExpr* node) {
     if (node->name.value == "sizeof") {
         return generateSizeofCall(node);
     }
+    if (node->name.value == "and" || node->name.value == "or" || node->name.value == "ffs" ||
+        (node->name.value == "popcount" && isBitsArray(node->arguments[0].get()))) {
+        return generateBitsCall(node);
+    }
+    if (isMathBuiltin(node->name.value)) {
+        return generateMathBuiltinCall(node);
+    }
+    if (node->name.value == "send" || node->name.value == "recv" || node->name.value == "close") {
+        return generateChannelCall(node);
+    }
+    if (node->name.value == "now_ns" || node->name.value == "cycles" || node->name.value == "black_box") {
+        return generateBenchBuiltinCall(node);
+    }
+    if (node->name.value == "counter" || node->name.value == "gauge" || node->name.value == "histogram") {
+        return generateMetricCall(node);
+    }
+    if (node->name.value == "load" || node->name.value == "store" || node->name.value == "fetch_add" ||
+        node->name.value == "fetch_sub" || node->name.value == "compare_exchange") {
+        return generateAtomicCall(node);
+    }
 
     // Handle conversion functions (atoi, atof, itoa, ftoa)
     if (node->name.value == "atoi" || node->name.value == "atof" ||
@@ -625,7 +897,16 @@ llvm::Value* CodegenVisitor::handleRegularFunctionCall(CallExpr* node) {
         return nullptr;
     }
 
-    return builder->CreateCall(funcSymbol->llvmFunction, processedArgs);
+    llvm::CallInst* call = builder->CreateCall(funcSymbol->llvmFunction, processedArgs);
+
+    // The program may define its own sqrt or abs; the optimizer must not
+    // fold or rewrite calls to it as calls to the C library function
+    static const llvm::TargetLibraryInfoImpl libraryInfo{llvm::Triple()};
+    llvm::LibFunc libraryFunction;
+    if (libraryInfo.getLibFunc(node->name.value, libraryFunction)) {
+        call->addFnAttr(llvm::Attribute::NoBuiltin);
+    }
+    return call;
 }
 
 std::vector<llvm::Value*> CodegenVisitor::processCallArguments(
@@ -668,24 +949,50 @@ std::vector<llvm::Value*> CodegenVisitor::processCallArguments(
     return args;
 }
 
+llvm::Type* CodegenVisitor::getVariableStorageType(llvm::Value* address) const {
+    if (auto* allocaInst = llvm::dyn_cast<llvm::AllocaInst>(address)) {
+        return allocaInst->getAllocatedType();
+    }
+    if (auto* global = llvm::dyn_cast<llvm::GlobalVariable>(address)) {
+        return global->getValueType();
+    }
+    if (capturedAddresses.count(address)) {
+        return address->getType()->getPointerElementType();
+    }
+    return nullptr;
+}
+
 llvm::Value* CodegenVisitor::handleArrayArgument(llvm::Value* arg) {
+    // Constant arrays are read-only globals; the callee gets a copy it may write to
+    if (auto* global = llvm::dyn_cast<llvm::GlobalVariable>(arg)) {
+        if (global->isConstant() && global->getValueType()->isArrayTy()) {
+            llvm::Type* arrayType = global->getValueType();
+            llvm::Value* copy = generateAlloca(currentFunction, global->getName().str() + ".copy", arrayType);
+            builder->CreateMemCpy(copy, llvm::MaybeAlign(), global, llvm::MaybeAlign(),
+                                  llvm::ConstantExpr::getSizeOf(arrayType));
+            arg = copy;
+        }
+    }
+
     // Handle array argument conversions
-    if (auto* allocaInst = llvm::dyn_cast<llvm::AllocaInst>(arg)) {
+    llvm::Type* allocatedType = getVariableStorageType(arg);
+
+    if (allocatedType) {
         // For dynamic arrays (pointer type alloca), load the pointer
-        if (allocaInst->getAllocatedType()->isPointerTy()) {
+        if (allocatedType->isPointerTy()) {
             arg = builder->CreateLoad(
-                allocaInst->getAllocatedType(),
+                allocatedType,
                 arg,
                 "array.arg"
             );
-        } else if (allocaInst->getAllocatedType()->isArrayTy()) {
+        } else if (allocatedType->isArrayTy()) {
             // For fixed arrays, get pointer to first element
             std::vector<llvm::Value*> indices = {
                 llvm::ConstantInt::get(context, llvm::APInt(32, 0)),
                 llvm::ConstantInt::get(context, llvm::APInt(32, 0))
             };
             arg = builder->CreateInBoundsGEP(
-                allocaInst->getAllocatedType(),
+                allocatedType,
                 arg,
                 indices,
                 "array.arg"
@@ -977,6 +1284,90 @@ void CodegenVisitor::generateMallocCall(CallExpr* node) {
 }
 
 
+// Math builtins and their arity
+static const std::unordered_map<std::string, size_t> mathBuiltins = {
+    {"sqrt", 1}, {"floor", 1}, {"pow", 2}, {"fma", 3}, {"abs", 1},
+    {"min", 2}, {"max", 2}, {"popcount", 1}, {"clz", 1}, {"ctz", 1}
+};
+
+bool CodegenVisitor::isMathBuiltin(const std::string& name) const {
+    return mathBuiltins.count(name) > 0;
+}
+
+llvm::Value* CodegenVisitor::generateMathBuiltinCall(CallExpr* node) {
+    const std::string& name = node->name.value;
+    if (node->arguments.size() != mathBuiltins.at(name)) {
+        reportError(name + "() expects " + std::to_string(mathBuiltins.at(name)) + " argument(s)", node->loc);
+        return nullptr;
+    }
+
+    // Evaluate all operands up front
+    std::vector<llvm::Value*> args;
+    for (const auto& argument : node->arguments) {
+        argument->accept(this);
+        if (!lastValue) {
+            reportError("Invalid argument to " + name + "()", node->loc);
+            return nullptr;
+        }
+        args.push_back(lastValue);
+    }
+
+    llvm::Type* doubleTy = llvm::Type::getDoubleTy(context);
+    llvm::Type* int32Ty = llvm::Type::getInt32Ty(context);
+
+    // Floating-point only intrinsics: integer operands are promoted
+    if (name == "sqrt" || name == "floor" || name == "pow" || name == "fma") {
+        for (auto& arg : args) {
+            arg = typeHelper.convert(arg, doubleTy);
+        }
+        if (name == "sqrt") {
+            return builder->CreateUnaryIntrinsic(llvm::Intrinsic::sqrt, args[0], nullptr, "sqrt.tmp");
+        }
+        if (name == "floor") {
+            return builder->CreateUnaryIntrinsic(llvm::Intrinsic::floor, args[0], nullptr, "floor.tmp");
+        }
+        if (name == "pow") {
+            return builder->CreateBinaryIntrinsic(llvm::Intrinsic::pow, args[0], args[1], nullptr, "pow.tmp");
+        }
+        return builder->CreateIntrinsic(llvm::Intrinsic::fma, {doubleTy}, args, nullptr, "fma.tmp");
+    }
+
+    // abs/min/max select the integer or floating-point intrinsic by operand type
+    if (name == "abs") {
+        if (args[0]->getType()->isDoubleTy()) {
+            return builder->CreateUnaryIntrinsic(llvm::Intrinsic::fabs, args[0], nullptr, "abs.tmp");
+        }
+        llvm::Value* value = typeHelper.convert(args[0], int32Ty);
+        return builder->CreateBinaryIntrinsic(llvm::Intrinsic::abs, value,
+                                              builder->getFalse(), nullptr, "abs.tmp");
+    }
+    if (name == "min" || name == "max") {
+        auto operands = typeHelper.promoteOperands(args[0], args[1], node->loc);
+        if (!operands.commonType) return nullptr;
+
+        llvm::Intrinsic::ID id;
+        if (operands.commonType->isDoubleTy()) {
+            id = name == "min" ? llvm::Intrinsic::minnum : llvm::Intrinsic::maxnum;
+        } else {
+            id = name == "min" ? llvm::Intrinsic::smin : llvm::Intrinsic::smax;
+        }
+        return builder->CreateBinaryIntrinsic(id, operands.left, operands.right, nullptr, name + ".tmp");
+    }
+
+    // Bit counting intrinsics operate on 32-bit integers
+    llvm::Value* value = typeHelper.convert(args[0], int32Ty);
+    if (!value) {
+        reportError(name + "() requires an integer argument", node->loc);
+        return nullptr;
+    }
+    if (name == "popcount") {
+        return builder->CreateUnaryIntrinsic(llvm::Intrinsic::ctpop, value, nullptr, "popcount.tmp");
+    }
+    // Zero input is well defined and yields 32
+    llvm::Intrinsic::ID id = name == "clz" ? llvm::Intrinsic::ctlz : llvm::Intrinsic::cttz;
+    return builder->CreateBinaryIntrinsic(id, value, builder->getFalse(), nullptr, name + ".tmp");
+}
+
 // Helper function to get parent node
 ASTNode* CodegenVisitor::getCurrentParent(ASTNode* node) {
     return node ? node->parent : nullptr;
@@ -994,10 +1385,9 @@ void CodegenVisitor::generateFreeCall(CallExpr* node) {
     if (!ptr) return;
 
     // If we have a pointer to a pointer (e.g., i32**), load the actual pointer first
-    if (auto* allocaInst = llvm::dyn_cast<llvm::AllocaInst>(ptr)) {
-        if (allocaInst->getAllocatedType()->isPointerTy()) {
-            ptr = builder->CreateLoad(allocaInst->getAllocatedType(), ptr, "free.ptr");
-        }
+    llvm::Type* storageType = getVariableStorageType(ptr);
+    if (storageType && storageType->isPointerTy()) {
+        ptr = builder->CreateLoad(storageType, ptr, "free.ptr");
     }
 
     // Cast the pointer to i8* for free
@@ -1120,6 +1510,27 @@ void CodegenVisitor::visit(AssignExpr* node) {
         return;
     }
 
+    // A spawned call stores into the target once it completes
+    if (auto* spawn = dynamic_cast<SpawnExpr*>(node->value.get())) {
+        llvm::Value* destination = nullptr;
+        if (auto* var = dynamic_cast<VariableExpr*>(node->target.get())) {
+            Symbol* symbol = symbolTable.resolve(var->name.value);
+            destination = symbol ? symbol->llvmValue : nullptr;
+        } else if (dynamic_cast<ArrayAccessExpr*>(node->target.get())) {
+            isAssignmentTarget = true;
+            node->target->accept(this);
+            isAssignmentTarget = false;
+            destination = lastValue;
+        }
+        if (!destination) {
+            reportError("Invalid assignment target", node->loc);
+            return;
+        }
+        emitSpawn(spawn, destination);
+        lastValue = nullptr;
+        return;
+    }
+
     // Handle regular assignment (=)
     node->value->accept(this);
     llvm::Value* value = lastValue;
@@ -1148,6 +1559,8 @@ void CodegenVisitor::visit(AssignExpr* node) {
 
         builder->CreateStore(value, symbol->llvmValue);
         lastValue = value;
+    } else if (auto* bit = dynamic_cast<ArrayAccessExpr*>(node->target.get()); bit && isBitsArray(bit->array.get())) {
+        emitBitsStore(bit, value);
     } else if (auto* arrayAccess = dynamic_cast<ArrayAccessExpr*>(node->target.get())) {
         // Handle array element assignment
         isAssignmentTarget = true;
@@ -1294,6 +1707,17 @@ void CodegenVisitor::visit(ExprStmt* node) {
 // In codegen_visitor.cpp
 
 void CodegenVisitor::visit(VarDeclStmt* node) {
+    // Constants need no storage of their own
+    if (node->isConst && node->constValue) {
+        emitConstantDeclaration(node);
+        return;
+    }
+
+    if (!currentFunction) {
+        emitGlobalVariable(node);
+        return;
+    }
+
     // Step 1: Create the allocation
     llvm::Value* alloca = createVariableAllocation(node);
     if (!alloca) return;
@@ -1311,6 +1735,17 @@ llvm::Value* CodegenVisitor::createVariableAllocation(VarDeclStmt* node) {
         return nullptr;
     }
 
+    llvm::Type* allocType = getStorageType(node);
+    if (!allocType) return nullptr;
+
+    return generateAlloca(currentFunction, node->name.value, allocType);
+}
+
+llvm::Type* CodegenVisitor::getStorageType(VarDeclStmt* node) {
+    if (node->type.isBits()) {
+        return typeHelper.getLLVMType(node->type);
+    }
+
     // Get the base type without array modifier
     Type baseType(node->type.name, false);
     llvm::Type* elementType = typeHelper.getLLVMType(baseType);
@@ -1333,14 +1768,144 @@ llvm::Value* CodegenVisitor::createVariableAllocation(VarDeclStmt* node) {
         allocType = elementType;
     }
 
-    return generateAlloca(currentFunction, node->name.value, allocType);
+    return allocType;
+}
+
+void CodegenVisitor::emitGlobalVariable(VarDeclStmt* node) {
+    llvm::Type* storageType = getStorageType(node);
+    if (!storageType) return;
+
+    // Initializers were evaluated during semantic analysis; the rest start zeroed
+    llvm::Constant* initializer = llvm::Constant::getNullValue(storageType);
+    if (node->constValue) {
+        initializer = materializeConstant(*node->constValue, node->type);
+        if (!initializer) {
+            reportError("Cannot materialize initializer for global: " + node->name.value, node->loc);
+            return;
+        }
+    }
+
+    auto* global = new llvm::GlobalVariable(
+        *module, storageType, false, llvm::GlobalValue::InternalLinkage,
+        initializer, node->name.value
+    );
+    if (node->isThreadLocal) {
+        global->setThreadLocalMode(llvm::GlobalValue::GeneralDynamicTLSModel);
+    }
+
+    // Top-level symbols were already entered in the global scope by semantic analysis
+    if (Symbol* symbol = symbolTable.resolveGlobal(node->name.value)) {
+        symbol->llvmValue = global;
+    }
+}
+
+void CodegenVisitor::emitMemoWrapper(FunctionDecl* node, llvm::Function* wrapper, llvm::Function* impl) {
+    const uint64_t capacity = node->memoCapacity;
+    llvm::Type* i1Ty = llvm::Type::getInt1Ty(context);
+    llvm::Type* i64Ty = llvm::Type::getInt64Ty(context);
+    llvm::Type* returnType = wrapper->getReturnType();
+
+    std::vector<llvm::Value*> args;
+    for (auto& arg : wrapper->args()) {
+        args.push_back(&arg);
+    }
+
+    // A single int argument indexes the table directly, so small domains never
+    // collide; other signatures hash their arguments. Every slot keeps its key.
+    const bool directMapped = node->parameters.size() == 1 && node->parameters[0].type.name == "int";
+
+    std::vector<llvm::Type*> fields = { i1Ty };
+    for (llvm::Value* arg : args) {
+        fields.push_back(arg->getType());
+    }
+    fields.push_back(returnType);
+    llvm::StructType* entryType = llvm::StructType::create(context, fields, node->name.value + ".memo.entry");
+    llvm::ArrayType* tableType = llvm::ArrayType::get(entryType, capacity);
+
+    // One table per thread, so memoized functions need no locking
+    auto* table = new llvm::GlobalVariable(
+        *module, tableType, false, llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantAggregateZero::get(tableType), node->name.value + ".memo"
+    );
+    table->setThreadLocalMode(llvm::GlobalValue::GeneralDynamicTLSModel);
+
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", wrapper);
+    llvm::BasicBlock* hit = llvm::BasicBlock::Create(context, "memo.hit", wrapper);
+    llvm::BasicBlock* miss = llvm::BasicBlock::Create(context, "memo.miss", wrapper);
+    builder->SetInsertPoint(entry);
+
+    // Keys are compared as 64-bit integers; floats by their bit pattern
+    auto toKey = [&](llvm::Value* value) {
+        llvm::Type* type = value->getType();
+        if (type->isFloatingPointTy()) {
+            value = builder->CreateBitCast(value, llvm::IntegerType::get(context, type->getPrimitiveSizeInBits()));
+        }
+        return type->isIntegerTy(32) ? builder->CreateSExt(value, i64Ty) : builder->CreateZExtOrTrunc(value, i64Ty);
+    };
+
+    std::vector<llvm::Value*> keys;
+    for (llvm::Value* arg : args) {
+        keys.push_back(toKey(arg));
+    }
+
+    llvm::Value* index;
+    if (directMapped) {
+        index = builder->CreateAnd(keys[0], capacity - 1, "memo.index");
+    } else {
+        // Fibonacci hashing over the argument bits; the top bits select the slot
+        llvm::Value* hash = llvm::ConstantInt::get(i64Ty, 0);
+        for (llvm::Value* key : keys) {
+            hash = builder->CreateMul(builder->CreateXor(hash, key),
+                                      llvm::ConstantInt::get(i64Ty, 0x9E3779B97F4A7C15ULL));
+        }
+        unsigned shift = 64 - llvm::Log2_64(capacity);
+        index = shift < 64 ? builder->CreateLShr(hash, shift, "memo.index")
+                           : llvm::ConstantInt::get(i64Ty, 0);
+    }
+
+    llvm::Value* slot = builder->CreateInBoundsGEP(tableType, table, { llvm::ConstantInt::get(i64Ty, 0), index }, "memo.slot");
+    auto field = [&](unsigned i) {
+        return builder->CreateStructGEP(entryType, slot, i);
+    };
+    const unsigned valueField = fields.size() - 1;
+
+    llvm::Value* found = builder->CreateLoad(i1Ty, field(0), "memo.valid");
+    for (size_t i = 0; i < keys.size(); i++) {
+        llvm::Value* stored = toKey(builder->CreateLoad(args[i]->getType(), field(i + 1)));
+        found = builder->CreateAnd(found, builder->CreateICmpEQ(stored, keys[i]));
+    }
+    builder->CreateCondBr(found, hit, miss);
+
+    builder->SetInsertPoint(hit);
+    builder->CreateRet(builder->CreateLoad(returnType, field(valueField), "memo.value"));
+
+    // On a miss the slot is overwritten with the fresh result
+    builder->SetInsertPoint(miss);
+    llvm::Value* result = builder->CreateCall(impl, args, "memo.result");
+    builder->CreateStore(llvm::ConstantInt::getTrue(context), field(0));
+    for (size_t i = 0; i < keys.size(); i++) {
+        builder->CreateStore(args[i], field(i + 1));
+    }
+    builder->CreateStore(result, field(valueField));
+    builder->CreateRet(result);
 }
 
 void CodegenVisitor::handleVariableInitialization(VarDeclStmt* node, llvm::Value* alloca) {
+    // The variable reads as zero until the spawned call completes and is synced
+    if (auto* spawn = dynamic_cast<SpawnExpr*>(node->initializer.get())) {
+        builder->CreateStore(llvm::Constant::getNullValue(alloca->getType()->getPointerElementType()), alloca);
+        emitSpawn(spawn, alloca);
+        return;
+    }
+
     if (!node->initializer) {
         // Handle default initialization
         llvm::Type* varType = alloca->getType()->getPointerElementType();
-        if (node->type.isArray && node->type.arraySize >= 0) {
+        if (node->type.isBits()) {
+            // Cleared with memset; bit sets are often too large for an aggregate store
+            uint64_t bytes = TypeHelper::bitWords(node->type.arraySize) * 8;
+            builder->CreateMemSet(alloca, builder->getInt8(0), bytes, llvm::MaybeAlign(8));
+        } else if (node->type.isArray && node->type.arraySize >= 0) {
             // Fixed-size array initialization
             builder->CreateStore(llvm::ConstantAggregateZero::get(varType), alloca);
         } else if (node->type.isArray) {
@@ -1456,8 +2021,67 @@ void CodegenVisitor::updateSymbolTableEntry(const std::string& name, const Type&
     }
 }
 
+void CodegenVisitor::emitConstantDeclaration(VarDeclStmt* node) {
+    llvm::Constant* value = materializeConstant(*node->constValue, node->type);
+    if (!value) {
+        reportError("Cannot materialize constant: " + node->name.value, node->loc);
+        return;
+    }
+
+    // Arrays become read-only global tables
+    if (node->constValue->isArray()) {
+        std::string prefix = currentFunction ? currentFunction->getName().str() + "." : "";
+        auto* global = new llvm::GlobalVariable(
+            *module, value->getType(), true, llvm::GlobalValue::PrivateLinkage,
+            value, prefix + node->name.value
+        );
+        global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+        value = global;
+    }
+
+    // Top-level constants were already entered in the global scope by semantic analysis
+    if (currentFunction) {
+        symbolTable.declare(node->name.value, node->type);
+    }
+    if (Symbol* symbol = symbolTable.resolve(node->name.value)) {
+        symbol->llvmValue = value;
+        symbol->isConstant = true;
+    }
+}
+
+llvm::Constant* CodegenVisitor::materializeConstant(const ConstValue& value, const Type& type) {
+    switch (value.kind) {
+        case ConstValue::Kind::INT:
+            return llvm::ConstantInt::getSigned(llvm::Type::getInt32Ty(context), value.intValue);
+        case ConstValue::Kind::FLOAT:
+            return llvm::ConstantFP::get(llvm::Type::getDoubleTy(context), value.floatValue);
+        case ConstValue::Kind::BOOL:
+            return llvm::ConstantInt::get(llvm::Type::getInt1Ty(context), value.boolValue ? 1 : 0);
+        case ConstValue::Kind::STRING:
+            return getStringConstant(value.stringValue);
+        case ConstValue::Kind::ARRAY:
+            break;
+    }
+
+    Type elementType(type.name);
+    llvm::Type* llvmElementType = typeHelper.getLLVMType(elementType);
+    if (!llvmElementType) return nullptr;
+
+    std::vector<llvm::Constant*> elements;
+    elements.reserve(value.array->elements.size());
+    for (const auto& element : value.array->elements) {
+        llvm::Constant* constant = materializeConstant(element, elementType);
+        if (!constant) return nullptr;
+        elements.push_back(constant);
+    }
+    return llvm::ConstantArray::get(llvm::ArrayType::get(llvmElementType, elements.size()), elements);
+}
+
 void CodegenVisitor::visit(BlockStmt* node) {
     for (const auto& stmt : node->statements) {
+        if (debugBuilder) {
+            setStatementLocation(stmt->loc.line);
+        }
         stmt->accept(this);
     }
 }
@@ -1533,8 +2157,772 @@ void CodegenVisitor::visit(WhileStmt* node) {
     builder->SetInsertPoint(endBB);
 }
 
+void CodegenVisitor::visit(MatchStmt* node) {
+    llvm::Function* func = builder->GetInsertBlock()->getParent();
+
+    node->subject->accept(this);
+    if (!lastValue) return;
+    auto* subjectType = llvm::cast<llvm::IntegerType>(lastValue->getType());
+
+    // Without a wildcard the arms are exhaustive, so the default is unreachable
+    bool hasWildcard = !node->arms.empty() && node->arms.back().isWildcard();
+    llvm::BasicBlock* defaultBB = llvm::BasicBlock::Create(context, hasWildcard ? "matchdefault" : "matchnone", func);
+    llvm::BasicBlock* endBB = llvm::BasicBlock::Create(context, "matchend");
+
+    size_t caseCount = 0;
+    for (const auto& arm : node->arms) {
+        caseCount += arm.values.size();
+    }
+
+    // LLVM lowers the switch to jump tables, bit tests or a balanced decision
+    // tree depending on how dense the case values are
+    llvm::SwitchInst* switchInst = builder->CreateSwitch(lastValue, defaultBB, caseCount);
+
+    for (auto& arm : node->arms) {
+        llvm::BasicBlock* armBB = arm.isWildcard() ? defaultBB : llvm::BasicBlock::Create(context, "matcharm", func);
+        for (int64_t value : arm.values) {
+            switchInst->addCase(llvm::ConstantInt::get(subjectType, value, true), armBB);
+        }
+
+        builder->SetInsertPoint(armBB);
+        arm.body->accept(this);
+        if (!builder->GetInsertBlock()->getTerminator()) {
+            builder->CreateBr(endBB);
+        }
+    }
+
+    if (!hasWildcard) {
+        builder->SetInsertPoint(defaultBB);
+        builder->CreateUnreachable();
+    }
+
+    func->getBasicBlockList().push_back(endBB);
+    builder->SetInsertPoint(endBB);
+}
+
+// Identity element of a reduction operator for the accumulator type
+static llvm::Constant* reductionIdentity(const std::string& op, llvm::Type* type) {
+    if (type->isDoubleTy()) {
+        if (op == "+") return llvm::ConstantFP::get(type, 0.0);
+        if (op == "*") return llvm::ConstantFP::get(type, 1.0);
+        return llvm::ConstantFP::getInfinity(type, op == "max");
+    }
+    auto* intType = llvm::cast<llvm::IntegerType>(type);
+    if (op == "+") return llvm::ConstantInt::get(intType, 0);
+    if (op == "*") return llvm::ConstantInt::get(intType, 1);
+    unsigned bits = intType->getBitWidth();
+    return llvm::ConstantInt::get(intType, op == "min" ? llvm::APInt::getSignedMaxValue(bits)
+                                                       : llvm::APInt::getSignedMinValue(bits));
+}
+
+llvm::Value* CodegenVisitor::combineReduction(const std::string& op, llvm::Value* left, llvm::Value* right) {
+    bool isFloat = left->getType()->isDoubleTy();
+    if (op == "+") return isFloat ? builder->CreateFAdd(left, right) : builder->CreateAdd(left, right);
+    if (op == "*") return isFloat ? builder->CreateFMul(left, right) : builder->CreateMul(left, right);
+
+    llvm::Value* less = isFloat ? builder->CreateFCmpOLT(left, right) : builder->CreateICmpSLT(left, right);
+    return op == "min" ? builder->CreateSelect(less, left, right) : builder->CreateSelect(less, right, left);
+}
+
+void CodegenVisitor::visit(ParallelForStmt* node) {
+    llvm::Type* i8PtrTy = llvm::Type::getInt8PtrTy(context);
+    llvm::Type* i32Ty = llvm::Type::getInt32Ty(context);
+    llvm::Type* voidTy = llvm::Type::getVoidTy(context);
+
+    node->start->accept(this);
+    llvm::Value* start = lastValue;
+    node->end->accept(this);
+    llvm::Value* end = lastValue;
+    if (!start || !end) return;
+
+    auto isReduction = [&](const std::string& name) {
+        return std::any_of(node->reductions.begin(), node->reductions.end(),
+                           [&](const Reduction& reduction) { return reduction.variable.value == name; });
+    };
+
+    // The body sees enclosing locals through their addresses. Constants are
+    // shared as they are; reduction variables get private accumulators instead.
+    std::vector<Symbol*> captured;
+    std::vector<Symbol*> constants;
+    std::unordered_set<std::string> seen;
+    const auto& scopes = symbolTable.getScopes();
+    for (size_t i = scopes.size() - 1; i > 0; i--) {
+        for (const auto& entry : scopes[i]->getSymbols()) {
+            Symbol* symbol = entry.second.get();
+            if (symbol->kind != Symbol::Kind::VARIABLE || !symbol->llvmValue || !seen.insert(entry.first).second) {
+                continue;
+            }
+            if (symbol->isConstant) {
+                constants.push_back(symbol);
+            } else if (!isReduction(entry.first)) {
+                captured.push_back(symbol);
+            }
+        }
+    }
+
+    // Each reduction has a table with one cache-line-sized slot per worker
+    llvm::Function* stackSave = llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::stacksave);
+    llvm::Function* stackRestore = llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::stackrestore);
+    llvm::Value* savedStack = builder->CreateCall(stackSave);
+    llvm::Value* workers = builder->CreateCall(module->getFunction("lei_parallel_workers"), {}, "workers");
+
+    struct ReductionTable {
+        const Reduction* reduction;
+        Symbol* symbol;
+        llvm::Type* type;
+        llvm::Value* slots;
+        unsigned stride;
+    };
+    std::vector<ReductionTable> tables;
+    for (const auto& reduction : node->reductions) {
+        Symbol* symbol = symbolTable.resolve(reduction.variable.value);
+        if (!symbol || !symbol->llvmValue) {
+            reportError("Undefined reduction variable: " + reduction.variable.value, node->loc);
+            return;
+        }
+        llvm::Type* type = symbol->llvmValue->getType()->getPointerElementType();
+        unsigned stride = std::max(1u, 64u / static_cast<unsigned>(type->getPrimitiveSizeInBits() / 8));
+        llvm::Value* count = builder->CreateMul(workers, llvm::ConstantInt::get(i32Ty, stride));
+        llvm::Value* slots = builder->CreateAlloca(type, count, reduction.variable.value + ".partials");
+        tables.push_back({ &reduction, symbol, type, slots, stride });
+    }
+
+    // Per-worker slots start at the identity so unused workers don't affect the result
+    auto forEachWorker = [&](const std::function<void(llvm::Value*)>& emit) {
+        llvm::Function* function = builder->GetInsertBlock()->getParent();
+        llvm::BasicBlock* before = builder->GetInsertBlock();
+        llvm::BasicBlock* loop = llvm::BasicBlock::Create(context, "workers.loop", function);
+        llvm::BasicBlock* after = llvm::BasicBlock::Create(context, "workers.end", function);
+        builder->CreateBr(loop);
+        builder->SetInsertPoint(loop);
+        llvm::PHINode* worker = builder->CreatePHI(i32Ty, 2, "worker");
+        worker->addIncoming(llvm::ConstantInt::get(i32Ty, 0), before);
+        emit(worker);
+        llvm::Value* next = builder->CreateAdd(worker, llvm::ConstantInt::get(i32Ty, 1));
+        worker->addIncoming(next, builder->GetInsertBlock());
+        builder->CreateCondBr(builder->CreateICmpSLT(next, workers), loop, after);
+        builder->SetInsertPoint(after);
+    };
+    auto slotFor = [&](const ReductionTable& table, llvm::Value* worker) {
+        llvm::Value* index = builder->CreateMul(worker, llvm::ConstantInt::get(i32Ty, table.stride));
+        return builder->CreateInBoundsGEP(table.type, table.slots, index);
+    };
+    if (!tables.empty()) {
+        forEachWorker([&](llvm::Value* worker) {
+            for (const auto& table : tables) {
+                builder->CreateStore(reductionIdentity(table.reduction->op.value, table.type), slotFor(table, worker));
+            }
+        });
+    }
+
+    // Context passed to the outlined body: captured addresses, then reduction tables
+    std::vector<llvm::Type*> fields;
+    for (Symbol* symbol : captured) fields.push_back(symbol->llvmValue->getType());
+    for (const auto& table : tables) fields.push_back(table.slots->getType());
+    llvm::StructType* contextType = llvm::StructType::get(context, fields);
+
+    llvm::Value* contextValue = generateAlloca(currentFunction, "parallel.context", contextType);
+    for (size_t i = 0; i < fields.size(); i++) {
+        llvm::Value* value = i < captured.size() ? captured[i]->llvmValue : tables[i - captured.size()].slots;
+        builder->CreateStore(value, builder->CreateStructGEP(contextType, contextValue, i));
+    }
+
+    // Outline the body as 'void (i8* context, i32 lo, i32 hi, i32 worker)'
+    llvm::FunctionType* bodyType = llvm::FunctionType::get(voidTy, { i8PtrTy, i32Ty, i32Ty, i32Ty }, false);
+    llvm::Function* body = llvm::Function::Create(
+        bodyType, llvm::Function::InternalLinkage,
+        currentFunction->getName() + ".parallel", module.get()
+    );
+
+    llvm::Function* enclosing = currentFunction;
+    llvm::BasicBlock* resumeBlock = builder->GetInsertBlock();
+    llvm::Value* enclosingGroup = spawnGroup;
+    bool enclosingParallel = inParallelBody;
+    currentFunction = body;
+    spawnGroup = nullptr;
+    inParallelBody = true;
+
+    auto argument = body->arg_begin();
+    llvm::Value* bodyContext = &*argument++;
+    llvm::Value* lo = &*argument++;
+    llvm::Value* hi = &*argument++;
+    llvm::Value* worker = &*argument;
+
+    builder->SetInsertPoint(llvm::BasicBlock::Create(context, "entry", body));
+    llvm::Value* typedContext = builder->CreateBitCast(bodyContext, contextType->getPointerTo());
+
+    symbolTable.enterScope();
+    auto declareLocal = [&](const std::string& name, const Type& type, llvm::Value* address) {
+        symbolTable.declare(name, type);
+        Symbol* local = symbolTable.resolve(name);
+        local->llvmValue = address;
+        local->isAlloca = true;
+    };
+    for (size_t i = 0; i < captured.size(); i++) {
+        llvm::Value* address = builder->CreateLoad(fields[i], builder->CreateStructGEP(contextType, typedContext, i));
+        capturedAddresses.insert(address);
+        declareLocal(captured[i]->name, captured[i]->type, address);
+    }
+    for (Symbol* constant : constants) {
+        symbolTable.declare(constant->name, constant->type);
+        Symbol* local = symbolTable.resolve(constant->name);
+        local->llvmValue = constant->llvmValue;
+        local->isConstant = true;
+        local->constValue = constant->constValue;
+    }
+
+    std::vector<llvm::Value*> accumulators;
+    for (const auto& table : tables) {
+        llvm::Value* accumulator = generateAlloca(body, table.reduction->variable.value, table.type);
+        builder->CreateStore(reductionIdentity(table.reduction->op.value, table.type), accumulator);
+        declareLocal(table.reduction->variable.value, table.symbol->type, accumulator);
+        accumulators.push_back(accumulator);
+    }
+
+    llvm::Value* index = generateAlloca(body, node->variable.value, i32Ty);
+    builder->CreateStore(lo, index);
+    symbolTable.enterScope();
+    declareLocal(node->variable.value, Type("int"), index);
+
+    llvm::BasicBlock* condBB = llvm::BasicBlock::Create(context, "parallel.cond", body);
+    llvm::BasicBlock* bodyBB = llvm::BasicBlock::Create(context, "parallel.body", body);
+    llvm::BasicBlock* endBB = llvm::BasicBlock::Create(context, "parallel.end", body);
+    builder->CreateBr(condBB);
+
+    builder->SetInsertPoint(condBB);
+    llvm::Value* current = builder->CreateLoad(i32Ty, index);
+    builder->CreateCondBr(builder->CreateICmpSLT(current, hi), bodyBB, endBB);
+
+    builder->SetInsertPoint(bodyBB);
+    node->body->accept(this);
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        llvm::Value* next = builder->CreateAdd(builder->CreateLoad(i32Ty, index), llvm::ConstantInt::get(i32Ty, 1));
+        builder->CreateStore(next, index);
+        builder->CreateBr(condBB);
+    }
+
+    // Fold this chunk's accumulators into the worker's slots
+    builder->SetInsertPoint(endBB);
+    for (size_t i = 0; i < tables.size(); i++) {
+        size_t field = captured.size() + i;
+        llvm::Value* slots = builder->CreateLoad(fields[field], builder->CreateStructGEP(contextType, typedContext, field));
+        llvm::Value* slotIndex = builder->CreateMul(worker, llvm::ConstantInt::get(i32Ty, tables[i].stride));
+        llvm::Value* slot = builder->CreateInBoundsGEP(tables[i].type, slots, slotIndex);
+        llvm::Value* partial = builder->CreateLoad(tables[i].type, slot);
+        llvm::Value* chunk = builder->CreateLoad(tables[i].type, accumulators[i]);
+        builder->CreateStore(combineReduction(tables[i].reduction->op.value, partial, chunk), slot);
+    }
+    emitSync();
+    builder->CreateRetVoid();
+
+    symbolTable.exitScope();
+    symbolTable.exitScope();
+    currentFunction = enclosing;
+    spawnGroup = enclosingGroup;
+    inParallelBody = enclosingParallel;
+    builder->SetInsertPoint(resumeBlock);
+
+    builder->CreateCall(module->getFunction("lei_parallel_for"), {
+        typeHelper.convert(start, i32Ty),
+        typeHelper.convert(end, i32Ty),
+        body,
+        builder->CreateBitCast(contextValue, i8PtrTy)
+    });
+
+    // Combine the per-worker partial results into the reduction variables
+    if (!tables.empty()) {
+        forEachWorker([&](llvm::Value* worker) {
+            for (const auto& table : tables) {
+                llvm::Value* total = builder->CreateLoad(table.type, table.symbol->llvmValue);
+                llvm::Value* partial = builder->CreateLoad(table.type, slotFor(table, worker));
+                builder->CreateStore(combineReduction(table.reduction->op.value, total, partial), table.symbol->llvmValue);
+            }
+        });
+    }
+    builder->CreateCall(stackRestore, { savedStack });
+}
+
+llvm::Value* CodegenVisitor::getSpawnGroup() {
+    if (!spawnGroup) {
+        llvm::BasicBlock& entry = currentFunction->getEntryBlock();
+        llvm::IRBuilder<> entryBuilder(&entry, entry.begin());
+        llvm::Type* i64Ty = llvm::Type::getInt64Ty(context);
+        spawnGroup = entryBuilder.CreateAlloca(i64Ty, nullptr, "spawn.group");
+        entryBuilder.CreateStore(llvm::ConstantInt::get(i64Ty, 0), spawnGroup);
+    }
+    return spawnGroup;
+}
+
+void CodegenVisitor::emitSync() {
+    if (spawnGroup) {
+        builder->CreateCall(module->getFunction("lei_sync"), { spawnGroup });
+    }
+}
+
+llvm::Function* CodegenVisitor::packCall(CallExpr* call, llvm::Value* destination,
+                                         llvm::Value*& frame, llvm::Constant*& frameSize) {
+    auto* funcSymbol = symbolTable.resolveFunction(call->name.value);
+    if (!funcSymbol || !funcSymbol->llvmFunction) {
+        reportError("Undefined function: " + call->name.value, call->loc);
+        return nullptr;
+    }
+
+    // Arguments are evaluated now, in the calling function
+    std::vector<llvm::Value*> args = processCallArguments(call, funcSymbol);
+    if (args.size() != call->arguments.size()) return nullptr;
+
+    // The frame holds the result address followed by the arguments; the
+    // runtime copies it, so it can live in this function's entry block
+    llvm::Type* i8PtrTy = llvm::Type::getInt8PtrTy(context);
+    llvm::Type* resultPtrTy = destination ? destination->getType() : i8PtrTy;
+    std::vector<llvm::Type*> fields = { resultPtrTy };
+    for (llvm::Value* arg : args) fields.push_back(arg->getType());
+    llvm::StructType* frameType = llvm::StructType::get(context, fields);
+
+    frame = generateAlloca(currentFunction, "call.frame", frameType);
+    builder->CreateStore(destination ? destination : llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(i8PtrTy)),
+                         builder->CreateStructGEP(frameType, frame, 0));
+    for (size_t i = 0; i < args.size(); i++) {
+        builder->CreateStore(args[i], builder->CreateStructGEP(frameType, frame, i + 1));
+    }
+    frame = builder->CreateBitCast(frame, i8PtrTy);
+    frameSize = llvm::ConstantExpr::getSizeOf(frameType);
+
+    // Trampoline 'void (i8* frame)' unpacking the frame around the call
+    llvm::Function* callee = funcSymbol->llvmFunction;
+    llvm::Function* trampoline = llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getVoidTy(context), { i8PtrTy }, false),
+        llvm::Function::InternalLinkage,
+        callee->getName() + ".call",
+        module.get()
+    );
+
+    llvm::IRBuilderBase::InsertPoint resume = builder->saveIP();
+    builder->SetInsertPoint(llvm::BasicBlock::Create(context, "entry", trampoline));
+    llvm::Value* typedFrame = builder->CreateBitCast(&*trampoline->arg_begin(), frameType->getPointerTo());
+    std::vector<llvm::Value*> unpacked;
+    for (size_t i = 0; i < args.size(); i++) {
+        unpacked.push_back(builder->CreateLoad(fields[i + 1], builder->CreateStructGEP(frameType, typedFrame, i + 1)));
+    }
+    llvm::Value* result = builder->CreateCall(callee, unpacked);
+    if (destination) {
+        llvm::Value* resultAddress = builder->CreateLoad(resultPtrTy, builder->CreateStructGEP(frameType, typedFrame, 0));
+        builder->CreateStore(typeHelper.convert(result, resultPtrTy->getPointerElementType()), resultAddress);
+    }
+    builder->CreateRetVoid();
+    builder->restoreIP(resume);
+    return trampoline;
+}
+
+void CodegenVisitor::emitSpawn(SpawnExpr* node, llvm::Value* destination) {
+    llvm::Value* frame = nullptr;
+    llvm::Constant* frameSize = nullptr;
+    llvm::Function* trampoline = packCall(node->call.get(), destination, frame, frameSize);
+    if (!trampoline) return;
+
+    builder->CreateCall(module->getFunction("lei_spawn"), { getSpawnGroup(), trampoline, frame, frameSize });
+}
+
+void CodegenVisitor::visit(SpawnExpr* node) {
+    // Only reached as a statement: the result is discarded
+    emitSpawn(node, nullptr);
+    lastValue = nullptr;
+}
+
+void CodegenVisitor::visit(SyncStmt*) {
+    emitSync();
+}
+
+void CodegenVisitor::visit(GoStmt* node) {
+    llvm::Value* frame = nullptr;
+    llvm::Constant* frameSize = nullptr;
+    llvm::Function* trampoline = packCall(node->call.get(), nullptr, frame, frameSize);
+    if (!trampoline) return;
+
+    builder->CreateCall(module->getFunction("lei_go"), { trampoline, frame, frameSize });
+}
+
+void CodegenVisitor::visit(ChannelExpr* node) {
+    node->capacity->accept(this);
+    if (!lastValue) return;
+
+    llvm::Value* capacity = typeHelper.convert(lastValue, llvm::Type::getInt32Ty(context));
+    llvm::Value* handle = builder->CreateCall(module->getFunction("lei_chan_new"), { capacity }, "chan");
+    lastValue = builder->CreateBitCast(handle, typeHelper.getLLVMType(node->type));
+}
+
+Type CodegenVisitor::channelTypeOf(llvm::Value* channel) const {
+    auto* handle = llvm::cast<llvm::StructType>(channel->getType()->getPointerElementType());
+    return Type(handle->getName().str());
+}
+
+llvm::Value* CodegenVisitor::toChannelWord(llvm::Value* value, const Type& element) {
+    llvm::Type* i64Ty = llvm::Type::getInt64Ty(context);
+    llvm::Type* elementType = typeHelper.getLLVMType(element);
+
+    // String variables evaluate to their storage address
+    if (element.name == "str" && value->getType() == elementType->getPointerTo()) {
+        value = builder->CreateLoad(elementType, value);
+    }
+    value = typeHelper.convert(value, elementType);
+    if (!value) return nullptr;
+
+    if (element.name == "float") return builder->CreateBitCast(value, i64Ty);
+    if (element.name == "str") return builder->CreatePtrToInt(value, i64Ty);
+    if (element.name == "bool") return builder->CreateZExt(value, i64Ty);
+    return builder->CreateSExt(value, i64Ty);
+}
+
+llvm::Value* CodegenVisitor::fromChannelWord(llvm::Value* word, const Type& element) {
+    llvm::Type* elementType = typeHelper.getLLVMType(element);
+    if (element.name == "float") return builder->CreateBitCast(word, elementType);
+    if (element.name == "str") {
+        // A closed, drained channel hands back the zero word; str's zero value is ""
+        llvm::Value* closed = builder->CreateICmpEQ(word, llvm::ConstantInt::get(word->getType(), 0), "chan.closed");
+        return builder->CreateSelect(closed, builder->CreateGlobalStringPtr("", "chan.empty"),
+                                     builder->CreateIntToPtr(word, elementType), "chan.str");
+    }
+    return builder->CreateTrunc(word, elementType);
+}
+
+llvm::Value* CodegenVisitor::generateChannelCall(CallExpr* node) {
+    node->arguments[0]->accept(this);
+    llvm::Value* channel = lastValue;
+    if (!channel) return nullptr;
+
+    Type element = channelTypeOf(channel).channelElement();
+    llvm::Value* handle = builder->CreateBitCast(channel, llvm::Type::getInt8PtrTy(context));
+
+    if (node->name.value == "send") {
+        node->arguments[1]->accept(this);
+        if (!lastValue) return nullptr;
+        llvm::Value* word = toChannelWord(lastValue, element);
+        if (!word) {
+            reportError("Invalid value sent on " + channelTypeOf(channel).name, node->loc);
+            return nullptr;
+        }
+        return builder->CreateCall(module->getFunction("lei_chan_send"), { handle, word });
+    }
+    if (node->name.value == "recv") {
+        llvm::Value* word = builder->CreateCall(module->getFunction("lei_chan_recv"), { handle }, "recv");
+        return fromChannelWord(word, element);
+    }
+    return builder->CreateCall(module->getFunction("lei_chan_close"), { handle });
+}
+
+bool CodegenVisitor::isBitsArray(Expr* expr) {
+    auto* var = dynamic_cast<VariableExpr*>(expr);
+    if (!var) return false;
+    Symbol* symbol = symbolTable.resolve(var->name.value);
+    return symbol && symbol->type.isBits() && symbol->type.isArray;
+}
+
+llvm::Value* CodegenVisitor::getBitsWords(Expr* array, uint64_t& wordCount) {
+    auto* var = static_cast<VariableExpr*>(array);
+    wordCount = TypeHelper::bitWords(symbolTable.resolve(var->name.value)->type.arraySize);
+
+    bool wasAssignmentTarget = isAssignmentTarget;
+    isAssignmentTarget = false;
+    array->accept(this);
+    isAssignmentTarget = wasAssignmentTarget;
+    if (!lastValue) return nullptr;
+
+    llvm::Type* storage = getVariableStorageType(lastValue);
+    if (!storage || !storage->isArrayTy()) {
+        reportError("Invalid bits array", array->loc);
+        return nullptr;
+    }
+    return builder->CreateConstInBoundsGEP2_32(storage, lastValue, 0, 0, "bits.words");
+}
+
+void CodegenVisitor::locateBit(ArrayAccessExpr* node, llvm::Value*& word, llvm::Value*& mask) {
+    uint64_t wordCount = 0;
+    llvm::Value* words = getBitsWords(node->array.get(), wordCount);
+
+    bool wasAssignmentTarget = isAssignmentTarget;
+    isAssignmentTarget = false;
+    node->index->accept(this);
+    isAssignmentTarget = wasAssignmentTarget;
+    if (!words || !lastValue) return;
+
+    llvm::Value* index = builder->CreateZExt(lastValue, builder->getInt64Ty(), "bit.index");
+    word = builder->CreateInBoundsGEP(builder->getInt64Ty(), words, builder->CreateLShr(index, 6), "bit.word");
+    mask = builder->CreateShl(builder->getInt64(1), builder->CreateAnd(index, 63), "bit.mask");
+}
+
+void CodegenVisitor::emitBitsStore(ArrayAccessExpr* target, llvm::Value* value) {
+    llvm::Value* word = nullptr;
+    llvm::Value* mask = nullptr;
+    locateBit(target, word, mask);
+    if (!word) {
+        lastValue = nullptr;
+        return;
+    }
+    value = typeHelper.convert(value, builder->getInt1Ty());
+
+    // Iterations of a parallel loop may write different bits of the same word
+    if (inParallelBody) {
+        llvm::BasicBlock* setBB = llvm::BasicBlock::Create(context, "bit.set", currentFunction);
+        llvm::BasicBlock* clearBB = llvm::BasicBlock::Create(context, "bit.clear", currentFunction);
+        llvm::BasicBlock* doneBB = llvm::BasicBlock::Create(context, "bit.done", currentFunction);
+        builder->CreateCondBr(value, setBB, clearBB);
+        builder->SetInsertPoint(setBB);
+        builder->CreateAtomicRMW(llvm::AtomicRMWInst::Or, word, mask, llvm::MaybeAlign(8),
+                                 llvm::AtomicOrdering::Monotonic);
+        builder->CreateBr(doneBB);
+        builder->SetInsertPoint(clearBB);
+        builder->CreateAtomicRMW(llvm::AtomicRMWInst::And, word, builder->CreateNot(mask), llvm::MaybeAlign(8),
+                                 llvm::AtomicOrdering::Monotonic);
+        builder->CreateBr(doneBB);
+        builder->SetInsertPoint(doneBB);
+    } else {
+        llvm::Value* current = builder->CreateLoad(builder->getInt64Ty(), word);
+        llvm::Value* set = builder->CreateOr(current, mask);
+        llvm::Value* cleared = builder->CreateAnd(current, builder->CreateNot(mask));
+        builder->CreateStore(builder->CreateSelect(value, set, cleared), word);
+    }
+    lastValue = value;
+}
+
+// popcount, and and or run over <4 x i64> vectors with a scalar tail for the
+// last words; ffs scans a word at a time and stops at the first non-zero one
+llvm::Value* CodegenVisitor::generateBitsCall(CallExpr* node) {
+    const std::string& name = node->name.value;
+    llvm::Type* i64Ty = builder->getInt64Ty();
+    constexpr unsigned Lanes = 4;
+    llvm::Type* vectorTy = llvm::FixedVectorType::get(i64Ty, Lanes);
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+
+    uint64_t wordCount = 0;
+    llvm::Value* words = getBitsWords(node->arguments[0].get(), wordCount);
+    llvm::Value* others = nullptr;
+    if (name == "and" || name == "or") {
+        uint64_t otherCount = 0;
+        others = getBitsWords(node->arguments[1].get(), otherCount);
+        if (!others) words = nullptr;
+    }
+    if (!words) {
+        lastValue = nullptr;
+        return nullptr;
+    }
+
+    if (name == "ffs") {
+        llvm::BasicBlock* entryBB = builder->GetInsertBlock();
+        llvm::BasicBlock* scanBB = llvm::BasicBlock::Create(context, "ffs.scan", function);
+        llvm::BasicBlock* nextBB = llvm::BasicBlock::Create(context, "ffs.next", function);
+        llvm::BasicBlock* foundBB = llvm::BasicBlock::Create(context, "ffs.found", function);
+        llvm::BasicBlock* endBB = llvm::BasicBlock::Create(context, "ffs.end", function);
+        builder->CreateBr(scanBB);
+
+        builder->SetInsertPoint(scanBB);
+        llvm::PHINode* index = builder->CreatePHI(i64Ty, 2, "ffs.index");
+        index->addIncoming(builder->getInt64(0), entryBB);
+        llvm::Value* word = builder->CreateLoad(i64Ty, builder->CreateInBoundsGEP(i64Ty, words, index));
+        builder->CreateCondBr(builder->CreateICmpNE(word, builder->getInt64(0)), foundBB, nextBB);
+
+        builder->SetInsertPoint(nextBB);
+        llvm::Value* next = builder->CreateAdd(index, builder->getInt64(1));
+        index->addIncoming(next, nextBB);
+        builder->CreateCondBr(builder->CreateICmpULT(next, builder->getInt64(wordCount)), scanBB, endBB);
+
+        builder->SetInsertPoint(foundBB);
+        llvm::Value* bit = builder->CreateBinaryIntrinsic(llvm::Intrinsic::cttz, word, builder->getTrue());
+        llvm::Value* position = builder->CreateAdd(builder->CreateShl(index, 6), bit);
+        builder->CreateBr(endBB);
+
+        builder->SetInsertPoint(endBB);
+        llvm::PHINode* result = builder->CreatePHI(i64Ty, 2);
+        result->addIncoming(builder->getInt64(-1), nextBB);
+        result->addIncoming(position, foundBB);
+        lastValue = builder->CreateTrunc(result, builder->getInt32Ty(), "ffs");
+        return lastValue;
+    }
+
+    // Combines one vector or word of the operands; popcount accumulates into total
+    auto combine = [&](llvm::Type* type, llvm::Value* offset, llvm::Value* total) -> llvm::Value* {
+        llvm::Value* address = builder->CreateBitCast(builder->CreateInBoundsGEP(i64Ty, words, offset),
+                                                      type->getPointerTo());
+        llvm::Value* value = builder->CreateAlignedLoad(type, address, llvm::MaybeAlign(8));
+        if (name == "popcount") {
+            return builder->CreateAdd(total, builder->CreateUnaryIntrinsic(llvm::Intrinsic::ctpop, value));
+        }
+        llvm::Value* otherAddress = builder->CreateBitCast(builder->CreateInBoundsGEP(i64Ty, others, offset),
+                                                           type->getPointerTo());
+        llvm::Value* other = builder->CreateAlignedLoad(type, otherAddress, llvm::MaybeAlign(8));
+        llvm::Value* combined = name == "and" ? builder->CreateAnd(value, other) : builder->CreateOr(value, other);
+        builder->CreateAlignedStore(combined, address, llvm::MaybeAlign(8));
+        return total;
+    };
+
+    llvm::Value* total = llvm::Constant::getNullValue(vectorTy);
+    uint64_t vectorCount = wordCount / Lanes;
+    if (vectorCount > 0) {
+        llvm::BasicBlock* entryBB = builder->GetInsertBlock();
+        llvm::BasicBlock* loopBB = llvm::BasicBlock::Create(context, name + ".loop", function);
+        llvm::BasicBlock* endBB = llvm::BasicBlock::Create(context, name + ".end", function);
+        builder->CreateBr(loopBB);
+
+        builder->SetInsertPoint(loopBB);
+        llvm::PHINode* index = builder->CreatePHI(i64Ty, 2, name + ".index");
+        llvm::PHINode* partial = builder->CreatePHI(vectorTy, 2, name + ".partial");
+        index->addIncoming(builder->getInt64(0), entryBB);
+        partial->addIncoming(total, entryBB);
+        llvm::Value* sum = combine(vectorTy, builder->CreateMul(index, builder->getInt64(Lanes)), partial);
+        llvm::Value* next = builder->CreateAdd(index, builder->getInt64(1));
+        index->addIncoming(next, loopBB);
+        partial->addIncoming(sum, loopBB);
+        builder->CreateCondBr(builder->CreateICmpULT(next, builder->getInt64(vectorCount)), loopBB, endBB);
+
+        builder->SetInsertPoint(endBB);
+        total = sum;
+    }
+
+    llvm::Value* count = name == "popcount" ? builder->CreateAddReduce(total) : static_cast<llvm::Value*>(builder->getInt64(0));
+    for (uint64_t i = vectorCount * Lanes; i < wordCount; i++) {
+        count = combine(i64Ty, builder->getInt64(i), count);
+    }
+
+    // and/or return the updated words so the call is not mistaken for a user function
+    lastValue = name == "popcount" ? builder->CreateTrunc(count, builder->getInt32Ty(), "popcount") : words;
+    return lastValue;
+}
+
+llvm::Value* CodegenVisitor::generateAtomicCall(CallExpr* node) {
+    const std::string& name = node->name.value;
+    size_t operands = name == "load" ? 1 : name == "compare_exchange" ? 3 : 2;
+
+    // The optional trailing argument names the ordering; the default is seq_cst
+    llvm::AtomicOrdering ordering = llvm::AtomicOrdering::SequentiallyConsistent;
+    if (node->arguments.size() > operands) {
+        static const std::unordered_map<std::string, llvm::AtomicOrdering> orderings = {
+            {"relaxed", llvm::AtomicOrdering::Monotonic},
+            {"acquire", llvm::AtomicOrdering::Acquire},
+            {"release", llvm::AtomicOrdering::Release},
+            {"acq_rel", llvm::AtomicOrdering::AcquireRelease},
+            {"seq_cst", llvm::AtomicOrdering::SequentiallyConsistent},
+        };
+        auto* orderingName = static_cast<VariableExpr*>(node->arguments.back().get());
+        ordering = orderings.at(orderingName->name.value);
+    }
+
+    isAssignmentTarget = true;
+    node->arguments[0]->accept(this);
+    isAssignmentTarget = false;
+    llvm::Value* address = lastValue;
+    if (!address) return nullptr;
+
+    llvm::Type* valueType = address->getType()->getPointerElementType();
+    llvm::MaybeAlign alignment(module->getDataLayout().getTypeStoreSize(valueType).getFixedSize());
+    std::vector<llvm::Value*> values;
+    for (size_t i = 1; i < operands; i++) {
+        node->arguments[i]->accept(this);
+        if (!lastValue) return nullptr;
+        values.push_back(typeHelper.convert(lastValue, valueType));
+    }
+
+    if (name == "load") {
+        llvm::LoadInst* load = builder->CreateLoad(valueType, address, "atomic.load");
+        load->setAtomic(ordering);
+        load->setAlignment(*alignment);
+        return load;
+    }
+    if (name == "store") {
+        llvm::StoreInst* store = builder->CreateStore(values[0], address);
+        store->setAtomic(ordering);
+        store->setAlignment(*alignment);
+        return store;
+    }
+    if (name == "fetch_add" || name == "fetch_sub") {
+        auto op = name == "fetch_add" ? llvm::AtomicRMWInst::Add : llvm::AtomicRMWInst::Sub;
+        return builder->CreateAtomicRMW(op, address, values[0], alignment, ordering);
+    }
+
+    // A failed exchange only reads, so it cannot have release semantics
+    llvm::AtomicOrdering failure = ordering;
+    if (ordering == llvm::AtomicOrdering::Release) failure = llvm::AtomicOrdering::Monotonic;
+    if (ordering == llvm::AtomicOrdering::AcquireRelease) failure = llvm::AtomicOrdering::Acquire;
+    llvm::Value* exchange = builder->CreateAtomicCmpXchg(address, values[0], values[1], alignment, ordering, failure);
+    return builder->CreateExtractValue(exchange, 1, "exchanged");
+}
+
+void CodegenVisitor::visit(ForInStmt* node) {
+    if (node->generator) {
+        emitGeneratorLoop(node);
+        return;
+    }
+
+    node->source->accept(this);
+    llvm::Value* channel = lastValue;
+    if (!channel) return;
+
+    llvm::Type* i32Ty = llvm::Type::getInt32Ty(context);
+    llvm::Type* i64Ty = llvm::Type::getInt64Ty(context);
+    Type element = channelTypeOf(channel).channelElement();
+    llvm::Value* handle = builder->CreateBitCast(channel, llvm::Type::getInt8PtrTy(context));
+
+    // Values are received a batch at a time and handed to the body one by one
+    constexpr unsigned BatchSize = 16;
+    llvm::ArrayType* batchType = llvm::ArrayType::get(i64Ty, BatchSize);
+    llvm::Value* batch = generateAlloca(currentFunction, "recv.batch", batchType);
+    llvm::Value* count = generateAlloca(currentFunction, "recv.count", i32Ty);
+    llvm::Value* index = generateAlloca(currentFunction, "recv.index", i32Ty);
+    llvm::Value* variable = generateAlloca(currentFunction, node->variable.value, typeHelper.getLLVMType(element));
+
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* fetchBB = llvm::BasicBlock::Create(context, "recv.fetch", function);
+    llvm::BasicBlock* itemBB = llvm::BasicBlock::Create(context, "recv.item", function);
+    llvm::BasicBlock* nextBB = llvm::BasicBlock::Create(context, "recv.next", function);
+    llvm::BasicBlock* endBB = llvm::BasicBlock::Create(context, "recv.end", function);
+    builder->CreateBr(fetchBB);
+
+    // An empty batch means the channel is closed and drained
+    builder->SetInsertPoint(fetchBB);
+    llvm::Value* first = builder->CreateConstInBoundsGEP2_32(batchType, batch, 0, 0);
+    llvm::Value* received = builder->CreateCall(module->getFunction("lei_chan_recv_batch"),
+                                                { handle, first, llvm::ConstantInt::get(i32Ty, BatchSize) });
+    builder->CreateStore(received, count);
+    builder->CreateStore(llvm::ConstantInt::get(i32Ty, 0), index);
+    builder->CreateCondBr(builder->CreateICmpSGT(received, llvm::ConstantInt::get(i32Ty, 0)), itemBB, endBB);
+
+    builder->SetInsertPoint(itemBB);
+    llvm::Value* word = builder->CreateLoad(i64Ty, builder->CreateInBoundsGEP(batchType, batch, {
+        llvm::ConstantInt::get(i32Ty, 0), builder->CreateLoad(i32Ty, index)
+    }));
+    builder->CreateStore(fromChannelWord(word, element), variable);
+
+    symbolTable.enterScope();
+    symbolTable.declare(node->variable.value, element);
+    Symbol* symbol = symbolTable.resolve(node->variable.value);
+    symbol->llvmValue = variable;
+    symbol->isAlloca = true;
+    node->body->accept(this);
+    symbolTable.exitScope();
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        builder->CreateBr(nextBB);
+    }
+
+    builder->SetInsertPoint(nextBB);
+    llvm::Value* next = builder->CreateAdd(builder->CreateLoad(i32Ty, index), llvm::ConstantInt::get(i32Ty, 1));
+    builder->CreateStore(next, index);
+    builder->CreateCondBr(builder->CreateICmpSLT(next, builder->CreateLoad(i32Ty, count)), itemBB, fetchBB);
+
+    builder->SetInsertPoint(endBB);
+}
+
 void CodegenVisitor::visit(ReturnStmt* node) {
+    // Spawned calls may still be writing variables the return value reads
+    emitSync();
+
+    // Returning from a generator runs it to its final suspend point
+    if (generator.handle) {
+        destroyActiveGenerators();
+        builder->CreateBr(generator.finalSuspend);
+        lastValue = nullptr;
+        return;
+    }
+
     if (!node->value) {
+        destroyActiveGenerators();
         builder->CreateRetVoid();
         lastValue = nullptr;
         return;
@@ -1547,9 +2935,400 @@ void CodegenVisitor::visit(ReturnStmt* node) {
     llvm::Type* returnType = currentFunction->getReturnType();
     lastValue = typeHelper.convert(lastValue, returnType);
     
+    destroyActiveGenerators();
     builder->CreateRet(lastValue);
 }
 
+void CodegenVisitor::beginDebugInfo() {
+    llvm::SmallString<256> path(sampleSource);
+    llvm::sys::fs::make_absolute(path);
+    debugBuilder = std::make_unique<llvm::DIBuilder>(*module);
+    debugFile = debugBuilder->createFile(llvm::sys::path::filename(path), llvm::sys::path::parent_path(path));
+    debugBuilder->createCompileUnit(llvm::dwarf::DW_LANG_C, debugFile, "leic", false, "", 0, "",
+                                    llvm::DICompileUnit::LineTablesOnly);
+    module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+}
+
+llvm::DISubprogram* CodegenVisitor::getSubprogram(llvm::Function* function, int line) {
+    if (llvm::DISubprogram* existing = function->getSubprogram()) {
+        return existing;
+    }
+    unsigned start = static_cast<unsigned>(std::max(line, 0));
+    llvm::DISubroutineType* type = debugBuilder->createSubroutineType(debugBuilder->getOrCreateTypeArray({}));
+    llvm::DISubprogram* subprogram = debugBuilder->createFunction(
+        debugFile, function->getName(), llvm::StringRef(), debugFile, start, type, start,
+        llvm::DINode::FlagZero, llvm::DISubprogram::SPFlagDefinition);
+    function->setSubprogram(subprogram);
+    return subprogram;
+}
+
+void CodegenVisitor::setStatementLocation(int line) {
+    llvm::BasicBlock* block = builder->GetInsertBlock();
+    if (!block || !block->getParent() || line <= 0) return;
+    builder->SetCurrentDebugLocation(
+        llvm::DILocation::get(context, line, 0, getSubprogram(block->getParent(), line)));
+}
+
+void CodegenVisitor::finishDebugInfo() {
+    for (llvm::Function& function : *module) {
+        if (function.isDeclaration()) continue;
+        function.addFnAttr("frame-pointer", "all");
+
+        llvm::DISubprogram* subprogram = getSubprogram(&function, 0);
+        llvm::DILocation* last = llvm::DILocation::get(context, subprogram->getLine(), 0, subprogram);
+        for (llvm::BasicBlock& block : function) {
+            for (llvm::Instruction& instruction : block) {
+                llvm::DILocation* location = instruction.getDebugLoc().get();
+                if (location && location->getScope() == subprogram) {
+                    last = location;
+                } else {
+                    instruction.setDebugLoc(last);
+                }
+            }
+        }
+    }
+    debugBuilder->finalize();
+    debugBuilder.reset();
+    builder->SetCurrentDebugLocation(llvm::DebugLoc());
+}
+
+// The JIT cannot execute coroutine intrinsics, so modules with generators run
+// the LLVM coroutine passes. Generators are split into ramp, resume and destroy
+// functions; inlining a ramp into its loop lets CoroElide keep the frame on the
+// loop's stack instead of the heap.
+void CodegenVisitor::lowerCoroutines() {
+    llvm::LoopAnalysisManager loopAnalyses;
+    llvm::FunctionAnalysisManager functionAnalyses;
+    llvm::CGSCCAnalysisManager sccAnalyses;
+    llvm::ModuleAnalysisManager moduleAnalyses;
+    llvm::PassBuilder passBuilder;
+    passBuilder.registerModuleAnalyses(moduleAnalyses);
+    passBuilder.registerCGSCCAnalyses(sccAnalyses);
+    passBuilder.registerFunctionAnalyses(functionAnalyses);
+    passBuilder.registerLoopAnalyses(loopAnalyses);
+    passBuilder.crossRegisterProxies(loopAnalyses, functionAnalyses, sccAnalyses, moduleAnalyses);
+
+    llvm::ModulePassManager passes;
+    passes.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::CoroEarlyPass()));
+
+    // Callees are visited first, so a generator is already split when the
+    // inliner reaches the loops calling it
+    llvm::ModuleInlinerWrapperPass inliner(llvm::getInlineParams());
+    llvm::FunctionPassManager simplify;
+    simplify.addPass(llvm::SROAPass());
+    simplify.addPass(llvm::EarlyCSEPass());
+    simplify.addPass(llvm::CoroElidePass());
+    simplify.addPass(llvm::SimplifyCFGPass());
+    inliner.getPM().addPass(llvm::createCGSCCToFunctionPassAdaptor(std::move(simplify)));
+    inliner.getPM().addPass(llvm::CoroSplitPass());
+    passes.addPass(std::move(inliner));
+
+    passes.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::CoroCleanupPass()));
+    passes.run(*module, moduleAnalyses);
+}
+
+void CodegenVisitor::emitGeneratorPrologue() {
+    llvm::Function* function = currentFunction;
+    llvm::Type* i8PtrTy = llvm::Type::getInt8PtrTy(context);
+    llvm::Type* i64Ty = llvm::Type::getInt64Ty(context);
+    hasGenerators = true;
+
+    // Marks the function for CoroSplit
+    function->addFnAttr("coroutine.presplit", "0");
+
+    // The promise is read by the loop through llvm.coro.promise, so its
+    // alignment must be known on both sides
+    llvm::cast<llvm::AllocaInst>(generator.promise)->setAlignment(llvm::Align(GeneratorPromiseAlign));
+    llvm::Value* null = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(i8PtrTy));
+    generator.id = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_id),
+        { llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), GeneratorPromiseAlign),
+          builder->CreateBitCast(generator.promise, i8PtrTy), null, null },
+        "gen.id"
+    );
+
+    // CoroElide turns the frame into a stack slot of the loop when the
+    // generator is inlined there; llvm.coro.alloc then folds to false
+    llvm::BasicBlock* entry = builder->GetInsertBlock();
+    llvm::BasicBlock* allocBB = llvm::BasicBlock::Create(context, "gen.alloc", function);
+    llvm::BasicBlock* beginBB = llvm::BasicBlock::Create(context, "gen.begin", function);
+    llvm::Value* needAlloc = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_alloc), { generator.id });
+    builder->CreateCondBr(needAlloc, allocBB, beginBB);
+
+    builder->SetInsertPoint(allocBB);
+    llvm::Value* size = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_size, { i64Ty }));
+    llvm::Value* memory = builder->CreateCall(module->getFunction("malloc"), { size }, "gen.frame");
+    builder->CreateBr(beginBB);
+
+    builder->SetInsertPoint(beginBB);
+    llvm::PHINode* frame = builder->CreatePHI(i8PtrTy, 2);
+    frame->addIncoming(null, entry);
+    frame->addIncoming(memory, allocBB);
+    generator.handle = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_begin),
+        { generator.id, frame }, "gen.handle"
+    );
+
+    generator.finalSuspend = llvm::BasicBlock::Create(context, "gen.final");
+    generator.cleanup = llvm::BasicBlock::Create(context, "gen.cleanup");
+    generator.suspend = llvm::BasicBlock::Create(context, "gen.suspend");
+
+    // Start suspended: the body runs up to its first yield on the first resume
+    llvm::BasicBlock* startBB = llvm::BasicBlock::Create(context, "gen.start", function);
+    llvm::Value* state = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_suspend),
+        { llvm::ConstantTokenNone::get(context), builder->getFalse() }
+    );
+    llvm::SwitchInst* resume = builder->CreateSwitch(state, generator.suspend, 2);
+    resume->addCase(builder->getInt8(0), startBB);
+    resume->addCase(builder->getInt8(1), generator.cleanup);
+    builder->SetInsertPoint(startBB);
+}
+
+void CodegenVisitor::emitGeneratorEpilogue() {
+    llvm::Function* function = currentFunction;
+
+    // Resuming past the final suspend point is undefined, so only destruction continues
+    function->getBasicBlockList().push_back(generator.finalSuspend);
+    builder->SetInsertPoint(generator.finalSuspend);
+    llvm::BasicBlock* trapBB = llvm::BasicBlock::Create(context, "gen.resumed", function);
+    llvm::Value* state = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_suspend),
+        { llvm::ConstantTokenNone::get(context), builder->getTrue() }
+    );
+    llvm::SwitchInst* resume = builder->CreateSwitch(state, generator.suspend, 2);
+    resume->addCase(builder->getInt8(0), trapBB);
+    resume->addCase(builder->getInt8(1), generator.cleanup);
+    builder->SetInsertPoint(trapBB);
+    builder->CreateUnreachable();
+
+    // llvm.coro.free yields null when the frame was elided onto the caller's stack
+    function->getBasicBlockList().push_back(generator.cleanup);
+    builder->SetInsertPoint(generator.cleanup);
+    llvm::Value* memory = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_free),
+        { generator.id, generator.handle }
+    );
+    llvm::BasicBlock* freeBB = llvm::BasicBlock::Create(context, "gen.free", function);
+    builder->CreateCondBr(builder->CreateIsNotNull(memory), freeBB, generator.suspend);
+    builder->SetInsertPoint(freeBB);
+    builder->CreateCall(module->getFunction("free"), { memory });
+    builder->CreateBr(generator.suspend);
+
+    function->getBasicBlockList().push_back(generator.suspend);
+    builder->SetInsertPoint(generator.suspend);
+    builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_end),
+        { generator.handle, builder->getFalse() }
+    );
+    builder->CreateRet(generator.handle);
+}
+
+llvm::Value* CodegenVisitor::generateBenchBuiltinCall(CallExpr* node) {
+    const std::string& name = node->name.value;
+    if (name == "now_ns") {
+        lastValue = builder->CreateCall(module->getFunction("lei_now_ns"), {}, "now");
+        return lastValue;
+    }
+    if (name == "cycles") {
+        // rdtsc on x86; targets without a cycle counter read zero
+        llvm::Value* ticks = builder->CreateCall(
+            llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::readcyclecounter), {}, "ticks");
+        lastValue = builder->CreateUIToFP(ticks, builder->getDoubleTy(), "cycles");
+        return lastValue;
+    }
+
+    // black_box: a volatile round trip through memory that the optimizer can
+    // neither see through nor remove, so neither the value nor its computation
+    // can be folded away
+    node->arguments[0]->accept(this);
+    if (!lastValue) return nullptr;
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::Value* slot = generateAlloca(function, "blackbox", lastValue->getType());
+    builder->CreateStore(lastValue, slot, true);
+    lastValue = builder->CreateLoad(lastValue->getType(), slot, true, "blackbox");
+    return lastValue;
+}
+
+llvm::Value* CodegenVisitor::generateMetricCall(CallExpr* node) {
+    const std::string& name = static_cast<StringExpr*>(node->arguments[0].get())->token.value;
+    if (node->name.value == "counter") {
+        lastValue = builder->CreateAtomicRMW(llvm::AtomicRMWInst::Add, getMetricSlot(name, Lei::Metrics::COUNTER),
+                                             builder->getInt64(1), llvm::MaybeAlign(8),
+                                             llvm::AtomicOrdering::Monotonic);
+        return lastValue;
+    }
+
+    node->arguments[1]->accept(this);
+    if (!lastValue) return nullptr;
+    llvm::Value* value = typeHelper.convert(lastValue, builder->getDoubleTy());
+    if (node->name.value == "gauge") {
+        llvm::Value* slot = getMetricSlot(name, Lei::Metrics::GAUGE);
+        auto* store = builder->CreateAlignedStore(builder->CreateBitCast(value, builder->getInt64Ty()), slot,
+                                                  llvm::MaybeAlign(8));
+        store->setAtomic(llvm::AtomicOrdering::Monotonic);
+        lastValue = store;
+        return lastValue;
+    }
+    lastValue = builder->CreateCall(module->getFunction("lei_metric_observe"),
+                                    { getMetricSlot(name, Lei::Metrics::HISTOGRAM), value });
+    return lastValue;
+}
+
+// The slot address is cached in a global per metric, filled in by the first
+// use to run, so later updates are a load and an atomic operation
+llvm::Value* CodegenVisitor::getMetricSlot(const std::string& name, uint32_t kind) {
+    llvm::PointerType* slotTy = builder->getInt64Ty()->getPointerTo();
+    std::string cacheName = "metric." + std::to_string(kind) + "." + name;
+    llvm::GlobalVariable* cache = module->getNamedGlobal(cacheName);
+    if (!cache) {
+        cache = new llvm::GlobalVariable(*module, slotTy, false, llvm::GlobalValue::InternalLinkage,
+                                         llvm::ConstantPointerNull::get(slotTy), cacheName);
+        cache->setAlignment(llvm::MaybeAlign(8));
+    }
+
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* lookupBB = llvm::BasicBlock::Create(context, "metric.lookup", function);
+    llvm::BasicBlock* readyBB = llvm::BasicBlock::Create(context, "metric.ready", function);
+    llvm::LoadInst* cached = builder->CreateAlignedLoad(slotTy, cache, llvm::MaybeAlign(8), "metric.slot");
+    cached->setAtomic(llvm::AtomicOrdering::Monotonic);
+    llvm::BasicBlock* cachedBB = builder->GetInsertBlock();
+    builder->CreateCondBr(builder->CreateIsNull(cached), lookupBB, readyBB);
+
+    builder->SetInsertPoint(lookupBB);
+    llvm::Value* found = builder->CreateCall(module->getFunction("lei_metric_slot"),
+                                             { getStringConstant(name), builder->getInt32(kind) }, "metric.found");
+    builder->CreateAlignedStore(found, cache, llvm::MaybeAlign(8))->setAtomic(llvm::AtomicOrdering::Monotonic);
+    builder->CreateBr(readyBB);
+
+    builder->SetInsertPoint(readyBB);
+    llvm::PHINode* slot = builder->CreatePHI(slotTy, 2, "metric.slot");
+    slot->addIncoming(cached, cachedBB);
+    slot->addIncoming(found, lookupBB);
+    return slot;
+}
+
+void CodegenVisitor::visit(BenchStmt* node) {
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::Value* counter = generateAlloca(function, "bench.i", builder->getInt64Ty());
+    llvm::Value* handle = builder->CreateCall(
+        module->getFunction("lei_bench_begin"), { getStringConstant(node->name.value) }, "bench");
+
+    llvm::BasicBlock* nextBB = llvm::BasicBlock::Create(context, "bench.next", function);
+    llvm::BasicBlock* condBB = llvm::BasicBlock::Create(context, "bench.cond", function);
+    llvm::BasicBlock* bodyBB = llvm::BasicBlock::Create(context, "bench.body", function);
+    llvm::BasicBlock* endBB = llvm::BasicBlock::Create(context, "bench.end", function);
+    builder->CreateBr(nextBB);
+
+    // The runtime times each batch and picks the size of the next one; a
+    // batch of zero iterations means warmup and measurement are done
+    builder->SetInsertPoint(nextBB);
+    llvm::Value* batch = builder->CreateCall(module->getFunction("lei_bench_next"), { handle }, "batch");
+    builder->CreateStore(builder->getInt64(0), counter);
+    builder->CreateCondBr(builder->CreateICmpEQ(batch, builder->getInt64(0)), endBB, condBB);
+
+    builder->SetInsertPoint(condBB);
+    llvm::Value* i = builder->CreateLoad(builder->getInt64Ty(), counter, "bench.i");
+    builder->CreateCondBr(builder->CreateICmpULT(i, batch), bodyBB, nextBB);
+
+    builder->SetInsertPoint(bodyBB);
+    node->body->accept(this);
+    llvm::Value* current = builder->CreateLoad(builder->getInt64Ty(), counter);
+    builder->CreateStore(builder->CreateAdd(current, builder->getInt64(1)), counter);
+    builder->CreateBr(condBB);
+
+    builder->SetInsertPoint(endBB);
+    lastValue = nullptr;
+}
+
+void CodegenVisitor::visit(YieldStmt* node) {
+    node->value->accept(this);
+    if (!lastValue) return;
+    llvm::Type* elementType = llvm::cast<llvm::AllocaInst>(generator.promise)->getAllocatedType();
+    builder->CreateStore(typeHelper.convert(lastValue, elementType), generator.promise);
+
+    llvm::Function* function = currentFunction;
+    llvm::BasicBlock* resumeBB = llvm::BasicBlock::Create(context, "yield.resume", function);
+
+    // Destroying the generator here must also destroy the generators it is looping over
+    llvm::BasicBlock* destroyBB = generator.cleanup;
+    if (!activeGenerators.empty()) {
+        llvm::BasicBlock* current = builder->GetInsertBlock();
+        destroyBB = llvm::BasicBlock::Create(context, "yield.destroy", function);
+        builder->SetInsertPoint(destroyBB);
+        destroyActiveGenerators();
+        builder->CreateBr(generator.cleanup);
+        builder->SetInsertPoint(current);
+    }
+
+    llvm::Value* state = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_suspend),
+        { llvm::ConstantTokenNone::get(context), builder->getFalse() }
+    );
+    llvm::SwitchInst* resume = builder->CreateSwitch(state, generator.suspend, 2);
+    resume->addCase(builder->getInt8(0), resumeBB);
+    resume->addCase(builder->getInt8(1), destroyBB);
+    builder->SetInsertPoint(resumeBB);
+    lastValue = nullptr;
+}
+
+void CodegenVisitor::emitGeneratorLoop(ForInStmt* node) {
+    node->source->accept(this);
+    llvm::Value* handle = lastValue;
+    if (!handle) return;
+
+    auto* call = static_cast<CallExpr*>(node->source.get());
+    Type element = symbolTable.resolveFunction(call->name.value)->type;
+    llvm::Type* elementType = typeHelper.getLLVMType(element);
+    llvm::Value* variable = generateAlloca(currentFunction, node->variable.value, elementType);
+
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* nextBB = llvm::BasicBlock::Create(context, "gen.next", function);
+    llvm::BasicBlock* itemBB = llvm::BasicBlock::Create(context, "gen.item", function);
+    llvm::BasicBlock* endBB = llvm::BasicBlock::Create(context, "gen.end", function);
+    builder->CreateBr(nextBB);
+
+    // Each resume runs the generator to its next yield, or to the end of its body
+    builder->SetInsertPoint(nextBB);
+    builder->CreateCall(llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_resume), { handle });
+    llvm::Value* done = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_done), { handle });
+    builder->CreateCondBr(done, endBB, itemBB);
+
+    builder->SetInsertPoint(itemBB);
+    llvm::Value* promise = builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_promise),
+        { handle, builder->getInt32(GeneratorPromiseAlign), builder->getFalse() }
+    );
+    llvm::Value* slot = builder->CreateBitCast(promise, elementType->getPointerTo());
+    builder->CreateStore(builder->CreateLoad(elementType, slot), variable);
+
+    symbolTable.enterScope();
+    symbolTable.declare(node->variable.value, element);
+    Symbol* symbol = symbolTable.resolve(node->variable.value);
+    symbol->llvmValue = variable;
+    symbol->isAlloca = true;
+    activeGenerators.push_back(handle);
+    node->body->accept(this);
+    activeGenerators.pop_back();
+    symbolTable.exitScope();
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        builder->CreateBr(nextBB);
+    }
+
+    builder->SetInsertPoint(endBB);
+    builder->CreateCall(llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_destroy), { handle });
+}
+
+void CodegenVisitor::destroyActiveGenerators() {
+    for (auto it = activeGenerators.rbegin(); it != activeGenerators.rend(); ++it) {
+        builder->CreateCall(llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::coro_destroy), { *it });
+    }
+}
+
 void CodegenVisitor::declareFunction(const std::string& name, llvm::Type* returnType, 
                                      const std::vector<llvm::Type*>& paramTypes, bool isVarArgs) {
     llvm::FunctionType* funcType = llvm::FunctionType::get(returnType, paramTypes, isVarArgs);
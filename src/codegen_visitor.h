@@ -6,9 +6,11 @@
 #include "symbol_table.h"
 #include "error_handler.h"
 #include "type_helper.h"
+#include "const_evaluator.h"
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
@@ -29,6 +31,27 @@ public:
 
     // Main entry point for code generation
     std::unique_ptr<llvm::Module> generateModule(Program* program, const std::string& moduleName);
+
+    // Print the partially generated module to stderr when generation fails
+    void setDumpModuleOnError(bool enabled) { dumpModuleOnError = enabled; }
+
+    // Count every call of each function in the stats segment as 'calls.<name>'
+    void setProfileCalls(bool enabled) { profileCalls = enabled; }
+
+    // Keep frame pointers and emit line tables for 'sourcePath', so a
+    // sampling profiler can walk the stack and map addresses to lines
+    void setSampleProfiling(const std::string& sourcePath) { sampleSource = sourcePath; }
+
+    // Generation one function at a time. beginModule declares every function
+    // of 'declarations' (bodies are not needed) and emits its globals;
+    // emitFunction then generates any body, declareFunction adds functions
+    // found later, such as generic instances, and finishModule verifies the
+    // module and lowers generators. The module stays owned by the visitor
+    // until finishModule, so callers may print and free bodies in between.
+    llvm::Module* beginModule(Program* declarations, const std::string& moduleName);
+    bool declareFunction(FunctionDecl* function);
+    bool emitFunction(FunctionDecl* function);
+    std::unique_ptr<llvm::Module> finishModule();
     
 
     // AST Visitor interface implementation
@@ -45,11 +68,20 @@ public:
     void visit(CallExpr* node) override;
     void visit(ArrayInitExpr* node) override;
     void visit(ArrayAllocExpr* node) override;
+    void visit(SpawnExpr* node) override;
+    void visit(ChannelExpr* node) override;
     void visit(ExprStmt* node) override;
     void visit(VarDeclStmt* node) override;
     void visit(BlockStmt* node) override;
     void visit(IfStmt* node) override;
     void visit(WhileStmt* node) override;
+    void visit(ParallelForStmt* node) override;
+    void visit(SyncStmt* node) override;
+    void visit(GoStmt* node) override;
+    void visit(ForInStmt* node) override;
+    void visit(MatchStmt* node) override;
+    void visit(YieldStmt* node) override;
+    void visit(BenchStmt* node) override;
     void visit(ReturnStmt* node) override;
     void visit(TypeExpr* node) override;
 
@@ -64,25 +96,86 @@ private:
     ErrorHandler& errorHandler = ErrorHandler::instance();  // Reference to singleton error handler
     TypeHelper& typeHelper;
     bool isAssignmentTarget = false;
+    std::unordered_set<llvm::Value*> capturedAddresses;  // Enclosing locals seen from outlined loop bodies
+    llvm::Value* spawnGroup = nullptr;  // Counter of the current function's outstanding spawned calls
+    bool inParallelBody = false;        // Emitting an outlined parallel loop body
+
+    // Coroutine state of the generator being emitted
+    struct GeneratorFrame {
+        llvm::Value* id = nullptr;          // llvm.coro.id token
+        llvm::Value* handle = nullptr;      // llvm.coro.begin result, returned to the caller
+        llvm::Value* promise = nullptr;     // Slot the yielded value is stored in
+        llvm::BasicBlock* finalSuspend = nullptr;
+        llvm::BasicBlock* cleanup = nullptr;  // Frees the frame when the loop destroys the generator
+        llvm::BasicBlock* suspend = nullptr;  // Returns control to the resumer
+    };
+    GeneratorFrame generator;
+    static constexpr unsigned GeneratorPromiseAlign = 8;
+    std::vector<llvm::Value*> activeGenerators;  // Handles of the enclosing generator loops
+    bool hasGenerators = false;
 
     // Helper methods for type conversion and code generation
     ASTNode* getCurrentParent(ASTNode* node);
     llvm::Value* generateAlloca(llvm::Function* function, const std::string& name, llvm::Type* type);
     void declareRuntimeFunctions();
+    bool declareProgram(Program* node);
     void declareFunction(const std::string& name, llvm::Type* returnType, 
                                      const std::vector<llvm::Type*>& paramTypes, bool isVarArgs = false);
                                       llvm::Value* handleBuiltinFunction(CallExpr* node);
     llvm::Value* handleRegularFunctionCall(CallExpr* node);
     std::vector<llvm::Value*> processCallArguments(CallExpr* node, FunctionSymbol* funcSymbol);
 
+    void emitShortCircuit(BinaryExpr* node);
     llvm::Value* createVariableAllocation(VarDeclStmt* node);
+    llvm::Type* getStorageType(VarDeclStmt* node);
+    void emitGlobalVariable(VarDeclStmt* node);
+    void emitMemoWrapper(FunctionDecl* node, llvm::Function* wrapper, llvm::Function* impl);
+    llvm::Value* combineReduction(const std::string& op, llvm::Value* left, llvm::Value* right);
+    llvm::Value* getSpawnGroup();
+    llvm::Function* packCall(CallExpr* call, llvm::Value* destination, llvm::Value*& frame, llvm::Constant*& frameSize);
+    void emitSpawn(SpawnExpr* node, llvm::Value* destination);
+
+    // Channels hold every element type as a 64-bit word
+    llvm::Value* toChannelWord(llvm::Value* value, const Type& element);
+    llvm::Value* fromChannelWord(llvm::Value* word, const Type& element);
+    llvm::Value* generateChannelCall(CallExpr* node);
+    Type channelTypeOf(llvm::Value* channel) const;
+    llvm::Value* generateAtomicCall(CallExpr* node);
+
+    // bits[N] arrays: element i is bit i % 64 of word i / 64
+    bool isBitsArray(Expr* expr);
+    llvm::Value* getBitsWords(Expr* array, uint64_t& wordCount);
+    void locateBit(ArrayAccessExpr* node, llvm::Value*& word, llvm::Value*& mask);
+    void emitBitsStore(ArrayAccessExpr* target, llvm::Value* value);
+    llvm::Value* generateBitsCall(CallExpr* node);
+
+    // now_ns, cycles and black_box; 'bench' blocks drive the runtime's timer loop
+    llvm::Value* generateBenchBuiltinCall(CallExpr* node);
+    void emitSync();
+
+    // counter, gauge and histogram update slots of the stats segment
+    llvm::Value* generateMetricCall(CallExpr* node);
+    llvm::Value* getMetricSlot(const std::string& name, uint32_t kind);
+
+    // Generators, lowered to LLVM switched-resume coroutines
+    void emitGeneratorPrologue();
+    void emitGeneratorEpilogue();
+    void emitGeneratorLoop(ForInStmt* node);
+    void destroyActiveGenerators();
+    void lowerCoroutines();
     void handleVariableInitialization(VarDeclStmt* node, llvm::Value* alloca);
     void handleArrayInitialization(VarDeclStmt* node, llvm::Value* alloca, ArrayInitExpr* arrayInit);
     llvm::Value* handleArrayArgument(llvm::Value* arg);
+    llvm::Type* getVariableStorageType(llvm::Value* address) const;
     void initializeFixedArray(VarDeclStmt* node, llvm::Value* alloca, ArrayInitExpr* arrayInit);
     void initializeDynamicArray(VarDeclStmt* node, llvm::Value* alloca);
     void updateSymbolTableEntry(const std::string& name, const Type& type, llvm::Value* alloca);
 
+    // Compile-time constants
+    void emitConstantDeclaration(VarDeclStmt* node);
+    llvm::Constant* materializeConstant(const ConstValue& value, const Type& type);
+    llvm::Constant* getStringConstant(const std::string& value);
+
     // Built-in function generators
     void generatePrintCall(CallExpr* node);
     void generateInputCall(CallExpr* node);
@@ -91,8 +184,25 @@ private:
     void generateReallocCall(CallExpr* node);
     void generateStrlenCall(CallExpr* node);
     llvm::Value* generateSizeofCall(CallExpr* node);
+    bool isMathBuiltin(const std::string& name) const;
+    llvm::Value* generateMathBuiltinCall(CallExpr* node);
+
+    // Line tables for the sampling profiler: every statement sets the
+    // location of the code it generates, and finishDebugInfo assigns what was
+    // generated outside a statement, e.g. in outlined functions, to the
+    // nearest line of the function the code ended up in
+    void beginDebugInfo();
+    llvm::DISubprogram* getSubprogram(llvm::Function* function, int line);
+    void setStatementLocation(int line);
+    void finishDebugInfo();
+    std::unique_ptr<llvm::DIBuilder> debugBuilder;
+    llvm::DIFile* debugFile = nullptr;
+    std::string sampleSource;
 
     void reportError(const std::string& message, const Location& loc);
+    bool dumpModuleOnError = false;
+    bool profileCalls = false;
+    void dumpFailedModule();
 };
 
 #endif // CODEGEN_VISITOR_H
\ No newline at end of file
@@ -5,28 +5,109 @@
 #include "semantic_visitor.h"
 #include "codegen_visitor.h"
 #include "source_reader.h"
+#include "runtime.h"
+#include "jit_memory.h"
+#include "ast_cache.h"
+#include "speculative_jit.h"
+#include "loop_fusion.h"
+#include "sample_profiler.h"
+#include <llvm/ADT/SetVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/xxhash.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+void Compiler::initializeNativeTarget() {
+    static std::once_flag initialized;
+    std::call_once(initialized, []() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+}
+
+std::unique_ptr<Program> Compiler::analyzeSource(const std::string& source) {
+    // Unchanged source skips the front end
+    if (!astCacheDir.empty()) {
+        if (auto cached = Lei::AstCache(astCacheDir).load(source, symbolTable)) {
+            return cached;
+        }
+    }
 
-bool Compiler::compile(const std::string& source, const std::string& outputPath,  bool printAST, bool printSymbolTable, bool printIR) {
     // Lexical Analysis
     Lexer lexer(source);
     auto tokens = lexer.tokenize();
     if (errorHandler.hasErrors()) {
-        return false;
+        return nullptr;
     }
 
     // Parsing
     Parser parser(tokens);
     auto ast = parser.parse();
     if (!ast || errorHandler.hasErrors()) {
-        return false;
+        return nullptr;
     }
 
     // Semantic Analysis
     SemanticAnalyzer analyzer(symbolTable);
     if (!analyzer.analyze(ast.get())) {
-        return false;
+        return nullptr;
+    }
+
+    if (!astCacheDir.empty()) {
+        Lei::AstCache(astCacheDir).store(source, *ast, symbolTable);
+    }
+    return ast;
+}
+
+bool Compiler::check(const std::string& source) {
+    return analyzeSource(source) != nullptr;
+}
+
+std::unique_ptr<llvm::Module> Compiler::buildModule(const std::string& source, bool printAST, bool printSymbolTable, bool printIR) {
+    return buildModule(source, printAST, printSymbolTable, printIR, llvmContext);
+}
+
+std::unique_ptr<llvm::Module> Compiler::buildModule(const std::string& source, bool printAST, bool printSymbolTable, bool printIR,
+                                                    llvm::LLVMContext& context) {
+    auto ast = analyzeSource(source);
+    if (!ast) {
+        return nullptr;
+    }
+
+    if (fuseLoops) {
+        std::unordered_map<std::string, FunctionDecl*> functions;
+        for (const auto& function : ast->functions) {
+            functions[function->name.value] = function.get();
+        }
+        Lei::LoopFusion fusion(functions, symbolTable);
+        for (const auto& function : ast->functions) {
+            fusion.run(function.get());
+        }
     }
 
     if (printAST) {
@@ -35,10 +116,15 @@ bool Compiler::compile(const std::string& source, const std::string& outputPath,
     }
 
     // Code Generation
-    CodegenVisitor codegen(llvmContext);
+    CodegenVisitor codegen(context);
+    codegen.setDumpModuleOnError(dumpIROnError);
+    codegen.setProfileCalls(profile);
+    if (sampleFrequency > 0) {
+        codegen.setSampleProfiling(errorHandler.getSourcePath());
+    }
     auto module = codegen.generateModule(ast.get(), "module");
     if (!module || errorHandler.hasErrors()) {
-        return false;
+        return nullptr;
     }
 
     if (printSymbolTable) {
@@ -49,6 +135,30 @@ bool Compiler::compile(const std::string& source, const std::string& outputPath,
     module->print(llvm::outs(), nullptr);
     }
 
+    return module;
+}
+
+bool Compiler::reportRuntimeCalls(const llvm::Module& module) {
+    for (const llvm::Function& function : module) {
+        if (function.isDeclaration() && function.getName().startswith("lei_") && !function.use_empty()) {
+            errorHandler.error(
+                ErrorLevel::CODEGEN,
+                0, 0,
+                "Program calls the Lei runtime (" + function.getName().str() + "), which parallel for, spawn, "
+                "channels, go, bench, now_ns and metrics need; run it with -e instead of writing it to a file"
+            );
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Compiler::compile(const std::string& source, const std::string& outputPath,  bool printAST, bool printSymbolTable, bool printIR) {
+    auto module = buildModule(source, printAST, printSymbolTable, printIR);
+    if (!module || reportRuntimeCalls(*module)) {
+        return false;
+    }
+
     // Write output
     std::error_code EC;
     llvm::raw_fd_ostream dest(outputPath, EC, llvm::sys::fs::OF_None);
@@ -60,62 +170,33 @@ bool Compiler::compile(const std::string& source, const std::string& outputPath,
         );
         return false;
     }
+    module->print(dest, nullptr);
 
     return true;
 }
 
 bool Compiler::execute(const std::string& source,  bool printAST, bool printSymbolTable, bool printIR) {
-    // Lexical Analysis
-    Lexer lexer(source);
-    auto tokens = lexer.tokenize();
-    if (errorHandler.hasErrors()) {
-        return false;
-    }
-
-    // Parsing
-    Parser parser(tokens);
-    auto ast = parser.parse();
-    if (!ast || errorHandler.hasErrors()) {
-        return false;
-    }
-
-    // Semantic Analysis
-    SemanticAnalyzer analyzer(symbolTable);
-    if (!analyzer.analyze(ast.get())) {
-        return false;
+    if (compileThreads > 0) {
+        return executeLazily(source, printAST, printSymbolTable, printIR);
     }
 
-    if (printAST) {
-        ASTPrinter printer;
-        std::cout << "AST Structure:\n" << printer.print(ast.get()) << std::endl;
-    }
-
-    
-
-    // Code Generation
-    CodegenVisitor codegen(llvmContext);
-    auto module = codegen.generateModule(ast.get(), "module");
-    if (!module || errorHandler.hasErrors()) {
+    auto module = buildModule(source, printAST, printSymbolTable, printIR);
+    if (!module) {
         return false;
     }
 
-    if (printSymbolTable) {
-        symbolTable.print();
-    }
-
-    
-    // Print module state before execution
-    if(printIR) {
-    module->print(llvm::outs(), nullptr);
-    }
-
-
     // Initialize JIT ExecutionEngine
+    initializeNativeTarget();
+    Lei::Runtime::registerSymbols();
+    if (profile) {
+        Lei::Runtime::profileAllocations();
+    }
     std::string errorStr;
     llvm::EngineBuilder engineBuilder(std::move(module));
     auto engine = engineBuilder
         .setErrorStr(&errorStr)
         .setEngineKind(llvm::EngineKind::JIT)
+        .setMCJITMemoryManager(std::make_unique<Lei::JitMemoryManager>())
         .create();
 
     if (!engine) {
@@ -132,13 +213,869 @@ bool Compiler::execute(const std::string& source,  bool printAST, bool printSymb
     }
 
 
+    // The profiler reads each object's line table as it is loaded, so the
+    // code is finalized after it is registered and before sampling starts
+    std::unique_ptr<Lei::SampleProfiler> profiler;
+    if (sampleFrequency > 0) {
+        profiler = std::make_unique<Lei::SampleProfiler>(sampleFrequency);
+        engine->RegisterJITEventListener(profiler.get());
+        engine->finalizeObject();
+        if (!profiler->start()) {
+            errorHandler.error(ErrorLevel::CODEGEN, 0, 0, "Failed to start the sampling profiler");
+            delete engine;
+            return false;
+        }
+    }
+
     // Execute the function
     std::vector<llvm::GenericValue> args;
     llvm::GenericValue result = engine->runFunction(mainFunction, args);
+    Lei::Runtime::finish();
+    jitMemory = Lei::JitMemoryPool::instance().stats();
+
+    if (profiler) {
+        profiler->stop();
+        if (!profiler->writeFolded(sampleOutput)) {
+            std::cerr << "Error: Could not write profile to " << sampleOutput << std::endl;
+        } else {
+            std::cerr << "Profile: " << profiler->samples() << " samples, " << profiler->dropped()
+                      << " dropped, written to " << sampleOutput << std::endl;
+        }
+        engine->UnregisterJITEventListener(profiler.get());
+    }
 
     // Print the result
     std::cout << "Execution Result: " << result.IntVal.getSExtValue() << std::endl;
 
     delete engine;
     return true;
-}
\ No newline at end of file
+}
+
+namespace {
+
+// Object files keyed by module identifier. runMany gives every engine a copy
+// of the same module, so only the first one runs the code generator; watch
+// names each function's module after its IR, so only edited functions do.
+class ModuleObjectCache : public llvm::ObjectCache {
+public:
+    void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override {
+        objects[module->getModuleIdentifier()] =
+            llvm::MemoryBuffer::getMemBufferCopy(object.getBuffer(), object.getBufferIdentifier());
+        compiled++;
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override {
+        auto found = objects.find(module->getModuleIdentifier());
+        if (found == objects.end()) return nullptr;
+        return llvm::MemoryBuffer::getMemBuffer(found->second->getMemBufferRef(), false);
+    }
+
+    // Drops the objects of modules that are no longer part of the program
+    void retain(const std::unordered_set<std::string>& identifiers) {
+        for (auto it = objects.begin(); it != objects.end();) {
+            it = identifiers.count(it->first) ? std::next(it) : objects.erase(it);
+        }
+    }
+
+    size_t compiledCount() const { return compiled; }
+
+private:
+    std::unordered_map<std::string, std::unique_ptr<llvm::MemoryBuffer>> objects;
+    size_t compiled = 0;
+};
+
+// Collects the globals a function refers to, looking through constant
+// expressions and initializers of the private constants it uses
+void collectGlobals(llvm::Function& function, llvm::SetVector<llvm::GlobalValue*>& globals) {
+    std::vector<const llvm::Value*> pending;
+    std::unordered_set<const llvm::Value*> seen;
+    for (llvm::Instruction& instruction : llvm::instructions(function)) {
+        for (const llvm::Value* operand : instruction.operands()) {
+            if (llvm::isa<llvm::Constant>(operand)) pending.push_back(operand);
+        }
+    }
+    while (!pending.empty()) {
+        const llvm::Value* value = pending.back();
+        pending.pop_back();
+        if (!seen.insert(value).second) continue;
+
+        if (auto* global = llvm::dyn_cast<llvm::GlobalValue>(value)) {
+            globals.insert(const_cast<llvm::GlobalValue*>(global));
+            auto* variable = llvm::dyn_cast<llvm::GlobalVariable>(global);
+            if (variable && variable->hasLocalLinkage() && variable->hasInitializer()) {
+                pending.push_back(variable->getInitializer());
+            }
+        } else if (auto* constant = llvm::dyn_cast<llvm::Constant>(value)) {
+            for (const llvm::Value* operand : constant->operands()) pending.push_back(operand);
+        }
+    }
+}
+
+// Names a module after a hash of its IR, so an unchanged function gets the
+// same identifier, and with it the same cached object, on every rebuild
+void nameByContent(llvm::Module& module, const std::string& prefix) {
+    module.setModuleIdentifier("");
+    module.setSourceFileName("");
+    std::string ir;
+    llvm::raw_string_ostream stream(ir);
+    module.print(stream, nullptr);
+    module.setModuleIdentifier(prefix + "#" + llvm::utohexstr(llvm::xxHash64(stream.str())));
+}
+
+} // namespace
+
+namespace Lei {
+
+// Moves every function definition into a module of its own holding only
+// declarations of what it calls and reads, plus copies of the string
+// constants it uses. The returned list starts with the original module,
+// which keeps the global variables and the functions that use thread-locals:
+// RuntimeDyld cannot resolve a thread-local defined in another object.
+std::vector<std::unique_ptr<llvm::Module>> splitByFunction(std::unique_ptr<llvm::Module> module) {
+    // Module-local symbols become visible to the other modules. Private
+    // constants stay local and are copied into each module that uses them.
+    unsigned unnamed = 0;
+    for (llvm::GlobalValue& global : module->global_values()) {
+        auto* variable = llvm::dyn_cast<llvm::GlobalVariable>(&global);
+        bool copied = variable && variable->isConstant() && variable->hasLocalLinkage();
+        if (!global.hasLocalLinkage() || copied) continue;
+        if (!global.hasName()) global.setName("lei.local." + std::to_string(unnamed++));
+        global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        global.setVisibility(llvm::GlobalValue::DefaultVisibility);
+    }
+
+    std::vector<std::unique_ptr<llvm::Module>> modules;
+    modules.push_back(nullptr);
+    std::vector<llvm::Function*> moved;
+    for (llvm::Function& function : *module) {
+        if (function.isDeclaration()) continue;
+        llvm::SetVector<llvm::GlobalValue*> globals;
+        collectGlobals(function, globals);
+        if (llvm::any_of(globals, [](llvm::GlobalValue* global) { return global->isThreadLocal(); })) continue;
+
+        auto part = std::make_unique<llvm::Module>("", module->getContext());
+        part->setDataLayout(module->getDataLayout());
+        part->setTargetTriple(module->getTargetTriple());
+
+        llvm::ValueToValueMapTy map;
+        std::vector<std::pair<llvm::GlobalVariable*, llvm::GlobalVariable*>> constants;
+        for (llvm::GlobalValue* global : globals) {
+            if (global == &function) continue;
+            if (auto* callee = llvm::dyn_cast<llvm::Function>(global)) {
+                auto* declaration = llvm::Function::Create(callee->getFunctionType(), llvm::GlobalValue::ExternalLinkage,
+                                                           callee->getName(), part.get());
+                declaration->copyAttributesFrom(callee);
+                map[callee] = declaration;
+            } else if (auto* variable = llvm::dyn_cast<llvm::GlobalVariable>(global)) {
+                bool copied = variable->isConstant() && variable->hasLocalLinkage();
+                auto* copy = new llvm::GlobalVariable(
+                    *part, variable->getValueType(), variable->isConstant(),
+                    copied ? variable->getLinkage() : llvm::GlobalValue::ExternalLinkage, nullptr,
+                    variable->getName(), nullptr, variable->getThreadLocalMode(), variable->getAddressSpace());
+                copy->copyAttributesFrom(variable);
+                if (copied) constants.emplace_back(variable, copy);
+                map[variable] = copy;
+            }
+        }
+        for (auto& constant : constants) {
+            constant.second->setInitializer(llvm::MapValue(constant.first->getInitializer(), map));
+        }
+
+        auto* clone = llvm::Function::Create(function.getFunctionType(), function.getLinkage(),
+                                             function.getName(), part.get());
+        map[&function] = clone;
+        auto argument = clone->arg_begin();
+        for (llvm::Argument& original : function.args()) {
+            argument->setName(original.getName());
+            map[&original] = &*argument++;
+        }
+        llvm::SmallVector<llvm::ReturnInst*, 8> returns;
+        llvm::CloneFunctionInto(clone, &function, map, llvm::CloneFunctionChangeType::DifferentModule, returns);
+        // Cloning registers the compile units even when there are none; an
+        // empty list reads as malformed debug info when the module is copied
+        llvm::NamedMDNode* units = part->getNamedMetadata("llvm.dbg.cu");
+        if (units && units->getNumOperands() == 0) part->eraseNamedMetadata(units);
+
+        nameByContent(*part, function.getName().str());
+        modules.push_back(std::move(part));
+        moved.push_back(&function);
+    }
+
+    for (llvm::Function* function : moved) {
+        function->deleteBody();
+    }
+    for (auto it = module->global_begin(); it != module->global_end();) {
+        llvm::GlobalVariable& variable = *it++;
+        variable.removeDeadConstantUsers();
+        if (variable.hasLocalLinkage() && variable.use_empty()) variable.eraseFromParent();
+    }
+    nameByContent(*module, "globals");
+    modules[0] = std::move(module);
+    return modules;
+}
+
+// Only strings and comments need skipping, so this is a cheap text scan;
+// the lexer still sees every character of each unit
+std::vector<SourceUnit> splitTopLevel(const std::string& source) {
+    static const char* const keywords[] = { "fn", "var", "const", "threadlocal" };
+    auto beginsDeclaration = [&](size_t pos) {
+        if (source[pos] == '@') return true;
+        for (const char* keyword : keywords) {
+            size_t length = std::strlen(keyword);
+            if (source.compare(pos, length, keyword) == 0 &&
+                (pos + length == source.size() || !std::isalnum(static_cast<unsigned char>(source[pos + length])))) {
+                return true;
+            }
+        }
+        return false;
+    };
+    // Attribute lines such as '@memo' belong to the declaration after them
+    auto onlyAttributes = [&](size_t begin, size_t end) {
+        for (size_t pos = begin; pos < end; pos++) {
+            char c = source[pos];
+            if (std::isspace(static_cast<unsigned char>(c))) continue;
+            if (c == '/' && pos + 1 < end && source[pos + 1] == '/') {
+                pos = std::min(source.find('\n', pos), end);
+            } else if (c == '@') {
+                while (pos + 1 < end && (std::isalnum(static_cast<unsigned char>(source[pos + 1])) || source[pos + 1] == '_')) pos++;
+                size_t next = pos + 1;
+                while (next < end && (source[next] == ' ' || source[next] == '\t')) next++;
+                if (next < end && source[next] == '(') pos = std::min(source.find(')', next), end);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    std::vector<SourceUnit> units = { { 0, source.size(), 1 } };
+    int depth = 0;
+    int line = 1;
+    bool lineStart = true;
+    for (size_t pos = 0; pos < source.size(); pos++) {
+        char c = source[pos];
+        if (lineStart && depth == 0 && pos > units.back().begin && beginsDeclaration(pos) &&
+            !(source[units.back().begin] == '@' && onlyAttributes(units.back().begin, pos))) {
+            units.back().end = pos;
+            units.push_back({ pos, source.size(), line });
+        }
+        lineStart = false;
+        if (c == '\n') {
+            line++;
+            lineStart = true;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}') {
+            depth = std::max(depth - 1, 0);
+        } else if (c == '"') {
+            for (pos++; pos < source.size() && source[pos] != '"'; pos++) {
+                if (source[pos] == '\\') pos++;
+                else if (source[pos] == '\n') line++;
+            }
+        } else if (c == '/' && pos + 1 < source.size() && source[pos + 1] == '/') {
+            pos = std::min(source.find('\n', pos), source.size()) - 1;
+        }
+    }
+    return units;
+}
+
+} // namespace Lei
+
+namespace {
+
+std::unique_ptr<Program> parseUnit(const std::string& source, const Lei::SourceUnit& unit,
+                                   std::unordered_set<std::string>* calls = nullptr) {
+    Lexer lexer(source, unit.begin, unit.end, unit.line);
+    std::vector<Token> tokens = lexer.tokenize();
+    // As in a whole-file compile, lexical errors anywhere stop parsing
+    if (ErrorHandler::instance().hasErrors(ErrorLevel::LEXICAL)) {
+        return nullptr;
+    }
+    if (calls) {
+        for (size_t i = 0; i + 1 < tokens.size(); i++) {
+            if (tokens[i].type == IDENTIFIER && tokens[i + 1].type == LPAREN) calls->insert(tokens[i].value);
+        }
+    }
+    Parser parser(tokens);
+    return parser.parse();
+}
+
+// Functions whose bodies are needed while analyzing others: const functions
+// are evaluated, generics instantiated, generators checked as a whole and
+// attributes such as @memo look at everything the function calls
+bool needsBodyResident(const FunctionDecl& function) {
+    return function.isConst || function.isGeneric() || function.isGenerator || !function.attributes.empty();
+}
+
+// Coroutine intrinsics are lowered for the whole module at the end, and
+// attribute groups are numbered per module, so such functions stay behind
+bool keepInModule(llvm::Function& function) {
+    if (function.getAttributes().hasFnAttrs()) return true;
+    for (llvm::Instruction& instruction : llvm::instructions(function)) {
+        auto* call = llvm::dyn_cast<llvm::CallBase>(&instruction);
+        if (!call) continue;
+        if (call->getAttributes().hasFnAttrs()) return true;
+        llvm::Function* callee = call->getCalledFunction();
+        if (callee && callee->getName().startswith("llvm.coro.")) return true;
+    }
+    return false;
+}
+
+// Adds the named struct types that 'type' refers to, pointees included
+void collectStructTypes(llvm::Type* type, llvm::SetVector<llvm::StructType*>& types) {
+    auto* structType = llvm::dyn_cast<llvm::StructType>(type);
+    if (structType && structType->hasName() && !types.insert(structType)) return;
+    for (llvm::Type* contained : type->subtypes()) {
+        collectStructTypes(contained, types);
+    }
+}
+
+void collectStructTypes(llvm::Function& function, llvm::SetVector<llvm::StructType*>& types) {
+    collectStructTypes(function.getType(), types);
+    for (llvm::Instruction& instruction : llvm::instructions(function)) {
+        collectStructTypes(instruction.getType(), types);
+        for (const llvm::Value* operand : instruction.operands()) {
+            collectStructTypes(operand->getType(), types);
+        }
+        if (auto* alloca = llvm::dyn_cast<llvm::AllocaInst>(&instruction)) {
+            collectStructTypes(alloca->getAllocatedType(), types);
+        } else if (auto* gep = llvm::dyn_cast<llvm::GetElementPtrInst>(&instruction)) {
+            collectStructTypes(gep->getSourceElementType(), types);
+        }
+    }
+}
+
+// Writes the finished function bodies of one unit and drops them from the
+// module, leaving declarations for later calls. Functions the code generator
+// added meanwhile, such as outlined loop bodies, are flushed with the unit;
+// They follow 'lastKnown' in the module's function list, as new globals
+// follow 'lastGlobal', which is advanced past them.
+bool flushFunctions(llvm::Module& module, const std::vector<std::string>& names, llvm::Function* lastKnown,
+                    llvm::GlobalVariable*& lastGlobal, llvm::raw_ostream& out,
+                    std::unordered_set<std::string>& emitted, llvm::SetVector<llvm::StructType*>& types) {
+    // Unnamed globals are numbered per module, which changes as more are added
+    auto global = lastGlobal ? std::next(lastGlobal->getIterator()) : module.global_begin();
+    for (; global != module.global_end(); ++global) {
+        if (!global->hasName()) global->setName("const");
+        lastGlobal = &*global;
+    }
+
+    std::vector<llvm::Function*> candidates;
+    for (const std::string& name : names) {
+        if (llvm::Function* function = module.getFunction(name)) candidates.push_back(function);
+    }
+    for (auto it = std::next(lastKnown->getIterator()); it != module.end(); ++it) {
+        candidates.push_back(&*it);
+    }
+
+    // Printing in place would number the whole module for every function, so
+    // each one is printed from a module of its own and then moved back
+    llvm::Module scratch("", module.getContext());
+    auto& functions = module.getFunctionList();
+    for (llvm::Function* function : candidates) {
+        if (function->isDeclaration() || keepInModule(*function)) continue;
+        std::string error;
+        llvm::raw_string_ostream errorStream(error);
+        if (llvm::verifyFunction(*function, &errorStream)) {
+            ErrorHandler::instance().error(
+                ErrorLevel::CODEGEN,
+                0, 0,
+                "Function verification failed: " + errorStream.str()
+            );
+            return false;
+        }
+        out << "\n";
+        scratch.getFunctionList().splice(scratch.end(), functions, function->getIterator());
+        function->print(out);
+        emitted.insert(function->getName().str());
+        collectStructTypes(*function, types);
+        function->deleteBody();
+        functions.splice(functions.end(), scratch.getFunctionList(), function->getIterator());
+    }
+    return true;
+}
+
+// Prints the module without the declarations of functions already written,
+// adding the definitions of struct types only those functions used
+void printRemainder(llvm::Module& module, const std::unordered_set<std::string>& emitted,
+                    const llvm::SetVector<llvm::StructType*>& types, llvm::raw_ostream& out) {
+    std::vector<llvm::StructType*> remaining = module.getIdentifiedStructTypes();
+    for (llvm::StructType* type : types) {
+        if (std::find(remaining.begin(), remaining.end(), type) != remaining.end()) continue;
+        type->print(out);
+        out << "\n";
+    }
+
+    std::string text;
+    llvm::raw_string_ostream stream(text);
+    module.print(stream, nullptr);
+    stream.flush();
+
+    bool skipBlank = false;
+    for (size_t begin = 0; begin < text.size();) {
+        size_t end = std::min(text.find('\n', begin), text.size());
+        llvm::StringRef line(text.data() + begin, end - begin);
+        begin = end + 1;
+
+        if (skipBlank && line.empty()) {
+            skipBlank = false;
+            continue;
+        }
+        skipBlank = false;
+        if (line.startswith("; ModuleID") || line.startswith("source_filename")) continue;
+        if (line.startswith("declare ")) {
+            size_t at = line.find('@');
+            llvm::StringRef name = line.substr(at + 1).take_until([](char c) { return c == '('; });
+            if (at != llvm::StringRef::npos && emitted.count(name.str())) {
+                skipBlank = true;
+                continue;
+            }
+        }
+        out << line << "\n";
+    }
+}
+
+// ORC locks a module's context while it compiles the module, so parts that
+// share one context compile one at a time. A bitcode round trip moves a part
+// into a context of its own.
+llvm::Expected<llvm::orc::ThreadSafeModule> withOwnContext(const llvm::Module& module) {
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream out(bitcode);
+    llvm::WriteBitcodeToFile(module, out);
+
+    auto context = std::make_unique<llvm::LLVMContext>();
+    auto copy = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()), module.getModuleIdentifier()), *context);
+    if (!copy) {
+        return copy.takeError();
+    }
+    return llvm::orc::ThreadSafeModule(std::move(*copy), std::move(context));
+}
+
+} // namespace
+
+bool Compiler::executeLazily(const std::string& source, bool printAST, bool printSymbolTable, bool printIR) {
+    llvm::LLVMContext context;
+    auto module = buildModule(source, printAST, printSymbolTable, printIR, context);
+    if (!module) {
+        return false;
+    }
+    if (!module->getFunction("main")) {
+        errorHandler.error(ErrorLevel::CODEGEN, 0, 0, "Failed to find main function in module");
+        return false;
+    }
+
+    initializeNativeTarget();
+    Lei::Runtime::registerSymbols();
+    if (profile) {
+        Lei::Runtime::profileAllocations();
+    }
+    auto jit = Lei::SpeculativeJit::create(compileThreads);
+    if (!jit) {
+        errorHandler.error(ErrorLevel::CODEGEN, 0, 0,
+            "Failed to create execution engine: " + llvm::toString(jit.takeError()));
+        return false;
+    }
+    // One module per function: the lazy layer copies a function's whole
+    // module each time it compiles one, which is quadratic for a single module.
+    // Each part gets its own context so compile threads can work in parallel.
+    for (auto& part : Lei::splitByFunction(std::move(module))) {
+        auto owned = withOwnContext(*part);
+        if (!owned) {
+            errorHandler.error(ErrorLevel::CODEGEN, 0, 0,
+                "Failed to copy module for execution engine: " + llvm::toString(owned.takeError()));
+            return false;
+        }
+        if (auto error = (*jit)->addModule(std::move(*owned))) {
+            errorHandler.error(ErrorLevel::CODEGEN, 0, 0,
+                "Failed to add module to execution engine: " + llvm::toString(std::move(error)));
+            return false;
+        }
+    }
+
+    auto mainSymbol = (*jit)->lookup("main");
+    if (!mainSymbol) {
+        llvm::consumeError(mainSymbol.takeError());
+        errorHandler.error(ErrorLevel::CODEGEN, 0, 0, "Failed to find main function in module");
+        return false;
+    }
+
+    // Execute the function
+    auto mainFunction = llvm::jitTargetAddressToFunction<int (*)()>(mainSymbol->getAddress());
+    int result = mainFunction();
+    Lei::Runtime::finish();
+
+    // Print the result
+    std::cout << "Execution Result: " << result << std::endl;
+    return true;
+}
+
+bool Compiler::runMany(const std::string& source, const std::vector<std::string>& inputs,
+                       const std::string& outputDir, int jobs) {
+    auto module = buildModule(source, false, false, false);
+    if (!module) {
+        return false;
+    }
+    if (!module->getFunction("main")) {
+        errorHandler.error(ErrorLevel::CODEGEN, 0, 0, "Failed to find main function in module");
+        return false;
+    }
+
+    initializeNativeTarget();
+    Lei::Runtime::registerSymbols();
+    Lei::Runtime::redirectStandardStreams();
+
+    // Every run gets its own engine, and with it fresh globals, loaded from the
+    // one object file. Engines share the LLVM context, so creating and
+    // destroying them is serialized; the programs themselves run concurrently.
+    ModuleObjectCache objectCache;
+    std::mutex engineMutex;
+    bool engineFailed = false;
+    auto loadEngine = [&](uint64_t& mainAddress) -> llvm::ExecutionEngine* {
+        std::lock_guard<std::mutex> lock(engineMutex);
+        std::string errorStr;
+        llvm::EngineBuilder engineBuilder(llvm::CloneModule(*module));
+        llvm::ExecutionEngine* engine = engineBuilder
+            .setErrorStr(&errorStr)
+            .setEngineKind(llvm::EngineKind::JIT)
+            .setMCJITMemoryManager(std::make_unique<Lei::JitMemoryManager>())
+            .create();
+        if (!engine) {
+            if (!engineFailed) {
+                errorHandler.error(ErrorLevel::CODEGEN, 0, 0, "Failed to create execution engine: " + errorStr);
+            }
+            engineFailed = true;
+            return nullptr;
+        }
+        engine->setObjectCache(&objectCache);
+        mainAddress = engine->getFunctionAddress("main");
+        return engine;
+    };
+
+    struct RunResult {
+        int exitCode = 0;
+        double milliseconds = 0.0;
+        bool ran = false;
+    };
+    std::vector<RunResult> results(inputs.size());
+    std::atomic<size_t> nextInput{0};
+
+    auto worker = [&]() {
+        for (size_t i = nextInput++; i < inputs.size(); i = nextInput++) {
+            std::string input = Lei::SourceReader::readSourceFile(inputs[i]);
+
+            uint64_t mainAddress = 0;
+            llvm::ExecutionEngine* engine = loadEngine(mainAddress);
+            if (!engine) return;
+
+            auto start = std::chrono::steady_clock::now();
+            Lei::Runtime::Session* session = Lei::Runtime::openSession(std::move(input));
+            int exitCode = reinterpret_cast<int32_t (*)()>(mainAddress)();
+            std::string output = Lei::Runtime::closeSession(session);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+            {
+                std::lock_guard<std::mutex> lock(engineMutex);
+                jitMemory = Lei::JitMemoryPool::instance().stats();
+                delete engine;
+            }
+
+            if (!outputDir.empty()) {
+                std::string name = llvm::sys::path::filename(inputs[i]).str();
+                std::ofstream(outputDir + "/" + name + ".out", std::ios::binary) << output;
+            }
+            results[i] = { exitCode, elapsed.count(), true };
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < std::max(1, jobs); i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+    if (engineFailed) {
+        return false;
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        std::cout << inputs[i] << ": exit " << results[i].exitCode << ", "
+                  << results[i].milliseconds << " ms" << std::endl;
+        if (results[i].exitCode != 0) failed++;
+    }
+    std::cout << inputs.size() << " runs on " << std::max(1, jobs) << " threads in " << total.count() << " s ("
+              << (total.count() > 0.0 ? inputs.size() / total.count() : 0.0) << " runs/s), "
+              << failed << " failed" << std::endl;
+    return failed == 0;
+}
+
+bool Compiler::watch(const std::string& path, DiagnosticFormat format) {
+#if defined(__linux__)
+    initializeNativeTarget();
+    Lei::Runtime::registerSymbols();
+
+    std::string directory = llvm::sys::path::parent_path(path).str();
+    std::string name = llvm::sys::path::filename(path).str();
+    int notify = inotify_init1(IN_CLOEXEC);
+    if (notify < 0 || inotify_add_watch(notify, directory.empty() ? "." : directory.c_str(),
+                                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        std::cerr << "Error: cannot watch " << path << std::endl;
+        if (notify >= 0) close(notify);
+        return false;
+    }
+
+    // Outlives every build, so unchanged functions are loaded, not compiled
+    ModuleObjectCache objectCache;
+
+    auto rebuild = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        std::string source = Lei::SourceReader::readSourceFile(path);
+        errorHandler.clearAllErrors();
+        errorHandler.setSource(path, source);
+
+        // A fresh compiler per build, so nothing of the previous program's
+        // symbols or LLVM context carries over
+        Compiler build;
+        build.dumpIROnError = dumpIROnError;
+        build.astCacheDir = astCacheDir;
+        build.fuseLoops = fuseLoops;
+        auto module = build.buildModule(source, false, false, false);
+        if (!module || !module->getFunction("main")) {
+            if (module) errorHandler.error(ErrorLevel::CODEGEN, 0, 0, "Failed to find main function in module");
+            errorHandler.report(std::cerr, format);
+            return;
+        }
+
+        auto modules = Lei::splitByFunction(std::move(module));
+        std::unordered_set<std::string> identifiers;
+        for (const auto& part : modules) {
+            identifiers.insert(part->getModuleIdentifier());
+        }
+        size_t total = modules.size();
+        size_t compiledBefore = objectCache.compiledCount();
+
+        std::string errorStr;
+        llvm::EngineBuilder engineBuilder(std::move(modules[0]));
+        std::unique_ptr<llvm::ExecutionEngine> engine(engineBuilder
+            .setErrorStr(&errorStr)
+            .setEngineKind(llvm::EngineKind::JIT)
+            .setMCJITMemoryManager(std::make_unique<Lei::JitMemoryManager>())
+            .create());
+        if (!engine) {
+            errorHandler.error(ErrorLevel::CODEGEN, 0, 0, "Failed to create execution engine: " + errorStr);
+            errorHandler.report(std::cerr, format);
+            return;
+        }
+        engine->setObjectCache(&objectCache);
+        for (size_t i = 1; i < modules.size(); i++) {
+            engine->addModule(std::move(modules[i]));
+        }
+        uint64_t mainAddress = engine->getFunctionAddress("main");
+        objectCache.retain(identifiers);
+        std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - start;
+        std::cout << "Rebuilt " << path << " in " << latency.count() << " ms, "
+                  << objectCache.compiledCount() - compiledBefore << " of " << total
+                  << " modules compiled" << std::endl;
+
+        int result = reinterpret_cast<int32_t (*)()>(mainAddress)();
+        Lei::Runtime::finish();
+        std::cout << "Execution Result: " << result << std::endl;
+    };
+
+    rebuild();
+    std::cout << "Watching " << path << " for changes" << std::endl;
+
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t length = read(notify, buffer, sizeof(buffer));
+        if (length <= 0) break;
+
+        bool changed = false;
+        for (char* at = buffer; at < buffer + length;) {
+            auto* event = reinterpret_cast<inotify_event*>(at);
+            if (event->len > 0 && name == event->name) changed = true;
+            at += sizeof(inotify_event) + event->len;
+        }
+        if (!changed) continue;
+
+        // Editors save in several steps; wait for the burst to settle
+        pollfd pending = { notify, POLLIN, 0 };
+        while (poll(&pending, 1, 50) > 0) {
+            if (read(notify, buffer, sizeof(buffer)) <= 0) break;
+        }
+        rebuild();
+    }
+    close(notify);
+    return true;
+#else
+    std::cerr << "Error: --watch is only supported on Linux" << std::endl;
+    return false;
+#endif
+}
+
+bool Compiler::compileStreaming(const std::string& source, const std::string& outputPath) {
+    std::vector<Lei::SourceUnit> units = Lei::splitTopLevel(source);
+
+    // Signatures: every function is parsed once and kept without its body,
+    // unless analyzing other functions needs that body
+    Program declarations({}, Token(END, "", 1, 1));
+    std::unordered_map<std::string, size_t> unitOf;
+    std::unordered_map<std::string, size_t> declaredAt;
+    std::unordered_set<std::string> resident;
+    std::vector<std::string> pending;
+    for (size_t k = 0; k < units.size(); k++) {
+        auto part = parseUnit(source, units[k]);
+        if (!part) continue;
+        for (auto& global : part->globals) {
+            declarations.globals.push_back(std::move(global));
+        }
+        for (auto& function : part->functions) {
+            unitOf.emplace(function->name.value, k);
+            declaredAt.emplace(function->name.value, declarations.functions.size());
+            if (needsBodyResident(*function)) {
+                resident.insert(function->name.value);
+                if (!function->attributes.empty()) pending.push_back(function->name.value);
+            } else {
+                function->body = std::make_unique<BlockStmt>(std::vector<std::unique_ptr<Stmt>>(), function->name);
+            }
+            declarations.functions.push_back(std::move(function));
+        }
+    }
+    if (errorHandler.hasErrors()) {
+        return false;
+    }
+
+    // Attributes need the bodies of everything their function calls
+    std::unordered_set<size_t> reloaded;
+    while (!pending.empty()) {
+        auto found = unitOf.find(pending.back());
+        pending.pop_back();
+        std::unordered_set<std::string> calls;
+        parseUnit(source, units[found->second], &calls);
+        for (const std::string& callee : calls) {
+            if (unitOf.count(callee) && resident.insert(callee).second) {
+                pending.push_back(callee);
+                reloaded.insert(unitOf[callee]);
+            }
+        }
+    }
+    for (size_t k : reloaded) {
+        auto part = parseUnit(source, units[k]);
+        for (auto& function : part->functions) {
+            const std::string& name = function->name.value;
+            if (unitOf[name] == k && resident.count(name)) {
+                declarations.functions[declaredAt[name]] = std::move(function);
+            }
+        }
+    }
+
+    // Semantic errors do not stop the sweep below, so every body is still
+    // checked, but code is only generated while there are none
+    SemanticAnalyzer analyzer(symbolTable);
+    analyzer.setBodyFilter(&resident);
+    bool generating = analyzer.analyze(&declarations);
+
+    // Only resident bodies are known when deciding whether calls are pure
+    std::unordered_map<std::string, FunctionDecl*> residentFunctions;
+    for (const auto& function : declarations.functions) {
+        if (resident.count(function->name.value)) {
+            residentFunctions[function->name.value] = function.get();
+        }
+    }
+    Lei::LoopFusion fusion(residentFunctions, symbolTable);
+
+    CodegenVisitor codegen(llvmContext);
+    codegen.setDumpModuleOnError(dumpIROnError);
+    llvm::Module* module = nullptr;
+    std::error_code EC;
+    std::unique_ptr<llvm::raw_fd_ostream> dest;
+    if (generating) {
+        module = codegen.beginModule(&declarations, "module");
+        if (!module) {
+            return false;
+        }
+        dest = std::make_unique<llvm::raw_fd_ostream>(outputPath, EC, llvm::sys::fs::OF_None);
+        if (EC) {
+            errorHandler.error(
+                ErrorLevel::CODEGEN,
+                0, 0,
+                "Could not open output file: " + EC.message()
+            );
+            return false;
+        }
+        *dest << "; ModuleID = '" << module->getModuleIdentifier() << "'\n"
+              << "source_filename = \"" << module->getSourceFileName() << "\"\n";
+    }
+    auto fail = [&]() {
+        if (dest) {
+            dest->close();
+            llvm::sys::fs::remove(outputPath);
+        }
+        return false;
+    };
+
+    // Bodies: one unit at a time is parsed, analyzed, generated and written,
+    // then its tokens, AST and IR bodies are released
+    std::unordered_set<std::string> emitted;
+    llvm::SetVector<llvm::StructType*> types;
+    llvm::GlobalVariable* lastGlobal = nullptr;
+    for (const Lei::SourceUnit& unit : units) {
+        auto part = parseUnit(source, unit);
+        if (!part) {
+            return fail();
+        }
+        std::vector<std::string> names;
+        llvm::Function* lastKnown = generating ? &module->getFunctionList().back() : nullptr;
+        for (auto& function : part->functions) {
+            if (resident.count(function->name.value)) continue;
+
+            size_t instances = declarations.functions.size();
+            if (!analyzer.analyzeFunction(function.get())) {
+                generating = false;
+            }
+            if (!generating) continue;
+
+            for (size_t i = instances; i < declarations.functions.size(); i++) {
+                codegen.declareFunction(declarations.functions[i].get());
+            }
+            if (fuseLoops) {
+                fusion.run(function.get());
+            }
+            if (!codegen.emitFunction(function.get())) {
+                return fail();
+            }
+            names.push_back(function->name.value);
+        }
+        if (generating && (reportRuntimeCalls(*module) ||
+                           !flushFunctions(*module, names, lastKnown, lastGlobal, *dest, emitted, types))) {
+            return fail();
+        }
+    }
+    if (!generating) {
+        return fail();
+    }
+
+    // Resident functions and generic instances end up in the module itself
+    for (size_t i = 0; i < declarations.functions.size(); i++) {
+        FunctionDecl* function = declarations.functions[i].get();
+        if (resident.count(function->name.value) || !unitOf.count(function->name.value)) {
+            if (fuseLoops) {
+                fusion.run(function);
+            }
+            if (!codegen.emitFunction(function)) {
+                return fail();
+            }
+        }
+    }
+    auto finished = codegen.finishModule();
+    if (!finished || errorHandler.hasErrors() || reportRuntimeCalls(*finished)) {
+        return fail();
+    }
+    *dest << "\n";
+    printRemainder(*finished, emitted, types, *dest);
+    return true;
+}
@@ -7,10 +7,13 @@
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/IR/LLVMContext.h>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include "symbol_table.h"
 #include "error_handler.h"
 #include "ast.h"
+#include "jit_memory.h"
 #include <iostream>
 
 class Compiler {
@@ -18,9 +21,77 @@ public:
     llvm::LLVMContext llvmContext;
     ErrorHandler& errorHandler = ErrorHandler::instance();
     SymbolTable& symbolTable = SymbolTable::instance();  // Use singleton instance instead of direct member
+    bool dumpIROnError = false;  // Print the partial module when code generation fails
+    std::string astCacheDir;     // Analyzed programs are cached here when set
+    unsigned compileThreads = 0; // execute() compiles lazily on this many threads when set
+    bool fuseLoops = true;       // Merge adjacent loops over the same range before code generation
+    bool profile = false;        // execute() counts calls and allocations in the stats segment
+    unsigned sampleFrequency = 0;  // execute() samples the program's stack this many times per CPU second
+    std::string sampleOutput = "profile.folded";  // Folded stacks written after a sampled run
+    Lei::JitMemoryStats jitMemory;  // Sampled by execute() and runMany() while the program is still loaded
 
     bool compile(const std::string& source, const std::string& outputPath, bool printAST, bool printSymbolTable, bool printIR);
+
+    // Writes the same IR as compile() while holding only one top-level
+    // declaration's tokens, AST and IR body at a time, after a first pass that
+    // keeps signatures. Bodies other functions depend on during analysis, of
+    // const, generic, generator and attributed functions, stay in memory.
+    bool compileStreaming(const std::string& source, const std::string& outputPath);
+
     bool execute(const std::string& source,  bool printAST, bool printSymbolTable, bool printIR);
+
+    // Lexing, parsing and semantic analysis only; no LLVM state is touched
+    bool check(const std::string& source);
+
+    // Compiles once, then runs main for each input file on up to 'jobs' threads
+    // with the file as stdin. Each run's stdout goes to <outputDir>/<file>.out
+    // when outputDir is set. Prints exit code and time per input; returns
+    // false if compilation failed or any run exited non-zero.
+    bool runMany(const std::string& source, const std::vector<std::string>& inputs,
+                 const std::string& outputDir, int jobs);
+
+    // Runs the program, then again each time the file is saved. Every
+    // function is compiled as a module of its own and the object files are
+    // kept between builds, so a rebuild only compiles the functions whose IR
+    // changed and links the rest from the cache. Returns when watching fails.
+    bool watch(const std::string& path, DiagnosticFormat format);
+
+private:
+    // Native target setup is only needed to run code, so it happens on first use
+    static void initializeNativeTarget();
+
+    std::unique_ptr<Program> analyzeSource(const std::string& source);
+    std::unique_ptr<llvm::Module> buildModule(const std::string& source, bool printAST, bool printSymbolTable, bool printIR);
+    std::unique_ptr<llvm::Module> buildModule(const std::string& source, bool printAST, bool printSymbolTable, bool printIR,
+                                              llvm::LLVMContext& context);
+
+    // Output files are not linked against the runtime, which only exists inside
+    // leic; reports the first runtime entry point the module calls
+    bool reportRuntimeCalls(const llvm::Module& module);
+
+    // execute() on the speculative ORC JIT
+    bool executeLazily(const std::string& source, bool printAST, bool printSymbolTable, bool printIR);
+};
+
+namespace Lei {
+
+// A stretch of source holding one top-level declaration, or several when a
+// declaration does not start on a line of its own
+struct SourceUnit {
+    size_t begin;
+    size_t end;
+    int line;
 };
 
+// Splits the source where a line at brace depth zero starts with a
+// declaration keyword or an attribute; attribute lines stay with the
+// declaration after them. Used by compileStreaming().
+std::vector<SourceUnit> splitTopLevel(const std::string& source);
+
+// Gives every function definition a module of its own, named after a hash
+// of its IR. Used by watch() and the lazy JIT.
+std::vector<std::unique_ptr<llvm::Module>> splitByFunction(std::unique_ptr<llvm::Module> module);
+
+} // namespace Lei
+
 #endif // COMPILER_H
\ No newline at end of file
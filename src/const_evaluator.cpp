@@ -0,0 +1,620 @@
+#include "const_evaluator.h"
+#include <cmath>
+#include <limits>
+#include <unordered_set>
+
+namespace {
+
+// Internal signal used to unwind evaluation once an expression is known not to be constant
+struct EvaluationError {
+    std::string reason;
+};
+
+// Lei ints are 32-bit and wrap on overflow, matching the generated code
+int64_t wrapInt(int64_t value) {
+    return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+double asFloat(const ConstValue& value) {
+    return value.kind == ConstValue::Kind::FLOAT ? value.floatValue
+                                                 : static_cast<double>(value.intValue);
+}
+
+bool isNumeric(const ConstValue& value) {
+    return value.kind == ConstValue::Kind::INT || value.kind == ConstValue::Kind::FLOAT;
+}
+
+} // namespace
+
+ConstValue ConstValue::makeInt(int64_t value) {
+    ConstValue result;
+    result.kind = Kind::INT;
+    result.intValue = wrapInt(value);
+    return result;
+}
+
+ConstValue ConstValue::makeFloat(double value) {
+    ConstValue result;
+    result.kind = Kind::FLOAT;
+    result.floatValue = value;
+    return result;
+}
+
+ConstValue ConstValue::makeBool(bool value) {
+    ConstValue result;
+    result.kind = Kind::BOOL;
+    result.boolValue = value;
+    return result;
+}
+
+ConstValue ConstValue::makeString(const std::string& value) {
+    ConstValue result;
+    result.kind = Kind::STRING;
+    result.stringValue = value;
+    return result;
+}
+
+ConstValue ConstValue::makeArray(std::vector<ConstValue> elements) {
+    ConstValue result;
+    result.kind = Kind::ARRAY;
+    result.array = std::make_shared<ConstArray>();
+    result.array->elements = std::move(elements);
+    return result;
+}
+
+std::string ConstValue::typeName() const {
+    switch (kind) {
+        case Kind::INT: return "int";
+        case Kind::FLOAT: return "float";
+        case Kind::BOOL: return "bool";
+        case Kind::STRING: return "str";
+        case Kind::ARRAY: return "array";
+    }
+    return "unknown";
+}
+
+ConstEvaluator::ConstEvaluator(const std::unordered_map<std::string, FunctionDecl*>& constFunctions,
+                               ConstantLookup lookup, ConstEvalLimits limits)
+    : constFunctions(constFunctions), lookup(std::move(lookup)), limits(limits) {}
+
+std::shared_ptr<ConstValue> ConstEvaluator::evaluate(Expr* expr, const Type& targetType) {
+    frames.clear();
+    returning = false;
+    steps = 0;
+    failureReason.clear();
+
+    try {
+        return std::make_shared<ConstValue>(convert(eval(expr), targetType));
+    } catch (const EvaluationError& e) {
+        failureReason = e.reason;
+        return nullptr;
+    } catch (const std::exception& e) {
+        failureReason = std::string("invalid literal (") + e.what() + ")";
+        return nullptr;
+    }
+}
+
+bool ConstEvaluator::isPureBuiltin(const std::string& name) {
+    static const std::unordered_set<std::string> builtins = {
+        "sqrt", "floor", "pow", "fma", "abs", "min", "max",
+        "popcount", "clz", "ctz"
+    };
+    return builtins.count(name) > 0;
+}
+
+ConstValue ConstEvaluator::eval(Expr* expr) {
+    expr->accept(this);
+    return lastValue;
+}
+
+void ConstEvaluator::step() {
+    if (++steps > limits.maxSteps) {
+        fail("evaluation exceeded " + std::to_string(limits.maxSteps) + " steps");
+    }
+}
+
+void ConstEvaluator::fail(const std::string& reason) {
+    throw EvaluationError{reason};
+}
+
+ConstValue* ConstEvaluator::findLocal(const std::string& name) {
+    if (frames.empty()) return nullptr;
+    auto& scopes = frames.back();
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+        auto found = it->find(name);
+        if (found != it->end()) return &found->second;
+    }
+    return nullptr;
+}
+
+ConstValue ConstEvaluator::readVariable(const std::string& name) {
+    if (ConstValue* local = findLocal(name)) {
+        return *local;
+    }
+    if (const ConstValue* constant = lookup(name, !frames.empty())) {
+        return *constant;
+    }
+    fail("'" + name + "' is not a constant");
+}
+
+ConstValue ConstEvaluator::convert(const ConstValue& value, const Type& type) {
+    if (type.isArray) {
+        if (!value.isArray()) {
+            fail("expected an array but got " + value.typeName());
+        }
+        if (type.isFixedArray() && value.array->elements.size() != static_cast<size_t>(type.arraySize)) {
+            // Shorter initializer lists are zero-padded, as at runtime
+            if (value.array->elements.size() > static_cast<size_t>(type.arraySize)) {
+                fail("too many elements for array of size " + std::to_string(type.arraySize));
+            }
+            if (static_cast<size_t>(type.arraySize) > limits.maxArrayElements) {
+                fail("array exceeds " + std::to_string(limits.maxArrayElements) + " elements");
+            }
+            std::vector<ConstValue> elements;
+            for (const auto& element : value.array->elements) {
+                elements.push_back(convert(element, Type(type.name)));
+            }
+            while (elements.size() < static_cast<size_t>(type.arraySize)) {
+                elements.push_back(defaultValue(Type(type.name)));
+            }
+            return ConstValue::makeArray(std::move(elements));
+        }
+        // Arrays are shared by reference, so elements of another type get a
+        // new array rather than changing one that may be frozen or aliased
+        std::vector<ConstValue> elements;
+        bool changed = false;
+        for (const auto& element : value.array->elements) {
+            elements.push_back(convert(element, Type(type.name)));
+            changed = changed || elements.back().kind != element.kind;
+        }
+        return changed ? ConstValue::makeArray(std::move(elements)) : value;
+    }
+
+    if (type.name == "float" && value.kind == ConstValue::Kind::INT) {
+        return ConstValue::makeFloat(static_cast<double>(value.intValue));
+    }
+    if (type.name == "int" && value.kind == ConstValue::Kind::FLOAT) {
+        return ConstValue::makeInt(static_cast<int64_t>(value.floatValue));
+    }
+    if (type.name == "void" || type.name == value.typeName()) {
+        return value;
+    }
+    fail("cannot convert " + value.typeName() + " to " + type.name);
+}
+
+ConstValue ConstEvaluator::defaultValue(const Type& type) {
+    if (type.isArray) {
+        if (!type.isFixedArray()) {
+            fail("dynamic arrays cannot be created at compile time");
+        }
+        if (static_cast<size_t>(type.arraySize) > limits.maxArrayElements) {
+            fail("array exceeds " + std::to_string(limits.maxArrayElements) + " elements");
+        }
+        return ConstValue::makeArray(std::vector<ConstValue>(type.arraySize, defaultValue(Type(type.name))));
+    }
+    if (type.name == "int") return ConstValue::makeInt(0);
+    if (type.name == "float") return ConstValue::makeFloat(0.0);
+    if (type.name == "bool") return ConstValue::makeBool(false);
+    if (type.name == "str") return ConstValue::makeString("");
+    fail("type " + type.name + " has no compile-time representation");
+}
+
+void ConstEvaluator::visit(Program*) {
+    fail("a program is not an expression");
+}
+
+void ConstEvaluator::visit(FunctionDecl*) {
+    fail("nested function declarations are not supported");
+}
+
+void ConstEvaluator::visit(NumberExpr* node) {
+    step();
+    if (node->isFloat) {
+        lastValue = ConstValue::makeFloat(std::stod(node->token.value));
+    } else {
+        lastValue = ConstValue::makeInt(std::stoll(node->token.value));
+    }
+}
+
+void ConstEvaluator::visit(StringExpr* node) {
+    step();
+    lastValue = ConstValue::makeString(node->token.value);
+}
+
+void ConstEvaluator::visit(BoolExpr* node) {
+    step();
+    lastValue = ConstValue::makeBool(node->value);
+}
+
+void ConstEvaluator::visit(VariableExpr* node) {
+    step();
+    lastValue = readVariable(node->name.value);
+}
+
+ConstValue& ConstEvaluator::elementRef(ArrayAccessExpr* access, std::shared_ptr<ConstArray>& storage,
+                                        bool forWrite) {
+    ConstValue base = eval(access->array.get());
+    ConstValue index = eval(access->index.get());
+
+    if (!base.isArray()) {
+        fail("cannot index a value of type " + base.typeName());
+    }
+    if (forWrite && base.array->frozen) {
+        fail("cannot modify a constant array");
+    }
+    if (index.kind != ConstValue::Kind::INT) {
+        fail("array index must be an integer");
+    }
+    // Keep the storage alive while the caller holds the element reference
+    storage = base.array;
+    auto& elements = base.array->elements;
+    if (index.intValue < 0 || static_cast<size_t>(index.intValue) >= elements.size()) {
+        fail("array index " + std::to_string(index.intValue) + " out of bounds for size " +
+             std::to_string(elements.size()));
+    }
+    return elements[index.intValue];
+}
+
+void ConstEvaluator::visit(ArrayAccessExpr* node) {
+    step();
+    std::shared_ptr<ConstArray> storage;
+    lastValue = elementRef(node, storage, false);
+}
+
+ConstValue ConstEvaluator::applyBinary(TokenType op, const ConstValue& left, const ConstValue& right) {
+    if (op == AND || op == OR) {
+        if (left.kind != ConstValue::Kind::BOOL || right.kind != ConstValue::Kind::BOOL) {
+            fail("logical operators require boolean operands");
+        }
+        return ConstValue::makeBool(op == AND ? left.boolValue && right.boolValue
+                                              : left.boolValue || right.boolValue);
+    }
+
+    if (left.kind == ConstValue::Kind::BOOL && right.kind == ConstValue::Kind::BOOL) {
+        if (op == EQUALS_EQUALS) return ConstValue::makeBool(left.boolValue == right.boolValue);
+        if (op == NOT_EQUALS) return ConstValue::makeBool(left.boolValue != right.boolValue);
+        fail("invalid operator for boolean operands");
+    }
+
+    if (!isNumeric(left) || !isNumeric(right)) {
+        fail("operator requires numeric operands but got " + left.typeName() +
+             " and " + right.typeName());
+    }
+
+    if (left.kind == ConstValue::Kind::FLOAT || right.kind == ConstValue::Kind::FLOAT) {
+        double l = asFloat(left);
+        double r = asFloat(right);
+        switch (op) {
+            case PLUS: return ConstValue::makeFloat(l + r);
+            case MINUS: return ConstValue::makeFloat(l - r);
+            case STAR: return ConstValue::makeFloat(l * r);
+            case SLASH: return ConstValue::makeFloat(l / r);
+            case EQUALS_EQUALS: return ConstValue::makeBool(l == r);
+            case NOT_EQUALS: return ConstValue::makeBool(l != r && !std::isnan(l) && !std::isnan(r));
+            case LESS: return ConstValue::makeBool(l < r);
+            case LESS_EQUAL: return ConstValue::makeBool(l <= r);
+            case GREATER: return ConstValue::makeBool(l > r);
+            case GREATER_EQUAL: return ConstValue::makeBool(l >= r);
+            default: fail("unsupported binary operator");
+        }
+    }
+
+    int64_t l = left.intValue;
+    int64_t r = right.intValue;
+    switch (op) {
+        case PLUS: return ConstValue::makeInt(l + r);
+        case MINUS: return ConstValue::makeInt(l - r);
+        case STAR: return ConstValue::makeInt(l * r);
+        case SLASH:
+            if (r == 0) fail("division by zero");
+            return ConstValue::makeInt(l / r);
+        case EQUALS_EQUALS: return ConstValue::makeBool(l == r);
+        case NOT_EQUALS: return ConstValue::makeBool(l != r);
+        case LESS: return ConstValue::makeBool(l < r);
+        case LESS_EQUAL: return ConstValue::makeBool(l <= r);
+        case GREATER: return ConstValue::makeBool(l > r);
+        case GREATER_EQUAL: return ConstValue::makeBool(l >= r);
+        default: fail("unsupported binary operator");
+    }
+}
+
+void ConstEvaluator::visit(BinaryExpr* node) {
+    step();
+    // Both operands are evaluated, matching the non-short-circuit codegen
+    ConstValue left = eval(node->left.get());
+    ConstValue right = eval(node->right.get());
+    lastValue = applyBinary(node->op.type, left, right);
+}
+
+void ConstEvaluator::visit(UnaryExpr* node) {
+    step();
+    ConstValue operand = eval(node->expr.get());
+
+    switch (node->op.type) {
+        case MINUS:
+            if (operand.kind == ConstValue::Kind::INT) {
+                lastValue = ConstValue::makeInt(-operand.intValue);
+            } else if (operand.kind == ConstValue::Kind::FLOAT) {
+                lastValue = ConstValue::makeFloat(-operand.floatValue);
+            } else {
+                fail("unary '-' requires a numeric operand");
+            }
+            break;
+        case NOT:
+            if (operand.kind != ConstValue::Kind::BOOL) {
+                fail("unary '!' requires a boolean operand");
+            }
+            lastValue = ConstValue::makeBool(!operand.boolValue);
+            break;
+        default:
+            fail("unsupported unary operator");
+    }
+}
+
+void ConstEvaluator::visit(AssignExpr* node) {
+    step();
+    ConstValue value = eval(node->value.get());
+
+    ConstValue* target = nullptr;
+    std::shared_ptr<ConstArray> storage;
+    if (auto* var = dynamic_cast<VariableExpr*>(node->target.get())) {
+        target = findLocal(var->name.value);
+        if (!target) {
+            fail("cannot assign to '" + var->name.value + "' at compile time");
+        }
+    } else if (auto* access = dynamic_cast<ArrayAccessExpr*>(node->target.get())) {
+        target = &elementRef(access, storage, true);
+    } else {
+        fail("invalid assignment target");
+    }
+
+    if (node->op.type != EQUALS) {
+        TokenType op = node->op.type == PLUS_EQUALS ? PLUS :
+                       node->op.type == MINUS_EQUALS ? MINUS :
+                       node->op.type == STAR_EQUALS ? STAR : SLASH;
+        value = applyBinary(op, *target, value);
+    }
+
+    // Keep the storage type of the target, as the generated store would
+    if (target->kind == ConstValue::Kind::FLOAT && value.kind == ConstValue::Kind::INT) {
+        value = ConstValue::makeFloat(static_cast<double>(value.intValue));
+    } else if (target->kind == ConstValue::Kind::INT && value.kind == ConstValue::Kind::FLOAT) {
+        value = ConstValue::makeInt(static_cast<int64_t>(value.floatValue));
+    }
+
+    *target = value;
+    lastValue = value;
+}
+
+ConstValue ConstEvaluator::callBuiltin(const std::string& name, const std::vector<ConstValue>& args) {
+    for (const auto& arg : args) {
+        if (!isNumeric(arg)) {
+            fail("function " + name + " requires numeric arguments");
+        }
+    }
+
+    if (name == "sqrt") return ConstValue::makeFloat(std::sqrt(asFloat(args[0])));
+    if (name == "floor") return ConstValue::makeFloat(std::floor(asFloat(args[0])));
+    if (name == "pow") return ConstValue::makeFloat(std::pow(asFloat(args[0]), asFloat(args[1])));
+    if (name == "fma") return ConstValue::makeFloat(std::fma(asFloat(args[0]), asFloat(args[1]), asFloat(args[2])));
+
+    if (name == "abs") {
+        if (args[0].kind == ConstValue::Kind::FLOAT) return ConstValue::makeFloat(std::fabs(args[0].floatValue));
+        return ConstValue::makeInt(args[0].intValue < 0 ? -args[0].intValue : args[0].intValue);
+    }
+
+    if (name == "min" || name == "max") {
+        bool isMin = name == "min";
+        if (args[0].kind == ConstValue::Kind::FLOAT || args[1].kind == ConstValue::Kind::FLOAT) {
+            double l = asFloat(args[0]);
+            double r = asFloat(args[1]);
+            return ConstValue::makeFloat(isMin ? std::fmin(l, r) : std::fmax(l, r));
+        }
+        int64_t l = args[0].intValue;
+        int64_t r = args[1].intValue;
+        return ConstValue::makeInt(isMin ? std::min(l, r) : std::max(l, r));
+    }
+
+    // Bit builtins operate on the 32-bit pattern
+    if (args[0].kind != ConstValue::Kind::INT) {
+        fail("function " + name + " requires an integer argument");
+    }
+    uint32_t bits = static_cast<uint32_t>(args[0].intValue);
+    int count = 0;
+    if (name == "popcount") {
+        for (; bits; bits &= bits - 1) ++count;
+    } else if (name == "clz") {
+        for (uint32_t mask = 0x80000000u; mask && !(bits & mask); mask >>= 1) ++count;
+    } else if (name == "ctz") {
+        for (uint32_t mask = 1u; mask && !(bits & mask); mask <<= 1) ++count;
+    } else {
+        fail("function " + name + " cannot be evaluated at compile time");
+    }
+    return ConstValue::makeInt(count);
+}
+
+ConstValue ConstEvaluator::callFunction(FunctionDecl* func, std::vector<ConstValue> args) {
+    if (frames.size() >= limits.maxCallDepth) {
+        fail("const fn call depth exceeded " + std::to_string(limits.maxCallDepth));
+    }
+    if (args.size() != func->parameters.size()) {
+        fail("wrong number of arguments to " + func->name.value);
+    }
+
+    Scope params;
+    for (size_t i = 0; i < args.size(); ++i) {
+        params[func->parameters[i].name.value] = convert(args[i], func->parameters[i].type);
+    }
+    frames.push_back({std::move(params)});
+
+    lastValue = ConstValue();
+    returning = false;
+    func->body->accept(this);
+
+    ConstValue result = lastValue;
+    bool returned = returning;
+    returning = false;
+    frames.pop_back();
+
+    if (func->returnType.name == "void" && !func->returnType.isArray) {
+        return ConstValue();
+    }
+    if (!returned) {
+        fail("function " + func->name.value + " did not return a value");
+    }
+    return convert(result, func->returnType);
+}
+
+void ConstEvaluator::visit(CallExpr* node) {
+    step();
+    const std::string& name = node->name.value;
+
+    std::vector<ConstValue> args;
+    for (const auto& arg : node->arguments) {
+        args.push_back(eval(arg.get()));
+    }
+
+    auto it = constFunctions.find(name);
+    if (it != constFunctions.end()) {
+        lastValue = callFunction(it->second, std::move(args));
+    } else if (isPureBuiltin(name) && !shadowedBuiltins.count(name)) {
+        lastValue = callBuiltin(name, args);
+    } else {
+        fail("call to non-const function '" + name + "'");
+    }
+}
+
+void ConstEvaluator::visit(ArrayInitExpr* node) {
+    step();
+    if (node->elements.size() > limits.maxArrayElements) {
+        fail("array exceeds " + std::to_string(limits.maxArrayElements) + " elements");
+    }
+    std::vector<ConstValue> elements;
+    elements.reserve(node->elements.size());
+    for (const auto& element : node->elements) {
+        elements.push_back(eval(element.get()));
+    }
+    lastValue = ConstValue::makeArray(std::move(elements));
+}
+
+void ConstEvaluator::visit(ArrayAllocExpr*) {
+    fail("heap allocation is not allowed at compile time");
+}
+
+void ConstEvaluator::visit(TypeExpr*) {
+    fail("type expressions have no compile-time value");
+}
+
+void ConstEvaluator::visit(ExprStmt* node) {
+    step();
+    eval(node->expr.get());
+}
+
+void ConstEvaluator::visit(VarDeclStmt* node) {
+    step();
+    if (frames.empty()) {
+        fail("declarations are only evaluated inside const fn bodies");
+    }
+
+    ConstValue value = node->initializer ? convert(eval(node->initializer.get()), node->type)
+                                         : defaultValue(node->type);
+    frames.back().back()[node->name.value] = std::move(value);
+}
+
+void ConstEvaluator::visit(BlockStmt* node) {
+    step();
+    frames.back().emplace_back();
+    for (const auto& stmt : node->statements) {
+        stmt->accept(this);
+        if (returning) break;
+    }
+    frames.back().pop_back();
+}
+
+void ConstEvaluator::visit(IfStmt* node) {
+    step();
+    ConstValue condition = eval(node->condition.get());
+    if (condition.kind != ConstValue::Kind::BOOL) {
+        fail("condition must be a boolean");
+    }
+    if (condition.boolValue) {
+        node->thenBranch->accept(this);
+    } else if (node->elseBranch) {
+        node->elseBranch->accept(this);
+    }
+}
+
+void ConstEvaluator::visit(WhileStmt* node) {
+    step();
+    while (true) {
+        ConstValue condition = eval(node->condition.get());
+        if (condition.kind != ConstValue::Kind::BOOL) {
+            fail("condition must be a boolean");
+        }
+        if (!condition.boolValue) break;
+        node->body->accept(this);
+        if (returning) break;
+    }
+}
+
+void ConstEvaluator::visit(MatchStmt* node) {
+    step();
+    ConstValue subject = eval(node->subject.get());
+    auto integer = [this](const ConstValue& value) -> int64_t {
+        if (value.kind == ConstValue::Kind::INT) return value.intValue;
+        if (value.kind == ConstValue::Kind::BOOL) return value.boolValue ? 1 : 0;
+        fail("match patterns must be int or bool");
+    };
+    int64_t key = integer(subject);
+
+    for (auto& arm : node->arms) {
+        bool matched = arm.isWildcard();
+        for (const auto& pattern : arm.patterns) {
+            int64_t low = integer(eval(pattern.value.get()));
+            int64_t high = pattern.end ? integer(eval(pattern.end.get())) : low + 1;
+            matched = matched || (key >= low && key < high);
+        }
+        if (matched) {
+            arm.body->accept(this);
+            return;
+        }
+    }
+}
+
+void ConstEvaluator::visit(YieldStmt*) {
+    fail("generators cannot run at compile time");
+}
+
+void ConstEvaluator::visit(BenchStmt*) {
+    fail("benchmarks cannot run at compile time");
+}
+
+void ConstEvaluator::visit(ParallelForStmt*) {
+    fail("parallel loops cannot be evaluated at compile time");
+}
+
+void ConstEvaluator::visit(SpawnExpr*) {
+    fail("'spawn' cannot be evaluated at compile time");
+}
+
+void ConstEvaluator::visit(SyncStmt*) {
+    fail("'sync' cannot be evaluated at compile time");
+}
+
+void ConstEvaluator::visit(ChannelExpr*) {
+    fail("channels cannot be created at compile time");
+}
+
+void ConstEvaluator::visit(GoStmt*) {
+    fail("'go' cannot be evaluated at compile time");
+}
+
+void ConstEvaluator::visit(ForInStmt*) {
+    fail("channel loops cannot be evaluated at compile time");
+}
+
+void ConstEvaluator::visit(ReturnStmt* node) {
+    step();
+    lastValue = node->value ? eval(node->value.get()) : ConstValue();
+    returning = true;
+}
@@ -0,0 +1,132 @@
+#ifndef CONST_EVALUATOR_H
+#define CONST_EVALUATOR_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ast.h"
+#include "visitor.h"
+
+struct ConstValue;
+
+// Backing storage of a compile-time array. Arrays are shared by reference,
+// like Lei arrays at runtime; named constants are frozen once evaluated.
+struct ConstArray {
+    std::vector<ConstValue> elements;
+    bool frozen = false;
+};
+
+// A value computed during semantic analysis
+struct ConstValue {
+    enum class Kind { INT, FLOAT, BOOL, STRING, ARRAY };
+
+    Kind kind = Kind::INT;
+    int64_t intValue = 0;
+    double floatValue = 0.0;
+    bool boolValue = false;
+    std::string stringValue;
+    std::shared_ptr<ConstArray> array;
+
+    static ConstValue makeInt(int64_t value);
+    static ConstValue makeFloat(double value);
+    static ConstValue makeBool(bool value);
+    static ConstValue makeString(const std::string& value);
+    static ConstValue makeArray(std::vector<ConstValue> elements);
+
+    bool isArray() const { return kind == Kind::ARRAY; }
+    std::string typeName() const;
+};
+
+// Resource limits bounding the compile time spent on a single constant
+struct ConstEvalLimits {
+    size_t maxSteps = 1000000;          // AST nodes evaluated per evaluate() call
+    size_t maxCallDepth = 256;          // Nested const fn calls
+    size_t maxArrayElements = 1 << 20;  // Elements per compile-time array
+};
+
+// AST interpreter for constant expressions and 'const fn' bodies
+class ConstEvaluator : public Visitor {
+public:
+
+    // Resolves named constants that are not bound by the evaluator itself.
+    // globalOnly is set while evaluating inside a const fn body.
+    using ConstantLookup = std::function<const ConstValue*(const std::string& name, bool globalOnly)>;
+
+    ConstEvaluator(const std::unordered_map<std::string, FunctionDecl*>& constFunctions,
+                   ConstantLookup lookup, ConstEvalLimits limits = ConstEvalLimits());
+
+    // Evaluate an expression and convert the result to targetType.
+    // Returns nullptr when the expression is not a compile-time constant.
+    std::shared_ptr<ConstValue> evaluate(Expr* expr, const Type& targetType);
+    const std::string& getFailureReason() const { return failureReason; }
+
+    // Builtins the evaluator can execute
+    static bool isPureBuiltin(const std::string& name);
+
+    // Builtin names the program declares functions of its own with; calls
+    // to them are not builtin calls
+    void setShadowedBuiltins(std::unordered_set<std::string> names) { shadowedBuiltins = std::move(names); }
+
+    void visit(Program* node) override;
+    void visit(FunctionDecl* node) override;
+    void visit(NumberExpr* node) override;
+    void visit(StringExpr* node) override;
+    void visit(BoolExpr* node) override;
+    void visit(VariableExpr* node) override;
+    void visit(ArrayAccessExpr* node) override;
+    void visit(BinaryExpr* node) override;
+    void visit(UnaryExpr* node) override;
+    void visit(AssignExpr* node) override;
+    void visit(CallExpr* node) override;
+    void visit(ArrayInitExpr* node) override;
+    void visit(ArrayAllocExpr* node) override;
+    void visit(SpawnExpr* node) override;
+    void visit(ChannelExpr* node) override;
+    void visit(TypeExpr* node) override;
+    void visit(ExprStmt* node) override;
+    void visit(VarDeclStmt* node) override;
+    void visit(BlockStmt* node) override;
+    void visit(IfStmt* node) override;
+    void visit(WhileStmt* node) override;
+    void visit(ParallelForStmt* node) override;
+    void visit(SyncStmt* node) override;
+    void visit(GoStmt* node) override;
+    void visit(ForInStmt* node) override;
+    void visit(MatchStmt* node) override;
+    void visit(YieldStmt* node) override;
+    void visit(BenchStmt* node) override;
+    void visit(ReturnStmt* node) override;
+
+private:
+    using Scope = std::unordered_map<std::string, ConstValue>;
+
+    const std::unordered_map<std::string, FunctionDecl*>& constFunctions;
+    ConstantLookup lookup;
+    ConstEvalLimits limits;
+    std::unordered_set<std::string> shadowedBuiltins;
+
+    std::vector<std::vector<Scope>> frames;  // One scope stack per active call
+    ConstValue lastValue;
+    bool returning = false;
+    size_t steps = 0;
+    std::string failureReason;
+
+    ConstValue eval(Expr* expr);
+    void step();
+    [[noreturn]] void fail(const std::string& reason);
+
+    ConstValue readVariable(const std::string& name);
+    ConstValue* findLocal(const std::string& name);
+    ConstValue& elementRef(ArrayAccessExpr* access, std::shared_ptr<ConstArray>& storage, bool forWrite);
+    ConstValue callFunction(FunctionDecl* func, std::vector<ConstValue> args);
+    ConstValue callBuiltin(const std::string& name, const std::vector<ConstValue>& args);
+    ConstValue applyBinary(TokenType op, const ConstValue& left, const ConstValue& right);
+    ConstValue convert(const ConstValue& value, const Type& type);
+    ConstValue defaultValue(const Type& type);
+};
+
+#endif // CONST_EVALUATOR_H
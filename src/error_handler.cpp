@@ -1,7 +1,28 @@
 #include "error_handler.h"
-#include <iostream>
-#include <sstream>
 #include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <sstream>
+
+namespace {
+
+// Lowercase level names used as JSON values and SARIF rule ids
+const char* levelId(ErrorLevel level) {
+    switch (level) {
+        case ErrorLevel::LEXICAL:  return "lexical";
+        case ErrorLevel::SYNTAX:   return "syntax";
+        case ErrorLevel::SEMANTIC: return "semantic";
+        case ErrorLevel::CODEGEN:  return "codegen";
+        case ErrorLevel::RUNTIME:  return "runtime";
+        default:                   return "unknown";
+    }
+}
+
+const ErrorLevel allLevels[] = {
+    ErrorLevel::LEXICAL, ErrorLevel::SYNTAX, ErrorLevel::SEMANTIC, ErrorLevel::CODEGEN, ErrorLevel::RUNTIME
+};
+
+} // namespace
 
 std::string ErrorHandler::getLevelString(ErrorLevel level) {
     switch (level) {
@@ -14,45 +35,60 @@ std::string ErrorHandler::getLevelString(ErrorLevel level) {
     }
 }
 
+bool ErrorHandler::parseFormat(const std::string& name, DiagnosticFormat& format) {
+    if (name == "text") format = DiagnosticFormat::TEXT;
+    else if (name == "json") format = DiagnosticFormat::JSON;
+    else if (name == "sarif") format = DiagnosticFormat::SARIF;
+    else return false;
+    return true;
+}
+
+std::string ErrorHandler::quoteJson(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"':  quoted += "\\\""; break;
+            case '\\': quoted += "\\\\"; break;
+            case '\n': quoted += "\\n"; break;
+            case '\r': quoted += "\\r"; break;
+            case '\t': quoted += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    quoted += escaped;
+                } else {
+                    quoted += c;
+                }
+        }
+    }
+    return quoted + "\"";
+}
+
 void ErrorHandler::error(ErrorLevel level, const Token& token, const std::string& message) {
     error(level, token.line, token.column, message);
 }
 
 void ErrorHandler::error(ErrorLevel level, int line, int column, const std::string& message) {
-    errors.emplace_back(level, line, column, message);
-    
-    // Print error to stderr immediately with color coding
-    std::cerr << "\033[1;31m" << getLevelString(level) << "\033[0m"  // Red color for error level
-              << " at line " << line << ", column " << column 
-              << ": " << message << std::endl;
+    // Past the limit errors are only counted, so a cascade costs no memory
+    size_t& count = counts[index(level)];
+    if (maxErrorsPerLevel == 0 || count < maxErrorsPerLevel) {
+        errors.emplace_back(level, line, column, message);
+    }
+    count++;
 }
 
-void ErrorHandler::errorWithContext(ErrorLevel level, const Token& token, 
+void ErrorHandler::errorWithContext(ErrorLevel level, const Token& token,
                                   const std::string& message, const std::string& sourceCode) {
-    // Extract the relevant line from source code
-    std::istringstream stream(sourceCode);
-    std::string line;
-    int currentLine = 1;
-    
-    while (std::getline(stream, line) && currentLine < token.line) {
-        currentLine++;
+    if (source.empty()) {
+        setSource(sourcePath, sourceCode);
     }
-    
-    std::string context = line + "\n" + 
-                         std::string(token.column - 1, ' ') + "^";
-    
-    errors.emplace_back(level, token.line, token.column, message, context);
-    
-    // Print error with context
-    std::cerr << "\033[1;31m" << getLevelString(level) << "\033[0m\n"
-              << "At line " << token.line << ", column " << token.column << ":\n"
-              << context << "\n"
-              << message << std::endl;
+    error(level, token.line, token.column, message);
 }
 
-bool ErrorHandler::hasErrors(ErrorLevel level) const {
-    return std::any_of(errors.begin(), errors.end(),
-                      [level](const Error& e) { return e.level == level; });
+size_t ErrorHandler::getSuppressedCount(ErrorLevel level) const {
+    size_t count = counts[index(level)];
+    return maxErrorsPerLevel == 0 || count <= maxErrorsPerLevel ? 0 : count - maxErrorsPerLevel;
 }
 
 std::vector<ErrorHandler::Error> ErrorHandler::getErrors(ErrorLevel level) const {
@@ -62,14 +98,123 @@ std::vector<ErrorHandler::Error> ErrorHandler::getErrors(ErrorLevel level) const
     return levelErrors;
 }
 
-size_t ErrorHandler::getErrorCount(ErrorLevel level) const {
-    return std::count_if(errors.begin(), errors.end(),
-                        [level](const Error& e) { return e.level == level; });
-}
-
 void ErrorHandler::clearErrors(ErrorLevel level) {
     errors.erase(
         std::remove_if(errors.begin(), errors.end(),
                       [level](const Error& e) { return e.level == level; }),
         errors.end());
-}
\ No newline at end of file
+    counts[index(level)] = 0;
+}
+
+void ErrorHandler::clearAllErrors() {
+    errors.clear();
+    std::fill(std::begin(counts), std::end(counts), 0);
+}
+
+void ErrorHandler::setSource(const std::string& path, const std::string& text) {
+    sourcePath = path;
+    source = text;
+    lineStarts.clear();
+}
+
+std::string ErrorHandler::sourceLine(int line) const {
+    if (lineStarts.empty() && !source.empty()) {
+        lineStarts.push_back(0);
+        for (size_t i = 0; i < source.size(); i++) {
+            if (source[i] == '\n') lineStarts.push_back(i + 1);
+        }
+    }
+    if (line <= 0 || static_cast<size_t>(line) > lineStarts.size()) return "";
+
+    size_t start = lineStarts[line - 1];
+    size_t end = source.find('\n', start);
+    std::string text = source.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    if (!text.empty() && text.back() == '\r') text.pop_back();
+    return text;
+}
+
+void ErrorHandler::report(std::ostream& out, DiagnosticFormat format) const {
+    // Rendered into one buffer and written at once
+    std::ostringstream buffer;
+    switch (format) {
+        case DiagnosticFormat::TEXT:  reportText(buffer); break;
+        case DiagnosticFormat::JSON:  reportJson(buffer); break;
+        case DiagnosticFormat::SARIF: reportSarif(buffer); break;
+    }
+    out << buffer.str();
+    out.flush();
+}
+
+void ErrorHandler::reportText(std::ostream& out) const {
+    for (const auto& error : errors) {
+        // With a file, the location reads 'path:line:column' as compilers print
+        // it, which tells apart the diagnostics of several files
+        if (sourcePath.empty()) {
+            out << "\033[1;31m" << getLevelString(error.level) << "\033[0m"  // Red color for error level
+                << " at line " << error.line << ", column " << error.column;
+        } else {
+            out << sourcePath;
+            if (error.line > 0) out << ":" << error.line << ":" << error.column;
+            out << ": \033[1;31m" << getLevelString(error.level) << "\033[0m";
+        }
+        out << ": " << error.message << "\n";
+
+        std::string line = sourceLine(error.line);
+        if (!line.empty()) {
+            out << "    " << line << "\n"
+                << "    " << std::string(std::max(error.column - 1, 0), ' ') << "^\n";
+        }
+    }
+    for (ErrorLevel level : allLevels) {
+        if (size_t suppressed = getSuppressedCount(level)) {
+            out << suppressed << " more " << levelId(level) << " errors not shown\n";
+        }
+    }
+}
+
+void ErrorHandler::reportJson(std::ostream& out) const {
+    out << "{\"file\":" << quoteJson(sourcePath) << ",\"diagnostics\":[";
+    for (size_t i = 0; i < errors.size(); i++) {
+        const Error& error = errors[i];
+        out << (i ? "," : "") << "{\"level\":\"" << levelId(error.level) << "\""
+            << ",\"line\":" << error.line << ",\"column\":" << error.column
+            << ",\"message\":" << quoteJson(error.message)
+            << ",\"source\":" << quoteJson(sourceLine(error.line)) << "}";
+    }
+    out << "],\"suppressed\":{";
+    bool first = true;
+    for (ErrorLevel level : allLevels) {
+        if (size_t suppressed = getSuppressedCount(level)) {
+            out << (first ? "" : ",") << "\"" << levelId(level) << "\":" << suppressed;
+            first = false;
+        }
+    }
+    out << "}}\n";
+}
+
+void ErrorHandler::reportSarif(std::ostream& out) const {
+    out << "{\"version\":\"2.1.0\","
+        << "\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\","
+        << "\"runs\":[{\"tool\":{\"driver\":{\"name\":\"leic\",\"rules\":[";
+    for (size_t i = 0; i < std::size(allLevels); i++) {
+        out << (i ? "," : "") << "{\"id\":\"" << levelId(allLevels[i]) << "\","
+            << "\"shortDescription\":{\"text\":" << quoteJson(getLevelString(allLevels[i])) << "}}";
+    }
+    out << "]}},\"results\":[";
+    for (size_t i = 0; i < errors.size(); i++) {
+        const Error& error = errors[i];
+        out << (i ? "," : "") << "{\"ruleId\":\"" << levelId(error.level) << "\",\"level\":\"error\","
+            << "\"message\":{\"text\":" << quoteJson(error.message) << "},"
+            << "\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":" << quoteJson(sourcePath) << "}";
+        // Errors without a position, such as module verification, have no region
+        if (error.line > 0) {
+            out << ",\"region\":{\"startLine\":" << error.line;
+            if (error.column > 0) out << ",\"startColumn\":" << error.column;
+            std::string line = sourceLine(error.line);
+            if (!line.empty()) out << ",\"snippet\":{\"text\":" << quoteJson(line) << "}";
+            out << "}";
+        }
+        out << "}}]}";
+    }
+    out << "]}]}\n";
+}
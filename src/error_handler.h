@@ -1,6 +1,8 @@
 #ifndef ERROR_HANDLER_H
 #define ERROR_HANDLER_H
 
+#include <cstddef>
+#include <ostream>
 #include <string>
 #include <vector>
 #include <map>
@@ -16,6 +18,13 @@ enum class ErrorLevel {
     RUNTIME     // Runtime errors (for interpreter mode)
 };
 
+// How ErrorHandler::report renders diagnostics
+enum class DiagnosticFormat {
+    TEXT,   // Colored messages with the offending source line
+    JSON,   // One object listing every diagnostic
+    SARIF   // SARIF 2.1.0 log for code scanning tools
+};
+
 class ErrorHandler {
 public:
     struct Error {
@@ -23,10 +32,9 @@ public:
         int line;
         int column;
         std::string message;
-        std::string sourceSnippet;  // Context from source code
         
-        Error(ErrorLevel lvl, int l, int c, const std::string& msg, const std::string& snippet = "") 
-            : level(lvl), line(l), column(c), message(msg), sourceSnippet(snippet) {}
+        Error(ErrorLevel lvl, int l, int c, const std::string& msg)
+            : level(lvl), line(l), column(c), message(msg) {}
     };
 
     // Report an error at a specific token with error level
@@ -35,12 +43,13 @@ public:
     // Report an error at a specific location with error level
     void error(ErrorLevel level, int line, int column, const std::string& message);
 
-    // Report an error with source code context
+    // Report an error with source code context. The context is resolved from
+    // the line table when the diagnostics are reported.
     void errorWithContext(ErrorLevel level, const Token& token, 
                          const std::string& message, const std::string& sourceCode);
     
     // Check if any errors have been reported for a specific level
-    bool hasErrors(ErrorLevel level) const;
+    bool hasErrors(ErrorLevel level) const { return counts[index(level)] > 0; }
     
     // Check if any errors have been reported at all
     bool hasErrors() const { return !errors.empty(); }
@@ -51,8 +60,11 @@ public:
     // Get all errors
     const std::vector<Error>& getAllErrors() const { return errors; }
     
-    // Get error count for a specific level
-    size_t getErrorCount(ErrorLevel level) const;
+    // Get error count for a specific level, including suppressed errors
+    size_t getErrorCount(ErrorLevel level) const { return counts[index(level)]; }
+
+    // Errors of a level reported past the limit: counted but not kept
+    size_t getSuppressedCount(ErrorLevel level) const;
     
     // Get total error count
     size_t getTotalErrorCount() const { return errors.size(); }
@@ -61,11 +73,27 @@ public:
     void clearErrors(ErrorLevel level);
     
     // Clear all errors
-    void clearAllErrors() { errors.clear(); }
+    void clearAllErrors();
+
+    // Most errors kept per level; 0 keeps every error
+    void setMaxErrorsPerLevel(size_t limit) { maxErrorsPerLevel = limit; }
+
+    // Source file the diagnostics refer to; its line table is built on first use
+    void setSource(const std::string& path, const std::string& source);
+    const std::string& getSourcePath() const { return sourcePath; }
+
+    // Writes every kept diagnostic, then the number suppressed per level
+    void report(std::ostream& out, DiagnosticFormat format) const;
 
     // Get string representation of error level
     static std::string getLevelString(ErrorLevel level);
 
+    // Parses "text", "json" or "sarif"
+    static bool parseFormat(const std::string& name, DiagnosticFormat& format);
+
+    // Quotes text as a JSON string literal
+    static std::string quoteJson(const std::string& text);
+
     // Static method to get singleton instance
     static ErrorHandler& instance() {
         static ErrorHandler handler;
@@ -73,7 +101,21 @@ public:
     }
 
 private:
+    static constexpr size_t LevelCount = 5;
+
     std::vector<Error> errors;
+    size_t counts[LevelCount] = {};
+    size_t maxErrorsPerLevel = 100;
+
+    std::string sourcePath;
+    std::string source;
+    mutable std::vector<size_t> lineStarts;  // Offset of each line, built lazily
+
+    static size_t index(ErrorLevel level) { return static_cast<size_t>(level); }
+    std::string sourceLine(int line) const;
+    void reportText(std::ostream& out) const;
+    void reportJson(std::ostream& out) const;
+    void reportSarif(std::ostream& out) const;
     
     // Private constructor for singleton pattern
     ErrorHandler() = default;
@@ -0,0 +1,241 @@
+#include "jit_memory.h"
+#include <llvm/Support/Memory.h>
+#include <llvm/Support/Process.h>
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace Lei {
+
+namespace {
+
+// Regions advised for huge pages are mapped in multiples of the huge page
+// size on x86-64; others in multiples of the page size
+constexpr uint64_t HugePageSize = 2 * 1024 * 1024;
+constexpr uint64_t FirstRegionSize = 256 * 1024;
+constexpr uint64_t MaxRegionSize = 32 * 1024 * 1024;
+
+uint64_t roundUp(uint64_t value, uint64_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+bool protect(uint8_t* base, uint64_t size, unsigned flags) {
+    return !llvm::sys::Memory::protectMappedMemory(llvm::sys::MemoryBlock(base, size), flags);
+}
+
+} // namespace
+
+JitMemoryPool& JitMemoryPool::instance() {
+    static JitMemoryPool* pool = new JitMemoryPool();
+    return *pool;
+}
+
+JitMemoryPool::JitMemoryPool() : page(llvm::sys::Process::getPageSizeEstimate()) {
+    if (const char* requested = std::getenv("LEI_JIT_HUGE_PAGES")) {
+        hugePages = std::atoi(requested) != 0;
+    }
+    for (ZoneState& state : zones) {
+        state.nextRegion = hugePages ? HugePageSize : FirstRegionSize;
+    }
+}
+
+JitMemoryPool::~JitMemoryPool() {
+    for (const auto& region : regions) {
+        llvm::sys::MemoryBlock block(region.first, region.second);
+        llvm::sys::Memory::releaseMappedMemory(block);
+    }
+}
+
+uint8_t* JitMemoryPool::allocate(Zone zone, uint64_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ZoneState& state = zones[static_cast<int>(zone)];
+
+    uint8_t* address = takeFreeSpan(state, size);
+    if (address) {
+        reusedBytes += size;
+    } else {
+        if (static_cast<uint64_t>(state.tailEnd - state.tail) < size && !mapRegion(state, size)) {
+            return nullptr;
+        }
+        address = state.tail;
+        state.tail += size;
+    }
+
+    state.inUse += size;
+    state.peak = std::max(state.peak, state.inUse);
+    return address;
+}
+
+void JitMemoryPool::release(Zone zone, uint8_t* address, uint64_t size) {
+    protect(address, size, llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ZoneState& state = zones[static_cast<int>(zone)];
+    state.inUse -= size;
+    addFreeSpan(state, address, size);
+}
+
+// First fit by address, so reused memory stays next to the live code
+uint8_t* JitMemoryPool::takeFreeSpan(ZoneState& state, uint64_t size) {
+    for (auto it = state.freeSpans.begin(); it != state.freeSpans.end(); ++it) {
+        if (it->second < size) continue;
+        uint8_t* address = it->first;
+        uint64_t remaining = it->second - size;
+        state.freeSpans.erase(it);
+        if (remaining > 0) {
+            state.freeSpans.emplace(address + size, remaining);
+        }
+        return address;
+    }
+    return nullptr;
+}
+
+void JitMemoryPool::addFreeSpan(ZoneState& state, uint8_t* address, uint64_t size) {
+    auto next = state.freeSpans.lower_bound(address);
+    if (next != state.freeSpans.end() && address + size == next->first) {
+        size += next->second;
+        next = state.freeSpans.erase(next);
+    }
+    if (next != state.freeSpans.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == address) {
+            previous->second += size;
+            return;
+        }
+    }
+    state.freeSpans.emplace(address, size);
+}
+
+bool JitMemoryPool::mapRegion(ZoneState& state, uint64_t size) {
+    // Mapping near the first region keeps code and data within the +-2 GB
+    // reach of PC-relative relocations
+    uint64_t length = std::max(state.nextRegion, roundUp(size, hugePages ? HugePageSize : page));
+    llvm::sys::MemoryBlock near;
+    if (!regions.empty()) {
+        near = llvm::sys::MemoryBlock(regions.front().first, regions.front().second);
+    }
+    std::error_code error;
+    llvm::sys::MemoryBlock block = llvm::sys::Memory::allocateMappedMemory(
+        length, &near, llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE, error);
+    if (error) return false;
+
+#if defined(MADV_HUGEPAGE)
+    if (hugePages) {
+        madvise(block.base(), block.allocatedSize(), MADV_HUGEPAGE);
+    }
+#endif
+
+    regions.emplace_back(block.base(), block.allocatedSize());
+    state.nextRegion = std::min(state.nextRegion * 2, MaxRegionSize);
+    if (state.tail != state.tailEnd) {
+        addFreeSpan(state, state.tail, state.tailEnd - state.tail);
+    }
+    state.tail = static_cast<uint8_t*>(block.base());
+    state.tailEnd = state.tail + block.allocatedSize();
+    return true;
+}
+
+JitMemoryStats JitMemoryPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    JitMemoryStats result;
+    for (const auto& region : regions) {
+        result.reservedBytes += region.second;
+    }
+    auto summarize = [](const ZoneState& state, JitZoneStats& zone) {
+        zone.liveBytes = state.inUse;
+        zone.peakBytes = state.peak;
+        for (const auto& span : state.freeSpans) {
+            zone.freeBytes += span.second;
+            zone.largestFreeBytes = std::max(zone.largestFreeBytes, span.second);
+            zone.freeSpans++;
+        }
+    };
+    summarize(zones[static_cast<int>(Zone::Code)], result.code);
+    summarize(zones[static_cast<int>(Zone::Data)], result.data);
+    result.reusedBytes = reusedBytes;
+    result.hugePages = hugePages;
+    return result;
+}
+
+JitMemoryManager::~JitMemoryManager() {
+    JitMemoryPool& pool = JitMemoryPool::instance();
+    for (const Span& span : code) {
+        pool.release(JitMemoryPool::Zone::Code, span.base, span.size);
+    }
+    for (const auto* spans : { &readOnly, &writable }) {
+        for (const Span& span : *spans) {
+            pool.release(JitMemoryPool::Zone::Data, span.base, span.size);
+        }
+    }
+}
+
+void JitMemoryManager::reserve(std::vector<Span>& spans, JitMemoryPool::Zone zone, uint64_t size, uint64_t alignment) {
+    if (size == 0) return;
+    JitMemoryPool& pool = JitMemoryPool::instance();
+    uint64_t length = roundUp(size + std::max<uint64_t>(alignment, 1) - 1, pool.pageSize());
+    if (uint8_t* base = pool.allocate(zone, length)) {
+        spans.push_back({ base, length, 0, false });
+    }
+}
+
+void JitMemoryManager::reserveAllocationSpace(uintptr_t codeSize, uint32_t codeAlign, uintptr_t roDataSize,
+                                              uint32_t roDataAlign, uintptr_t rwDataSize, uint32_t rwDataAlign) {
+    reserve(code, JitMemoryPool::Zone::Code, codeSize, codeAlign);
+    reserve(readOnly, JitMemoryPool::Zone::Data, roDataSize, roDataAlign);
+    reserve(writable, JitMemoryPool::Zone::Data, rwDataSize, rwDataAlign);
+}
+
+uint8_t* JitMemoryManager::carve(std::vector<Span>& spans, JitMemoryPool::Zone zone, uint64_t size, uint64_t alignment) {
+    alignment = std::max<uint64_t>(alignment, 16);
+    if (!spans.empty() && !spans.back().sealed) {
+        Span& span = spans.back();
+        uint64_t offset = roundUp(reinterpret_cast<uintptr_t>(span.base) + span.used, alignment) -
+                          reinterpret_cast<uintptr_t>(span.base);
+        if (offset + size <= span.size) {
+            span.used = offset + size;
+            return span.base + offset;
+        }
+    }
+
+    // Sections beyond the announced sizes get a span of their own
+    size_t count = spans.size();
+    reserve(spans, zone, std::max<uint64_t>(size, 1), alignment);
+    if (spans.size() == count) return nullptr;
+    return carve(spans, zone, size, alignment);
+}
+
+uint8_t* JitMemoryManager::allocateCodeSection(uintptr_t size, unsigned alignment, unsigned,
+                                               llvm::StringRef) {
+    return carve(code, JitMemoryPool::Zone::Code, size, alignment);
+}
+
+uint8_t* JitMemoryManager::allocateDataSection(uintptr_t size, unsigned alignment, unsigned,
+                                               llvm::StringRef, bool isReadOnly) {
+    return carve(isReadOnly ? readOnly : writable, JitMemoryPool::Zone::Data, size, alignment);
+}
+
+bool JitMemoryManager::finalizeMemory(std::string* errorMessage) {
+    for (Span& span : code) {
+        if (span.sealed) continue;
+        if (!protect(span.base, span.size, llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_EXEC)) {
+            if (errorMessage) *errorMessage = "Cannot make JIT code executable";
+            return true;
+        }
+        llvm::sys::Memory::InvalidateInstructionCache(span.base, span.size);
+        span.sealed = true;
+    }
+    for (Span& span : readOnly) {
+        if (span.sealed) continue;
+        if (!protect(span.base, span.size, llvm::sys::Memory::MF_READ)) {
+            if (errorMessage) *errorMessage = "Cannot make JIT constants read-only";
+            return true;
+        }
+        span.sealed = true;
+    }
+    return false;
+}
+
+} // namespace Lei
@@ -0,0 +1,126 @@
+#ifndef JIT_MEMORY_H
+#define JIT_MEMORY_H
+
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Lei {
+
+// Counters of one zone of the JIT memory pool, in bytes of whole pages
+struct JitZoneStats {
+    uint64_t liveBytes = 0;         // Held by loaded sections
+    uint64_t peakBytes = 0;
+    uint64_t freeBytes = 0;         // Released spans waiting to be reused
+    uint64_t largestFreeBytes = 0;
+    uint64_t freeSpans = 0;
+
+    // Share of the free space that a request for all of it could not use
+    double fragmentation() const {
+        return freeBytes == 0 ? 0.0 : 1.0 - static_cast<double>(largestFreeBytes) / freeBytes;
+    }
+};
+
+struct JitMemoryStats {
+    uint64_t reservedBytes = 0;     // Mapped from the OS by the pool
+    uint64_t reusedBytes = 0;       // Allocations served from released spans
+    bool hugePages = false;
+    JitZoneStats code;
+    JitZoneStats data;
+};
+
+// Process-wide memory for JIT output. Code and data live in separate zones of
+// pooled regions, so the code of every loaded module is packed into as few
+// pages as possible instead of one small mapping per section. A zone's first
+// region is small and each further one twice as large, up to a cap. Released
+// spans are coalesced and reused lowest address first, which keeps live code
+// dense. With LEI_JIT_HUGE_PAGES=1 regions are advised for transparent huge
+// pages and sized in whole huge pages.
+class JitMemoryPool {
+public:
+    enum class Zone { Code, Data };
+
+    // The pool every JitMemoryManager draws from. It is never destroyed, so
+    // code of detached threads stays mapped while the process exits.
+    static JitMemoryPool& instance();
+
+    JitMemoryPool();
+    ~JitMemoryPool();  // Unmaps every region
+    JitMemoryPool(const JitMemoryPool&) = delete;
+    JitMemoryPool& operator=(const JitMemoryPool&) = delete;
+
+    uint64_t pageSize() const { return page; }
+
+    // Returns size bytes (a multiple of the page size) of read-write memory,
+    // or null if the OS refuses to map more
+    uint8_t* allocate(Zone zone, uint64_t size);
+
+    // Makes the span read-write again and returns it for reuse
+    void release(Zone zone, uint8_t* address, uint64_t size);
+
+    JitMemoryStats stats() const;
+
+private:
+    struct ZoneState {
+        std::map<uint8_t*, uint64_t> freeSpans;  // Address -> size, coalesced
+        uint8_t* tail = nullptr;                 // Untouched end of the newest region
+        uint8_t* tailEnd = nullptr;
+        uint64_t inUse = 0;
+        uint64_t peak = 0;
+        uint64_t nextRegion = 0;                 // Size of the next region to map
+    };
+
+    uint8_t* takeFreeSpan(ZoneState& state, uint64_t size);
+    void addFreeSpan(ZoneState& state, uint8_t* address, uint64_t size);
+    bool mapRegion(ZoneState& state, uint64_t size);
+
+    mutable std::mutex mutex;
+    uint64_t page;
+    bool hugePages = false;
+    ZoneState zones[2];
+    std::vector<std::pair<void*, uint64_t>> regions;
+    uint64_t reusedBytes = 0;
+};
+
+// MCJIT memory manager drawing from JitMemoryPool. The sizes RuntimeDyld
+// announces up front are reserved as one span per kind of section, so an
+// object's sections end up adjacent. Code becomes read-execute and read-only
+// data read-only when the engine finalizes; spans go back to the pool when
+// the engine is destroyed.
+class JitMemoryManager : public llvm::RTDyldMemoryManager {
+public:
+    ~JitMemoryManager() override;
+
+    uint8_t* allocateCodeSection(uintptr_t size, unsigned alignment, unsigned sectionID,
+                                 llvm::StringRef sectionName) override;
+    uint8_t* allocateDataSection(uintptr_t size, unsigned alignment, unsigned sectionID,
+                                 llvm::StringRef sectionName, bool isReadOnly) override;
+
+    bool needsToReserveAllocationSpace() override { return true; }
+    void reserveAllocationSpace(uintptr_t codeSize, uint32_t codeAlign, uintptr_t roDataSize,
+                                uint32_t roDataAlign, uintptr_t rwDataSize, uint32_t rwDataAlign) override;
+
+    bool finalizeMemory(std::string* errorMessage = nullptr) override;
+
+private:
+    struct Span {
+        uint8_t* base;
+        uint64_t size;
+        uint64_t used;
+        bool sealed;  // Protections applied; nothing more is placed in it
+    };
+
+    std::vector<Span> code;
+    std::vector<Span> readOnly;
+    std::vector<Span> writable;
+
+    uint8_t* carve(std::vector<Span>& spans, JitMemoryPool::Zone zone, uint64_t size, uint64_t alignment);
+    void reserve(std::vector<Span>& spans, JitMemoryPool::Zone zone, uint64_t size, uint64_t alignment);
+};
+
+} // namespace Lei
+
+#endif // JIT_MEMORY_H
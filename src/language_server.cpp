@@ -0,0 +1,739 @@
+#include "language_server.h"
+#include "lexer.h"
+#include "parser.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+namespace Lei {
+
+namespace {
+
+// Just enough JSON to read protocol messages
+struct Json {
+    enum class Kind { Null, Bool, Number, String, Array, Object };
+
+    Kind kind = Kind::Null;
+    bool boolean = false;
+    std::string text;  // String value, or the literal text of a number
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> members;
+
+    const Json& operator[](const std::string& key) const {
+        static const Json missing;
+        for (const auto& member : members) {
+            if (member.first == key) return member.second;
+        }
+        return missing;
+    }
+
+    bool isNull() const { return kind == Kind::Null; }
+    int asInt() const { return kind == Kind::Number ? std::atoi(text.c_str()) : 0; }
+};
+
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : text(text) {}
+
+    bool read(Json& value) {
+        if (!parseValue(value)) return false;
+        skipSpace();
+        return pos == text.size();
+    }
+
+private:
+    const std::string& text;
+    size_t pos = 0;
+
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t length = std::char_traits<char>::length(word);
+        if (text.compare(pos, length, word) != 0) return false;
+        pos += length;
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, unsigned codePoint) {
+        if (codePoint < 0x80) {
+            out += static_cast<char>(codePoint);
+        } else if (codePoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    bool parseHex(unsigned& value) {
+        if (pos + 4 > text.size()) return false;
+        value = static_cast<unsigned>(std::strtoul(text.substr(pos, 4).c_str(), nullptr, 16));
+        pos += 4;
+        return true;
+    }
+
+    bool parseString(std::string& out) {
+        pos++;  // Opening quote
+        while (pos < text.size() && text[pos] != '"') {
+            char c = text[pos++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size()) return false;
+            char escaped = text[pos++];
+            switch (escaped) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    unsigned codePoint;
+                    if (!parseHex(codePoint)) return false;
+                    // A high surrogate is followed by the low half of the pair
+                    if (codePoint >= 0xD800 && codePoint < 0xDC00 && literal("\\u")) {
+                        unsigned low;
+                        if (!parseHex(low)) return false;
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, codePoint);
+                    break;
+                }
+                default: out += escaped;
+            }
+        }
+        if (pos >= text.size()) return false;
+        pos++;  // Closing quote
+        return true;
+    }
+
+    bool parseValue(Json& value) {
+        skipSpace();
+        if (pos >= text.size()) return false;
+
+        char c = text[pos];
+        if (c == '{') {
+            value.kind = Json::Kind::Object;
+            pos++;
+            skipSpace();
+            if (pos < text.size() && text[pos] == '}') { pos++; return true; }
+            while (true) {
+                skipSpace();
+                std::string key;
+                if (pos >= text.size() || text[pos] != '"' || !parseString(key)) return false;
+                skipSpace();
+                if (pos >= text.size() || text[pos++] != ':') return false;
+                value.members.emplace_back(std::move(key), Json());
+                if (!parseValue(value.members.back().second)) return false;
+                skipSpace();
+                if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+                if (pos < text.size() && text[pos] == '}') { pos++; return true; }
+                return false;
+            }
+        }
+        if (c == '[') {
+            value.kind = Json::Kind::Array;
+            pos++;
+            skipSpace();
+            if (pos < text.size() && text[pos] == ']') { pos++; return true; }
+            while (true) {
+                value.items.emplace_back();
+                if (!parseValue(value.items.back())) return false;
+                skipSpace();
+                if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+                if (pos < text.size() && text[pos] == ']') { pos++; return true; }
+                return false;
+            }
+        }
+        if (c == '"') {
+            value.kind = Json::Kind::String;
+            return parseString(value.text);
+        }
+        if (literal("true")) { value.kind = Json::Kind::Bool; value.boolean = true; return true; }
+        if (literal("false")) { value.kind = Json::Kind::Bool; return true; }
+        if (literal("null")) return true;
+
+        size_t start = pos;
+        while (pos < text.size() && (std::isdigit(static_cast<unsigned char>(text[pos])) ||
+                                     std::string("+-.eE").find(text[pos]) != std::string::npos)) {
+            pos++;
+        }
+        if (pos == start) return false;
+        value.kind = Json::Kind::Number;
+        value.text = text.substr(start, pos - start);
+        return true;
+    }
+};
+
+// A declaration keyword in column 1, outside any braces, right after the '}'
+// or ';' that ended the previous declaration, begins a new unit. Attributes
+// stay with their function because '@memo' is not preceded by either.
+bool beginsDeclaration(const Token& token) {
+    switch (token.type) {
+        case FN: case VAR: case CONST: case THREADLOCAL: case AT:
+            return token.column == 1;
+        default:
+            return false;
+    }
+}
+
+std::vector<size_t> unitStarts(const std::vector<Token>& tokens) {
+    std::vector<size_t> starts;
+    int depth = 0;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        bool afterDeclaration = i > 0 && (tokens[i - 1].type == RBRACE || tokens[i - 1].type == SEMICOLON);
+        if (i == 0 || (depth == 0 && afterDeclaration && beginsDeclaration(tokens[i]))) {
+            starts.push_back(i);
+        }
+        if (tokens[i].type == LBRACE) depth++;
+        else if (tokens[i].type == RBRACE && depth > 0) depth--;
+    }
+    return starts;
+}
+
+// The tokens close every brace and end like a declaration, so whatever
+// follows them still starts a unit of its own
+bool endsDeclaration(const std::vector<Token>& tokens) {
+    int depth = 0;
+    for (const Token& token : tokens) {
+        if (token.type == LBRACE) depth++;
+        else if (token.type == RBRACE && depth > 0) depth--;
+    }
+    return depth == 0 && !tokens.empty() &&
+           (tokens.back().type == RBRACE || tokens.back().type == SEMICOLON);
+}
+
+std::string formatType(const Type& type) {
+    std::string result = type.name;
+    if (type.isArray) {
+        result += "[" + (type.arraySize >= 0 ? std::to_string(type.arraySize) : std::string()) + "]";
+    }
+    return result;
+}
+
+std::string formatFunction(const std::string& name, const Type& returnType, const std::vector<Parameter>& parameters) {
+    std::string result = "fn " + formatType(returnType) + " " + name + "(";
+    for (size_t i = 0; i < parameters.size(); i++) {
+        result += (i ? ", " : "") + parameters[i].name.value + ": " + formatType(parameters[i].type);
+    }
+    return result + ")";
+}
+
+// Names declared by a unit, and everything about them that callers depend on
+std::string declaredNames(const Program& program) {
+    std::string names;
+    for (const auto& func : program.functions) names += "fn " + func->name.value + ";";
+    for (const auto& global : program.globals) names += "var " + global->name.value + ";";
+    return names;
+}
+
+std::string signatureOf(const Program& program) {
+    std::string signature;
+    for (const auto& func : program.functions) {
+        signature += formatFunction(func->name.value, func->returnType, func->parameters);
+        signature += func->isConst ? " const" : "";
+        signature += func->isGenerator ? " gen" : "";
+        for (const auto& parameter : func->typeParameters) signature += " <" + parameter + ">";
+        signature += ";";
+    }
+    return signature;
+}
+
+// Units whose analysis reaches into other declarations, so they are always
+// reparsed and analyzed: globals are checked on every pass, generics through
+// the instances their callers create, const functions by evaluating them
+bool analyzedEveryPass(const Program& program) {
+    if (!program.globals.empty()) return true;
+    for (const auto& func : program.functions) {
+        if (func->isGeneric() || func->isConst) return true;
+    }
+    return false;
+}
+
+std::string position(int line, int character) {
+    return "{\"line\":" + std::to_string(std::max(line, 0)) + ",\"character\":" +
+           std::to_string(std::max(character, 0)) + "}";
+}
+
+} // namespace
+
+int LanguageServer::run(std::istream& in, std::ostream& out) {
+    output = &out;
+    ErrorHandler::instance().setMaxErrorsPerLevel(0);
+
+    bool shutdown = false;
+    bool exit = false;
+    std::string header;
+    while (!exit) {
+        size_t length = 0;
+        bool haveLength = false;
+        while (std::getline(in, header) && header != "\r" && !header.empty()) {
+            if (header.compare(0, 15, "Content-Length:") == 0) {
+                length = std::strtoul(header.c_str() + 15, nullptr, 10);
+                haveLength = true;
+            }
+        }
+        if (!in) break;
+        if (!haveLength) continue;
+
+        std::string body(length, '\0');
+        if (!in.read(&body[0], static_cast<std::streamsize>(length))) break;
+        handle(body, shutdown, exit);
+    }
+    return shutdown ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void LanguageServer::send(const std::string& body) {
+    *output << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+    output->flush();
+}
+
+void LanguageServer::respond(const std::string& id, const std::string& result) {
+    send("{\"jsonrpc\":\"2.0\",\"id\":" + id + ",\"result\":" + result + "}");
+}
+
+void LanguageServer::handle(const std::string& message, bool& shutdown, bool& exit) {
+    Json request;
+    if (!JsonReader(message).read(request)) {
+        send("{\"jsonrpc\":\"2.0\",\"id\":null,\"error\":{\"code\":-32700,\"message\":\"Parse error\"}}");
+        return;
+    }
+
+    const std::string& method = request["method"].text;
+    const Json& idValue = request["id"];
+    std::string id = idValue.kind == Json::Kind::String ? ErrorHandler::quoteJson(idValue.text) : idValue.text;
+    const Json& params = request["params"];
+    const std::string& uri = params["textDocument"]["uri"].text;
+
+    if (method == "initialize") {
+        respond(id, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+                    "\"hoverProvider\":true,\"definitionProvider\":true},"
+                    "\"serverInfo\":{\"name\":\"leic\"}}");
+    } else if (method == "shutdown") {
+        shutdown = true;
+        respond(id, "null");
+    } else if (method == "exit") {
+        exit = true;
+    } else if (method == "textDocument/didOpen") {
+        Document& doc = documents[uri];
+        doc.uri = uri;
+        doc.text = params["textDocument"]["text"].text;
+        rebuild(doc);
+        analyze(doc);
+        publishDiagnostics(doc);
+    } else if (method == "textDocument/didChange") {
+        auto found = documents.find(uri);
+        if (found == documents.end()) return;
+        Document& doc = found->second;
+        for (const Json& change : params["contentChanges"].items) {
+            const Json& range = change["range"];
+            if (range.isNull()) {
+                doc.text = change["text"].text;
+                rebuild(doc);
+            } else {
+                applyChange(doc, range["start"]["line"].asInt(), range["start"]["character"].asInt(),
+                            range["end"]["line"].asInt(), range["end"]["character"].asInt(), change["text"].text);
+            }
+        }
+        analyze(doc);
+        publishDiagnostics(doc);
+    } else if (method == "textDocument/didClose") {
+        send("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":" +
+             ErrorHandler::quoteJson(uri) + ",\"diagnostics\":[]}}");
+        documents.erase(uri);
+    } else if (method == "textDocument/hover" || method == "textDocument/definition") {
+        auto found = documents.find(uri);
+        int line = params["position"]["line"].asInt();
+        int character = params["position"]["character"].asInt();
+        if (found == documents.end()) {
+            respond(id, "null");
+        } else if (method == "textDocument/hover") {
+            respond(id, hover(found->second, line, character));
+        } else {
+            respond(id, definition(found->second, line, character));
+        }
+    } else if (!idValue.isNull()) {
+        send("{\"jsonrpc\":\"2.0\",\"id\":" + id + ",\"error\":{\"code\":-32601,\"message\":\"Method not found: " +
+             method + "\"}}");
+    }
+}
+
+void LanguageServer::indexLines(Document& doc) {
+    doc.lineStarts.assign(1, 0);
+    for (size_t i = 0; i < doc.text.size(); i++) {
+        if (doc.text[i] == '\n') doc.lineStarts.push_back(i + 1);
+    }
+}
+
+// Relexes the whole document and splits it into units
+void LanguageServer::rebuild(Document& doc) {
+    indexLines(doc);
+
+    ErrorHandler& errors = ErrorHandler::instance();
+    errors.clearAllErrors();
+    Lexer lexer(doc.text);
+    std::vector<Token> tokens = lexer.tokenize();
+    tokens.pop_back();  // END
+
+    doc.units.clear();
+    std::vector<size_t> starts = unitStarts(tokens);
+    for (size_t k = 0; k < starts.size(); k++) {
+        Unit unit;
+        unit.startLine = k == 0 ? 0 : tokens[starts[k]].line - 1;
+        size_t end = k + 1 < starts.size() ? starts[k + 1] : tokens.size();
+        for (size_t i = starts[k]; i < end; i++) {
+            unit.tokens.push_back(tokens[i]);
+            unit.tokens.back().line -= unit.startLine;
+        }
+        doc.units.push_back(std::move(unit));
+    }
+    for (size_t k = 0; k < doc.units.size(); k++) {
+        int next = k + 1 < doc.units.size() ? doc.units[k + 1].startLine : static_cast<int>(doc.lineStarts.size());
+        doc.units[k].lineCount = next - doc.units[k].startLine;
+    }
+
+    for (const auto& error : errors.getAllErrors()) {
+        for (auto& unit : doc.units) {
+            if (error.line - 1 < unit.startLine + unit.lineCount) {
+                unit.syntaxErrors.emplace_back(error.level, error.line - unit.startLine, error.column, error.message);
+                break;
+            }
+        }
+    }
+    doc.analyzeAll = true;
+}
+
+// Applies one edit. An edit inside a single unit relexes only that unit;
+// anything else, or an edit that changes where units begin, relexes it all.
+void LanguageServer::applyChange(Document& doc, int startLine, int startCharacter, int endLine, int endCharacter,
+                                 const std::string& text) {
+    // Positions are taken as byte offsets, which matches UTF-16 for ASCII sources
+    auto offset = [&doc](int line, int character) {
+        if (line < 0) return size_t(0);
+        if (static_cast<size_t>(line) >= doc.lineStarts.size()) return doc.text.size();
+        size_t lineEnd = static_cast<size_t>(line) + 1 < doc.lineStarts.size()
+                             ? doc.lineStarts[line + 1] - 1 : doc.text.size();
+        return std::min(doc.lineStarts[line] + std::max(character, 0), lineEnd);
+    };
+    size_t from = offset(startLine, startCharacter);
+    size_t to = std::max(from, offset(endLine, endCharacter));
+    int lineDelta = static_cast<int>(std::count(text.begin(), text.end(), '\n')) -
+                    static_cast<int>(std::count(doc.text.begin() + from, doc.text.begin() + to, '\n'));
+
+    size_t unit = doc.units.size();
+    for (size_t k = 0; k < doc.units.size(); k++) {
+        const Unit& candidate = doc.units[k];
+        if (candidate.startLine <= startLine && endLine < candidate.startLine + candidate.lineCount) {
+            unit = k;
+            break;
+        }
+    }
+
+    doc.text.replace(from, to - from, text);
+    indexLines(doc);
+
+    if (unit >= doc.units.size() || !relexUnit(doc, unit, lineDelta)) {
+        rebuild(doc);
+    }
+}
+
+bool LanguageServer::relexUnit(Document& doc, size_t index, int lineDelta) {
+    Unit& unit = doc.units[index];
+    int lineCount = unit.lineCount + lineDelta;
+    if (lineCount <= 0) return false;
+
+    size_t begin = doc.lineStarts[unit.startLine];
+    size_t endLine = static_cast<size_t>(unit.startLine + lineCount);
+    size_t end = endLine < doc.lineStarts.size() ? doc.lineStarts[endLine] : doc.text.size();
+    std::string slice = doc.text.substr(begin, end - begin);
+
+    // Lexical errors such as an open string may swallow what follows, and the
+    // unit boundaries must stay where they were
+    ErrorHandler& errors = ErrorHandler::instance();
+    errors.clearAllErrors();
+    Lexer lexer(slice);
+    std::vector<Token> tokens = lexer.tokenize();
+    tokens.pop_back();  // END
+    bool last = index + 1 == doc.units.size();
+    if (errors.hasErrors() || tokens.empty() || unitStarts(tokens).size() != 1 ||
+        (index > 0 && !beginsDeclaration(tokens.front())) || (!last && !endsDeclaration(tokens))) {
+        return false;
+    }
+
+    unit.tokens = std::move(tokens);
+    unit.lineCount = lineCount;
+    unit.syntaxErrors.clear();
+    unit.reparse = true;
+    for (size_t k = index + 1; k < doc.units.size(); k++) {
+        doc.units[k].startLine += lineDelta;
+    }
+    return true;
+}
+
+void LanguageServer::parseUnit(Unit& unit) {
+    std::vector<Token> tokens = unit.tokens;
+    for (Token& token : tokens) {
+        token.line += unit.startLine;
+    }
+    int endLine = tokens.empty() ? unit.startLine + 1 : tokens.back().line;
+    tokens.emplace_back(END, "", endLine, tokens.empty() ? 1 : tokens.back().column + 1);
+
+    ErrorHandler& errors = ErrorHandler::instance();
+    errors.clearAllErrors();
+    Parser parser(tokens);
+    auto program = parser.parse();
+
+    unit.syntaxErrors.erase(std::remove_if(unit.syntaxErrors.begin(), unit.syntaxErrors.end(),
+                                           [](const ErrorHandler::Error& e) { return e.level == ErrorLevel::SYNTAX; }),
+                            unit.syntaxErrors.end());
+    for (const auto& error : errors.getAllErrors()) {
+        unit.syntaxErrors.emplace_back(error.level, error.line - unit.startLine, error.column, error.message);
+    }
+
+    unit.ast = unit.syntaxErrors.empty() ? std::move(program) : nullptr;
+    unit.astStartLine = unit.startLine;
+    unit.reparse = false;
+    unit.fresh = true;
+    unit.reanalyze = true;
+
+    unit.calls.clear();
+    for (size_t i = 0; i + 1 < unit.tokens.size(); i++) {
+        if (unit.tokens[i].type == IDENTIFIER && unit.tokens[i + 1].type == LPAREN) {
+            unit.calls.insert(unit.tokens[i].value);
+        }
+    }
+}
+
+void LanguageServer::analyze(Document& doc) {
+    for (auto& unit : doc.units) {
+        if (unit.reparse) parseUnit(unit);
+    }
+
+    // Semantic results would describe a program that no longer parses, so the
+    // previous ones stay until every unit parses again
+    for (const auto& unit : doc.units) {
+        if (!unit.ast) return;
+    }
+
+    // Bodies to revisit: edited units, and the callers of any whose
+    // signature changed. New or removed names can resolve anywhere.
+    for (const auto& unit : doc.units) {
+        if (unit.reanalyze && declaredNames(*unit.ast) != unit.names) {
+            doc.analyzeAll = true;
+        }
+    }
+    std::unordered_set<std::string> changed;
+    for (auto& unit : doc.units) {
+        if (!doc.analyzeAll && unit.reanalyze && signatureOf(*unit.ast) != unit.signature) {
+            for (const auto& func : unit.ast->functions) changed.insert(func->name.value);
+        }
+    }
+    for (auto& unit : doc.units) {
+        if (doc.analyzeAll || analyzedEveryPass(*unit.ast)) {
+            unit.reanalyze = true;
+        }
+        for (const auto& name : changed) {
+            if (unit.calls.count(name)) unit.reanalyze = true;
+        }
+    }
+
+    // Bodies about to be analyzed need a fresh AST, since analysis rewrites
+    // calls to generics. The others only contribute their signatures, whose
+    // tokens are moved to the unit's current position.
+    for (auto& unit : doc.units) {
+        if (unit.reanalyze && !unit.fresh) {
+            parseUnit(unit);
+        } else if (!unit.reanalyze && unit.astStartLine != unit.startLine) {
+            int delta = unit.startLine - unit.astStartLine;
+            for (auto& func : unit.ast->functions) {
+                func->name.line += delta;
+                func->loc.line += delta;
+                for (auto& parameter : func->parameters) parameter.name.line += delta;
+            }
+            unit.astStartLine = unit.startLine;
+        }
+    }
+
+    std::vector<std::unique_ptr<FunctionDecl>> functions;
+    std::vector<std::unique_ptr<VarDeclStmt>> globals;
+    std::unordered_set<std::string> bodies;
+    for (auto& unit : doc.units) {
+        for (auto& func : unit.ast->functions) {
+            if (unit.reanalyze) bodies.insert(func->name.value);
+            functions.push_back(std::move(func));
+        }
+        for (auto& global : unit.ast->globals) {
+            globals.push_back(std::move(global));
+        }
+    }
+    Program program(std::move(functions), Token(END, "", 1, 1));
+    program.globals = std::move(globals);
+
+    ErrorHandler& errors = ErrorHandler::instance();
+    errors.clearAllErrors();
+    std::vector<SymbolBinding> bindings;
+    SemanticAnalyzer analyzer;
+    analyzer.setBodyFilter(doc.analyzeAll ? nullptr : &bodies);
+    analyzer.setBindingRecorder(&bindings);
+    analyzer.analyze(&program);
+
+    // Declarations go back to their units; generic instances are dropped
+    size_t nextFunction = 0;
+    size_t nextGlobal = 0;
+    for (auto& unit : doc.units) {
+        for (auto& func : unit.ast->functions) func = std::move(program.functions[nextFunction++]);
+        for (auto& global : unit.ast->globals) global = std::move(program.globals[nextGlobal++]);
+    }
+
+    // Results of skipped bodies are kept; their signatures were rechecked,
+    // but nothing they depend on changed
+    auto unitAt = [&doc](int line) -> Unit* {
+        auto after = std::upper_bound(doc.units.begin(), doc.units.end(), line - 1,
+                                      [](int target, const Unit& unit) { return target < unit.startLine; });
+        if (after == doc.units.begin()) return nullptr;
+        Unit& unit = *std::prev(after);
+        return line - 1 < unit.startLine + unit.lineCount ? &unit : nullptr;
+    };
+    for (auto& unit : doc.units) {
+        if (!unit.reanalyze) continue;
+        unit.diagnostics.clear();
+        unit.bindings.clear();
+    }
+    doc.programErrors.clear();
+    for (const auto& error : errors.getAllErrors()) {
+        Unit* unit = error.line > 0 ? unitAt(error.line) : nullptr;
+        if (!unit) {
+            doc.programErrors.push_back(error);
+        } else if (unit->reanalyze) {
+            unit->diagnostics.emplace_back(error.level, error.line - unit->startLine, error.column, error.message);
+        }
+    }
+    for (auto& binding : bindings) {
+        Unit* unit = unitAt(binding.name.line);
+        if (!unit || !unit->reanalyze) continue;
+        binding.name.line -= unit->startLine;
+        if (!binding.isGlobal && binding.declarationLine > 0) {
+            binding.declarationLine -= unit->startLine;
+        }
+        unit->bindings.push_back(std::move(binding));
+    }
+
+    for (auto& unit : doc.units) {
+        if (!unit.reanalyze) continue;
+        unit.names = declaredNames(*unit.ast);
+        unit.signature = signatureOf(*unit.ast);
+        unit.fresh = false;
+        unit.reanalyze = false;
+    }
+    doc.analyzeAll = false;
+}
+
+void LanguageServer::publishDiagnostics(const Document& doc) {
+    // Diagnostics cover the identifier or number they point at
+    auto range = [&doc](int line, int column) {
+        int character = std::max(column - 1, 0);
+        int length = 1;
+        if (line >= 0 && static_cast<size_t>(line) < doc.lineStarts.size()) {
+            size_t start = doc.lineStarts[line] + character;
+            size_t end = start;
+            while (end < doc.text.size() && (std::isalnum(static_cast<unsigned char>(doc.text[end])) || doc.text[end] == '_')) {
+                end++;
+            }
+            length = std::max<int>(1, static_cast<int>(end - start));
+        }
+        return "{\"start\":" + position(line, character) + ",\"end\":" + position(line, character + length) + "}";
+    };
+
+    std::ostringstream body;
+    body << "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":"
+         << ErrorHandler::quoteJson(doc.uri) << ",\"diagnostics\":[";
+    bool first = true;
+    auto add = [&](const ErrorHandler::Error& error, int startLine) {
+        int line = error.line > 0 ? startLine + error.line - 1 : 0;
+        body << (first ? "" : ",") << "{\"range\":" << range(line, error.line > 0 ? error.column : 1)
+             << ",\"severity\":1,\"source\":\"leic\",\"message\":"
+             << ErrorHandler::quoteJson(ErrorHandler::getLevelString(error.level) + ": " + error.message) << "}";
+        first = false;
+    };
+    for (const auto& error : doc.programErrors) add(error, 0);
+    for (const auto& unit : doc.units) {
+        for (const auto& error : unit.syntaxErrors) add(error, unit.startLine);
+        for (const auto& error : unit.diagnostics) add(error, unit.startLine);
+    }
+    body << "]}}";
+    send(body.str());
+}
+
+const SymbolBinding* LanguageServer::bindingAt(const Document& doc, int line, int character, const Unit** owner) const {
+    for (const auto& unit : doc.units) {
+        if (line < unit.startLine || line >= unit.startLine + unit.lineCount) continue;
+        int relativeLine = line - unit.startLine + 1;
+        int column = character + 1;
+        for (const auto& binding : unit.bindings) {
+            if (binding.name.line == relativeLine && column >= binding.name.column &&
+                column < binding.name.column + static_cast<int>(binding.name.value.size())) {
+                *owner = &unit;
+                return &binding;
+            }
+        }
+        return nullptr;
+    }
+    return nullptr;
+}
+
+std::string LanguageServer::hover(const Document& doc, int line, int character) const {
+    const Unit* unit = nullptr;
+    const SymbolBinding* binding = bindingAt(doc, line, character, &unit);
+    if (!binding) return "null";
+
+    std::string text = binding->kind == Symbol::Kind::FUNCTION
+        ? formatFunction(binding->name.value, binding->type, binding->parameters)
+        : (binding->isGlobal ? "global " : "") + binding->name.value + ": " + formatType(binding->type);
+    return "{\"contents\":{\"kind\":\"markdown\",\"value\":" + ErrorHandler::quoteJson("```lei\n" + text + "\n```") + "}}";
+}
+
+std::string LanguageServer::definition(const Document& doc, int line, int character) const {
+    const Unit* unit = nullptr;
+    const SymbolBinding* binding = bindingAt(doc, line, character, &unit);
+    if (!binding || binding->declarationLine == 0) return "null";
+
+    auto location = [&doc](int targetLine, int column, size_t length) {
+        int character = column - 1;
+        return "{\"uri\":" + ErrorHandler::quoteJson(doc.uri) + ",\"range\":{\"start\":" + position(targetLine, character) +
+               ",\"end\":" + position(targetLine, character + static_cast<int>(length)) + "}}";
+    };
+
+    if (!binding->isGlobal) {
+        return location(unit->startLine + binding->declarationLine - 1, binding->declarationColumn,
+                        binding->name.value.size());
+    }
+
+    // Global declarations may have moved since the binding was recorded
+    const std::string& name = binding->name.value;
+    for (const auto& candidate : doc.units) {
+        if (!candidate.ast) continue;
+        int delta = candidate.startLine - candidate.astStartLine;
+        for (const auto& func : candidate.ast->functions) {
+            if (func->name.value == name) return location(func->name.line + delta - 1, func->name.column, name.size());
+        }
+        for (const auto& global : candidate.ast->globals) {
+            if (global->name.value == name) return location(global->name.line + delta - 1, global->name.column, name.size());
+        }
+    }
+    return "null";
+}
+
+} // namespace Lei
@@ -0,0 +1,84 @@
+#ifndef LANGUAGE_SERVER_H
+#define LANGUAGE_SERVER_H
+
+#include "ast.h"
+#include "error_handler.h"
+#include "semantic_visitor.h"
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace Lei {
+
+// Language Server Protocol over stdio: diagnostics, hover and go to definition.
+//
+// A document is kept as a list of units, one per top-level function or global,
+// each with its own tokens, AST and analysis results. Token lines are stored
+// relative to the unit, so an edit inside one function relexes and reparses
+// only that function and moves the units below it by changing their start
+// line. Semantic analysis still declares every signature but revisits only
+// the bodies of edited functions, plus their callers when a signature changed.
+class LanguageServer {
+public:
+    // Serves requests until 'exit'; returns the process exit code
+    int run(std::istream& in, std::ostream& out);
+
+private:
+    struct Unit {
+        int startLine = 0;                 // First document line, 0-based
+        int lineCount = 0;
+        std::vector<Token> tokens;         // Lines relative to the unit, 1-based
+        std::vector<ErrorHandler::Error> syntaxErrors;  // Lexical and syntax, relative lines
+
+        std::unique_ptr<Program> ast;      // Null while the unit does not parse
+        int astStartLine = 0;              // startLine when the AST lines were last set
+        bool reparse = true;               // AST needs rebuilding from the tokens
+        bool fresh = false;                // AST not yet changed by analysis
+        bool reanalyze = true;             // Body needs semantic analysis
+
+        std::string names;                 // Declared names, as of the last analysis
+        std::string signature;
+        std::unordered_set<std::string> calls;
+        std::vector<ErrorHandler::Error> diagnostics;  // Semantic, relative lines
+        std::vector<SymbolBinding> bindings;           // Use lines relative
+    };
+
+    struct Document {
+        std::string uri;
+        std::string text;
+        std::vector<size_t> lineStarts;
+        std::vector<Unit> units;
+        std::vector<ErrorHandler::Error> programErrors;  // Not tied to a line
+        bool analyzeAll = true;
+    };
+
+    std::map<std::string, Document> documents;
+    std::ostream* output = nullptr;
+
+    void send(const std::string& body);
+    void respond(const std::string& id, const std::string& result);
+    void handle(const std::string& message, bool& shutdown, bool& exit);
+
+    // Document maintenance
+    void indexLines(Document& doc);
+    void rebuild(Document& doc);
+    void applyChange(Document& doc, int startLine, int startCharacter, int endLine, int endCharacter,
+                     const std::string& text);
+    bool relexUnit(Document& doc, size_t index, int lineDelta);
+    void parseUnit(Unit& unit);
+    void analyze(Document& doc);
+    void publishDiagnostics(const Document& doc);
+
+    // Queries, positions 0-based
+    const SymbolBinding* bindingAt(const Document& doc, int line, int character, const Unit** owner) const;
+    std::string hover(const Document& doc, int line, int character) const;
+    std::string definition(const Document& doc, int line, int character) const;
+};
+
+} // namespace Lei
+
+#endif // LANGUAGE_SERVER_H
@@ -17,6 +17,21 @@ const std::unordered_map<std::string, TokenType> keywords = {
     {"if", IF},
     {"else", ELSE},
     {"while", WHILE},
+    {"const", CONST},
+    {"threadlocal", THREADLOCAL},
+    {"parallel", PARALLEL},
+    {"for", FOR},
+    {"in", IN},
+    {"reduce", REDUCE},
+    {"spawn", SPAWN},
+    {"sync", SYNC},
+    {"chan", CHAN},
+    {"go", GO},
+    {"atomic", ATOMIC},
+    {"match", MATCH},
+    {"gen", GEN},
+    {"yield", YIELD},
+    {"bench", BENCH},
     {"true", BOOL_LITERAL},
     {"false", BOOL_LITERAL}
 };
@@ -25,18 +40,21 @@ Token::Token(TokenType t, const std::string& v, int l, int c)
     : type(t), value(v), line(l), column(c) {}
 
 Lexer::Lexer(const std::string& code)
-    : input(code), pos(0), line(1), column(1) {}
+    : input(code), pos(0), end(code.size()), line(1), column(1) {}
+
+Lexer::Lexer(const std::string& code, size_t begin, size_t stop, int firstLine)
+    : input(code), pos(begin), end(std::min(stop, code.size())), line(firstLine), column(1) {}
 
 char Lexer::peek() const {
-    return pos < input.size() ? input[pos] : '\0';
+    return pos < end ? input[pos] : '\0';
 }
 
 char Lexer::peekNext() const {
-    return (pos + 1) < input.size() ? input[pos + 1] : '\0';
+    return (pos + 1) < end ? input[pos + 1] : '\0';
 }
 
 void Lexer::advance() {
-    if (pos < input.size()) {
+    if (pos < end) {
         if (input[pos] == '\n') {
             line++;
             column = 1;
@@ -50,7 +68,7 @@ void Lexer::advance() {
 std::string Lexer::getCurrentContext() const {
     const size_t contextSize = 20;
     size_t start = (pos > contextSize) ? pos - contextSize : 0;
-    size_t length = std::min(contextSize * 2, input.size() - start);
+    size_t length = std::min(contextSize * 2, end - start);
     std::string context = input.substr(start, length);
     
     if (pos - start < context.length()) {
@@ -60,7 +78,7 @@ std::string Lexer::getCurrentContext() const {
 }
 
 void Lexer::skipWhitespaceAndComments() {
-    while (pos < input.size()) {
+    while (pos < end) {
         char current = peek();
         
         if (std::isspace(current)) {
@@ -68,10 +86,10 @@ void Lexer::skipWhitespaceAndComments() {
         }
         else if (current == '/' && peekNext() == '/') {
             // Skip until end of line
-            while (pos < input.size() && peek() != '\n') {
+            while (pos < end && peek() != '\n') {
                 advance();
             }
-            if (pos < input.size()) {
+            if (pos < end) {
                 advance(); // Skip the newline
             }
         }
@@ -86,7 +104,7 @@ Token Lexer::handleIdentifier() {
     int startLine = line;
     int startColumn = column;
     
-    while (pos < input.size() && (std::isalnum(peek()) || peek() == '_')) {
+    while (pos < end && (std::isalnum(peek()) || peek() == '_')) {
         word += peek();
         advance();
     }
@@ -106,7 +124,11 @@ Token Lexer::handleNumber() {
     bool isFloat = false;
     bool hasDigitsAfterDot = false;
     
-    while (pos < input.size() && (std::isdigit(peek()) || peek() == '.')) {
+    while (pos < end && (std::isdigit(peek()) || peek() == '.')) {
+        // '..' ends an integer range bound such as '0..n'
+        if (peek() == '.' && peekNext() == '.' && !isFloat) {
+            break;
+        }
         if (peek() == '.') {
             if (isFloat) {
                 ErrorHandler::instance().error(
@@ -159,9 +181,9 @@ Token Lexer::handleString() {
     
     advance(); // Skip opening quote
     
-    while (pos < input.size() && peek() != '"') {
+    while (pos < end && peek() != '"') {
         if (peek() == '\\') {
-            if (pos + 1 >= input.size()) {
+            if (pos + 1 >= end) {
                 ErrorHandler::instance().error(
                     ErrorLevel::LEXICAL,
                     line, column,
@@ -197,7 +219,7 @@ Token Lexer::handleString() {
         advance();
     }
     
-    if (pos >= input.size()) {
+    if (pos >= end) {
         ErrorHandler::instance().error(
             ErrorLevel::LEXICAL,
             startLine, startColumn,
@@ -213,10 +235,10 @@ Token Lexer::handleString() {
 std::vector<Token> Lexer::tokenize() {
     std::vector<Token> tokens;
     
-    while (pos < input.size()) {
+    while (pos < end) {
         skipWhitespaceAndComments();
         
-        if (pos >= input.size()) break;
+        if (pos >= end) break;
         
         int startLine = line;
         int startColumn = column;
@@ -281,6 +303,9 @@ std::vector<Token> Lexer::tokenize() {
                     if (peek() == '=') {
                         advance();
                         token = Token(EQUALS_EQUALS, "==", startLine, startColumn);
+                    } else if (peek() == '>') {
+                        advance();
+                        token = Token(FAT_ARROW, "=>", startLine, startColumn);
                     } else {
                         token = Token(EQUALS, "=", startLine, startColumn);
                     }
@@ -350,6 +375,21 @@ std::vector<Token> Lexer::tokenize() {
                 case ';': token = Token(SEMICOLON, ";", startLine, startColumn); break;
                 case ':': token = Token(COLON, ":", startLine, startColumn); break;
                 case ',': token = Token(COMMA, ",", startLine, startColumn); break;
+                case '@': token = Token(AT, "@", startLine, startColumn); break;
+
+                case '.':
+                    if (peek() == '.') {
+                        advance();
+                        token = Token(DOT_DOT, "..", startLine, startColumn);
+                    } else {
+                        ErrorHandler::instance().error(
+                            ErrorLevel::LEXICAL,
+                            startLine, startColumn,
+                            "Expected '..' for range operator"
+                        );
+                        validToken = false;
+                    }
+                    break;
                     
                 default:
                     ErrorHandler::instance().error(
@@ -12,6 +12,7 @@ class Lexer {
 private:
     const std::string& input;  ///< Input source code
     size_t pos;               ///< Current position in input
+    size_t end;               ///< Position where lexing stops
     int line;                ///< Current line number
     int column;              ///< Current column number
 
@@ -27,6 +28,10 @@ private:
 
 public:
     explicit Lexer(const std::string& code);
+
+    /// Lexes code[begin, stop), which starts at the beginning of line firstLine,
+    /// so token positions match the whole source
+    Lexer(const std::string& code, size_t begin, size_t stop, int firstLine);
     std::vector<Token> tokenize();
 };
 
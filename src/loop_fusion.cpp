@@ -0,0 +1,530 @@
+#include "loop_fusion.h"
+#include "const_evaluator.h"
+#include <cstdlib>
+#include <map>
+#include <unordered_set>
+
+namespace Lei {
+
+namespace {
+
+bool isVariable(Expr* expr, const std::string& name) {
+    auto* var = dynamic_cast<VariableExpr*>(expr);
+    return var && var->name.value == name;
+}
+
+bool isOne(Expr* expr) {
+    auto* number = dynamic_cast<NumberExpr*>(expr);
+    return number && !number->isFloat && number->token.value == "1";
+}
+
+bool sameExpr(Expr* a, Expr* b) {
+    if (auto* number = dynamic_cast<NumberExpr*>(a)) {
+        auto* other = dynamic_cast<NumberExpr*>(b);
+        return other && other->isFloat == number->isFloat && other->token.value == number->token.value;
+    }
+    if (auto* var = dynamic_cast<VariableExpr*>(a)) {
+        return isVariable(b, var->name.value);
+    }
+    if (auto* binary = dynamic_cast<BinaryExpr*>(a)) {
+        auto* other = dynamic_cast<BinaryExpr*>(b);
+        return other && other->op.type == binary->op.type && sameExpr(binary->left.get(), other->left.get()) &&
+               sameExpr(binary->right.get(), other->right.get());
+    }
+    if (auto* unary = dynamic_cast<UnaryExpr*>(a)) {
+        auto* other = dynamic_cast<UnaryExpr*>(b);
+        return other && other->op.type == unary->op.type && sameExpr(unary->expr.get(), other->expr.get());
+    }
+    return false;
+}
+
+// Collects the variables of an expression made only of them, integer
+// literals and arithmetic, which then has no side effects and stays the same
+// as long as none of the variables is written
+bool collectOperands(Expr* expr, std::vector<std::string>& names) {
+    if (auto* number = dynamic_cast<NumberExpr*>(expr)) {
+        return !number->isFloat;
+    }
+    if (auto* var = dynamic_cast<VariableExpr*>(expr)) {
+        names.push_back(var->name.value);
+        return true;
+    }
+    if (auto* binary = dynamic_cast<BinaryExpr*>(expr)) {
+        TokenType op = binary->op.type;
+        return (op == PLUS || op == MINUS || op == STAR || op == SLASH) &&
+               collectOperands(binary->left.get(), names) && collectOperands(binary->right.get(), names);
+    }
+    if (auto* unary = dynamic_cast<UnaryExpr*>(expr)) {
+        return unary->op.type == MINUS && collectOperands(unary->expr.get(), names);
+    }
+    return false;
+}
+
+// 'v = v + 1;', 'v = 1 + v;' or 'v += 1;'
+bool isIncrement(Stmt* stmt, const std::string& variable) {
+    auto* exprStmt = dynamic_cast<ExprStmt*>(stmt);
+    auto* assign = exprStmt ? dynamic_cast<AssignExpr*>(exprStmt->expr.get()) : nullptr;
+    if (!assign || !isVariable(assign->target.get(), variable)) return false;
+    if (assign->op.type == PLUS_EQUALS) return isOne(assign->value.get());
+
+    auto* sum = dynamic_cast<BinaryExpr*>(assign->value.get());
+    return assign->op.type == EQUALS && sum && sum->op.type == PLUS &&
+           ((isVariable(sum->left.get(), variable) && isOne(sum->right.get())) ||
+            (isOne(sum->left.get()) && isVariable(sum->right.get(), variable)));
+}
+
+// An array index as scale * i + sum of loop-invariant terms + offset
+struct Affine {
+    bool known = false;
+    int64_t scale = 0;
+    std::map<std::string, int64_t> terms;
+    int64_t offset = 0;
+
+    bool isConstant() const { return known && scale == 0 && terms.empty(); }
+
+    Affine plus(const Affine& other, int64_t sign) const {
+        Affine sum;
+        if (!known || !other.known) return sum;
+        sum = *this;
+        sum.scale += sign * other.scale;
+        sum.offset += sign * other.offset;
+        for (const auto& term : other.terms) {
+            if ((sum.terms[term.first] += sign * term.second) == 0) sum.terms.erase(term.first);
+        }
+        return sum;
+    }
+
+    Affine times(int64_t factor) const {
+        Affine product = *this;
+        product.scale *= factor;
+        product.offset *= factor;
+        for (auto it = product.terms.begin(); it != product.terms.end();) {
+            if ((it->second *= factor) == 0) {
+                it = product.terms.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return product;
+    }
+};
+
+struct Access {
+    std::string array;  // Empty when the array is not a plain variable
+    bool fixed;         // A fixed-size array, which has storage of its own
+    Affine index;
+    bool write;
+};
+
+} // namespace
+
+// Everything about one loop body that fusing it with another loop could
+// change: the scalars it reads and writes, the array elements it touches
+// and whether it prints. Variables declared inside the body are private to
+// an iteration and are left out.
+class LoopFusion::BodySummary : public Visitor {
+public:
+    std::unordered_set<std::string> reads;
+    std::unordered_set<std::string> writes;
+    std::vector<Access> accesses;
+    bool blocked = false;  // Contains something that must not be reordered
+    bool prints = false;
+
+    BodySummary(LoopFusion& fusion, const std::string& induction) : fusion(fusion), induction(induction) {}
+
+    // Summarizes a loop body without its trailing increment
+    void summarize(BlockStmt* body) {
+        privates.emplace_back();
+        for (size_t i = 0; i + 1 < body->statements.size(); i++) {
+            body->statements[i]->accept(this);
+        }
+        privates.pop_back();
+    }
+
+    void visit(Program*) override { blocked = true; }
+    void visit(FunctionDecl*) override { blocked = true; }
+    void visit(NumberExpr*) override {}
+    void visit(StringExpr*) override {}
+    void visit(BoolExpr*) override {}
+    void visit(TypeExpr*) override {}
+
+    void visit(VariableExpr* node) override {
+        if (!findPrivate(node->name.value)) reads.insert(node->name.value);
+    }
+
+    void visit(ArrayAccessExpr* node) override {
+        record(node, false);
+        node->array->accept(this);
+        node->index->accept(this);
+    }
+
+    void visit(BinaryExpr* node) override {
+        node->left->accept(this);
+        node->right->accept(this);
+    }
+
+    void visit(UnaryExpr* node) override {
+        node->expr->accept(this);
+    }
+
+    void visit(AssignExpr* node) override {
+        bool compound = node->op.type != EQUALS;
+        if (auto* var = dynamic_cast<VariableExpr*>(node->target.get())) {
+            const std::string& name = var->name.value;
+            if (name == induction) {
+                blocked = true;
+            } else if (!findPrivate(name)) {
+                writes.insert(name);
+                if (compound) reads.insert(name);
+            }
+        } else if (auto* access = dynamic_cast<ArrayAccessExpr*>(node->target.get())) {
+            record(access, true);
+            if (compound) record(access, false);
+            access->array->accept(this);
+            access->index->accept(this);
+        } else {
+            blocked = true;
+        }
+        node->value->accept(this);
+    }
+
+    void visit(CallExpr* node) override {
+        if (node->constValue) return;  // Folded at compile time
+        for (const auto& arg : node->arguments) {
+            arg->accept(this);
+        }
+        if (node->name.value == "print") {
+            prints = true;
+        } else if (!fusion.callable(node->name.value)) {
+            blocked = true;
+        }
+    }
+
+    void visit(ArrayInitExpr* node) override {
+        for (const auto& element : node->elements) {
+            element->accept(this);
+        }
+    }
+
+    void visit(ArrayAllocExpr* node) override {
+        node->size->accept(this);
+    }
+
+    void visit(SpawnExpr*) override { blocked = true; }
+    void visit(ChannelExpr*) override { blocked = true; }
+
+    void visit(ExprStmt* node) override {
+        node->expr->accept(this);
+    }
+
+    void visit(VarDeclStmt* node) override {
+        if (node->initializer) {
+            node->initializer->accept(this);
+        }
+        privates.back().emplace(node->name.value, node->type);
+    }
+
+    void visit(BlockStmt* node) override {
+        privates.emplace_back();
+        for (const auto& stmt : node->statements) {
+            stmt->accept(this);
+        }
+        privates.pop_back();
+    }
+
+    void visit(IfStmt* node) override {
+        node->condition->accept(this);
+        node->thenBranch->accept(this);
+        if (node->elseBranch) {
+            node->elseBranch->accept(this);
+        }
+    }
+
+    void visit(WhileStmt* node) override {
+        node->condition->accept(this);
+        node->body->accept(this);
+    }
+
+    void visit(MatchStmt* node) override {
+        node->subject->accept(this);
+        for (const auto& arm : node->arms) {
+            arm.body->accept(this);
+        }
+    }
+
+    void visit(ParallelForStmt*) override { blocked = true; }
+    void visit(SyncStmt*) override { blocked = true; }
+    void visit(GoStmt*) override { blocked = true; }
+    void visit(ForInStmt*) override { blocked = true; }
+    void visit(YieldStmt*) override { blocked = true; }
+    void visit(BenchStmt*) override { blocked = true; }
+    void visit(ReturnStmt*) override { blocked = true; }
+
+private:
+    LoopFusion& fusion;
+    const std::string& induction;
+    std::vector<std::unordered_map<std::string, Type>> privates;
+
+    const Type* findPrivate(const std::string& name) const {
+        for (auto it = privates.rbegin(); it != privates.rend(); ++it) {
+            auto found = it->find(name);
+            if (found != it->end()) return &found->second;
+        }
+        return nullptr;
+    }
+
+    void record(ArrayAccessExpr* node, bool write) {
+        Access access{ "", false, affine(node->index.get()), write };
+        if (auto* var = dynamic_cast<VariableExpr*>(node->array.get())) {
+            const Type* type = findPrivate(var->name.value);
+            if (type && type->isFixedArray()) return;  // Storage of this iteration alone
+            if (!type) type = fusion.findType(var->name.value);
+            access.array = var->name.value;
+            access.fixed = type && type->isFixedArray();
+        }
+        accesses.push_back(std::move(access));
+    }
+
+    Affine affine(Expr* expr) const {
+        Affine result;
+        if (auto* number = dynamic_cast<NumberExpr*>(expr)) {
+            if (number->isFloat) return result;
+            result.known = true;
+            result.offset = std::strtoll(number->token.value.c_str(), nullptr, 10);
+        } else if (auto* var = dynamic_cast<VariableExpr*>(expr)) {
+            if (findPrivate(var->name.value)) return result;  // Differs between iterations
+            result.known = true;
+            if (var->name.value == induction) {
+                result.scale = 1;
+            } else {
+                result.terms[var->name.value] = 1;
+            }
+        } else if (auto* binary = dynamic_cast<BinaryExpr*>(expr)) {
+            Affine left = affine(binary->left.get());
+            Affine right = affine(binary->right.get());
+            if (binary->op.type == PLUS) return left.plus(right, 1);
+            if (binary->op.type == MINUS) return left.plus(right, -1);
+            if (binary->op.type == STAR && left.known && right.known) {
+                if (left.isConstant()) return right.times(left.offset);
+                if (right.isConstant()) return left.times(right.offset);
+            }
+        } else if (auto* unary = dynamic_cast<UnaryExpr*>(expr)) {
+            if (unary->op.type == MINUS) return affine(unary->expr.get()).times(-1);
+        }
+        return result;
+    }
+};
+
+namespace {
+
+// Whether, with both loops running in lockstep, every element the second
+// access reaches at iteration i is reached by the first by iteration i too.
+// With equal positive scales that holds exactly when the second offset is
+// not ahead of the first.
+bool inOrder(const Affine& first, const Affine& second, const std::unordered_set<std::string>& written) {
+    if (!first.known || !second.known || first.scale <= 0 || first.scale != second.scale ||
+        first.terms != second.terms) {
+        return false;
+    }
+    for (const auto& term : first.terms) {
+        if (written.count(term.first)) return false;
+    }
+    return second.offset <= first.offset;
+}
+
+} // namespace
+
+LoopFusion::LoopFusion(const std::unordered_map<std::string, FunctionDecl*>& functions, SymbolTable& symbolTable)
+    : symbolTable(symbolTable), purity(functions, symbolTable), functions(functions) {}
+
+int LoopFusion::run(FunctionDecl* function) {
+    if (!function->body || function->isGeneric()) return 0;
+
+    fused = 0;
+    locals.clear();
+    locals.emplace_back();
+    for (const auto& param : function->parameters) {
+        locals.back().emplace(param.name.value, param.type);
+    }
+    fuseBlock(function->body.get());
+    locals.clear();
+    return fused;
+}
+
+bool LoopFusion::callable(const std::string& name) {
+    if (ConstEvaluator::isPureBuiltin(name) || name == "sizeof" || name == "itoa" || name == "ftoa") {
+        return true;
+    }
+
+    // Pure functions read no memory but their arguments, so scalar ones only
+    auto callee = functions.find(name);
+    if (callee == functions.end() || !callee->second->body) return false;
+    for (const auto& param : callee->second->parameters) {
+        if (param.type.isArray || param.type.name == "str") return false;
+    }
+    std::string reason;
+    return purity.isPure(callee->second, reason);
+}
+
+const Type* LoopFusion::findType(const std::string& name) const {
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+        auto found = it->find(name);
+        if (found != it->end()) return &found->second;
+    }
+    Symbol* global = symbolTable.resolveGlobal(name);
+    return global && global->kind == Symbol::Kind::VARIABLE ? &global->type : nullptr;
+}
+
+void LoopFusion::fuseIn(Stmt* stmt) {
+    if (auto* block = dynamic_cast<BlockStmt*>(stmt)) {
+        fuseBlock(block);
+    } else if (auto* ifStmt = dynamic_cast<IfStmt*>(stmt)) {
+        fuseIn(ifStmt->thenBranch.get());
+        if (ifStmt->elseBranch) fuseIn(ifStmt->elseBranch.get());
+    } else if (auto* whileStmt = dynamic_cast<WhileStmt*>(stmt)) {
+        fuseIn(whileStmt->body.get());
+    } else if (auto* parallel = dynamic_cast<ParallelForStmt*>(stmt)) {
+        locals.emplace_back();
+        locals.back().emplace(parallel->variable.value, Type("int"));
+        fuseBlock(parallel->body.get());
+        locals.pop_back();
+    } else if (auto* forIn = dynamic_cast<ForInStmt*>(stmt)) {
+        locals.emplace_back();
+        locals.back().emplace(forIn->variable.value, Type(""));
+        fuseBlock(forIn->body.get());
+        locals.pop_back();
+    } else if (auto* match = dynamic_cast<MatchStmt*>(stmt)) {
+        for (auto& arm : match->arms) {
+            fuseBlock(arm.body.get());
+        }
+    } else if (auto* bench = dynamic_cast<BenchStmt*>(stmt)) {
+        fuseBlock(bench->body.get());
+    }
+}
+
+void LoopFusion::fuseBlock(BlockStmt* block) {
+    locals.emplace_back();
+    auto& statements = block->statements;
+    for (size_t k = 0; k < statements.size(); k++) {
+        if (auto* decl = dynamic_cast<VarDeclStmt*>(statements[k].get())) {
+            locals.back().erase(decl->name.value);
+            locals.back().emplace(decl->name.value, decl->type);
+        }
+        fuseIn(statements[k].get());
+
+        // The statement just seen may be the second of two loops; a fused
+        // loop takes the place of the first, and may absorb the next one
+        if (k >= 3 && tryFuse(statements, k - 3)) {
+            k -= 2;
+        }
+    }
+    locals.pop_back();
+}
+
+// statements[first] to [first + 3] as 'i = s; while i < n { A; i = i + 1; }
+// i = s; while i < n { B; i = i + 1; }', with the first assignment possibly
+// a declaration, become 'i = s; while i < n { { A } { B } i = i + 1; }'
+bool LoopFusion::tryFuse(std::vector<std::unique_ptr<Stmt>>& statements, size_t first) {
+    auto* loop1 = dynamic_cast<WhileStmt*>(statements[first + 1].get());
+    auto* loop2 = dynamic_cast<WhileStmt*>(statements[first + 3].get());
+    if (!loop1 || !loop2) return false;
+
+    // Both loops start the same int variable at the same value
+    std::string induction;
+    Expr* start = nullptr;
+    if (auto* decl = dynamic_cast<VarDeclStmt*>(statements[first].get())) {
+        if (!decl->initializer || decl->type.name != "int" || decl->type.isArray) return false;
+        induction = decl->name.value;
+        start = decl->initializer.get();
+    } else {
+        auto* init = dynamic_cast<ExprStmt*>(statements[first].get());
+        auto* assign = init ? dynamic_cast<AssignExpr*>(init->expr.get()) : nullptr;
+        auto* var = assign ? dynamic_cast<VariableExpr*>(assign->target.get()) : nullptr;
+        const Type* type = var ? findType(var->name.value) : nullptr;
+        if (!type || assign->op.type != EQUALS || type->name != "int" || type->isArray) return false;
+        induction = var->name.value;
+        start = assign->value.get();
+    }
+    auto* reinit = dynamic_cast<ExprStmt*>(statements[first + 2].get());
+    auto* restart = reinit ? dynamic_cast<AssignExpr*>(reinit->expr.get()) : nullptr;
+    if (!restart || restart->op.type != EQUALS || !isVariable(restart->target.get(), induction) ||
+        !sameExpr(start, restart->value.get())) {
+        return false;
+    }
+
+    // ...run it up to the same bound...
+    auto* cond1 = dynamic_cast<BinaryExpr*>(loop1->condition.get());
+    auto* cond2 = dynamic_cast<BinaryExpr*>(loop2->condition.get());
+    if (!cond1 || !cond2 || (cond1->op.type != LESS && cond1->op.type != LESS_EQUAL) ||
+        cond2->op.type != cond1->op.type || !isVariable(cond1->left.get(), induction) ||
+        !isVariable(cond2->left.get(), induction) || !sameExpr(cond1->right.get(), cond2->right.get())) {
+        return false;
+    }
+
+    // ...and step it by one at the very end of the body
+    auto* body1 = dynamic_cast<BlockStmt*>(loop1->body.get());
+    auto* body2 = dynamic_cast<BlockStmt*>(loop2->body.get());
+    if (!body1 || !body2 || body1->statements.empty() || body2->statements.empty() ||
+        !isIncrement(body1->statements.back().get(), induction) ||
+        !isIncrement(body2->statements.back().get(), induction)) {
+        return false;
+    }
+
+    std::vector<std::string> invariants;
+    if (!collectOperands(start, invariants) || !collectOperands(cond1->right.get(), invariants)) {
+        return false;
+    }
+
+    BodySummary a(*this, induction);
+    BodySummary b(*this, induction);
+    a.summarize(body1);
+    b.summarize(body2);
+    if (a.blocked || b.blocked || (a.prints && b.prints)) return false;
+
+    // Start and bound must mean the same before, between and after the loops
+    std::unordered_set<std::string> written = a.writes;
+    written.insert(b.writes.begin(), b.writes.end());
+    for (const std::string& name : invariants) {
+        if (name == induction || written.count(name)) return false;
+    }
+
+    // A scalar written by one body must not be seen by the other, which
+    // would otherwise observe it mid-loop instead of before or after
+    for (const std::string& name : a.writes) {
+        if (b.reads.count(name) || b.writes.count(name)) return false;
+    }
+    for (const std::string& name : b.writes) {
+        if (a.reads.count(name)) return false;
+    }
+
+    // Elements one body writes and the other touches must be in order.
+    // Arrays with different names may share memory unless both are fixed.
+    for (const Access& x : a.accesses) {
+        for (const Access& y : b.accesses) {
+            if (!x.write && !y.write) continue;
+            bool alias = x.array.empty() || y.array.empty() || x.array == y.array || !(x.fixed && y.fixed);
+            if (alias && !inOrder(x.index, y.index, written)) return false;
+        }
+    }
+
+    std::unique_ptr<Stmt> increment = std::move(body1->statements.back());
+    body1->statements.pop_back();
+    body2->statements.pop_back();
+
+    std::vector<std::unique_ptr<Stmt>> merged;
+    merged.push_back(std::move(loop1->body));
+    merged.push_back(std::move(loop2->body));
+    merged.push_back(std::move(increment));
+    auto body = std::make_unique<BlockStmt>(std::move(merged), Token(LBRACE, "{", body1->loc.line, body1->loc.column));
+    for (const auto& stmt : body->statements) {
+        stmt->setParent(body.get());
+    }
+    body->setParent(loop1);
+    loop1->body = std::move(body);
+
+    statements.erase(statements.begin() + first + 2, statements.begin() + first + 4);
+    fused++;
+    return true;
+}
+
+} // namespace Lei
@@ -0,0 +1,51 @@
+#ifndef LOOP_FUSION_H
+#define LOOP_FUSION_H
+
+#include "ast.h"
+#include "purity_checker.h"
+#include "symbol_table.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Lei {
+
+// Merges adjacent counted loops over the same range into one loop, so
+// streaming array code walks memory once instead of once per loop.
+//
+// Two loops qualify when they share the induction variable, start, bound and
+// step, i.e. 'i = s; while i < n { A; i = i + 1; } i = s; while i < n { B;
+// i = i + 1; }', and fusing cannot change what either body observes: no
+// scalar written by one body is used by the other, every array element the
+// second body touches at iteration i is one the first body is done with by
+// iteration i (indices are compared as i plus loop-invariant terms), and at
+// most one of the bodies prints. Bodies that return, yield, spawn, use
+// channels or call functions with side effects are left alone.
+class LoopFusion {
+public:
+    LoopFusion(const std::unordered_map<std::string, FunctionDecl*>& functions, SymbolTable& symbolTable);
+
+    // Fuses loops throughout the function's body; returns how many loops were merged away
+    int run(FunctionDecl* function);
+
+private:
+    SymbolTable& symbolTable;
+    PurityChecker purity;
+    const std::unordered_map<std::string, FunctionDecl*>& functions;
+    std::vector<std::unordered_map<std::string, Type>> locals;
+    int fused = 0;
+
+    void fuseIn(Stmt* stmt);
+    void fuseBlock(BlockStmt* block);
+    bool tryFuse(std::vector<std::unique_ptr<Stmt>>& statements, size_t first);
+
+    // Whether calls to 'name' may be reordered with the other loop's work
+    bool callable(const std::string& name);
+    const Type* findType(const std::string& name) const;
+
+    class BodySummary;
+};
+
+} // namespace Lei
+
+#endif // LOOP_FUSION_H
@@ -1,26 +1,31 @@
 #include "compiler.h"
 #include "source_reader.h"
-#include <llvm/Support/TargetSelect.h>
+#include "jit_memory.h"
+#include "language_server.h"
+#include "metrics.h"
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
-#include <sstream>  // Added for istringstream
+#include <thread>
 #include "CLI11.hpp"
 
-// Forward declaration of helper function
-void printErrorsWithContext(const std::vector<ErrorHandler::Error>& errors, const std::string& sourceCode);
+// Forward declaration of helper functions
+void printJitMemoryStats(const Lei::JitMemoryStats& stats);
+int checkFiles(Compiler& compiler, const std::vector<std::string>& paths, DiagnosticFormat format);
 
 int main(int argc, char* argv[]) {
-    // LLVM initialization
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmPrinter();
-    llvm::InitializeNativeTargetAsmParser();
-    
     CLI::App app{"Lei Compiler"};
 
-    std::string inputPath;
-    app.add_option("input", inputPath, "Input source file")
-       ->required()
+    std::vector<std::string> inputPaths;
+    app.add_option("input", inputPaths, "Input source file (several with --check)")
        ->check(CLI::ExistingFile);
 
+    bool checkOnly = false;
+    app.add_flag("--check", checkOnly, "Report syntax and semantic errors without generating code");
+
+    bool languageServer = false;
+    app.add_flag("--lsp", languageServer, "Run as a language server on stdin and stdout");
+
     std::string outputPath = "output.ll";
     app.add_option("-o,--output", outputPath, "Output path for generated LLVM IR");
 
@@ -36,10 +41,145 @@ int main(int argc, char* argv[]) {
     bool printIR = false;
     app.add_flag("--print-ir", printIR, "Print the LLVM IR");
 
+    bool stream = false;
+    app.add_flag("--stream", stream, "Compile one function at a time, keeping memory use flat for large sources");
+
+    bool watch = false;
+    app.add_flag("--watch", watch, "Run the program again each time the input file is saved");
+
+    bool runMany = false;
+    app.add_flag("--run-many", runMany, "Compile once and run the program on every file in --inputs");
+
+    std::string inputsDir;
+    app.add_option("--inputs", inputsDir, "Directory of stdin files for --run-many")
+       ->check(CLI::ExistingDirectory);
+
+    std::string outputsDir;
+    app.add_option("--outputs", outputsDir, "Directory receiving the stdout of each --run-many run")
+       ->check(CLI::ExistingDirectory);
+
+    int jobs = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    app.add_option("-j,--jobs", jobs, "Programs run concurrently by --run-many")
+       ->check(CLI::PositiveNumber);
+
+    unsigned compileThreads = 0;
+    app.add_option("--compile-threads", compileThreads,
+                   "Run on a lazy JIT compiling on this many threads, ahead of calls; 0 compiles everything first");
+
+    bool jitStats = false;
+    app.add_flag("--jit-stats", jitStats, "Print JIT code memory counters after execution");
+
+    std::string diagnosticsFormat = "text";
+    app.add_option("--diagnostics-format", diagnosticsFormat, "Diagnostics output on stderr: text, json or sarif")
+       ->check(CLI::IsMember({"text", "json", "sarif"}));
+
+    size_t maxErrors = 100;
+    app.add_option("--max-errors", maxErrors, "Errors reported per phase, 0 for no limit");
+
+    bool dumpIROnError = false;
+    app.add_flag("--dump-ir-on-error", dumpIROnError, "Print the partially generated IR when code generation fails");
+
+    std::string astCacheDir;
+    app.add_option("--ast-cache", astCacheDir, "Directory caching analyzed programs, so unchanged sources skip to code generation");
+
+    bool profile = false;
+    app.add_flag("--profile", profile, "With -e, count function calls and allocations in the stats segment");
+
+    unsigned sampleFrequency = 0;
+    app.add_option("--sample-profile", sampleFrequency,
+                   "With -e, sample the program's stack this many times per CPU second")
+       ->check(CLI::Range(1u, 10000u));
+
+    std::string sampleOutput = "profile.folded";
+    app.add_option("--sample-output", sampleOutput, "Folded stacks file written by --sample-profile");
+
+    int statsPid = 0;
+    app.add_option("--stats-attach", statsPid, "Show the live metrics of a running Lei program")
+       ->check(CLI::PositiveNumber);
+
+    bool noFuseLoops = false;
+    app.add_flag("--no-fuse-loops", noFuseLoops, "Keep adjacent loops over the same range separate");
+
     CLI11_PARSE(app, argc, argv);
+
+    if (statsPid > 0) {
+        if (!Lei::Metrics::attach(statsPid, std::cout, 1000)) {
+            std::cerr << "Error: process " << statsPid << " has no Lei stats segment" << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (languageServer) {
+        std::ios::sync_with_stdio(false);
+        Lei::LanguageServer server;
+        return server.run(std::cin, std::cout);
+    }
+    
+    if (inputPaths.empty()) {
+        std::cerr << "Error: input is required" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (inputPaths.size() > 1 && !checkOnly) {
+        std::cerr << "Error: Only --check accepts more than one input file" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string& inputPath = inputPaths.front();
+
+    if (runMany && inputsDir.empty()) {
+        std::cerr << "Error: --run-many requires --inputs" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (stream && (execute || runMany || watch || checkOnly || printAST || printSymbolTable || printIR)) {
+        std::cerr << "Error: --stream only writes IR to --output" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (profile && !execute) {
+        std::cerr << "Error: --profile requires -e" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (profile && runMany) {
+        std::cerr << "Error: --profile cannot be combined with --run-many" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (profile && watch) {
+        std::cerr << "Error: --profile cannot be combined with --watch" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (sampleFrequency > 0 && (!execute || runMany)) {
+        std::cerr << "Error: --sample-profile requires -e" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (sampleFrequency > 0 && compileThreads > 0) {
+        std::cerr << "Error: --sample-profile cannot be combined with --compile-threads" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    DiagnosticFormat format = DiagnosticFormat::TEXT;
+    ErrorHandler::parseFormat(diagnosticsFormat, format);
     
     
     try {
+        if (checkOnly) {
+            Compiler compiler;
+            compiler.astCacheDir = astCacheDir;
+            compiler.errorHandler.setMaxErrorsPerLevel(maxErrors);
+            return checkFiles(compiler, inputPaths, format);
+        }
+
+        if (watch) {
+            Compiler compiler;
+            compiler.dumpIROnError = dumpIROnError;
+            compiler.astCacheDir = astCacheDir;
+            compiler.fuseLoops = !noFuseLoops;
+            compiler.errorHandler.setMaxErrorsPerLevel(maxErrors);
+            return compiler.watch(inputPath, format) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+
         // Read source file
         std::string sourceCode = Lei::SourceReader::readSourceFile(inputPath);
         if (sourceCode.empty()) {
@@ -49,32 +189,47 @@ int main(int argc, char* argv[]) {
 
         // Create compiler and compile
         Compiler compiler;
+        compiler.dumpIROnError = dumpIROnError;
+        compiler.astCacheDir = astCacheDir;
+        compiler.compileThreads = compileThreads;
+        compiler.fuseLoops = !noFuseLoops;
+        compiler.profile = profile;
+        compiler.sampleFrequency = sampleFrequency;
+        compiler.sampleOutput = sampleOutput;
+        compiler.errorHandler.setMaxErrorsPerLevel(maxErrors);
+        compiler.errorHandler.setSource(inputPath, sourceCode);
         
-        if (execute) {
-            if (!compiler.execute(sourceCode, printAST, printSymbolTable, printIR)) {
-                if (compiler.errorHandler.hasErrors(ErrorLevel::CODEGEN)) {
-                    printErrorsWithContext(compiler.errorHandler.getErrors(ErrorLevel::CODEGEN), sourceCode);
+        if (runMany) {
+            std::vector<std::string> inputs;
+            for (const auto& entry : std::filesystem::directory_iterator(inputsDir)) {
+                if (entry.is_regular_file()) {
+                    inputs.push_back(entry.path().string());
                 }
+            }
+            std::sort(inputs.begin(), inputs.end());
+
+            bool succeeded = compiler.runMany(sourceCode, inputs, outputsDir, jobs);
+            if (jitStats) {
+                printJitMemoryStats(compiler.jitMemory);
+            }
+            if (!succeeded) {
+                compiler.errorHandler.report(std::cerr, format);
+                return EXIT_FAILURE;
+            }
+        } else if (execute) {
+            bool succeeded = compiler.execute(sourceCode, printAST, printSymbolTable, printIR);
+            if (jitStats) {
+                printJitMemoryStats(compiler.jitMemory);
+            }
+            if (!succeeded) {
+                compiler.errorHandler.report(std::cerr, format);
                 return EXIT_FAILURE;
             }
         } else {
-            if (!compiler.compile(sourceCode, outputPath, printAST, printSymbolTable, printIR)) {
-                if (compiler.errorHandler.hasErrors(ErrorLevel::LEXICAL)) {
-                    std::cerr << "\nLexical Analysis Failed\n";
-                    printErrorsWithContext(compiler.errorHandler.getErrors(ErrorLevel::LEXICAL), sourceCode);
-                }
-                if (compiler.errorHandler.hasErrors(ErrorLevel::SYNTAX)) {
-                    std::cerr << "\nParsing Failed\n";
-                    printErrorsWithContext(compiler.errorHandler.getErrors(ErrorLevel::SYNTAX), sourceCode);
-                }
-                if (compiler.errorHandler.hasErrors(ErrorLevel::SEMANTIC)) {
-                    std::cerr << "\nSemantic Analysis Failed\n";
-                    printErrorsWithContext(compiler.errorHandler.getErrors(ErrorLevel::SEMANTIC), sourceCode);
-                }
-                if (compiler.errorHandler.hasErrors(ErrorLevel::CODEGEN)) {
-                    std::cerr << "\nCode Generation Failed\n";
-                    printErrorsWithContext(compiler.errorHandler.getErrors(ErrorLevel::CODEGEN), sourceCode);
-                }
+            bool succeeded = stream ? compiler.compileStreaming(sourceCode, outputPath)
+                                    : compiler.compile(sourceCode, outputPath, printAST, printSymbolTable, printIR);
+            if (!succeeded) {
+                compiler.errorHandler.report(std::cerr, format);
                 return EXIT_FAILURE;
             }
             std::cout << "Compilation successful. Output written to: " << outputPath << std::endl;
@@ -86,32 +241,36 @@ int main(int argc, char* argv[]) {
     }
 }
 
-void printErrorsWithContext(const std::vector<ErrorHandler::Error>& errors, const std::string& sourceCode) {
-    std::istringstream sourceStream(sourceCode);
-    std::vector<std::string> lines;
-    std::string line;
-    
-    // Read all lines into vector for easier access
-    while (std::getline(sourceStream, line)) {
-        lines.push_back(line);
-    }
-    
-    for (const auto& error : errors) {
-        std::cerr << "\n" << ErrorHandler::getLevelString(error.level)
-                  << " at line " << error.line << ", column " << error.column << ":\n";
-        
-        // Print the line where error occurred
-        if (error.line > 0 && error.line <= lines.size()) {
-            std::cerr << lines[error.line - 1] << "\n";
-            // Print caret pointing to error position
-            std::cerr << std::string(error.column - 1, ' ') << "^\n";
+// Checks each file in turn with one compiler, reporting the diagnostics of
+// every file that has any. Returns the process exit code.
+int checkFiles(Compiler& compiler, const std::vector<std::string>& paths, DiagnosticFormat format) {
+    int status = EXIT_SUCCESS;
+    for (const auto& path : paths) {
+        compiler.errorHandler.clearAllErrors();
+        std::string sourceCode = Lei::SourceReader::readSourceFile(path);
+        compiler.errorHandler.setSource(path, sourceCode);
+        if (sourceCode.empty()) {
+            std::cerr << "Error: Unable to read source file: " << path << std::endl;
+            status = EXIT_FAILURE;
+            continue;
         }
-        
-        std::cerr << error.message << "\n";
-        
-        // Print context if available
-        if (!error.sourceSnippet.empty()) {
-            std::cerr << "Context:\n" << error.sourceSnippet << "\n";
+        if (!compiler.check(sourceCode)) {
+            compiler.errorHandler.report(std::cerr, format);
+            status = EXIT_FAILURE;
         }
     }
-}
\ No newline at end of file
+    return status;
+}
+
+void printJitMemoryStats(const Lei::JitMemoryStats& stats) {
+    auto kib = [](uint64_t bytes) { return std::to_string(bytes / 1024) + " KiB"; };
+    std::cerr << "JIT memory: " << kib(stats.reservedBytes) << " mapped, " << kib(stats.reusedBytes) << " reused"
+              << (stats.hugePages ? ", huge pages advised" : "") << "\n";
+    for (const auto& zone : { std::make_pair("code", &stats.code), std::make_pair("data", &stats.data) }) {
+        std::cerr << "  " << zone.first << ": " << kib(zone.second->liveBytes) << " live, "
+                  << kib(zone.second->peakBytes) << " peak, " << kib(zone.second->freeBytes) << " free in "
+                  << zone.second->freeSpans << " spans, fragmentation "
+                  << static_cast<int>(zone.second->fragmentation() * 100.0 + 0.5) << "%\n";
+    }
+    std::cerr.flush();
+}
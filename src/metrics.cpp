@@ -0,0 +1,221 @@
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Lei {
+namespace Metrics {
+
+namespace {
+
+std::string segmentName(int pid) {
+    return "/lei-stats." + std::to_string(pid);
+}
+
+double toDouble(uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint64_t toBits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+#if defined(__linux__)
+std::string publishedName;
+
+void removeSegment() {
+    shm_unlink(publishedName.c_str());
+}
+
+// Maps a fresh segment for this process; a leftover of an earlier process
+// with the same pid is replaced
+Segment* createShared() {
+    std::string name = segmentName(getpid());
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return nullptr;
+
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, sizeof(Segment)) == 0) {
+        memory = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    publishedName = name;
+    std::atexit(removeSegment);
+    return static_cast<Segment*>(memory);
+}
+#endif
+
+// This process's segment, zero-filled and created on first use
+Segment* segment() {
+    static Segment* created = []() {
+        Segment* shared = nullptr;
+#if defined(__linux__)
+        shared = createShared();
+#endif
+        if (!shared) {
+            shared = static_cast<Segment*>(std::calloc(1, sizeof(Segment)));
+        }
+        shared->version = VERSION;
+        shared->capacity = CAPACITY;
+        shared->magic = MAGIC;
+        return shared;
+    }();
+    return created;
+}
+
+std::mutex registration;
+Slot overflow;  // Shared by every metric past the segment's capacity
+
+// Upper bound of the bucket holding the q-th quantile
+double quantile(const uint64_t* buckets, uint64_t count, double q) {
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= std::max<uint64_t>(rank, 1)) return std::ldexp(1.0, b);
+    }
+    return std::ldexp(1.0, BUCKETS - 1);
+}
+
+#if defined(__linux__)
+void report(const Segment& shared, int pid, std::vector<uint64_t>& previous, double elapsed, double attached,
+            std::ostream& out) {
+    out << "pid " << pid << ", attached " << std::fixed << std::setprecision(1) << attached << " s\n";
+    uint32_t count = std::min(shared.count.load(std::memory_order_acquire), CAPACITY);
+    for (uint32_t i = 0; i < count; i++) {
+        const Slot& slot = shared.slots[i];
+        uint64_t value = slot.value.load(std::memory_order_relaxed);
+        std::string name(slot.name, strnlen(slot.name, NAME_SIZE));
+        out << "  " << std::left << std::setw(32) << name << std::right;
+
+        if (slot.kind == GAUGE) {
+            out << " gauge     " << std::setw(14) << std::setprecision(2) << toDouble(value) << "\n";
+            continue;
+        }
+        std::string rate = elapsed > 0
+            ? std::to_string(static_cast<uint64_t>(std::llround((value - previous[i]) / elapsed))) + "/s"
+            : "";
+        previous[i] = value;
+        if (slot.kind == COUNTER) {
+            out << " counter   " << std::setw(14) << value << std::setw(14) << rate << "\n";
+            continue;
+        }
+
+        uint64_t buckets[BUCKETS];
+        for (int b = 0; b < BUCKETS; b++) {
+            buckets[b] = slot.buckets[b].load(std::memory_order_relaxed);
+        }
+        double sum = toDouble(slot.sum.load(std::memory_order_relaxed));
+        out << " histogram " << std::setw(14) << value << std::setw(14) << rate;
+        if (value > 0) {
+            out << std::setprecision(2) << "  mean " << sum / value << std::setprecision(0)
+                << "  p50 <" << quantile(buckets, value, 0.5) << "  p99 <" << quantile(buckets, value, 0.99);
+        }
+        out << "\n";
+    }
+    out << std::endl;
+}
+#endif
+
+} // namespace
+
+Slot* slot(const std::string& name, Kind kind) {
+    Segment* shared = segment();
+    std::string stored = name.substr(0, NAME_SIZE - 1);
+
+    std::lock_guard<std::mutex> lock(registration);
+    uint32_t count = shared->count.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < count; i++) {
+        Slot& existing = shared->slots[i];
+        if (existing.kind == kind && stored == existing.name) return &existing;
+    }
+    if (count == CAPACITY) return &overflow;
+
+    Slot& created = shared->slots[count];
+    std::memcpy(created.name, stored.c_str(), stored.size() + 1);
+    created.kind = kind;
+    shared->count.store(count + 1, std::memory_order_release);
+    return &created;
+}
+
+void observe(Slot* slot, double value) {
+    slot->value.fetch_add(1, std::memory_order_relaxed);
+    uint64_t sum = slot->sum.load(std::memory_order_relaxed);
+    while (!slot->sum.compare_exchange_weak(sum, toBits(toDouble(sum) + value), std::memory_order_relaxed)) {
+    }
+
+    int bucket = 0;
+    if (std::isinf(value)) {
+        bucket = BUCKETS - 1;
+    } else if (value >= 1) {
+        std::frexp(value, &bucket);  // value lies in [2^(bucket-1), 2^bucket)
+        bucket = std::min(bucket, BUCKETS - 1);
+    }
+    slot->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool attach(int pid, std::ostream& out, int intervalMs) {
+#if defined(__linux__)
+    std::string name = segmentName(pid);
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    void* memory = mmap(nullptr, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) return false;
+    const auto& shared = *static_cast<const Segment*>(memory);
+    if (shared.magic != MAGIC || shared.version != VERSION || shared.capacity != CAPACITY) {
+        munmap(memory, sizeof(Segment));
+        return false;
+    }
+
+    // The program is never stopped: values are read while it updates them
+    using Clock = std::chrono::steady_clock;
+    std::vector<uint64_t> previous(CAPACITY, 0);
+    Clock::time_point start = Clock::now();
+    Clock::time_point last = start;
+    report(shared, pid, previous, 0, 0, out);
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+        bool alive = kill(pid, 0) == 0 || errno == EPERM;
+        Clock::time_point now = Clock::now();
+        report(shared, pid, previous, std::chrono::duration<double>(now - last).count(),
+               std::chrono::duration<double>(now - start).count(), out);
+        last = now;
+        if (!alive) {
+            out << "process " << pid << " exited" << std::endl;
+            shm_unlink(name.c_str());  // Left behind if it was killed
+            break;
+        }
+    }
+    munmap(memory, sizeof(Segment));
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace Metrics
+} // namespace Lei
@@ -0,0 +1,71 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace Lei {
+
+// Live metrics of a running program, published in a shared memory segment
+// named '/lei-stats.<pid>' (under /dev/shm on Linux) that 'leic --stats-attach'
+// maps read-only while the program keeps running.
+//
+// Every metric is one fixed-size slot. Programs update slots with relaxed
+// atomic operations and never take a lock; only creating a slot for a new
+// name does, which generated code does once per name and module. A slot is
+// complete before the published count covers it, so readers need no lock
+// either.
+namespace Metrics {
+
+enum Kind : uint32_t {
+    COUNTER = 0,    // Monotonic count, reported with its rate
+    GAUGE = 1,      // Last value set, stored as the bits of a double
+    HISTOGRAM = 2,  // Count, sum and power-of-two buckets of the values seen
+};
+
+constexpr uint64_t MAGIC = 0x5354415453494c45;  // "LEISTATS"
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t CAPACITY = 1024;
+constexpr int BUCKETS = 64;  // Bucket 0 holds values below 1, bucket b those in [2^(b-1), 2^b)
+constexpr size_t NAME_SIZE = 48;
+
+struct Slot {
+    std::atomic<uint64_t> value;  // First, so generated code updates the slot address itself
+    std::atomic<uint64_t> sum;    // Bits of a histogram's double sum
+    char name[NAME_SIZE];
+    uint32_t kind;
+    uint32_t reserved;
+    std::atomic<uint64_t> buckets[BUCKETS];
+};
+
+struct Segment {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    std::atomic<uint32_t> count;  // Slots published so far
+    uint32_t reserved;
+    Slot slots[CAPACITY];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "slots are shared between processes");
+
+// Slot of the metric 'name' of the given kind, created on first use. When
+// the segment is full or cannot be created, metrics still work but go to
+// memory no other process can see.
+Slot* slot(const std::string& name, Kind kind);
+
+// Adds one value to a histogram
+void observe(Slot* slot, double value);
+
+// Prints the metrics of process 'pid' every 'intervalMs' milliseconds, with
+// the rate of every counter and histogram since the previous report, until
+// the process exits. Returns false if the process has no segment.
+bool attach(int pid, std::ostream& out, int intervalMs);
+
+} // namespace Metrics
+} // namespace Lei
+
+#endif // METRICS_H
@@ -1,5 +1,6 @@
 #include "parser.h"
 #include <sstream>
+#include <algorithm>
 
 Parser::Parser(const std::vector<Token>& tokens) 
     : tokens(tokens), current(0) {}
@@ -59,8 +60,18 @@ void Parser::synchronize() {
         switch (peek().type) {
             case FN:
             case VAR:
+            case CONST:
+            case THREADLOCAL:
+            case AT:
             case IF:
             case WHILE:
+            case PARALLEL:
+            case SYNC:
+            case GO:
+            case FOR:
+            case MATCH:
+            case YIELD:
+            case BENCH:
             case RETURN:
             case LBRACE:  // Add LBRACE as a synchronization point
                 return;
@@ -72,12 +83,41 @@ void Parser::synchronize() {
 
 std::unique_ptr<Program> Parser::parse() {
     std::vector<std::unique_ptr<FunctionDecl>> functions;
+    std::vector<std::unique_ptr<VarDeclStmt>> globals;
     Token startToken = peek();
     
     while (!isAtEnd()) {
         try {
-            if (match(FN)) {
+            if (check(AT)) {
+                std::vector<Attribute> attributes = parseAttributes();
+                bool isConst = match(CONST);
+                consume(FN, "Expected function declaration after attributes");
+                if (auto function = parseFunction()) {
+                    function->isConst = isConst;
+                    function->attributes = std::move(attributes);
+                    functions.push_back(std::move(function));
+                }
+            } else if (match(FN)) {
                 functions.push_back(parseFunction());
+            } else if (match(CONST)) {
+                if (match(FN)) {
+                    if (auto function = parseFunction()) {
+                        function->isConst = true;
+                        functions.push_back(std::move(function));
+                    }
+                } else if (auto global = parseConstDecl()) {
+                    globals.push_back(std::move(global));
+                }
+            } else if (match(VAR)) {
+                if (auto global = parseVarDecl()) {
+                    globals.push_back(std::move(global));
+                }
+            } else if (match(THREADLOCAL)) {
+                consume(VAR, "Expected 'var' after 'threadlocal'");
+                if (auto global = parseVarDecl()) {
+                    global->isThreadLocal = true;
+                    globals.push_back(std::move(global));
+                }
             } else {
                 ErrorHandler::instance().error(
                     ErrorLevel::SYNTAX,
@@ -92,7 +132,9 @@ std::unique_ptr<Program> Parser::parse() {
         }
     }
     
-    return std::make_unique<Program>(std::move(functions), startToken);
+    auto program = std::make_unique<Program>(std::move(functions), startToken);
+    program->globals = std::move(globals);
+    return program;
 }
 
 Type Parser::parseType() {
@@ -105,6 +147,32 @@ Type Parser::parseType() {
     else if (match(BOOL_TYPE)) typeName = "bool";
     else if (match(STRING_TYPE)) typeName = "str";
     else if (match(VOID)) typeName = "void";
+    else if (check(IDENTIFIER) && isTypeParameter(peek().value)) typeName = advance().value;
+    // 'bits' is only a type name here, so it stays usable as an identifier
+    else if (check(IDENTIFIER) && peek().value == "bits") typeName = advance().value;
+    else if (match(CHAN)) {
+        Token chanToken = previous();
+        consume(LESS, "Expected '<' after 'chan'");
+        Type element = parseType();
+        consume(GREATER, "Expected '>' after channel element type");
+        // Values travel through the channel as single machine words
+        bool scalar = element.name == "int" || element.name == "float" ||
+                      element.name == "bool" || element.name == "str";
+        if (!scalar || element.isArray) {
+            errorAt(chanToken, "Channel element type must be int, float, bool or str");
+        }
+        typeName = Type::channel(element.name).name;
+    }
+    else if (match(ATOMIC)) {
+        Token atomicToken = previous();
+        consume(LESS, "Expected '<' after 'atomic'");
+        Type value = parseType();
+        consume(GREATER, "Expected '>' after atomic value type");
+        if (value.name != "int" || value.isArray) {
+            errorAt(atomicToken, "Atomic value type must be int");
+        }
+        typeName = Type::atomic(value.name).name;
+    }
     else {
         ErrorHandler::instance().error(
             ErrorLevel::SYNTAX,
@@ -122,14 +190,33 @@ Type Parser::parseType() {
         }
         consume(RBRACKET, "Expected ']' after array size");
     }
+
+    // Packed words are only laid out for a size known at compile time
+    if (typeName == "bits" && arraySize <= 0) {
+        errorAt(previous(), "bits requires a fixed positive size: bits[N]");
+    }
     
     return Type(typeName, isArray, arraySize);
 }
 
 std::unique_ptr<FunctionDecl> Parser::parseFunction() {
     Token fnToken = previous();
+    size_t startIndex = current - 1;
+
+    // The return type may already use the type parameters declared after the name
+    typeParameters = scanTypeParameters();
+
+    // A generator's declared type is the type of the values it yields
+    bool isGenerator = match(GEN);
     Type returnType = parseType();
     Token name = consume(IDENTIFIER, "Expected function name");
+
+    if (match(LESS)) {
+        do {
+            consume(IDENTIFIER, "Expected type parameter name");
+        } while (match(COMMA));
+        consume(GREATER, "Expected '>' after type parameters");
+    }
     
     consume(LPAREN, "Expected '(' after function name");
     
@@ -143,6 +230,7 @@ std::unique_ptr<FunctionDecl> Parser::parseFunction() {
     // Parse the function body as a block
     auto body = parseBlock();
     if (!body) {
+        typeParameters.clear();
         ErrorHandler::instance().error(
             ErrorLevel::SYNTAX,
             peek().line,
@@ -152,8 +240,55 @@ std::unique_ptr<FunctionDecl> Parser::parseFunction() {
         return nullptr;
     }
     
-    return std::make_unique<FunctionDecl>(name, returnType, std::move(parameters),
-                                        std::move(body), fnToken);
+    auto function = std::make_unique<FunctionDecl>(name, returnType, std::move(parameters),
+                                                   std::move(body), fnToken);
+    function->isGenerator = isGenerator;
+
+    // Generic functions keep their tokens so semantic analysis can instantiate them
+    if (!typeParameters.empty()) {
+        function->typeParameters = std::move(typeParameters);
+        function->templateTokens.assign(tokens.begin() + startIndex, tokens.begin() + current);
+    }
+    typeParameters.clear();
+    return function;
+}
+
+std::vector<std::string> Parser::scanTypeParameters() const {
+    // Look for 'name <' before the parameter list
+    for (size_t i = current; i + 1 < tokens.size(); ++i) {
+        if (tokens[i].type == LPAREN || tokens[i].type == LBRACE) break;
+        if (tokens[i].type != IDENTIFIER || tokens[i + 1].type != LESS) continue;
+
+        std::vector<std::string> names;
+        for (size_t j = i + 2; j < tokens.size() && tokens[j].type == IDENTIFIER; j += 2) {
+            names.push_back(tokens[j].value);
+            if (j + 1 >= tokens.size() || tokens[j + 1].type != COMMA) break;
+        }
+        return names;
+    }
+    return {};
+}
+
+bool Parser::isTypeParameter(const std::string& name) const {
+    return std::find(typeParameters.begin(), typeParameters.end(), name) != typeParameters.end();
+}
+
+std::vector<Attribute> Parser::parseAttributes() {
+    std::vector<Attribute> attributes;
+
+    while (match(AT)) {
+        Attribute attribute(consume(IDENTIFIER, "Expected attribute name after '@'"));
+        if (match(LPAREN)) {
+            if (!check(RPAREN)) {
+                do {
+                    attribute.arguments.push_back(advance());
+                } while (match(COMMA));
+            }
+            consume(RPAREN, "Expected ')' after attribute arguments");
+        }
+        attributes.push_back(std::move(attribute));
+    }
+    return attributes;
 }
 
 std::vector<Parameter> Parser::parseParameters() {
@@ -186,8 +321,25 @@ std::unique_ptr<BlockStmt> Parser::parseBlock() {
 std::unique_ptr<Stmt> Parser::parseStatement() {
     try {
         if (match(VAR)) return parseVarDecl();
+        if (match(CONST)) return parseConstDecl();
+        if (check(THREADLOCAL)) {
+            errorAt(peek(), "'threadlocal' is only allowed on top-level variables");
+            synchronize();
+            return nullptr;
+        }
         if (match(IF)) return parseIfStmt();
         if (match(WHILE)) return parseWhileStmt();
+        if (match(PARALLEL)) return parseParallelForStmt();
+        if (match(FOR)) return parseForInStmt();
+        if (match(MATCH)) return parseMatchStmt();
+        if (match(YIELD)) return parseYieldStmt();
+        if (match(BENCH)) return parseBenchStmt();
+        if (match(GO)) return parseGoStmt();
+        if (match(SYNC)) {
+            Token syncToken = previous();
+            consume(SEMICOLON, "Expected ';' after 'sync'");
+            return std::make_unique<SyncStmt>(syncToken);
+        }
         if (match(RETURN)) return parseReturnStmt();
         if (match(LBRACE)) {
             // Create a block statement directly from a brace
@@ -205,6 +357,11 @@ std::unique_ptr<Stmt> Parser::parseStatement() {
         }
         
         // Handle type declarations that shouldn't appear here
+        if (check(IDENTIFIER) && isTypeParameter(peek().value)) {
+            errorAt(peek(), "Unexpected type name in statement position");
+            synchronize();
+            return nullptr;
+        }
         if (peek().type == INT || peek().type == FLOAT_TYPE || 
             peek().type == BOOL_TYPE || peek().type == STRING_TYPE) {
             ErrorHandler::instance().error(
@@ -251,6 +408,17 @@ std::unique_ptr<VarDeclStmt> Parser::parseVarDecl() {
     return std::make_unique<VarDeclStmt>(name, type, std::move(initializer), varToken);
 }
 
+std::unique_ptr<VarDeclStmt> Parser::parseConstDecl() {
+    auto decl = parseVarDecl();
+    if (!decl) return nullptr;
+
+    if (!decl->initializer) {
+        errorAt(decl->name, "Constant declaration requires an initializer");
+    }
+    decl->isConst = true;
+    return decl;
+}
+
 std::unique_ptr<IfStmt> Parser::parseIfStmt() {
     Token ifToken = previous();
     auto condition = parseExpression();
@@ -277,6 +445,61 @@ std::unique_ptr<WhileStmt> Parser::parseWhileStmt() {
     return std::make_unique<WhileStmt>(std::move(condition), std::move(body), whileToken);
 }
 
+std::unique_ptr<ParallelForStmt> Parser::parseParallelForStmt() {
+    Token parallelToken = previous();
+    consume(FOR, "Expected 'for' after 'parallel'");
+    Token variable = consume(IDENTIFIER, "Expected loop variable name");
+    consume(IN, "Expected 'in' after loop variable");
+    auto start = parseExpression();
+    consume(DOT_DOT, "Expected '..' in loop range");
+    auto end = parseExpression();
+
+    std::vector<Reduction> reductions;
+    if (match(REDUCE)) {
+        consume(LPAREN, "Expected '(' after 'reduce'");
+        do {
+            Token op = peek();
+            bool validOp = match(PLUS) || match(STAR) ||
+                           (check(IDENTIFIER) && (op.value == "min" || op.value == "max") && match(IDENTIFIER));
+            if (!validOp) {
+                errorAt(op, "Expected reduction operator '+', '*', 'min' or 'max'");
+                synchronize();
+                return nullptr;
+            }
+            consume(COLON, "Expected ':' after reduction operator");
+            reductions.emplace_back(op, consume(IDENTIFIER, "Expected reduction variable name"));
+        } while (match(COMMA));
+        consume(RPAREN, "Expected ')' after reduction clauses");
+    }
+
+    auto body = parseBlock();
+    return std::make_unique<ParallelForStmt>(variable, std::move(start), std::move(end),
+                                             std::move(reductions), std::move(body), parallelToken);
+}
+
+std::unique_ptr<ForInStmt> Parser::parseForInStmt() {
+    Token forToken = previous();
+    Token variable = consume(IDENTIFIER, "Expected loop variable name");
+    consume(IN, "Expected 'in' after loop variable");
+    auto source = parseExpression();
+    auto body = parseBlock();
+    return std::make_unique<ForInStmt>(variable, std::move(source), std::move(body), forToken);
+}
+
+std::unique_ptr<YieldStmt> Parser::parseYieldStmt() {
+    Token yieldToken = previous();
+    auto value = parseExpression();
+    consume(SEMICOLON, "Expected ';' after yield value");
+    return std::make_unique<YieldStmt>(yieldToken, std::move(value));
+}
+
+std::unique_ptr<BenchStmt> Parser::parseBenchStmt() {
+    Token benchToken = previous();
+    Token name = consume(STRING_LITERAL, "Expected benchmark name string after 'bench'");
+    auto body = parseBlock();
+    return std::make_unique<BenchStmt>(benchToken, name, std::move(body));
+}
+
 std::unique_ptr<ReturnStmt> Parser::parseReturnStmt() {
     Token returnToken = previous();
     std::unique_ptr<Expr> value = nullptr;
@@ -404,6 +627,7 @@ std::unique_ptr<Expr> Parser::parseFactor() {
 }
 
 std::unique_ptr<Expr> Parser::parseUnary() {
+    if (match(SPAWN)) return parseSpawn();
     if (match(NOT) || match(MINUS)) {
         Token op = previous();
         auto right = parseUnary();
@@ -413,6 +637,59 @@ std::unique_ptr<Expr> Parser::parseUnary() {
     return parseCall();
 }
 
+std::unique_ptr<Expr> Parser::parseSpawn() {
+    Token spawnToken = previous();
+    auto expr = parseCall();
+    if (!dynamic_cast<CallExpr*>(expr.get())) {
+        errorAt(spawnToken, "Expected function call after 'spawn'");
+        return expr;
+    }
+    std::unique_ptr<CallExpr> call(static_cast<CallExpr*>(expr.release()));
+    return std::make_unique<SpawnExpr>(spawnToken, std::move(call));
+}
+
+std::unique_ptr<MatchStmt> Parser::parseMatchStmt() {
+    Token matchToken = previous();
+    auto subject = parseExpression();
+    consume(LBRACE, "Expected '{' after match subject");
+
+    std::vector<MatchArm> arms;
+    while (!check(RBRACE) && !isAtEnd()) {
+        MatchArm arm;
+        if (check(IDENTIFIER) && peek().value == "_") {
+            advance();
+        } else {
+            do {
+                MatchPattern pattern;
+                pattern.value = parseExpression();
+                if (match(DOT_DOT)) {
+                    pattern.end = parseExpression();
+                }
+                arm.patterns.push_back(std::move(pattern));
+            } while (match(COMMA));
+        }
+        consume(FAT_ARROW, "Expected '=>' after match pattern");
+        arm.body = parseBlock();
+        arms.push_back(std::move(arm));
+    }
+
+    consume(RBRACE, "Expected '}' after match arms");
+    return std::make_unique<MatchStmt>(matchToken, std::move(subject), std::move(arms));
+}
+
+std::unique_ptr<GoStmt> Parser::parseGoStmt() {
+    Token goToken = previous();
+    auto expr = parseCall();
+    if (!dynamic_cast<CallExpr*>(expr.get())) {
+        errorAt(goToken, "Expected function call after 'go'");
+        synchronize();
+        return nullptr;
+    }
+    consume(SEMICOLON, "Expected ';' after 'go' call");
+    std::unique_ptr<CallExpr> call(static_cast<CallExpr*>(expr.release()));
+    return std::make_unique<GoStmt>(goToken, std::move(call));
+}
+
 std::unique_ptr<Expr> Parser::parseCall() {
     auto expr = parsePrimary();
     
@@ -461,6 +738,14 @@ std::unique_ptr<Expr> Parser::parsePrimary() {
         if (match(IDENTIFIER)) {
             return std::make_unique<VariableExpr>(previous());
         }
+        if (check(CHAN)) {
+            Token chanToken = peek();
+            Type type = parseType();
+            consume(LPAREN, "Expected '(' with the capacity after channel type");
+            auto capacity = parseExpression();
+            consume(RPAREN, "Expected ')' after channel capacity");
+            return std::make_unique<ChannelExpr>(chanToken, type, std::move(capacity));
+        }
         if (match(INT) || match(FLOAT_TYPE) || match(BOOL_TYPE) || match(STRING_TYPE)) {
             return parseTypeExpression();
         }
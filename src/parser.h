@@ -17,6 +17,7 @@ public:
 private:
     const std::vector<Token>& tokens;
     size_t current;
+    std::vector<std::string> typeParameters;  // Of the generic function being parsed
 
     // Token handling
     Token peek() const;
@@ -30,15 +31,26 @@ private:
 
     // Type parsing
     Type parseType();
+    std::vector<std::string> scanTypeParameters() const;
+    bool isTypeParameter(const std::string& name) const;
     
     // Declarations and statements
     std::unique_ptr<FunctionDecl> parseFunction();
+    std::vector<Attribute> parseAttributes();
     std::vector<Parameter> parseParameters();
     std::unique_ptr<Stmt> parseStatement();
     std::unique_ptr<BlockStmt> parseBlock();
     std::unique_ptr<VarDeclStmt> parseVarDecl();
+    std::unique_ptr<VarDeclStmt> parseConstDecl();
     std::unique_ptr<IfStmt> parseIfStmt();
     std::unique_ptr<WhileStmt> parseWhileStmt();
+    std::unique_ptr<ParallelForStmt> parseParallelForStmt();
+    std::unique_ptr<Expr> parseSpawn();
+    std::unique_ptr<GoStmt> parseGoStmt();
+    std::unique_ptr<ForInStmt> parseForInStmt();
+    std::unique_ptr<MatchStmt> parseMatchStmt();
+    std::unique_ptr<YieldStmt> parseYieldStmt();
+    std::unique_ptr<BenchStmt> parseBenchStmt();
     std::unique_ptr<ReturnStmt> parseReturnStmt();
     std::unique_ptr<ExprStmt> parseExprStmt();
     
@@ -0,0 +1,239 @@
+#include "purity_checker.h"
+#include "const_evaluator.h"
+
+PurityChecker::PurityChecker(const std::unordered_map<std::string, FunctionDecl*>& functions,
+                             SymbolTable& symbolTable)
+    : functions(functions), symbolTable(symbolTable) {}
+
+bool PurityChecker::isPure(FunctionDecl* func, std::string& reason) {
+    const std::string& name = func->name.value;
+
+    auto cached = results.find(name);
+    if (cached != results.end()) {
+        reason = cached->second;
+        return reason.empty();
+    }
+    if (inProgress.count(name)) {
+        return true;
+    }
+
+    // Each function is checked with its own local scopes
+    auto savedLocals = std::move(locals);
+    auto savedFailure = std::move(failure);
+    locals.clear();
+    failure.clear();
+    inProgress.insert(name);
+
+    func->accept(this);
+
+    inProgress.erase(name);
+    reason = failure;
+    results[name] = failure;
+    locals = std::move(savedLocals);
+    failure = std::move(savedFailure);
+    return reason.empty();
+}
+
+void PurityChecker::impure(const std::string& reason) {
+    if (failure.empty()) {
+        failure = reason;
+    }
+}
+
+const Type* PurityChecker::findLocal(const std::string& name) const {
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+        auto found = it->find(name);
+        if (found != it->end()) return &found->second;
+    }
+    return nullptr;
+}
+
+void PurityChecker::visit(Program* node) {
+    for (const auto& func : node->functions) {
+        func->accept(this);
+    }
+}
+
+void PurityChecker::visit(FunctionDecl* node) {
+    locals.emplace_back();
+    for (const auto& param : node->parameters) {
+        locals.back().emplace(param.name.value, param.type);
+    }
+    node->body->accept(this);
+    locals.pop_back();
+}
+
+void PurityChecker::visit(NumberExpr*) {}
+
+void PurityChecker::visit(StringExpr*) {}
+
+void PurityChecker::visit(BoolExpr*) {}
+
+void PurityChecker::visit(VariableExpr* node) {
+    if (findLocal(node->name.value)) return;
+
+    // Reading a mutable global makes the result depend on program state
+    Symbol* global = symbolTable.resolveGlobal(node->name.value);
+    if (global && global->kind == Symbol::Kind::VARIABLE && !global->isConstant) {
+        impure("reads global variable '" + node->name.value + "'");
+    }
+}
+
+void PurityChecker::visit(ArrayAccessExpr* node) {
+    node->array->accept(this);
+    node->index->accept(this);
+}
+
+void PurityChecker::visit(BinaryExpr* node) {
+    node->left->accept(this);
+    node->right->accept(this);
+}
+
+void PurityChecker::visit(UnaryExpr* node) {
+    node->expr->accept(this);
+}
+
+void PurityChecker::visit(AssignExpr* node) {
+    node->target->accept(this);
+    node->value->accept(this);
+
+    bool elementWrite = false;
+    Expr* root = node->target.get();
+    while (auto* access = dynamic_cast<ArrayAccessExpr*>(root)) {
+        root = access->array.get();
+        elementWrite = true;
+    }
+
+    auto* var = dynamic_cast<VariableExpr*>(root);
+    if (!var) return;
+
+    const Type* local = findLocal(var->name.value);
+    if (!local) {
+        impure("assigns to global variable '" + var->name.value + "'");
+    } else if (elementWrite && !local->isFixedArray()) {
+        // Dynamic arrays may alias memory owned by the caller
+        impure("writes through array '" + var->name.value + "'");
+    }
+}
+
+void PurityChecker::visit(CallExpr* node) {
+    for (const auto& arg : node->arguments) {
+        arg->accept(this);
+    }
+
+    // The program's own functions come first: they may shadow a builtin
+    const std::string& name = node->name.value;
+    auto callee = functions.find(name);
+    if (callee == functions.end()) {
+        if (!ConstEvaluator::isPureBuiltin(name) && name != "sizeof" && name != "atoi" && name != "atof") {
+            impure("calls '" + name + "', which has side effects");
+        }
+        return;
+    }
+
+    std::string reason;
+    if (!isPure(callee->second, reason)) {
+        impure("calls impure function '" + name + "' (" + reason + ")");
+    }
+}
+
+void PurityChecker::visit(ArrayInitExpr* node) {
+    for (const auto& element : node->elements) {
+        element->accept(this);
+    }
+}
+
+void PurityChecker::visit(ArrayAllocExpr*) {
+    impure("allocates heap memory");
+}
+
+void PurityChecker::visit(TypeExpr*) {}
+
+void PurityChecker::visit(ExprStmt* node) {
+    node->expr->accept(this);
+}
+
+void PurityChecker::visit(VarDeclStmt* node) {
+    if (node->initializer) {
+        node->initializer->accept(this);
+    }
+    locals.back().emplace(node->name.value, node->type);
+}
+
+void PurityChecker::visit(BlockStmt* node) {
+    locals.emplace_back();
+    for (const auto& stmt : node->statements) {
+        stmt->accept(this);
+    }
+    locals.pop_back();
+}
+
+void PurityChecker::visit(IfStmt* node) {
+    node->condition->accept(this);
+    node->thenBranch->accept(this);
+    if (node->elseBranch) {
+        node->elseBranch->accept(this);
+    }
+}
+
+void PurityChecker::visit(WhileStmt* node) {
+    node->condition->accept(this);
+    node->body->accept(this);
+}
+
+void PurityChecker::visit(MatchStmt* node) {
+    node->subject->accept(this);
+    for (const auto& arm : node->arms) {
+        arm.body->accept(this);
+    }
+}
+
+void PurityChecker::visit(ParallelForStmt* node) {
+    node->start->accept(this);
+    node->end->accept(this);
+    locals.emplace_back();
+    locals.back().emplace(node->variable.value, Type("int"));
+    node->body->accept(this);
+    locals.pop_back();
+}
+
+void PurityChecker::visit(SpawnExpr*) {
+    impure("spawns concurrent calls");
+}
+
+void PurityChecker::visit(SyncStmt*) {}
+
+void PurityChecker::visit(ChannelExpr*) {
+    impure("creates a channel");
+}
+
+void PurityChecker::visit(GoStmt*) {
+    impure("starts threads");
+}
+
+void PurityChecker::visit(ForInStmt* node) {
+    if (!node->generator) {
+        impure("receives from a channel");
+        return;
+    }
+    node->source->accept(this);
+    // Generators yield scalars, so the element type never makes a write impure
+    locals.emplace_back();
+    locals.back().emplace(node->variable.value, Type("any"));
+    node->body->accept(this);
+    locals.pop_back();
+}
+
+void PurityChecker::visit(YieldStmt* node) {
+    node->value->accept(this);
+}
+
+void PurityChecker::visit(BenchStmt*) {
+    impure("runs a benchmark");
+}
+
+void PurityChecker::visit(ReturnStmt* node) {
+    if (node->value) {
+        node->value->accept(this);
+    }
+}
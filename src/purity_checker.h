@@ -0,0 +1,64 @@
+#ifndef PURITY_CHECKER_H
+#define PURITY_CHECKER_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ast.h"
+#include "symbol_table.h"
+#include "visitor.h"
+
+// Decides whether a function is pure: its result depends only on its arguments
+// and calling it has no observable side effects. Used to validate '@memo'.
+class PurityChecker : public Visitor {
+public:
+    PurityChecker(const std::unordered_map<std::string, FunctionDecl*>& functions, SymbolTable& symbolTable);
+
+    // Returns false and sets reason for the first impure construct found
+    bool isPure(FunctionDecl* func, std::string& reason);
+
+    void visit(Program* node) override;
+    void visit(FunctionDecl* node) override;
+    void visit(NumberExpr* node) override;
+    void visit(StringExpr* node) override;
+    void visit(BoolExpr* node) override;
+    void visit(VariableExpr* node) override;
+    void visit(ArrayAccessExpr* node) override;
+    void visit(BinaryExpr* node) override;
+    void visit(UnaryExpr* node) override;
+    void visit(AssignExpr* node) override;
+    void visit(CallExpr* node) override;
+    void visit(ArrayInitExpr* node) override;
+    void visit(ArrayAllocExpr* node) override;
+    void visit(SpawnExpr* node) override;
+    void visit(ChannelExpr* node) override;
+    void visit(TypeExpr* node) override;
+    void visit(ExprStmt* node) override;
+    void visit(VarDeclStmt* node) override;
+    void visit(BlockStmt* node) override;
+    void visit(IfStmt* node) override;
+    void visit(WhileStmt* node) override;
+    void visit(ParallelForStmt* node) override;
+    void visit(SyncStmt* node) override;
+    void visit(GoStmt* node) override;
+    void visit(ForInStmt* node) override;
+    void visit(MatchStmt* node) override;
+    void visit(YieldStmt* node) override;
+    void visit(BenchStmt* node) override;
+    void visit(ReturnStmt* node) override;
+
+private:
+    const std::unordered_map<std::string, FunctionDecl*>& functions;
+    SymbolTable& symbolTable;
+
+    std::unordered_map<std::string, std::string> results;  // Function name -> impurity reason ("" if pure)
+    std::unordered_set<std::string> inProgress;           // Recursive calls are assumed pure
+    std::vector<std::unordered_map<std::string, Type>> locals;
+    std::string failure;
+
+    void impure(const std::string& reason);
+    const Type* findLocal(const std::string& name) const;
+};
+
+#endif // PURITY_CHECKER_H
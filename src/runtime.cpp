@@ -0,0 +1,1022 @@
+#include "runtime.h"
+#include "metrics.h"
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Index of the worker running the current thread's chunk, -1 outside parallel loops
+thread_local int currentWorker = -1;
+
+// Set on the pool's own threads, which never wait for a parallel loop themselves
+thread_local bool isPoolThread = false;
+
+// Run the current thread is working for; null for the process-wide default
+// session. Carried over to pool threads, spawned tasks and 'go' threads.
+thread_local Lei::Runtime::Session* currentSession = nullptr;
+
+// A spawned call. The copied argument frame follows the header in the same allocation.
+struct Task {
+    LeiTaskBody body;
+    int64_t* group;  // Outstanding-call counter of the spawning function
+    Lei::Runtime::Session* session;
+
+    void* frame() { return this + 1; }
+};
+
+void runTask(Task* task) {
+    Lei::Runtime::Session* saved = currentSession;
+    currentSession = task->session;
+    task->body(task->frame());
+    currentSession = saved;
+    // The group may go out of scope as soon as it reaches zero
+    __atomic_fetch_sub(task->group, 1, __ATOMIC_ACQ_REL);
+    std::free(task);
+}
+
+// Chase-Lev work-stealing deque. The owning thread pushes and pops at the
+// bottom; other threads steal from the top. Grows by doubling; replaced
+// buffers are kept until the deque dies since a thief may still read them.
+class TaskDeque {
+public:
+    TaskDeque() {
+        buffers.emplace_back(new Buffer(64));
+        buffer.store(buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    int64_t size() const {
+        int64_t count = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+        return count > 0 ? count : 0;
+    }
+
+    void push(Task* task) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Buffer* slots = buffer.load(std::memory_order_relaxed);
+        if (b - t > slots->capacity - 1) {
+            slots = grow(slots, t, b);
+        }
+        slots->put(b, task);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    Task* pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* slots = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Task* task = slots->get(b);
+        if (t == b) {
+            // Last task: race thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                task = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    Task* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+
+        Task* task = buffer.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return task;
+    }
+
+private:
+    struct Buffer {
+        int64_t capacity;
+        std::unique_ptr<std::atomic<Task*>[]> slots;
+
+        explicit Buffer(int64_t c) : capacity(c), slots(new std::atomic<Task*>[c]) {}
+        Task* get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+        void put(int64_t i, Task* task) { slots[i & (capacity - 1)].store(task, std::memory_order_relaxed); }
+    };
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Buffer*> buffer{nullptr};
+    std::vector<std::unique_ptr<Buffer>> buffers;
+
+    Buffer* grow(Buffer* old, int64_t t, int64_t b) {
+        buffers.emplace_back(new Buffer(old->capacity * 2));
+        Buffer* bigger = buffers.back().get();
+        for (int64_t i = t; i < b; i++) {
+            bigger->put(i, old->get(i));
+        }
+        buffer.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+};
+
+// Every thread that spawns registers a deque here so idle threads can steal from it
+constexpr int MaxDeques = 256;
+std::atomic<TaskDeque*> deques[MaxDeques];
+std::atomic<int> dequeCount{0};
+thread_local TaskDeque* localDeque = nullptr;
+thread_local bool dequeUnavailable = false;
+
+// Slots of threads that have exited. The deque stays in its slot, since a
+// thief may still be stealing from it, and goes to the next thread that
+// spawns; every group was synced before the thread exited, so it is empty.
+std::mutex freeDequesMutex;
+std::vector<int> freeDeques;
+
+struct DequeSlot {
+    int index = -1;
+
+    ~DequeSlot() {
+        if (index < 0) return;
+        std::lock_guard<std::mutex> lock(freeDequesMutex);
+        freeDeques.push_back(index);
+    }
+};
+thread_local DequeSlot localSlot;
+
+TaskDeque* threadDeque() {
+    if (!localDeque && !dequeUnavailable) {
+        {
+            std::lock_guard<std::mutex> lock(freeDequesMutex);
+            if (!freeDeques.empty()) {
+                localSlot.index = freeDeques.back();
+                freeDeques.pop_back();
+                localDeque = deques[localSlot.index].load(std::memory_order_acquire);
+                return localDeque;
+            }
+        }
+
+        int slot = dequeCount.fetch_add(1);
+        if (slot >= MaxDeques) {
+            dequeUnavailable = true;
+            return nullptr;
+        }
+        localDeque = new TaskDeque;
+        deques[slot].store(localDeque, std::memory_order_release);
+        localSlot.index = slot;
+    }
+    return localDeque;
+}
+
+// A worker's share of the iteration space. Both bounds live in one word so the
+// owner (taking chunks from the front) and thieves (splitting off the back)
+// can claim iterations with a single compare-and-swap.
+struct alignas(64) WorkRange {
+    std::atomic<uint64_t> bounds{0};
+
+    static uint64_t pack(int64_t lo, int64_t hi) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(lo)) << 32) | static_cast<uint32_t>(hi);
+    }
+    static int64_t low(uint64_t packed) { return static_cast<int32_t>(packed >> 32); }
+    static int64_t high(uint64_t packed) { return static_cast<int32_t>(packed & 0xFFFFFFFFu); }
+};
+
+struct ParallelJob {
+    LeiRangeBody body;
+    void* context;
+    Lei::Runtime::Session* session;
+    int workers;
+    int64_t grain;                       // Smallest chunk worth scheduling on its own
+    std::unique_ptr<WorkRange[]> ranges;
+    std::atomic<int64_t> remaining;      // Iterations not yet completed
+};
+
+class ThreadPool {
+public:
+    static ThreadPool& instance() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    int workerCount() const { return static_cast<int>(threads.size()) + 1; }
+
+    void parallelFor(int32_t begin, int32_t end, LeiRangeBody body, void* context) {
+        if (end <= begin) return;
+
+        // Nested loops, loops inside tasks on pool threads, single-core machines
+        // and loops started while the pool is busy elsewhere run inline as worker 0
+        std::unique_lock<std::mutex> busy(dispatch, std::defer_lock);
+        if (currentWorker >= 0 || isPoolThread || threads.empty() || !busy.try_lock()) {
+            int saved = currentWorker;
+            currentWorker = 0;
+            body(context, begin, end, 0);
+            currentWorker = saved;
+            return;
+        }
+
+        const int workers = workerCount();
+        const int64_t total = static_cast<int64_t>(end) - begin;
+
+        ParallelJob job;
+        job.body = body;
+        job.context = context;
+        job.session = currentSession;
+        job.workers = workers;
+        job.grain = std::max<int64_t>(1, total / (static_cast<int64_t>(workers) * 64));
+        job.ranges.reset(new WorkRange[workers]);
+        job.remaining.store(total);
+
+        // Start from an even split; stealing rebalances uneven iterations
+        for (int i = 0; i < workers; i++) {
+            int64_t lo = begin + total * i / workers;
+            int64_t hi = begin + total * (i + 1) / workers;
+            job.ranges[i].bounds.store(WorkRange::pack(lo, hi));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &job;
+            active = workers - 1;
+            generation++;
+        }
+        wake.notify_all();
+
+        participate(job, 0);
+
+        // The job lives on this stack frame, so wait until every worker has left it
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return active == 0; });
+        current = nullptr;
+    }
+
+    void spawn(int64_t* group, LeiTaskBody body, const void* frame, int64_t frameSize) {
+        // Past the cutoff there is enough queued work to keep thieves busy,
+        // so further calls run immediately instead of paying for a task
+        TaskDeque* deque = threads.empty() ? nullptr : threadDeque();
+        if (!deque || deque->size() >= spawnCutoff) {
+            body(const_cast<void*>(frame));
+            return;
+        }
+
+        Task* task = static_cast<Task*>(std::malloc(sizeof(Task) + frameSize));
+        task->body = body;
+        task->group = group;
+        task->session = currentSession;
+        std::memcpy(task->frame(), frame, frameSize);
+        __atomic_fetch_add(group, 1, __ATOMIC_RELAXED);
+
+        deque->push(task);
+        queuedTasks.fetch_add(1);
+        if (sleepers.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            wake.notify_one();
+        }
+    }
+
+    // Helps with outstanding work until every call of the group has finished:
+    // first this thread's own tasks (newest first), then stolen ones
+    void sync(int64_t* group) {
+        while (__atomic_load_n(group, __ATOMIC_ACQUIRE) > 0) {
+            Task* task = localDeque ? localDeque->pop() : nullptr;
+            if (task) {
+                queuedTasks.fetch_sub(1);
+            } else {
+                task = stealTask(localDeque);
+            }
+
+            if (task) {
+                runTask(task);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex dispatch;  // One parallel loop on the pool at a time
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    ParallelJob* current = nullptr;
+    uint64_t generation = 0;
+    int active = 0;
+    bool stopping = false;
+    int64_t spawnCutoff = 32;            // Queued tasks per deque before spawns run inline
+    std::atomic<int64_t> queuedTasks{0};  // Tasks sitting in any deque
+    std::atomic<int> sleepers{0};         // Pool threads waiting for work
+
+    ThreadPool() {
+        int count = static_cast<int>(std::thread::hardware_concurrency());
+        if (const char* requested = std::getenv("LEI_THREADS")) {
+            count = std::atoi(requested);
+        }
+        count = std::max(1, count);
+        if (const char* cutoff = std::getenv("LEI_SPAWN_CUTOFF")) {
+            spawnCutoff = std::max(1, std::atoi(cutoff));
+        }
+
+        for (int i = 1; i < count; i++) {
+            threads.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void workerLoop(int index) {
+        isPoolThread = true;
+        TaskDeque* deque = threadDeque();
+        uint64_t seen = 0;
+        while (true) {
+            ParallelJob* job = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                sleepers.fetch_add(1);
+                wake.wait(lock, [&] { return stopping || generation != seen || queuedTasks.load() > 0; });
+                sleepers.fetch_sub(1);
+                if (stopping) return;
+                if (generation != seen) {
+                    seen = generation;
+                    job = current;
+                }
+            }
+
+            if (job) {
+                participate(*job, index);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--active == 0) {
+                    done.notify_one();
+                }
+                continue;
+            }
+
+            while (Task* task = stealTask(deque)) {
+                runTask(task);
+            }
+        }
+    }
+
+    Task* stealTask(TaskDeque* self) {
+        thread_local uint32_t seed = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        int count = std::min(dequeCount.load(), MaxDeques);
+        for (int i = 0; i < count; i++) {
+            TaskDeque* victim = deques[(seed + i) % count].load(std::memory_order_acquire);
+            if (!victim || victim == self) continue;
+            if (Task* task = victim->steal()) {
+                queuedTasks.fetch_sub(1);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void participate(ParallelJob& job, int index) {
+        Lei::Runtime::Session* saved = currentSession;
+        currentSession = job.session;
+        currentWorker = index;
+        int64_t lo, hi;
+        while (job.remaining.load(std::memory_order_acquire) > 0) {
+            if (takeChunk(job, job.ranges[index], lo, hi) || steal(job, index, lo, hi)) {
+                job.body(job.context, static_cast<int32_t>(lo), static_cast<int32_t>(hi), index);
+                job.remaining.fetch_sub(hi - lo, std::memory_order_acq_rel);
+            } else {
+                // Work is in flight between a victim and its thief
+                std::this_thread::yield();
+            }
+        }
+        currentWorker = -1;
+        currentSession = saved;
+    }
+
+    // Claims a chunk from the front of a worker's own range. Chunks shrink as
+    // the range drains, so the tail is left in pieces others can steal.
+    static bool takeChunk(ParallelJob& job, WorkRange& range, int64_t& lo, int64_t& hi) {
+        uint64_t bounds = range.bounds.load(std::memory_order_acquire);
+        while (true) {
+            int64_t first = WorkRange::low(bounds);
+            int64_t last = WorkRange::high(bounds);
+            if (first >= last) return false;
+
+            int64_t chunk = std::min(last - first, std::max(job.grain, (last - first) / 4));
+            if (range.bounds.compare_exchange_weak(bounds, WorkRange::pack(first + chunk, last),
+                                                   std::memory_order_acq_rel)) {
+                lo = first;
+                hi = first + chunk;
+                return true;
+            }
+        }
+    }
+
+    // Splits off the back half of another worker's range. The stolen part
+    // becomes the thief's own range; one chunk of it is returned to run now.
+    static bool steal(ParallelJob& job, int thief, int64_t& lo, int64_t& hi) {
+        for (int offset = 1; offset < job.workers; offset++) {
+            WorkRange& victim = job.ranges[(thief + offset) % job.workers];
+            uint64_t bounds = victim.bounds.load(std::memory_order_acquire);
+            while (true) {
+                int64_t first = WorkRange::low(bounds);
+                int64_t last = WorkRange::high(bounds);
+                if (first >= last) break;
+
+                int64_t middle = first + (last - first) / 2;
+                if (victim.bounds.compare_exchange_weak(bounds, WorkRange::pack(first, middle),
+                                                        std::memory_order_acq_rel)) {
+                    job.ranges[thief].bounds.store(WorkRange::pack(middle, last), std::memory_order_release);
+                    return takeChunk(job, job.ranges[thief], lo, hi);
+                }
+            }
+        }
+        return false;
+    }
+};
+
+// Parks the calling thread while word still holds expected. Wakers bump the
+// word before waking, so a wake between the check and the wait is not lost.
+void futexWait(std::atomic<uint32_t>& word, uint32_t expected) {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    while (word.load(std::memory_order_acquire) == expected) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+#endif
+}
+
+void futexWake(std::atomic<uint32_t>& word, int count) {
+    word.fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+#else
+    (void)count;
+#endif
+}
+
+// Bounded multi-producer multi-consumer queue of machine words (Vyukov's
+// sequence-numbered ring). Each cell's sequence says whether it is free for
+// the producer at that position or filled for the consumer. Threads spin
+// briefly on a full or empty ring, then park on a futex.
+class Channel {
+public:
+    explicit Channel(int32_t requested) {
+        capacity = 2;
+        while (capacity < static_cast<uint64_t>(requested)) capacity *= 2;
+        cells.reset(new Cell[capacity]);
+        for (uint64_t i = 0; i < capacity; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    void send(int64_t value) {
+        for (int attempt = 0;; attempt++) {
+            if (closed.load(std::memory_order_acquire)) {
+                std::fprintf(stderr, "Runtime error: send on closed channel\n");
+                return;
+            }
+            if (trySend(value)) {
+                wake(receiversWaiting, notEmpty, 1);
+                return;
+            }
+            if (attempt < SpinAttempts) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            uint32_t epoch = notFull.load(std::memory_order_acquire);
+            sendersWaiting.fetch_add(1);
+            if (!full() || closed.load()) {
+                sendersWaiting.fetch_sub(1);
+                continue;
+            }
+            futexWait(notFull, epoch);
+            sendersWaiting.fetch_sub(1);
+        }
+    }
+
+    // Receives up to max values at once; 0 means closed and drained
+    int32_t receive(int64_t* values, int32_t max) {
+        for (int attempt = 0;; attempt++) {
+            int32_t count = tryReceive(values, max);
+            if (count > 0) {
+                wake(sendersWaiting, notFull, count);
+                return count;
+            }
+            // Values sent before close are visible once closed is
+            if (closed.load(std::memory_order_acquire)) {
+                count = tryReceive(values, max);
+                if (count > 0) wake(sendersWaiting, notFull, count);
+                return count;
+            }
+            if (attempt < SpinAttempts) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            uint32_t epoch = notEmpty.load(std::memory_order_acquire);
+            receiversWaiting.fetch_add(1);
+            if (!empty() || closed.load()) {
+                receiversWaiting.fetch_sub(1);
+                continue;
+            }
+            futexWait(notEmpty, epoch);
+            receiversWaiting.fetch_sub(1);
+        }
+    }
+
+    void close() {
+        closed.store(true);
+        futexWake(notEmpty, INT_MAX);
+        futexWake(notFull, INT_MAX);
+    }
+
+private:
+    static constexpr int SpinAttempts = 64;
+
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        int64_t value;
+    };
+
+    uint64_t capacity;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<uint64_t> tail{0};  // Next position to send into
+    alignas(64) std::atomic<uint64_t> head{0};  // Next position to receive from
+    alignas(64) std::atomic<uint32_t> notEmpty{0};
+    std::atomic<uint32_t> notFull{0};
+    std::atomic<int> receiversWaiting{0};
+    std::atomic<int> sendersWaiting{0};
+    std::atomic<bool> closed{false};
+
+    Cell& cellAt(uint64_t position) { return cells[position & (capacity - 1)]; }
+
+    bool full() {
+        uint64_t position = tail.load();
+        return cellAt(position).sequence.load() != position;
+    }
+
+    bool empty() {
+        uint64_t position = head.load();
+        return cellAt(position).sequence.load() != position + 1;
+    }
+
+    // The waiter count is read after a full fence so it cannot miss a thread
+    // that registered before re-checking the ring
+    static void wake(std::atomic<int>& waiting, std::atomic<uint32_t>& word, int count) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) > 0) {
+            futexWake(word, count);
+        }
+    }
+
+    bool trySend(int64_t value) {
+        uint64_t position = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cellAt(position);
+            int64_t diff = static_cast<int64_t>(cell.sequence.load(std::memory_order_acquire) - position);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Claims a run of filled cells with a single CAS on head
+    int32_t tryReceive(int64_t* values, int32_t max) {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        while (true) {
+            int64_t diff = static_cast<int64_t>(cellAt(position).sequence.load(std::memory_order_acquire) - (position + 1));
+            if (diff < 0) return 0;
+            if (diff > 0) {
+                position = head.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            int32_t ready = 1;
+            while (ready < max && static_cast<uint64_t>(ready) < capacity &&
+                   cellAt(position + ready).sequence.load(std::memory_order_acquire) == position + ready + 1) {
+                ready++;
+            }
+            if (head.compare_exchange_weak(position, position + ready, std::memory_order_relaxed)) {
+                for (int32_t i = 0; i < ready; i++) {
+                    Cell& cell = cellAt(position + i);
+                    values[i] = cell.value;
+                    cell.sequence.store(position + i + capacity, std::memory_order_release);
+                }
+                return ready;
+            }
+        }
+    }
+};
+
+// One 'bench' block execution. Warmup doubles the batch size until a batch
+// fills a hundredth of the time budget; measurement then keeps that size and
+// records one per-iteration sample for each batch.
+struct Bench {
+    static constexpr size_t maxSamples = 100;
+    static constexpr size_t minSamples = 5;
+
+    using Clock = std::chrono::steady_clock;
+
+    std::string name;
+    Clock::duration budget;
+    Clock::time_point start;       // Start of the current phase
+    Clock::time_point batchStart;
+    uint64_t batch = 0;            // Iterations in the batch being run; 0 before the first
+    bool warming = true;
+    uint64_t iterations = 0;       // Measured iterations
+    std::vector<double> samples;   // Nanoseconds per iteration, one per measured batch
+
+    Bench(const char* name, Clock::duration budget) : name(name), budget(budget) {}
+
+    // Closes the batch that just ran and returns the size of the next one
+    uint64_t next() {
+        Clock::time_point now = Clock::now();
+        if (batch == 0) {
+            start = now;
+            batch = 1;
+        } else if (warming) {
+            if (now - batchStart < budget / 100 && batch < (uint64_t(1) << 40)) {
+                batch *= 2;
+            } else if (now - start >= budget / 10) {
+                warming = false;
+                start = now;
+            }
+        } else {
+            std::chrono::duration<double, std::nano> elapsed = now - batchStart;
+            samples.push_back(elapsed.count() / static_cast<double>(batch));
+            iterations += batch;
+            if (samples.size() >= maxSamples || (now - start >= budget && samples.size() >= minSamples)) {
+                return 0;
+            }
+        }
+        batchStart = Clock::now();
+        return batch;
+    }
+};
+
+Bench::Clock::duration benchBudget() {
+    int milliseconds = 1000;
+    if (const char* requested = std::getenv("LEI_BENCH_TIME_MS")) {
+        milliseconds = std::max(1, std::atoi(requested));
+    }
+    return std::chrono::milliseconds(milliseconds);
+}
+
+std::string formatDuration(double nanoseconds) {
+    static const char* units[] = { "ns", "us", "ms", "s" };
+    int unit = 0;
+    while (nanoseconds >= 1000.0 && unit < 3) {
+        nanoseconds /= 1000.0;
+        unit++;
+    }
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.2f %s", nanoseconds, units[unit]);
+    return buffer;
+}
+
+std::string formatRate(double perSecond) {
+    static const char* prefixes[] = { "", "K", "M", "G" };
+    int prefix = 0;
+    while (perSecond >= 1000.0 && prefix < 3) {
+        perSecond /= 1000.0;
+        prefix++;
+    }
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.2f%s", perSecond, prefixes[prefix]);
+    return buffer;
+}
+
+} // namespace
+
+namespace Lei {
+namespace Runtime {
+
+struct Session {
+    bool redirected = false;  // Streams are the buffers below rather than the process's
+    std::string input;
+    size_t inputOffset = 0;
+    std::string output;
+
+    // Guards the output and the registries. Threads started by 'go', channels
+    // and benchmarks are released by finishSession() once main has returned.
+    std::mutex mutex;
+    std::vector<std::thread> goThreads;
+    std::vector<std::unique_ptr<Channel>> channels;
+    std::vector<std::unique_ptr<Bench>> benches;
+};
+
+} // namespace Runtime
+} // namespace Lei
+
+namespace {
+
+using Lei::Runtime::Session;
+
+Session defaultSession;
+
+Session& session() {
+    return currentSession ? *currentSession : defaultSession;
+}
+
+void writeOutput(Session& target, const char* format, va_list args) {
+    if (!target.redirected) {
+        std::vprintf(format, args);
+        return;
+    }
+    va_list measure;
+    va_copy(measure, args);
+    int length = std::vsnprintf(nullptr, 0, format, measure);
+    va_end(measure);
+    if (length <= 0) return;
+
+    std::vector<char> text(static_cast<size_t>(length) + 1);
+    std::vsnprintf(text.data(), text.size(), format, args);
+    std::lock_guard<std::mutex> lock(target.mutex);
+    target.output.append(text.data(), static_cast<size_t>(length));
+}
+
+void printTo(Session& target, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    writeOutput(target, format, args);
+    va_end(args);
+}
+
+void reportBenches(Session& target) {
+    for (auto& bench : target.benches) {
+        std::vector<double>& samples = bench->samples;
+        if (samples.empty()) continue;
+        std::sort(samples.begin(), samples.end());
+        double median = samples[samples.size() / 2];
+        double p99 = samples[(samples.size() * 99 + 99) / 100 - 1];
+        printTo(target, "bench \"%s\": min %s, median %s, p99 %s, %s iter/s (%llu iterations)\n",
+                bench->name.c_str(),
+                formatDuration(samples.front()).c_str(),
+                formatDuration(median).c_str(),
+                formatDuration(p99).c_str(),
+                formatRate(median > 0.0 ? 1e9 / median : 0.0).c_str(),
+                static_cast<unsigned long long>(bench->iterations));
+    }
+    std::fflush(stdout);
+    target.benches.clear();
+}
+
+void finishSession(Session& target) {
+    // Threads may start more threads while earlier ones are joined
+    while (true) {
+        std::vector<std::thread> running;
+        {
+            std::lock_guard<std::mutex> lock(target.mutex);
+            running.swap(target.goThreads);
+        }
+        if (running.empty()) break;
+        for (auto& thread : running) {
+            thread.join();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.channels.clear();
+    }
+    reportBenches(target);
+}
+
+} // namespace
+
+extern "C" int32_t lei_parallel_workers() {
+    return ThreadPool::instance().workerCount();
+}
+
+extern "C" void lei_parallel_for(int32_t begin, int32_t end, LeiRangeBody body, void* context) {
+    ThreadPool::instance().parallelFor(begin, end, body, context);
+}
+
+extern "C" void lei_spawn(int64_t* group, LeiTaskBody body, const void* frame, int64_t frameSize) {
+    ThreadPool::instance().spawn(group, body, frame, frameSize);
+}
+
+extern "C" void lei_sync(int64_t* group) {
+    ThreadPool::instance().sync(group);
+}
+
+extern "C" void* lei_chan_new(int32_t capacity) {
+    Session& owner = session();
+    std::lock_guard<std::mutex> lock(owner.mutex);
+    owner.channels.emplace_back(new Channel(std::max(1, capacity)));
+    return owner.channels.back().get();
+}
+
+extern "C" void lei_chan_send(void* channel, int64_t value) {
+    static_cast<Channel*>(channel)->send(value);
+}
+
+extern "C" int64_t lei_chan_recv(void* channel) {
+    int64_t value = 0;
+    static_cast<Channel*>(channel)->receive(&value, 1);
+    return value;
+}
+
+extern "C" int32_t lei_chan_recv_batch(void* channel, int64_t* values, int32_t max) {
+    return static_cast<Channel*>(channel)->receive(values, max);
+}
+
+extern "C" void lei_chan_close(void* channel) {
+    static_cast<Channel*>(channel)->close();
+}
+
+extern "C" void lei_go(LeiTaskBody body, const void* frame, int64_t frameSize) {
+    const char* bytes = static_cast<const char*>(frame);
+    std::vector<char> copy(bytes, bytes + frameSize);
+    Session* parent = currentSession;
+    Session& owner = session();
+    std::lock_guard<std::mutex> lock(owner.mutex);
+    owner.goThreads.emplace_back([body, parent, copy = std::move(copy)]() mutable {
+        currentSession = parent;
+        body(copy.data());
+    });
+}
+
+extern "C" double lei_now_ns() {
+    auto since = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(since).count());
+}
+
+extern "C" void* lei_bench_begin(const char* name) {
+    static const Bench::Clock::duration budget = benchBudget();
+    Session& owner = session();
+    std::lock_guard<std::mutex> lock(owner.mutex);
+    owner.benches.emplace_back(new Bench(name, budget));
+    return owner.benches.back().get();
+}
+
+extern "C" int lei_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    writeOutput(session(), format, args);
+    va_end(args);
+    return 0;
+}
+
+extern "C" char* lei_fgets(char* buffer, int32_t size, FILE* stream) {
+    Session& source = session();
+    if (!source.redirected) {
+        return std::fgets(buffer, size, stream);
+    }
+
+    std::lock_guard<std::mutex> lock(source.mutex);
+    if (size <= 0 || source.inputOffset >= source.input.size()) return nullptr;
+    size_t end = source.input.find('\n', source.inputOffset);
+    end = end == std::string::npos ? source.input.size() : end + 1;
+    size_t length = std::min(end - source.inputOffset, static_cast<size_t>(size - 1));
+    std::memcpy(buffer, source.input.data() + source.inputOffset, length);
+    buffer[length] = '\0';
+    source.inputOffset += length;
+    return buffer;
+}
+
+extern "C" int64_t lei_bench_next(void* bench) {
+    return static_cast<int64_t>(static_cast<Bench*>(bench)->next());
+}
+
+extern "C" int64_t* lei_metric_slot(const char* name, int32_t kind) {
+    return reinterpret_cast<int64_t*>(Lei::Metrics::slot(name, static_cast<Lei::Metrics::Kind>(kind)));
+}
+
+extern "C" void lei_metric_observe(int64_t* slot, double value) {
+    Lei::Metrics::observe(reinterpret_cast<Lei::Metrics::Slot*>(slot), value);
+}
+
+namespace {
+
+struct AllocationCounters {
+    Lei::Metrics::Slot* allocations = Lei::Metrics::slot("alloc.count", Lei::Metrics::COUNTER);
+    Lei::Metrics::Slot* bytes = Lei::Metrics::slot("alloc.bytes", Lei::Metrics::COUNTER);
+    Lei::Metrics::Slot* frees = Lei::Metrics::slot("alloc.frees", Lei::Metrics::COUNTER);
+};
+
+AllocationCounters& allocationCounters() {
+    static AllocationCounters counters;
+    return counters;
+}
+
+void* profiledMalloc(int64_t size) {
+    AllocationCounters& counters = allocationCounters();
+    counters.allocations->value.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes->value.fetch_add(static_cast<uint64_t>(size), std::memory_order_relaxed);
+    return std::malloc(static_cast<size_t>(size));
+}
+
+void* profiledRealloc(void* memory, int64_t size) {
+    AllocationCounters& counters = allocationCounters();
+    counters.allocations->value.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes->value.fetch_add(static_cast<uint64_t>(size), std::memory_order_relaxed);
+    return std::realloc(memory, static_cast<size_t>(size));
+}
+
+void profiledFree(void* memory) {
+    if (memory) allocationCounters().frees->value.fetch_add(1, std::memory_order_relaxed);
+    std::free(memory);
+}
+
+} // namespace
+
+namespace Lei {
+namespace Runtime {
+
+void registerSymbols() {
+    llvm::sys::DynamicLibrary::AddSymbol("lei_parallel_workers", reinterpret_cast<void*>(&lei_parallel_workers));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_parallel_for", reinterpret_cast<void*>(&lei_parallel_for));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_spawn", reinterpret_cast<void*>(&lei_spawn));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_sync", reinterpret_cast<void*>(&lei_sync));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_chan_new", reinterpret_cast<void*>(&lei_chan_new));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_chan_send", reinterpret_cast<void*>(&lei_chan_send));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_chan_recv", reinterpret_cast<void*>(&lei_chan_recv));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_chan_recv_batch", reinterpret_cast<void*>(&lei_chan_recv_batch));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_chan_close", reinterpret_cast<void*>(&lei_chan_close));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_go", reinterpret_cast<void*>(&lei_go));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_now_ns", reinterpret_cast<void*>(&lei_now_ns));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_bench_begin", reinterpret_cast<void*>(&lei_bench_begin));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_bench_next", reinterpret_cast<void*>(&lei_bench_next));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_metric_slot", reinterpret_cast<void*>(&lei_metric_slot));
+    llvm::sys::DynamicLibrary::AddSymbol("lei_metric_observe", reinterpret_cast<void*>(&lei_metric_observe));
+}
+
+void redirectStandardStreams() {
+    llvm::sys::DynamicLibrary::AddSymbol("printf", reinterpret_cast<void*>(&lei_printf));
+    llvm::sys::DynamicLibrary::AddSymbol("fgets", reinterpret_cast<void*>(&lei_fgets));
+}
+
+void profileAllocations() {
+    allocationCounters();  // Publishes the segment before the program starts
+    llvm::sys::DynamicLibrary::AddSymbol("malloc", reinterpret_cast<void*>(&profiledMalloc));
+    llvm::sys::DynamicLibrary::AddSymbol("realloc", reinterpret_cast<void*>(&profiledRealloc));
+    llvm::sys::DynamicLibrary::AddSymbol("free", reinterpret_cast<void*>(&profiledFree));
+}
+
+void finish() {
+    finishSession(defaultSession);
+}
+
+Session* openSession(std::string input) {
+    Session* created = new Session;
+    created->redirected = true;
+    created->input = std::move(input);
+    currentSession = created;
+    return created;
+}
+
+std::string closeSession(Session* run) {
+    finishSession(*run);
+    if (currentSession == run) {
+        currentSession = nullptr;
+    }
+    std::string output = std::move(run->output);
+    delete run;
+    return output;
+}
+
+} // namespace Runtime
+} // namespace Lei
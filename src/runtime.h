@@ -0,0 +1,110 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Entry points called by generated code. They are linked into the compiler and
+// exposed to the JIT by Lei::Runtime::registerSymbols().
+extern "C" {
+
+// Outlined body of a parallel loop: runs iterations [lo, hi) on behalf of 'worker'
+typedef void (*LeiRangeBody)(void* context, int32_t lo, int32_t hi, int32_t worker);
+
+// Number of workers a parallel loop may use; worker indices are below this
+int32_t lei_parallel_workers();
+
+// Runs body over [begin, end) on the work-stealing pool and returns once every
+// iteration has completed
+void lei_parallel_for(int32_t begin, int32_t end, LeiRangeBody body, void* context);
+
+// Trampoline of a spawned call: unpacks the argument frame, makes the call and
+// stores the result
+typedef void (*LeiTaskBody)(void* frame);
+
+// Queues a call on this thread's work-stealing deque, or runs it right away
+// once enough work is queued. The frame is copied; group counts outstanding calls.
+void lei_spawn(int64_t* group, LeiTaskBody body, const void* frame, int64_t frameSize);
+
+// Runs queued and stolen tasks until every call counted by group has finished
+void lei_sync(int64_t* group);
+
+// Bounded channel of 64-bit words; capacity is rounded up to a power of two
+void* lei_chan_new(int32_t capacity);
+
+// Blocks while the channel is full
+void lei_chan_send(void* channel, int64_t value);
+
+// Blocks while the channel is empty; returns 0 once it is closed and drained
+int64_t lei_chan_recv(void* channel);
+
+// Receives up to max values in one step, blocking until at least one is
+// available. Returns the count, or 0 once the channel is closed and drained.
+int32_t lei_chan_recv_batch(void* channel, int64_t* values, int32_t max);
+
+void lei_chan_close(void* channel);
+
+// Runs the trampoline on a new thread with a copy of the frame
+void lei_go(LeiTaskBody body, const void* frame, int64_t frameSize);
+
+// Monotonic clock reading in nanoseconds
+double lei_now_ns();
+
+// Starts a 'bench' block; the result is passed to lei_bench_next
+void* lei_bench_begin(const char* name);
+
+// Returns how many iterations of the block to run next, timing the previous
+// batch, or 0 once warmup and measurement are complete
+int64_t lei_bench_next(void* bench);
+
+// Slot of a metric in the process's stats segment (metrics.h), created on
+// first use; kind is a Lei::Metrics::Kind. Counters and gauges are updated
+// in place by generated code.
+int64_t* lei_metric_slot(const char* name, int32_t kind);
+
+// Adds a value to a histogram slot
+void lei_metric_observe(int64_t* slot, double value);
+
+// Stand-ins for printf and fgets that use the current session's buffers when
+// its streams are redirected, and the process's streams otherwise
+int lei_printf(const char* format, ...);
+char* lei_fgets(char* buffer, int32_t size, FILE* stream);
+
+}
+
+namespace Lei {
+namespace Runtime {
+
+// Makes the runtime entry points resolvable by the JIT
+void registerSymbols();
+
+// Resolves the program's printf and fgets to lei_printf and lei_fgets, so
+// runs inside a session read and write its buffers
+void redirectStandardStreams();
+
+// Resolves the program's malloc, realloc and free to versions that count
+// allocations, bytes requested and frees in the stats segment
+void profileAllocations();
+
+// Waits for threads started with 'go', releases channels and prints the
+// results of 'bench' blocks; called after the program's main function returns
+void finish();
+
+// Standard streams and runtime state (threads started with 'go', channels,
+// benchmarks) of one program run. Runs outside a session share the process
+// streams and a default session.
+struct Session;
+
+// Starts a session reading stdin from input and makes it current on this
+// thread. Threads, tasks and parallel loops started by the run inherit it.
+Session* openSession(std::string input);
+
+// Finishes the run like finish(), then returns what it wrote to stdout and
+// releases the session
+std::string closeSession(Session* session);
+
+} // namespace Runtime
+} // namespace Lei
+
+#endif // RUNTIME_H
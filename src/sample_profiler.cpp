@@ -0,0 +1,305 @@
+#include "sample_profiler.h"
+#include <llvm/DebugInfo/DWARF/DWARFContext.h>
+#include <llvm/Demangle/Demangle.h>
+#include <llvm/Object/SymbolSize.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#if defined(__linux__) && defined(__x86_64__)
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+namespace Lei {
+
+namespace {
+
+std::atomic<SampleProfiler*> active{nullptr};
+
+#if defined(__linux__) && defined(__x86_64__)
+struct sigaction previousAction;
+
+void handleSignal(int, siginfo_t*, void* context) {
+    SampleProfiler::sample(context);
+}
+
+// A task clock perf event interrupts the thread on a high resolution timer;
+// it signals the thread on every overflow once it is set to async mode
+int openTaskClock(pid_t thread, long interval) {
+    struct perf_event_attr attributes = {};
+    attributes.type = PERF_TYPE_SOFTWARE;
+    attributes.size = sizeof(attributes);
+    attributes.config = PERF_COUNT_SW_TASK_CLOCK;
+    attributes.sample_period = static_cast<uint64_t>(interval);
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.disabled = 1;
+    int fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    if (fd < 0) return -1;
+
+    struct f_owner_ex owner = {F_OWNER_TID, thread};
+    if (fcntl(fd, F_SETOWN_EX, &owner) != 0 || fcntl(fd, F_SETSIG, SIGPROF) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_ASYNC) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+} // namespace
+
+SampleProfiler::SampleProfiler(unsigned frequency) : frequency(frequency), ring(new Sample[RingSize]) {}
+
+SampleProfiler::~SampleProfiler() {
+    stop();
+}
+
+void SampleProfiler::notifyObjectLoaded(ObjectKey, const llvm::object::ObjectFile& object,
+                                        const llvm::RuntimeDyld::LoadedObjectInfo& info) {
+    // The copy for debuggers has its sections at the addresses the code was loaded at
+    llvm::object::OwningBinary<llvm::object::ObjectFile> debugCopy = info.getObjectForDebug(object);
+    if (!debugCopy.getBinary()) return;
+    const llvm::object::ObjectFile& loaded = *debugCopy.getBinary();
+    std::unique_ptr<llvm::DIContext> dwarf = llvm::DWARFContext::create(loaded);
+
+    std::vector<Function> found;
+    for (const auto& [symbol, size] : llvm::object::computeSymbolSizes(loaded)) {
+        auto type = symbol.getType();
+        auto name = symbol.getName();
+        auto address = symbol.getAddress();
+        if (!type || !name || !address || *type != llvm::object::SymbolRef::ST_Function || size == 0) {
+            if (!type) llvm::consumeError(type.takeError());
+            if (!name) llvm::consumeError(name.takeError());
+            if (!address) llvm::consumeError(address.takeError());
+            continue;
+        }
+
+        uint64_t sectionIndex = llvm::object::SectionedAddress::UndefSection;
+        if (auto section = symbol.getSection()) {
+            if (*section != loaded.section_end()) sectionIndex = (*section)->getIndex();
+        } else {
+            llvm::consumeError(section.takeError());
+        }
+
+        Function function{static_cast<uintptr_t>(*address), static_cast<uintptr_t>(size), name->str(), {}};
+        for (const auto& [lineAddress, line] : dwarf->getLineInfoForAddressRange({*address, sectionIndex}, size)) {
+            if (line.Line > 0) function.lines.emplace_back(lineAddress, line.Line);
+        }
+        std::sort(function.lines.begin(), function.lines.end());
+        found.push_back(std::move(function));
+    }
+
+    std::lock_guard<std::mutex> lock(functionsMutex);
+    for (auto& function : found) functions.push_back(std::move(function));
+    std::sort(functions.begin(), functions.end(),
+              [](const Function& a, const Function& b) { return a.start < b.start; });
+}
+
+bool SampleProfiler::start() {
+#if defined(__linux__) && defined(__x86_64__)
+    if (running || frequency == 0) return false;
+
+    pthread_attr_t attributes;
+    void* stackLow = nullptr;
+    size_t stackSize = 0;
+    if (pthread_getattr_np(pthread_self(), &attributes) != 0) return false;
+    pthread_attr_getstack(&attributes, &stackLow, &stackSize);
+    pthread_attr_destroy(&attributes);
+    stackTop = reinterpret_cast<uintptr_t>(stackLow) + stackSize;
+
+    struct sigaction action = {};
+    action.sa_sigaction = handleSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &previousAction) != 0) return false;
+
+    // Signals follow this thread's CPU time, so time spent blocked is not
+    // sampled. The CPU clock timer only fires on scheduler ticks, so the perf
+    // event is preferred where the kernel allows it.
+    pid_t thread = static_cast<pid_t>(syscall(SYS_gettid));
+    long interval = std::max(1L, 1000000000L / static_cast<long>(frequency));
+    eventFd = openTaskClock(thread, interval);
+    if (eventFd < 0) {
+        struct sigevent event = {};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGPROF;
+        event.sigev_notify_thread_id = thread;
+        timer_t created;
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &created) != 0) {
+            sigaction(SIGPROF, &previousAction, nullptr);
+            return false;
+        }
+        timer = created;
+    }
+
+    running = true;
+    active.store(this, std::memory_order_release);
+    consumer = std::thread([this]() {
+        while (running.load(std::memory_order_acquire)) {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    });
+
+    if (eventFd >= 0) {
+        ioctl(eventFd, PERF_EVENT_IOC_ENABLE, 0);
+    } else {
+        struct itimerspec period = {};
+        period.it_interval.tv_sec = interval / 1000000000L;
+        period.it_interval.tv_nsec = interval % 1000000000L;
+        period.it_value = period.it_interval;
+        timer_settime(static_cast<timer_t>(timer), 0, &period, nullptr);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SampleProfiler::stop() {
+#if defined(__linux__) && defined(__x86_64__)
+    if (!running) return;
+    // The handler stays installed: a signal already pending finds no profiler and returns
+    if (eventFd >= 0) {
+        ioctl(eventFd, PERF_EVENT_IOC_DISABLE, 0);
+        close(eventFd);
+        eventFd = -1;
+    } else {
+        timer_delete(static_cast<timer_t>(timer));
+    }
+    active.store(nullptr, std::memory_order_release);
+
+    running.store(false, std::memory_order_release);
+    consumer.join();
+    drain();
+#endif
+}
+
+void SampleProfiler::sample(void* context) {
+#if defined(__linux__) && defined(__x86_64__)
+    SampleProfiler* profiler = active.load(std::memory_order_acquire);
+    if (!profiler) return;
+    const mcontext_t& machine = static_cast<ucontext_t*>(context)->uc_mcontext;
+    profiler->record(static_cast<uintptr_t>(machine.gregs[REG_RIP]), static_cast<uintptr_t>(machine.gregs[REG_RBP]),
+                     static_cast<uintptr_t>(machine.gregs[REG_RSP]));
+#else
+    (void)context;
+#endif
+}
+
+// Runs in the signal handler: no locks, no allocation, and only memory
+// between the interrupted stack pointer and the top of the stack is read
+void SampleProfiler::record(uintptr_t pc, uintptr_t frame, uintptr_t stackPointer) {
+    uint32_t slot = head.load(std::memory_order_relaxed);
+    if (slot - tail.load(std::memory_order_acquire) == RingSize) {
+        lost.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Sample& entry = ring[slot % RingSize];
+    entry.frames[0] = pc;
+    uint32_t depth = 1;
+    // Each frame holds the caller's frame pointer, then the return address.
+    // Frames grow towards the top of the stack; anything else means the
+    // chain went through code that uses the register for something else.
+    uintptr_t lowest = stackPointer;
+    while (depth < MaxDepth && frame >= lowest && frame % sizeof(uintptr_t) == 0 &&
+           frame + 2 * sizeof(uintptr_t) <= stackTop) {
+        const uintptr_t* saved = reinterpret_cast<const uintptr_t*>(frame);
+        if (saved[1] == 0) break;
+        entry.frames[depth++] = saved[1];
+        lowest = frame + 2 * sizeof(uintptr_t);
+        frame = saved[0];
+    }
+    entry.depth = depth;
+    head.store(slot + 1, std::memory_order_release);
+}
+
+void SampleProfiler::drain() {
+    uint32_t slot = tail.load(std::memory_order_relaxed);
+    uint32_t end = head.load(std::memory_order_acquire);
+    for (; slot != end; slot++) {
+        const Sample& entry = ring[slot % RingSize];
+        stacks[std::vector<uintptr_t>(entry.frames, entry.frames + entry.depth)]++;
+        taken++;
+    }
+    tail.store(slot, std::memory_order_release);
+}
+
+const SampleProfiler::Function* SampleProfiler::findFunction(uintptr_t address) const {
+    auto next = std::upper_bound(functions.begin(), functions.end(), address,
+                                 [](uintptr_t value, const Function& function) { return value < function.start; });
+    if (next == functions.begin()) return nullptr;
+    const Function& function = *std::prev(next);
+    return address < function.start + function.size ? &function : nullptr;
+}
+
+// 'function:line' for generated code, the symbol or library name otherwise
+std::string SampleProfiler::frameName(uintptr_t address, bool returnAddress) const {
+    // A return address belongs to the instruction after the call
+    uintptr_t instruction = returnAddress ? address - 1 : address;
+    if (const Function* function = findFunction(instruction)) {
+        auto line = std::upper_bound(function->lines.begin(), function->lines.end(),
+                                     std::make_pair(instruction, UINT32_MAX));
+        if (line == function->lines.begin()) return function->name;
+        return function->name + ":" + std::to_string(std::prev(line)->second);
+    }
+
+#if defined(__linux__) && defined(__x86_64__)
+    Dl_info symbol;
+    if (dladdr(reinterpret_cast<void*>(instruction), &symbol)) {
+        if (symbol.dli_sname) return llvm::demangle(symbol.dli_sname);
+        if (symbol.dli_fname) {
+            std::string library = symbol.dli_fname;
+            return "[" + library.substr(library.find_last_of('/') + 1) + "]";
+        }
+    }
+#endif
+    return "[unknown]";
+}
+
+bool SampleProfiler::writeFolded(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    std::lock_guard<std::mutex> lock(functionsMutex);
+    std::map<std::string, uint64_t> folded;
+    for (const auto& [frames, count] : stacks) {
+        // Frames outside the outermost generated one are the compiler running the program
+        size_t outermost = frames.size();
+        for (size_t i = frames.size(); i-- > 0;) {
+            if (findFunction(i == 0 ? frames[i] : frames[i] - 1)) {
+                outermost = i;
+                break;
+            }
+        }
+        if (outermost == frames.size()) outermost = 0;
+
+        std::string line;
+        for (size_t i = outermost + 1; i-- > 0;) {
+            if (!line.empty()) line += ';';
+            line += frameName(frames[i], i > 0);
+        }
+        folded[line] += count;
+    }
+    for (const auto& [line, count] : folded) {
+        out << line << ' ' << count << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+} // namespace Lei
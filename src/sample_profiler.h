@@ -0,0 +1,96 @@
+#ifndef SAMPLE_PROFILER_H
+#define SAMPLE_PROFILER_H
+
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Lei {
+
+// Sampling CPU profiler for JIT-compiled programs.
+//
+// A task clock perf event, or a timer on the CPU clock where perf events are
+// not allowed, sends the thread that calls start() SIGPROF 'frequency' times
+// per second of CPU time. The handler walks the frame pointer chain from the
+// interrupted instruction and pushes the raw return addresses into a
+// lock-free ring; a consumer thread drains the ring and counts identical
+// stacks. As a JIT event listener the profiler also reads
+// each loaded object's symbols and line table, which writeFolded() uses to
+// name every frame 'function:line'.
+//
+// Code generation must keep frame pointers and emit line tables (see
+// CodegenVisitor::setSampleProfiling), or stacks are cut short and frames
+// have no line. Only the thread that calls start() is sampled.
+class SampleProfiler : public llvm::JITEventListener {
+public:
+    explicit SampleProfiler(unsigned frequency);
+    ~SampleProfiler() override;
+
+    void notifyObjectLoaded(ObjectKey key, const llvm::object::ObjectFile& object,
+                            const llvm::RuntimeDyld::LoadedObjectInfo& info) override;
+
+    // Samples the calling thread until stop(); false if the timer cannot be set up
+    bool start();
+    void stop();
+
+    // Writes one 'outer;...;inner count' line per distinct stack, the format
+    // flamegraph.pl and speedscope read; false if the file cannot be written
+    bool writeFolded(const std::string& path) const;
+
+    uint64_t samples() const { return taken; }
+    uint64_t dropped() const { return lost.load(std::memory_order_relaxed); }
+
+    // Records the stack of the interrupted thread; called from the SIGPROF handler
+    static void sample(void* context);
+
+    static constexpr unsigned MaxDepth = 64;
+    static constexpr unsigned RingSize = 1024;  // Power of two
+
+    struct Sample {
+        uint32_t depth;
+        uintptr_t frames[MaxDepth];  // Interrupted instruction, then return addresses
+    };
+
+private:
+    struct Function {
+        uintptr_t start;
+        uintptr_t size;
+        std::string name;
+        std::vector<std::pair<uintptr_t, uint32_t>> lines;  // Start address of each line's code
+    };
+
+    unsigned frequency;
+    std::atomic<bool> running{false};
+    int eventFd = -1;        // Task clock perf event, or
+    void* timer = nullptr;   // CPU clock timer where perf events are not allowed
+    uintptr_t stackTop = 0;  // Frame pointers at or above this are not on the sampled stack
+    std::thread consumer;
+
+    // Written by the signal handler, read by the consumer thread
+    std::unique_ptr<Sample[]> ring;
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<uint64_t> lost{0};
+
+    uint64_t taken = 0;
+    std::map<std::vector<uintptr_t>, uint64_t> stacks;
+
+    mutable std::mutex functionsMutex;
+    std::vector<Function> functions;
+
+    void record(uintptr_t pc, uintptr_t frame, uintptr_t stackPointer);
+    void drain();
+
+    const Function* findFunction(uintptr_t address) const;
+    std::string frameName(uintptr_t address, bool returnAddress) const;
+};
+
+} // namespace Lei
+
+#endif // SAMPLE_PROFILER_H
@@ -1,5 +1,9 @@
 #include "semantic_visitor.h"
 #include "error_handler.h"
+#include "parser.h"
+#include "purity_checker.h"
+#include <algorithm>
+#include <cstdlib>
 
 // isConditionExpr() to check if an expression can evaluate to a boolean
 bool SemanticAnalyzer::isConditionExpr(Expr* expr) {
@@ -41,6 +45,8 @@ bool SemanticAnalyzer::isConditionExpr(Expr* expr) {
 bool SemanticAnalyzer::analyze(Program* program) {
     if (!program) return false;
     
+    // Symbols of a previously analyzed program must not leak into this one
+    symbolTable.reset();
     declareBuiltinFunctions();
     // Analyze the program
     program->accept(this);
@@ -49,6 +55,21 @@ bool SemanticAnalyzer::analyze(Program* program) {
     return !ErrorHandler::instance().hasErrors(ErrorLevel::SEMANTIC);
 }
 
+bool SemanticAnalyzer::analyzeFunction(FunctionDecl* function) {
+    if (!function || !currentProgram) return false;
+
+    size_t known = currentProgram->functions.size();
+    function->accept(this);
+    for (size_t i = known; i < currentProgram->functions.size(); i++) {
+        currentProgram->functions[i]->accept(this);
+    }
+    checkAttributes(function);
+    for (size_t i = known; i < currentProgram->functions.size(); i++) {
+        checkAttributes(currentProgram->functions[i].get());
+    }
+    return !ErrorHandler::instance().hasErrors(ErrorLevel::SEMANTIC);
+}
+
 void SemanticAnalyzer::declareBuiltinFunctions() {
 
     // Casting functions
@@ -97,13 +118,111 @@ void SemanticAnalyzer::declareBuiltinFunctions() {
         Parameter(Token(IDENTIFIER, "size", 0, 0), Type("int"))
     };
     symbolTable.declareFunction("realloc", Type("any", true), reallocParams);
+
+    // The builtins from here on do not reserve their names: a function or
+    // global of the program with the same name replaces the builtin
+    auto declareBuiltin = [this](const std::string& name, const Type& returnType,
+                                 const std::vector<Parameter>& params) {
+        symbolTable.declareFunction(name, returnType, params);
+        symbolTable.resolveFunction(name)->isBuiltin = true;
+    };
+
+    // Math builtins (lowered to LLVM intrinsics during code generation)
+    Parameter x(Token(IDENTIFIER, "x", 0, 0), Type("float"));
+    Parameter y(Token(IDENTIFIER, "y", 0, 0), Type("float"));
+    Parameter z(Token(IDENTIFIER, "z", 0, 0), Type("float"));
+    declareBuiltin("sqrt", Type("float"), { x });
+    declareBuiltin("floor", Type("float"), { x });
+    declareBuiltin("pow", Type("float"), { x, y });
+    declareBuiltin("fma", Type("float"), { x, y, z });
+
+    // Numeric builtins accepting either int or float operands
+    Parameter a(Token(IDENTIFIER, "a", 0, 0), Type("any"));
+    Parameter b(Token(IDENTIFIER, "b", 0, 0), Type("any"));
+    declareBuiltin("abs", Type("any"), { a });
+    declareBuiltin("min", Type("any"), { a, b });
+    declareBuiltin("max", Type("any"), { a, b });
+
+    // Bit manipulation builtins
+    Parameter bits(Token(IDENTIFIER, "x", 0, 0), Type("int"));
+    declareBuiltin("clz", Type("int"), { bits });
+    declareBuiltin("ctz", Type("int"), { bits });
+
+    // popcount also counts the set bits of a bits[N] array; the bulk bitset
+    // operations work a word at a time. Operands are checked by checkBitsCall.
+    Parameter bitset(Token(IDENTIFIER, "set", 0, 0), Type("any"));
+    Parameter other(Token(IDENTIFIER, "other", 0, 0), Type("any"));
+    declareBuiltin("popcount", Type("int"), { bitset });
+    declareBuiltin("and", Type("void"), { bitset, other });
+    declareBuiltin("or", Type("void"), { bitset, other });
+    declareBuiltin("ffs", Type("int"), { bitset });
+
+    // Channel operations; the element type is checked per call
+    Parameter channel(Token(IDENTIFIER, "channel", 0, 0), Type("any"));
+    Parameter value(Token(IDENTIFIER, "value", 0, 0), Type("any"));
+    declareBuiltin("send", Type("void"), { channel, value });
+    declareBuiltin("recv", Type("any"), { channel });
+    declareBuiltin("close", Type("void"), { channel });
+
+    // Atomic operations; arguments, including the optional memory ordering,
+    // are checked by checkAtomicCall
+    Parameter target(Token(IDENTIFIER, "target", 0, 0), Type("any"));
+    declareBuiltin("load", Type("int"), { target });
+    declareBuiltin("store", Type("void"), { target, value });
+    declareBuiltin("fetch_add", Type("int"), { target, value });
+    declareBuiltin("fetch_sub", Type("int"), { target, value });
+    declareBuiltin("compare_exchange", Type("bool"), { target, value, value });
+
+    // Benchmarking: timers return float since int is only 32 bits wide, and
+    // black_box hands back its scalar argument opaquely to the optimizer
+    declareBuiltin("now_ns", Type("float"), {});
+    declareBuiltin("cycles", Type("float"), {});
+    declareBuiltin("black_box", Type("any"), { value });
+
+    // Live metrics in the shared stats segment; names must be string literals
+    Parameter metric(Token(IDENTIFIER, "name", 0, 0), Type("str"));
+    Parameter sample(Token(IDENTIFIER, "value", 0, 0), Type("float"));
+    declareBuiltin("counter", Type("void"), { metric });
+    declareBuiltin("gauge", Type("void"), { metric, sample });
+    declareBuiltin("histogram", Type("void"), { metric, sample });
+}
+
+bool SemanticAnalyzer::isBuiltin(const std::string& name) const {
+    FunctionSymbol* function = symbolTable.resolveFunction(name);
+    return function && function->isBuiltin;
+}
+
+bool SemanticAnalyzer::isNumericBuiltin(const std::string& name) const {
+    return (name == "abs" || name == "min" || name == "max") && isBuiltin(name);
+}
+
+bool SemanticAnalyzer::isAtomicBuiltin(const std::string& name) const {
+    return (name == "load" || name == "store" || name == "fetch_add" || name == "fetch_sub" ||
+            name == "compare_exchange") && isBuiltin(name);
+}
+
+bool SemanticAnalyzer::isBitsBuiltin(const std::string& name) const {
+    return (name == "popcount" || name == "and" || name == "or" || name == "ffs") && isBuiltin(name);
+}
+
+bool SemanticAnalyzer::isChannelBuiltin(const std::string& name) const {
+    return (name == "send" || name == "recv" || name == "close") && isBuiltin(name);
 }
 
 void SemanticAnalyzer::visit(Program* node) {
     mainFound = false;  // Reset mainFound flag
+    constFunctions.clear();
+    shadowedBuiltins.clear();
+    generatorFunctions.clear();
+    genericFunctions.clear();
+    genericInstances.clear();
+    currentProgram = node;
     
     // First pass: declare all functions (enables forward references)
     for (const auto& func : node->functions) {
+        if (isBuiltin(func->name.value)) {
+            shadowedBuiltins.insert(func->name.value);
+        }
         if (!symbolTable.declareFunction(func->name.value, func->returnType, func->parameters)) {
             ErrorHandler::instance().error(
                 ErrorLevel::SEMANTIC,
@@ -111,6 +230,18 @@ void SemanticAnalyzer::visit(Program* node) {
                 func->name.column,
                 "Duplicate function declaration: " + func->name.value
             );
+        } else {
+            markDeclared(func->name);
+            if (func->isGeneric()) {
+                genericFunctions[func->name.value] = func.get();
+            } else if (func->isConst) {
+                constFunctions[func->name.value] = func.get();
+                symbolTable.resolveFunction(func->name.value)->isConst = true;
+            }
+        }
+        if (func->isGenerator) {
+            checkGenerator(func.get());
+            generatorFunctions.insert(func->name.value);
         }
         
         // Check if this is the main function
@@ -128,10 +259,49 @@ void SemanticAnalyzer::visit(Program* node) {
         );
     }
     
-    // Second pass: analyze function bodies
-    for (const auto& func : node->functions) {
-        func->accept(this);
+    // Globals are analyzed in source order, before any function body uses them
+    analyzingGlobals = true;
+    for (const auto& global : node->globals) {
+        global->accept(this);
+    }
+    analyzingGlobals = false;
+
+    // Second pass: analyze function bodies. Generic templates are only checked
+    // through their instances, which are appended to the list as calls are found.
+    size_t declared = node->functions.size();
+    auto skipped = [&](size_t i) {
+        return bodyFilter && i < declared && !bodyFilter->count(node->functions[i]->name.value);
+    };
+    for (size_t i = 0; i < node->functions.size(); i++) {
+        if (!node->functions[i]->isGeneric() && !skipped(i)) {
+            node->functions[i]->accept(this);
+        }
+    }
+
+    // Attributes are checked once every body, including generic instances, is known
+    for (size_t i = 0; i < node->functions.size(); i++) {
+        if (!node->functions[i]->isGeneric() && !skipped(i)) {
+            checkAttributes(node->functions[i].get());
+        }
+    }
+}
+
+void SemanticAnalyzer::recordBinding(const Token& name, Symbol* symbol) {
+    if (!bindings || !symbol) return;
+    std::vector<Parameter> parameters;
+    if (symbol->kind == Symbol::Kind::FUNCTION) {
+        parameters = static_cast<FunctionSymbol*>(symbol)->parameters;
     }
+    bindings->push_back({ name, symbol->kind, symbol->type, std::move(parameters), symbol->line, symbol->column,
+                          symbolTable.resolveGlobal(symbol->name) == symbol });
+}
+
+// Called right after a successful declaration, so the name is in the current scope
+void SemanticAnalyzer::markDeclared(const Token& name) {
+    Symbol* symbol = symbolTable.currentScope()->resolve(name.value);
+    symbol->line = name.line;
+    symbol->column = name.column;
+    recordBinding(name, symbol);
 }
 
 
@@ -145,10 +315,22 @@ void SemanticAnalyzer::visit(FunctionDecl* node) {
     }
     symbolTable.enterScope(); // Enter function scope
     currentFunctionReturnType = node->returnType;
+    currentFunctionDecl = node;
+    inConstFunction = node->isConst;
     
 
     // Declare parameters in function scope
     for (const auto& param : node->parameters) {
+        // A copied atomic would not be shared; arrays of atomics are passed by address
+        if (param.type.isAtomic() && !param.type.isArray) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                param.name.line,
+                param.name.column,
+                "Parameter '" + param.name.value + "' cannot be atomic; pass an " +
+                param.type.name + "[] array to share it"
+            );
+        }
         if (!symbolTable.declare(param.name.value, param.type)) {
             ErrorHandler::instance().error(
                 ErrorLevel::SEMANTIC,
@@ -156,15 +338,44 @@ void SemanticAnalyzer::visit(FunctionDecl* node) {
                 param.name.column,
                 "Duplicate parameter name: " + param.name.value
             );
+        } else {
+            markDeclared(param.name);
         }
     }
     
     // Analyze function body
     node->body->accept(this);
     
+    inConstFunction = false;
+    currentFunctionDecl = nullptr;
     symbolTable.exitScope(); // Exit function scope
 }
 
+void SemanticAnalyzer::checkGenerator(FunctionDecl* func) {
+    auto reject = [&](const std::string& message) {
+        ErrorHandler::instance().error(ErrorLevel::SEMANTIC, func->name.line, func->name.column, message);
+    };
+
+    const Type& element = func->returnType;
+    bool scalar = element.name == "int" || element.name == "float" ||
+                  element.name == "bool" || element.name == "str";
+    if (!scalar || element.isArray) {
+        reject("Generator '" + func->name.value + "' must yield int, float, bool or str");
+    }
+    if (func->isConst) {
+        reject("Generator '" + func->name.value + "' cannot be a const function");
+    }
+    if (func->isGeneric()) {
+        reject("Generator '" + func->name.value + "' cannot have type parameters");
+    }
+    if (func->getAttribute("memo")) {
+        reject("Generator '" + func->name.value + "' cannot be memoized");
+    }
+    if (func->name.value == "main") {
+        reject("Function main cannot be a generator");
+    }
+}
+
 bool SemanticAnalyzer::validateMainFunction(FunctionDecl* func) {
     return isValidMainSignature(func);
 }
@@ -238,11 +449,47 @@ bool SemanticAnalyzer::isValidMainSignature(FunctionDecl* func) {
 }
 
 void SemanticAnalyzer::visit(VarDeclStmt* node) {
+    if (node->type.name == "void") {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->name.line,
+            node->name.column,
+            "Variable cannot have 'void' type"
+        );
+    }
+
+    if (node->isConst && node->type.isAtomic()) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->name.line,
+            node->name.column,
+            "Constants cannot have atomic type"
+        );
+    }
+
+    // Packed sets start out clear and are filled bit by bit
+    if (node->type.isBits() && (node->isConst || node->initializer)) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->name.line,
+            node->name.column,
+            "bits arrays cannot have an initializer; they start with every bit clear"
+        );
+    }
+
+    // Atomics start out holding a plain value
+    Type declaredType = node->type.isAtomic() && !node->type.isArray ? node->type.atomicValue() : node->type;
+
     // Check initializer type if present
+    bool validInitializer = true;
+    bool isStaticInitializer = node->isConst || analyzingGlobals;
     if (node->initializer) {
-        node->initializer->accept(this);
+        if (isStaticInitializer) constContextDepth++;
+        visitAllowingSpawn(node->initializer.get());
+        if (isStaticInitializer) constContextDepth--;
+
         auto initType = getExprType(node->initializer.get());
-        if (initType && !symbolTable.isCompatibleTypes(node->type, *initType)) {
+        if (initType && !symbolTable.isCompatibleTypes(declaredType, *initType)) {
             ErrorHandler::instance().error(
                 ErrorLevel::SEMANTIC,
                 node->name.line,
@@ -250,7 +497,7 @@ void SemanticAnalyzer::visit(VarDeclStmt* node) {
                 "Type mismatch in variable declaration. Expected " + 
                 node->type.name + " but got " + initType->name
             );
-            return;
+            validInitializer = false;
         }
 
         if (auto* arrayInit = dynamic_cast<ArrayInitExpr*>(node->initializer.get())) {
@@ -262,34 +509,195 @@ void SemanticAnalyzer::visit(VarDeclStmt* node) {
                     node->name.column,
                     "Zero initializer '{}' can only be used for fixed-size arrays"
                 );
-                return;
+                validInitializer = false;
             }
         }
-    
-        if (node->type.name == "void") {
+    }
+
+    // Declare the variable in the current scope
+    if (!symbolTable.declare(node->name.value, node->type)) {
         ErrorHandler::instance().error(
             ErrorLevel::SEMANTIC,
             node->name.line,
             node->name.column,
-            "Variable cannot have 'void' type"
+            "Variable already declared in this scope: " + node->name.value
         );
+        return;
     }
+    markDeclared(node->name);
 
-    
-    // Declare the variable in the current scope
-    if (!symbolTable.declare(node->name.value, node->type)) {
+    if (!node->isConst) {
+        // Mutable globals are initialized statically
+        if (analyzingGlobals && node->initializer && validInitializer) {
+            std::string reason;
+            node->constValue = evaluateConstant(node->initializer.get(), declaredType, reason);
+            if (!node->constValue) {
+                ErrorHandler::instance().error(
+                    ErrorLevel::SEMANTIC,
+                    node->name.line,
+                    node->name.column,
+                    "Global variable '" + node->name.value +
+                    "' must be initialized with a compile-time constant: " + reason
+                );
+            }
+        }
+        return;
+    }
+
+    Symbol* symbol = symbolTable.resolve(node->name.value);
+    symbol->isConstant = true;
+    if (!node->initializer || !validInitializer) return;
+
+    // Evaluate the initializer now; codegen materializes the result
+    std::string reason;
+    node->constValue = evaluateConstant(node->initializer.get(), node->type, reason);
+    if (!node->constValue) {
         ErrorHandler::instance().error(
             ErrorLevel::SEMANTIC,
             node->name.line,
             node->name.column,
-            "Variable already declared in this scope: " + node->name.value
+            "Constant '" + node->name.value + "' is not a compile-time constant: " + reason
+        );
+        return;
+    }
+    if (node->constValue->isArray()) {
+        node->constValue->array->frozen = true;
+    }
+    symbol->constValue = node->constValue;
+}
+
+std::shared_ptr<ConstValue> SemanticAnalyzer::evaluateConstant(Expr* expr, const Type& type, std::string& reason,
+                                                               ConstEvalLimits limits) {
+    // Inside const fn bodies only global constants are visible to the evaluator
+    auto lookup = [this](const std::string& name, bool globalOnly) -> const ConstValue* {
+        Symbol* symbol = globalOnly ? symbolTable.resolveGlobal(name) : symbolTable.resolve(name);
+        return symbol && symbol->constValue ? symbol->constValue.get() : nullptr;
+    };
+
+    ConstEvaluator evaluator(constFunctions, lookup, limits);
+    evaluator.setShadowedBuiltins(shadowedBuiltins);
+    auto value = evaluator.evaluate(expr, type);
+    if (!value) {
+        reason = evaluator.getFailureReason();
+    }
+    return value;
+}
+
+void SemanticAnalyzer::checkConstCall(CallExpr* node, FunctionSymbol* func) {
+    // A const fn may only depend on other const fns and pure builtins
+    if (inConstFunction && !func->isConst && !(func->isBuiltin && ConstEvaluator::isPureBuiltin(node->name.value))) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->name.line,
+            node->name.column,
+            "Const function cannot call non-const function: " + node->name.value
         );
         return;
     }
+
+    if (!func->isConst) return;
+
+    // Array results have no runtime representation outside constant initializers
+    if (func->type.isArray) {
+        if (constContextDepth == 0 && !inConstFunction) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->name.line,
+                node->name.column,
+                "Const function returning an array can only initialize a constant: " + node->name.value
+            );
+        }
+        return;
+    }
+
+    // Fold calls whose arguments are all constant. A tighter step budget keeps
+    // calls that are too expensive to fold running at runtime instead.
+    ConstEvalLimits limits;
+    limits.maxSteps = 100000;
+    std::string reason;
+    node->constValue = evaluateConstant(node, func->type, reason, limits);
+}
+
+void SemanticAnalyzer::checkConstantAssignment(Expr* target, const Token& op) {
+    Expr* root = target;
+    while (auto* access = dynamic_cast<ArrayAccessExpr*>(root)) {
+        root = access->array.get();
+    }
+
+    auto* var = dynamic_cast<VariableExpr*>(root);
+    if (!var) return;
+
+    Symbol* symbol = symbolTable.resolve(var->name.value);
+    if (symbol && symbol->isConstant) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            op.line,
+            op.column,
+            "Cannot assign to constant: " + var->name.value
+        );
+    }
 }
+
+int SemanticAnalyzer::scopeIndexOf(const std::string& name) const {
+    const auto& scopes = symbolTable.getScopes();
+    for (int i = static_cast<int>(scopes.size()) - 1; i >= 0; i--) {
+        if (scopes[i]->getSymbols().count(name)) return i;
+    }
+    return -1;
+}
+
+void SemanticAnalyzer::checkParallelAssignment(Expr* target, const Token& op) {
+    if (parallelScopeBase == 0) return;
+
+    // Element writes are how iterations publish results; only shared scalars race
+    auto* var = dynamic_cast<VariableExpr*>(target);
+    if (!var) return;
+
+    const std::string& name = var->name.value;
+    int scope = scopeIndexOf(name);
+    if (scope < 0) return;
+
+    // The loop variable is the iteration's index; the outlined loop resets it
+    if (std::find(parallelVariables.begin(), parallelVariables.end(), std::make_pair(static_cast<size_t>(scope), name)) !=
+        parallelVariables.end()) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            op.line,
+            op.column,
+            "Cannot assign to parallel loop variable '" + name + "'"
+        );
+        return;
+    }
+
+    // Every worker has its own copy of a threadlocal global
+    if (scope == 0 && currentProgram) {
+        for (const auto& global : currentProgram->globals) {
+            if (global->name.value == name && global->isThreadLocal) return;
+        }
+    }
+
+    bool isReduction = std::find(parallelReductions.begin(), parallelReductions.end(), name) != parallelReductions.end();
+    if (static_cast<size_t>(scope) < parallelScopeBase && !isReduction) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            op.line,
+            op.column,
+            "Assignment to '" + name + "' inside a parallel loop races between iterations; " +
+            (scope == 0 ? "use an atomic<int>" : "use a reduction")
+        );
+    }
 }
 
 void SemanticAnalyzer::visit(AssignExpr* node) {
+    node->target->accept(this);
+    if (node->op.type == EQUALS) {
+        visitAllowingSpawn(node->value.get());
+    } else {
+        node->value->accept(this);
+    }
+    checkConstantAssignment(node->target.get(), node->op);
+    checkParallelAssignment(node->target.get(), node->op);
+
     auto targetType = getExprType(node->target.get());
     auto valueType = getExprType(node->value.get());
     
@@ -307,6 +715,9 @@ void SemanticAnalyzer::visit(AssignExpr* node) {
 }
 
 void SemanticAnalyzer::visit(BinaryExpr* node) {
+    node->left->accept(this);
+    node->right->accept(this);
+
     auto leftType = getExprType(node->left.get());
     auto rightType = getExprType(node->right.get());
     
@@ -335,15 +746,55 @@ std::optional<Type> SemanticAnalyzer::getExprType(Expr* expr) {
         return Type("bool");
     }
     else if (auto* var = dynamic_cast<VariableExpr*>(expr)) {
+        // Undefined variables are reported when the expression is visited
         if (auto* symbol = symbolTable.resolve(var->name.value)) {
             return symbol->type;
         }
-        ErrorHandler::instance().error(
-            ErrorLevel::SEMANTIC,
-            var->name.line,
-            var->name.column,
-            "Undefined variable: " + var->name.value
-        );
+    }
+    else if (auto* channel = dynamic_cast<ChannelExpr*>(expr)) {
+        return channel->type;
+    }
+    else if (auto* spawn = dynamic_cast<SpawnExpr*>(expr)) {
+        return getExprType(spawn->call.get());
+    }
+    else if (auto* call = dynamic_cast<CallExpr*>(expr)) {
+        auto* func = symbolTable.resolveFunction(call->name.value);
+        if (!func) return std::nullopt;
+        if (call->name.value == "recv" && func->isBuiltin && !call->arguments.empty()) {
+            auto channelType = getExprType(call->arguments[0].get());
+            if (channelType && channelType->isChannel() && !channelType->isArray) {
+                return channelType->channelElement();
+            }
+            return std::nullopt;
+        }
+        if (call->name.value == "black_box" && func->isBuiltin && !call->arguments.empty()) {
+            return getExprType(call->arguments[0].get());
+        }
+        if (isNumericBuiltin(call->name.value)) {
+            // abs/min/max take the type of their operands
+            for (const auto& arg : call->arguments) {
+                auto argType = getExprType(arg.get());
+                if (!argType) return std::nullopt;
+                if (argType->name == "float") return Type("float");
+            }
+            return Type("int");
+        }
+        return func->type;
+    }
+    else if (auto* binary = dynamic_cast<BinaryExpr*>(expr)) {
+        if (isConditionExpr(binary)) return Type("bool");
+        auto leftType = getExprType(binary->left.get());
+        auto rightType = getExprType(binary->right.get());
+        if (!leftType || !rightType) return std::nullopt;
+        return symbolTable.getCommonType(*leftType, *rightType);
+    }
+    else if (auto* unary = dynamic_cast<UnaryExpr*>(expr)) {
+        if (unary->op.type == NOT) return Type("bool");
+        return getExprType(unary->expr.get());
+    }
+    else if (auto* access = dynamic_cast<ArrayAccessExpr*>(expr)) {
+        auto arrayType = getExprType(access->array.get());
+        if (arrayType && arrayType->isArray) return Type(arrayType->isBits() ? "bool" : arrayType->name);
     }
     // Add other expression types as needed
     
@@ -432,73 +883,306 @@ void SemanticAnalyzer::visit(WhileStmt* node) {
     node->body->accept(this);
 }
 
-void SemanticAnalyzer::visit(ReturnStmt* node) {
-    if (!node->value) {
-        if (currentFunctionReturnType.name != "void") {
+void SemanticAnalyzer::visit(MatchStmt* node) {
+    node->subject->accept(this);
+
+    auto subjectType = getExprType(node->subject.get());
+    if (!subjectType) return;
+    if ((subjectType->name != "int" && subjectType->name != "bool") || subjectType->isArray) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->subject->loc.line,
+            node->subject->loc.column,
+            "Can only match on int or bool, got " + subjectType->name
+        );
+        return;
+    }
+    bool isBool = subjectType->name == "bool";
+    static const int64_t maxMatchRange = 1024;
+
+    // Evaluates one pattern bound to its case value
+    auto caseValue = [&](Expr* pattern, int64_t& value) {
+        pattern->accept(this);
+        auto patternType = getExprType(pattern);
+        if (!patternType) return false;
+        if (patternType->name != subjectType->name || patternType->isArray) {
             ErrorHandler::instance().error(
                 ErrorLevel::SEMANTIC,
-                node->keyword.line,
-                node->keyword.column,
-                "Function must return a value of type " + currentFunctionReturnType.name
+                pattern->loc.line,
+                pattern->loc.column,
+                "Match pattern of type " + patternType->name + " does not match subject of type " +
+                subjectType->name
             );
+            return false;
         }
-        return;
-    }
 
-    auto returnType = getExprType(node->value.get());
-    if (returnType) {
-        // Ensure compatibility, including array size
-        if (!symbolTable.isCompatibleTypes(currentFunctionReturnType, *returnType)) {
+        std::string reason;
+        auto constant = evaluateConstant(pattern, *subjectType, reason);
+        if (!constant) {
             ErrorHandler::instance().error(
                 ErrorLevel::SEMANTIC,
-                node->value->loc.line,
-                node->value->loc.column,
-                "Return type mismatch. Expected " + currentFunctionReturnType.name + 
-                " but got " + returnType->name
+                pattern->loc.line,
+                pattern->loc.column,
+                "Match pattern must be a compile-time constant: " + reason
             );
+            return false;
         }
-    }
-}
+        value = isBool ? (constant->boolValue ? 1 : 0) : constant->intValue;
+        return true;
+    };
 
+    std::unordered_set<int64_t> seen;
+    bool hasWildcard = false;
+    for (size_t i = 0; i < node->arms.size(); i++) {
+        MatchArm& arm = node->arms[i];
+        arm.values.clear();
 
-void SemanticAnalyzer::visit(NumberExpr* node) {
-    // Nothing to check - type is inherent
-}
+        if (arm.isWildcard()) {
+            if (i + 1 != node->arms.size()) {
+                ErrorHandler::instance().error(
+                    ErrorLevel::SEMANTIC,
+                    arm.body->loc.line,
+                    arm.body->loc.column,
+                    "Wildcard '_' must be the last match arm"
+                );
+            }
+            hasWildcard = true;
+        }
 
-void SemanticAnalyzer::visit(StringExpr* node) {
-    // Nothing to check - type is inherent
-}
+        for (auto& pattern : arm.patterns) {
+            int64_t low = 0;
+            if (!caseValue(pattern.value.get(), low)) continue;
+            int64_t high = low + 1;
+            if (pattern.end) {
+                if (isBool) {
+                    ErrorHandler::instance().error(
+                        ErrorLevel::SEMANTIC,
+                        pattern.end->loc.line,
+                        pattern.end->loc.column,
+                        "Range patterns require an int subject"
+                    );
+                    continue;
+                }
+                if (!caseValue(pattern.end.get(), high)) continue;
+                if (high <= low || high - low > maxMatchRange) {
+                    ErrorHandler::instance().error(
+                        ErrorLevel::SEMANTIC,
+                        pattern.value->loc.line,
+                        pattern.value->loc.column,
+                        "Match range " + std::to_string(low) + ".." + std::to_string(high) +
+                        " must be non-empty and cover at most " + std::to_string(maxMatchRange) + " values"
+                    );
+                    continue;
+                }
+            }
 
-void SemanticAnalyzer::visit(BoolExpr* node) {
-    // Nothing to check - type is inherent
-}
+            for (int64_t value = low; value < high; value++) {
+                if (!seen.insert(value).second) {
+                    std::string shown = isBool ? (value ? "true" : "false") : std::to_string(value);
+                    ErrorHandler::instance().error(
+                        ErrorLevel::SEMANTIC,
+                        pattern.value->loc.line,
+                        pattern.value->loc.column,
+                        "Duplicate match pattern " + shown
+                    );
+                    break;
+                }
+                arm.values.push_back(value);
+            }
+        }
 
-void SemanticAnalyzer::visit(VariableExpr* node) {
-    if (!symbolTable.resolve(node->name.value)) {
+        arm.body->accept(this);
+    }
+
+    bool exhaustive = hasWildcard || (isBool && seen.count(0) && seen.count(1));
+    if (!exhaustive) {
         ErrorHandler::instance().error(
             ErrorLevel::SEMANTIC,
-            node->name.line,
-            node->name.column,
-            "Undefined variable: " + node->name.value
+            node->keyword.line,
+            node->keyword.column,
+            isBool ? "Match on bool must cover true and false or end with '_'"
+                   : "Match on int must end with a wildcard '_' arm"
         );
     }
 }
 
-void SemanticAnalyzer::visit(ArrayAccessExpr* node) {
-    auto arrayType = getExprType(node->array.get());
-    auto indexType = getExprType(node->index.get());
+void SemanticAnalyzer::visit(ParallelForStmt* node) {
+    node->start->accept(this);
+    node->end->accept(this);
 
-    if (!arrayType) return;
+    for (Expr* bound : { node->start.get(), node->end.get() }) {
+        auto boundType = getExprType(bound);
+        if (boundType && (boundType->name != "int" || boundType->isArray)) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                bound->loc.line,
+                bound->loc.column,
+                "Parallel loop bounds must be int, got " + boundType->name
+            );
+        }
+    }
 
-    // Check if the type is actually an array
-    if (!arrayType->isArray) {
-        ErrorHandler::instance().error(
-            ErrorLevel::SEMANTIC,
-            node->array->loc.line,
-            node->array->loc.column,
-            "Cannot index non-array type"
-        );
-        return;
+    std::vector<std::string> reductions;
+    for (const auto& reduction : node->reductions) {
+        const std::string& name = reduction.variable.value;
+        Symbol* symbol = symbolTable.resolve(name);
+        if (!symbol) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                reduction.variable.line,
+                reduction.variable.column,
+                "Undefined variable: " + name
+            );
+            continue;
+        }
+
+        bool numeric = !symbol->type.isArray && (symbol->type.name == "int" || symbol->type.name == "float");
+        if (!numeric || symbol->isConstant || scopeIndexOf(name) <= 0) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                reduction.variable.line,
+                reduction.variable.column,
+                "Reduction variable '" + name + "' must be a local int or float variable"
+            );
+        } else if (std::find(reductions.begin(), reductions.end(), name) != reductions.end()) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                reduction.variable.line,
+                reduction.variable.column,
+                "Duplicate reduction variable: " + name
+            );
+        }
+        reductions.push_back(name);
+    }
+
+    size_t savedBase = parallelScopeBase;
+    std::vector<std::string> savedReductions = std::move(parallelReductions);
+    parallelScopeBase = symbolTable.getScopes().size();
+    parallelReductions = std::move(reductions);
+
+    symbolTable.enterScope();
+    symbolTable.declare(node->variable.value, Type("int"));
+    markDeclared(node->variable);
+    parallelVariables.emplace_back(parallelScopeBase, node->variable.value);
+    node->body->accept(this);
+    parallelVariables.pop_back();
+    symbolTable.exitScope();
+
+    parallelScopeBase = savedBase;
+    parallelReductions = std::move(savedReductions);
+}
+
+void SemanticAnalyzer::visit(ReturnStmt* node) {
+    if (parallelScopeBase > 0) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->keyword.line,
+            node->keyword.column,
+            "Cannot return from inside a parallel loop"
+        );
+    }
+    if (benchDepth > 0) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->keyword.line,
+            node->keyword.column,
+            "Cannot return from inside a bench block"
+        );
+    }
+
+    if (currentFunctionDecl && currentFunctionDecl->isGenerator) {
+        if (node->value) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->keyword.line,
+                node->keyword.column,
+                "Generator functions cannot return a value; use 'yield'"
+            );
+        }
+        return;
+    }
+
+    if (!node->value) {
+        if (currentFunctionReturnType.name != "void") {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->keyword.line,
+                node->keyword.column,
+                "Function must return a value of type " + currentFunctionReturnType.name
+            );
+        }
+        return;
+    }
+
+    node->value->accept(this);
+    auto returnType = getExprType(node->value.get());
+    if (returnType) {
+        // Ensure compatibility, including array size
+        if (!symbolTable.isCompatibleTypes(currentFunctionReturnType, *returnType)) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->value->loc.line,
+                node->value->loc.column,
+                "Return type mismatch. Expected " + currentFunctionReturnType.name + 
+                " but got " + returnType->name
+            );
+        }
+    }
+}
+
+
+void SemanticAnalyzer::visit(NumberExpr* node) {
+    // Nothing to check - type is inherent
+}
+
+void SemanticAnalyzer::visit(StringExpr* node) {
+    // Nothing to check - type is inherent
+}
+
+void SemanticAnalyzer::visit(BoolExpr* node) {
+    // Nothing to check - type is inherent
+}
+
+void SemanticAnalyzer::visit(VariableExpr* node) {
+    Symbol* symbol = symbolTable.resolve(node->name.value);
+    if (!symbol) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->name.line,
+            node->name.column,
+            "Undefined variable: " + node->name.value
+        );
+    } else if (symbol->type.isAtomic() && !symbol->type.isArray && !atomicOperand) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->name.line,
+            node->name.column,
+            "Atomic variable '" + node->name.value + "' can only be used through atomic operations"
+        );
+    }
+    recordBinding(node->name, symbol);
+}
+
+void SemanticAnalyzer::visit(ArrayAccessExpr* node) {
+    bool operand = atomicOperand;
+    atomicOperand = false;
+    node->array->accept(this);
+    node->index->accept(this);
+
+    auto arrayType = getExprType(node->array.get());
+    auto indexType = getExprType(node->index.get());
+
+    if (!arrayType) return;
+
+    // Check if the type is actually an array
+    if (!arrayType->isArray) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->array->loc.line,
+            node->array->loc.column,
+            "Cannot index non-array type"
+        );
+        return;
     }
 
     // Check if index is an integer
@@ -510,9 +1194,20 @@ void SemanticAnalyzer::visit(ArrayAccessExpr* node) {
             "Array index must be an integer"
         );
     }
+
+    if (arrayType->isAtomic() && !operand) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->loc.line,
+            node->loc.column,
+            "Atomic array elements can only be used through atomic operations"
+        );
+    }
 }
 
 void SemanticAnalyzer::visit(UnaryExpr* node) {
+    node->expr->accept(this);
+
     auto operandType = getExprType(node->expr.get());
     if (!operandType) return;
 
@@ -548,6 +1243,22 @@ void SemanticAnalyzer::visit(UnaryExpr* node) {
 }
 
 void SemanticAnalyzer::visit(CallExpr* node) {
+    bool iterated = generatorSource;
+    generatorSource = false;
+    if (!iterated && generatorFunctions.count(node->name.value)) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->name.line,
+            node->name.column,
+            "Generator '" + node->name.value + "' can only be iterated with 'for ... in'"
+        );
+    }
+
+    if (isAtomicBuiltin(node->name.value)) {
+        checkAtomicCall(node);
+        return;
+    }
+
     auto* func = symbolTable.resolveFunction(node->name.value);
     if (!func) {
         ErrorHandler::instance().error(
@@ -558,6 +1269,7 @@ void SemanticAnalyzer::visit(CallExpr* node) {
         );
         return;
     }
+    recordBinding(node->name, func);
     
     // Check argument count
     if (func->parameters.size() != node->arguments.size()) {
@@ -572,8 +1284,25 @@ void SemanticAnalyzer::visit(CallExpr* node) {
         return;
     }
 
+    // Calls to generic functions are redirected to the instance for the argument types
+    bool argumentsVisited = false;
+    auto generic = genericFunctions.find(node->name.value);
+    if (generic != genericFunctions.end()) {
+        for (const auto& arg : node->arguments) {
+            arg->accept(this);
+        }
+        argumentsVisited = true;
+
+        if (!instantiateGenericCall(node, generic->second)) return;
+        func = symbolTable.resolveFunction(node->name.value);
+    }
+
     // Check argument types
+    bool argumentsValid = true;
     for (size_t i = 0; i < node->arguments.size(); i++) {
+        if (!argumentsVisited) {
+            node->arguments[i]->accept(this);
+        }
         auto argType = getExprType(node->arguments[i].get());
         if (argType && !symbolTable.isCompatibleTypes(func->parameters[i].type, *argType)) {
             ErrorHandler::instance().error(
@@ -583,11 +1312,453 @@ void SemanticAnalyzer::visit(CallExpr* node) {
                 "Argument type mismatch. Expected " + func->parameters[i].type.name +
                 " but got " + argType->name
             );
+            argumentsValid = false;
+        }
+        if (argType && isNumericBuiltin(node->name.value) &&
+            (argType->isArray || (argType->name != "int" && argType->name != "float"))) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->arguments[i]->loc.line,
+                node->arguments[i]->loc.column,
+                "Function " + node->name.value + " requires numeric arguments but got " +
+                argType->name
+            );
+            argumentsValid = false;
+        }
+        if (argType && node->name.value == "black_box" && func->isBuiltin &&
+            (argType->isArray || (argType->name != "int" && argType->name != "float" && argType->name != "bool"))) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->arguments[i]->loc.line,
+                node->arguments[i]->loc.column,
+                "black_box requires an int, float or bool argument but got " + argType->name
+            );
+            argumentsValid = false;
         }
     }
+
+    if (argumentsValid && isChannelBuiltin(node->name.value)) {
+        checkChannelCall(node);
+    }
+    if (argumentsValid && isBitsBuiltin(node->name.value)) {
+        checkBitsCall(node);
+    }
+    if (argumentsValid && func->isBuiltin &&
+        (node->name.value == "counter" || node->name.value == "gauge" || node->name.value == "histogram") &&
+        !dynamic_cast<StringExpr*>(node->arguments[0].get())) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->arguments[0]->loc.line,
+            node->arguments[0]->loc.column,
+            "The name of metric " + node->name.value + " must be a string literal"
+        );
+    }
+    if (argumentsValid) {
+        checkConstCall(node, func);
+    }
+}
+
+void SemanticAnalyzer::checkAtomicCall(CallExpr* node) {
+    const std::string& name = node->name.value;
+    auto* func = symbolTable.resolveFunction(name);
+    size_t operands = func->parameters.size();
+    if (node->arguments.size() != operands && node->arguments.size() != operands + 1) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->name.line,
+            node->name.column,
+            "Wrong number of arguments to function " + name + ". Expected " + std::to_string(operands) +
+            " and an optional memory ordering but got " + std::to_string(node->arguments.size())
+        );
+        return;
+    }
+
+    // The ordering is a bare name, not a variable
+    if (node->arguments.size() > operands) {
+        Expr* orderingArg = node->arguments.back().get();
+        auto* ordering = dynamic_cast<VariableExpr*>(orderingArg);
+        static const std::vector<std::string> orderings = { "relaxed", "acquire", "release", "acq_rel", "seq_cst" };
+        if (!ordering || std::find(orderings.begin(), orderings.end(), ordering->name.value) == orderings.end()) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                orderingArg->loc.line,
+                orderingArg->loc.column,
+                "Expected memory ordering relaxed, acquire, release, acq_rel or seq_cst"
+            );
+        } else {
+            const std::string& order = ordering->name.value;
+            bool invalid = (name == "load" && (order == "release" || order == "acq_rel")) ||
+                           (name == "store" && (order == "acquire" || order == "acq_rel"));
+            if (invalid) {
+                ErrorHandler::instance().error(
+                    ErrorLevel::SEMANTIC,
+                    orderingArg->loc.line,
+                    orderingArg->loc.column,
+                    "Memory ordering '" + order + "' is not valid for " + name
+                );
+            }
+        }
+    }
+
+    atomicOperand = true;
+    node->arguments[0]->accept(this);
+    atomicOperand = false;
+
+    auto targetType = getExprType(node->arguments[0].get());
+    if (targetType && (!targetType->isAtomic() || targetType->isArray)) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->arguments[0]->loc.line,
+            node->arguments[0]->loc.column,
+            "Function " + name + " expects an atomic variable but got " + targetType->name
+        );
+        return;
+    }
+
+    for (size_t i = 1; i < operands; i++) {
+        node->arguments[i]->accept(this);
+        auto argType = getExprType(node->arguments[i].get());
+        if (targetType && argType && !symbolTable.isCompatibleTypes(targetType->atomicValue(), *argType)) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->arguments[i]->loc.line,
+                node->arguments[i]->loc.column,
+                "Argument type mismatch. Expected " + targetType->atomicValue().name + " but got " + argType->name
+            );
+        }
+    }
+}
+
+void SemanticAnalyzer::checkChannelCall(CallExpr* node) {
+    auto channelType = getExprType(node->arguments[0].get());
+    if (!channelType) return;
+
+    if (!channelType->isChannel() || channelType->isArray) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->arguments[0]->loc.line,
+            node->arguments[0]->loc.column,
+            "Function " + node->name.value + " expects a channel but got " + channelType->name
+        );
+        return;
+    }
+
+    if (node->name.value == "send") {
+        auto valueType = getExprType(node->arguments[1].get());
+        if (valueType && !symbolTable.isCompatibleTypes(channelType->channelElement(), *valueType)) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->arguments[1]->loc.line,
+                node->arguments[1]->loc.column,
+                "Cannot send " + valueType->name + " on " + channelType->name
+            );
+        }
+    }
+}
+
+void SemanticAnalyzer::checkBitsCall(CallExpr* node) {
+    const std::string& name = node->name.value;
+    auto setType = getExprType(node->arguments[0].get());
+    if (!setType) return;
+
+    bool isBits = setType->isBits() && setType->isArray;
+    if (name == "popcount" && !isBits && (setType->name != "int" || setType->isArray)) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->arguments[0]->loc.line,
+            node->arguments[0]->loc.column,
+            "Function popcount expects an int or a bits array but got " + setType->name
+        );
+        return;
+    }
+    if (name != "popcount" && !isBits) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->arguments[0]->loc.line,
+            node->arguments[0]->loc.column,
+            "Function " + name + " expects a bits array but got " + setType->name
+        );
+        return;
+    }
+
+    // The bulk operations combine word by word, so both sets have the same size
+    if (name == "and" || name == "or") {
+        auto otherType = getExprType(node->arguments[1].get());
+        if (otherType && (!otherType->isBits() || !otherType->isArray || otherType->arraySize != setType->arraySize)) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->arguments[1]->loc.line,
+                node->arguments[1]->loc.column,
+                "Function " + name + " expects bits[" + std::to_string(setType->arraySize) + "] but got " +
+                otherType->name + (otherType->isArray ? "[" + std::to_string(otherType->arraySize) + "]" : "")
+            );
+        }
+    }
+}
+
+// Appends the tokens spelling a type argument, e.g. 'chan < int >'; false for
+// types a type parameter cannot stand for
+static bool appendTypeTokens(const Type& type, const Token& at, std::vector<Token>& tokens) {
+    static const std::unordered_map<std::string, TokenType> scalarTokens = {
+        {"int", INT}, {"float", FLOAT_TYPE}, {"bool", BOOL_TYPE}, {"str", STRING_TYPE}
+    };
+
+    auto scalar = scalarTokens.find(type.name);
+    if (scalar != scalarTokens.end()) {
+        tokens.emplace_back(scalar->second, type.name, at.line, at.column);
+        return true;
+    }
+    if (type.isChannel() || type.isAtomic()) {
+        Type inner = type.isChannel() ? type.channelElement() : type.atomicValue();
+        tokens.emplace_back(type.isChannel() ? CHAN : ATOMIC, type.isChannel() ? "chan" : "atomic", at.line, at.column);
+        tokens.emplace_back(LESS, "<", at.line, at.column);
+        if (!appendTypeTokens(inner, at, tokens)) return false;
+        tokens.emplace_back(GREATER, ">", at.line, at.column);
+        return true;
+    }
+    return false;
+}
+
+bool SemanticAnalyzer::instantiateGenericCall(CallExpr* node, FunctionDecl* generic) {
+    auto isTypeParameter = [generic](const std::string& name) {
+        const auto& params = generic->typeParameters;
+        return std::find(params.begin(), params.end(), name) != params.end();
+    };
+
+    // Infer each type parameter from the arguments bound to it
+    std::unordered_map<std::string, std::string> bindings;
+    for (size_t i = 0; i < node->arguments.size(); i++) {
+        const Type& paramType = generic->parameters[i].type;
+        if (!isTypeParameter(paramType.name)) continue;
+
+        auto argType = getExprType(node->arguments[i].get());
+        if (!argType) continue;
+
+        if (argType->isArray != paramType.isArray) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->arguments[i]->loc.line,
+                node->arguments[i]->loc.column,
+                "Argument type mismatch. Expected " + paramType.name +
+                (paramType.isArray ? "[]" : "") + " but got " + argType->name +
+                (argType->isArray ? "[]" : "")
+            );
+            return false;
+        }
+
+        auto bound = bindings.find(paramType.name);
+        if (bound == bindings.end()) {
+            bindings[paramType.name] = argType->name;
+        } else if (bound->second != argType->name) {
+            // Mixed int and float scalars widen to float, as in arithmetic
+            bool numeric = !paramType.isArray &&
+                (bound->second == "int" || bound->second == "float") &&
+                (argType->name == "int" || argType->name == "float");
+            if (!numeric) {
+                ErrorHandler::instance().error(
+                    ErrorLevel::SEMANTIC,
+                    node->arguments[i]->loc.line,
+                    node->arguments[i]->loc.column,
+                    "Conflicting types for type parameter " + paramType.name + ": " +
+                    bound->second + " and " + argType->name
+                );
+                return false;
+            }
+            bound->second = "float";
+        }
+    }
+
+    std::vector<Type> typeArguments;
+    std::string mangledName = generic->name.value + "<";
+    for (const auto& param : generic->typeParameters) {
+        auto bound = bindings.find(param);
+        if (bound == bindings.end() || bound->second == "any" || bound->second == "void") {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->name.line,
+                node->name.column,
+                "Cannot infer type parameter " + param + " in call to " + generic->name.value
+            );
+            return false;
+        }
+        std::vector<Token> spelling;
+        if (!appendTypeTokens(Type(bound->second), node->name, spelling)) {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                node->name.line,
+                node->name.column,
+                "Type " + bound->second + " cannot be used for type parameter " + param + " in call to " +
+                generic->name.value
+            );
+            return false;
+        }
+        if (!typeArguments.empty()) mangledName += ",";
+        mangledName += bound->second;
+        typeArguments.emplace_back(bound->second);
+    }
+    mangledName += ">";
+
+    // Each distinct set of type arguments is instantiated once
+    if (!genericInstances.count(mangledName) &&
+        !instantiateGeneric(generic, typeArguments, mangledName)) {
+        return false;
+    }
+
+    node->name.value = mangledName;
+    return true;
+}
+
+FunctionDecl* SemanticAnalyzer::instantiateGeneric(FunctionDecl* generic, const std::vector<Type>& typeArguments,
+                                                   const std::string& mangledName) {
+    // Substitute the type arguments into the template's tokens and parse them again
+    const auto& source = generic->templateTokens;
+    std::vector<Token> tokens;
+    bool renamed = false;
+    for (size_t i = 0; i < source.size(); i++) {
+        const Token& token = source[i];
+
+        // The declaration name gets the mangled name and loses its type parameter list
+        if (!renamed && token.type == IDENTIFIER && token.value == generic->name.value &&
+            i + 1 < source.size() && source[i + 1].type == LESS) {
+            tokens.emplace_back(IDENTIFIER, mangledName, token.line, token.column);
+            while (i < source.size() && source[i].type != GREATER) i++;
+            renamed = true;
+            continue;
+        }
+
+        if (token.type == IDENTIFIER) {
+            const auto& params = generic->typeParameters;
+            auto param = std::find(params.begin(), params.end(), token.value);
+            if (param != params.end()) {
+                if (!appendTypeTokens(typeArguments[param - params.begin()], token, tokens)) {
+                    ErrorHandler::instance().error(
+                        ErrorLevel::SEMANTIC,
+                        generic->name.line,
+                        generic->name.column,
+                        "Failed to instantiate " + mangledName
+                    );
+                    return nullptr;
+                }
+                continue;
+            }
+        }
+        tokens.push_back(token);
+    }
+    tokens.emplace_back(END, "", source.back().line, source.back().column);
+
+    Parser parser(tokens);
+    auto program = parser.parse();
+    if (!program || program->functions.size() != 1 || !program->functions[0]) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            generic->name.line,
+            generic->name.column,
+            "Failed to instantiate " + mangledName
+        );
+        return nullptr;
+    }
+
+    std::unique_ptr<FunctionDecl> instance = std::move(program->functions[0]);
+    instance->isConst = generic->isConst;
+    instance->attributes = generic->attributes;
+
+    // Instances live in the global scope next to their template
+    Scope* globalScope = symbolTable.getScopes().front().get();
+    globalScope->declareFunction(mangledName, instance->returnType, instance->parameters);
+    if (instance->isConst) {
+        static_cast<FunctionSymbol*>(symbolTable.resolveGlobal(mangledName))->isConst = true;
+        constFunctions[mangledName] = instance.get();
+    }
+
+    FunctionDecl* result = instance.get();
+    genericInstances[mangledName] = result;
+    currentProgram->functions.push_back(std::move(instance));
+    return result;
+}
+
+void SemanticAnalyzer::checkAttributes(FunctionDecl* func) {
+    for (const auto& attribute : func->attributes) {
+        if (attribute.name.value == "memo") {
+            checkMemoAttribute(func, attribute);
+        } else {
+            ErrorHandler::instance().error(
+                ErrorLevel::SEMANTIC,
+                attribute.name.line,
+                attribute.name.column,
+                "Unknown attribute '@" + attribute.name.value + "'"
+            );
+        }
+    }
+}
+
+void SemanticAnalyzer::checkMemoAttribute(FunctionDecl* func, const Attribute& memo) {
+    static const int defaultCapacity = 1024;
+    static const int maxCapacity = 65536;
+
+    auto reject = [&](const std::string& reason) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            memo.name.line,
+            memo.name.column,
+            "Function '" + func->name.value + "' cannot be memoized: " + reason
+        );
+    };
+
+    // The optional argument bounds the number of cached results
+    int capacity = defaultCapacity;
+    if (memo.arguments.size() > 1) {
+        reject("'@memo' takes at most one argument");
+        return;
+    }
+    if (memo.arguments.size() == 1) {
+        const Token& argument = memo.arguments[0];
+        long requested = argument.type == NUMBER ? std::strtol(argument.value.c_str(), nullptr, 10) : 0;
+        if (requested <= 0 || requested > maxCapacity) {
+            reject("capacity must be an integer between 1 and " + std::to_string(maxCapacity));
+            return;
+        }
+        capacity = 1;
+        while (capacity < requested) capacity <<= 1;
+    }
+
+    auto isScalar = [](const Type& type) {
+        return !type.isArray && (type.name == "int" || type.name == "float" || type.name == "bool");
+    };
+    if (!isScalar(func->returnType)) {
+        reject("return type must be int, float or bool");
+        return;
+    }
+    if (func->parameters.empty()) {
+        reject("it takes no arguments");
+        return;
+    }
+    for (const auto& param : func->parameters) {
+        if (!isScalar(param.type)) {
+            reject("parameter '" + param.name.value + "' is not an int, float or bool");
+            return;
+        }
+    }
+
+    std::unordered_map<std::string, FunctionDecl*> functions;
+    for (const auto& candidate : currentProgram->functions) {
+        if (!candidate->isGeneric()) {
+            functions[candidate->name.value] = candidate.get();
+        }
+    }
+    PurityChecker purity(functions, symbolTable);
+    std::string reason;
+    if (!purity.isPure(func, reason)) {
+        reject("it is not pure (" + reason + ")");
+        return;
+    }
+
+    func->memoCapacity = capacity;
 }
 
 void SemanticAnalyzer::visit(ArrayInitExpr* node) {
+    for (const auto& element : node->elements) {
+        element->accept(this);
+    }
     if (node->elements.empty()) return;
 
     // Get the type of the first element
@@ -609,6 +1780,8 @@ void SemanticAnalyzer::visit(ArrayInitExpr* node) {
 }
 
 void SemanticAnalyzer::visit(ArrayAllocExpr* node) {
+    node->size->accept(this);
+
     auto sizeType = getExprType(node->size.get());
     if (sizeType && sizeType->name != "int") {
         ErrorHandler::instance().error(
@@ -621,7 +1794,184 @@ void SemanticAnalyzer::visit(ArrayAllocExpr* node) {
 }
 
 void SemanticAnalyzer::visit(ExprStmt* node) {
-    node->expr->accept(this);
+    visitAllowingSpawn(node->expr.get());
+}
+
+void SemanticAnalyzer::visitAllowingSpawn(Expr* expr) {
+    spawnAllowed = dynamic_cast<SpawnExpr*>(expr) != nullptr;
+    expr->accept(this);
+    spawnAllowed = false;
+}
+
+void SemanticAnalyzer::visit(SpawnExpr* node) {
+    bool allowed = spawnAllowed;
+    spawnAllowed = false;
+
+    if (!allowed) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->keyword.line,
+            node->keyword.column,
+            "'spawn' must be a statement, the value of an '=' assignment or a variable initializer"
+        );
+    }
+    if (inConstFunction || constContextDepth > 0 || analyzingGlobals) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->keyword.line,
+            node->keyword.column,
+            "'spawn' is not allowed in a compile-time context"
+        );
+    }
+
+    node->call->accept(this);
+
+    // Only user functions can run as tasks
+    const std::string& name = node->call->name.value;
+    if (!isUserFunction(name) && symbolTable.resolveFunction(name)) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->call->name.line,
+            node->call->name.column,
+            "Cannot spawn built-in function '" + name + "'"
+        );
+    }
+
+    if (currentFunctionDecl) {
+        currentFunctionDecl->spawns = true;
+    }
+}
+
+void SemanticAnalyzer::visit(SyncStmt*) {
+    // Waiting with nothing outstanding is a no-op
+}
+
+bool SemanticAnalyzer::isUserFunction(const std::string& name) const {
+    // Calls to generics have already been renamed to their instance
+    return std::any_of(currentProgram->functions.begin(), currentProgram->functions.end(),
+                       [&](const std::unique_ptr<FunctionDecl>& func) {
+                           return func->name.value == name && !func->isGeneric();
+                       });
+}
+
+void SemanticAnalyzer::visit(ChannelExpr* node) {
+    node->capacity->accept(this);
+    auto capacityType = getExprType(node->capacity.get());
+    if (capacityType && (capacityType->name != "int" || capacityType->isArray)) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->capacity->loc.line,
+            node->capacity->loc.column,
+            "Channel capacity must be int, got " + capacityType->name
+        );
+    }
+}
+
+void SemanticAnalyzer::visit(GoStmt* node) {
+    if (inConstFunction) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->keyword.line,
+            node->keyword.column,
+            "'go' is not allowed in a compile-time context"
+        );
+    }
+
+    node->call->accept(this);
+
+    const std::string& name = node->call->name.value;
+    if (!isUserFunction(name) && symbolTable.resolveFunction(name)) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->call->name.line,
+            node->call->name.column,
+            "Cannot start built-in function '" + name + "' with 'go'"
+        );
+    }
+}
+
+void SemanticAnalyzer::visit(ForInStmt* node) {
+    auto* call = dynamic_cast<CallExpr*>(node->source.get());
+    node->generator = call && generatorFunctions.count(call->name.value);
+    generatorSource = node->generator;
+    node->source->accept(this);
+    generatorSource = false;
+
+    Type element("error");
+    auto channelType = getExprType(node->source.get());
+    if (node->generator) {
+        element = symbolTable.resolveFunction(call->name.value)->type;
+    } else if (channelType && channelType->isChannel() && !channelType->isArray) {
+        element = channelType->channelElement();
+    } else if (channelType) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->source->loc.line,
+            node->source->loc.column,
+            "Can only iterate over a channel or a generator call, got " + channelType->name
+        );
+    }
+
+    symbolTable.enterScope();
+    symbolTable.declare(node->variable.value, element);
+    markDeclared(node->variable);
+    node->body->accept(this);
+    symbolTable.exitScope();
+}
+
+void SemanticAnalyzer::visit(YieldStmt* node) {
+    node->value->accept(this);
+
+    if (!currentFunctionDecl || !currentFunctionDecl->isGenerator) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->keyword.line,
+            node->keyword.column,
+            "'yield' can only be used inside a generator function"
+        );
+        return;
+    }
+    if (parallelScopeBase > 0) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->keyword.line,
+            node->keyword.column,
+            "Cannot yield from inside a parallel loop"
+        );
+    }
+    if (benchDepth > 0) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->keyword.line,
+            node->keyword.column,
+            "Cannot yield from inside a bench block"
+        );
+    }
+
+    auto valueType = getExprType(node->value.get());
+    if (valueType && !symbolTable.isCompatibleTypes(currentFunctionReturnType, *valueType)) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->value->loc.line,
+            node->value->loc.column,
+            "Cannot yield " + valueType->name + " from a generator of " + currentFunctionReturnType.name
+        );
+    }
+}
+
+void SemanticAnalyzer::visit(BenchStmt* node) {
+    if (node->name.value.empty()) {
+        ErrorHandler::instance().error(
+            ErrorLevel::SEMANTIC,
+            node->name.line,
+            node->name.column,
+            "Benchmark name cannot be empty"
+        );
+    }
+
+    benchDepth++;
+    node->body->accept(this);
+    benchDepth--;
 }
 
 void SemanticAnalyzer::visit(TypeExpr* node) {
@@ -4,8 +4,21 @@
 #include "visitor.h"
 #include "symbol_table.h"
 #include "ast.h"
+#include "const_evaluator.h"
 #include <optional>
+#include <unordered_map>
+#include <unordered_set>
 
+// A name in the source and the symbol it resolved to, for editor queries
+struct SymbolBinding {
+    Token name;                          // The use or declaration itself
+    Symbol::Kind kind;
+    Type type;                           // Variable type or function return type
+    std::vector<Parameter> parameters;   // Functions only
+    int declarationLine;                 // 0 for builtins
+    int declarationColumn;
+    bool isGlobal;
+};
 
 class SemanticAnalyzer : public Visitor {
 public:
@@ -15,6 +28,19 @@ public:
     // Entry point for analysis
     bool analyze(Program* program);
 
+    // Analyzes one more body against the program last passed to analyze(),
+    // which must have declared it. Generic instances it creates are appended
+    // to that program and analyzed too. Used to check functions one at a time
+    // after analyzing a program of signatures with the body filter set.
+    bool analyzeFunction(FunctionDecl* function);
+
+    // Limits the body pass to the named functions. Signatures, globals and
+    // generic instances are still checked. Null analyzes every body.
+    void setBodyFilter(const std::unordered_set<std::string>* names) { bodyFilter = names; }
+
+    // Appends every declared or resolved variable and function name to 'out'
+    void setBindingRecorder(std::vector<SymbolBinding>* out) { bindings = out; }
+
     // Visitor interface implementation
     void visit(Program* node) override;
     void visit(FunctionDecl* node) override;
@@ -29,11 +55,20 @@ public:
     void visit(CallExpr* node) override;
     void visit(ArrayInitExpr* node) override;
     void visit(ArrayAllocExpr* node) override;
+    void visit(SpawnExpr* node) override;
+    void visit(ChannelExpr* node) override;
     void visit(ExprStmt* node) override;
     void visit(VarDeclStmt* node) override;
     void visit(BlockStmt* node) override;
     void visit(IfStmt* node) override;
     void visit(WhileStmt* node) override;
+    void visit(ParallelForStmt* node) override;
+    void visit(SyncStmt* node) override;
+    void visit(GoStmt* node) override;
+    void visit(ForInStmt* node) override;
+    void visit(MatchStmt* node) override;
+    void visit(YieldStmt* node) override;
+    void visit(BenchStmt* node) override;
     void visit(ReturnStmt* node) override;
     void visit(TypeExpr* node) override;
 
@@ -51,9 +86,74 @@ private:
     void ensureArrayType(const Type& type, const Token& context);
     void ensureNumericType(const Type& type, const Token& context);
     void ensureBooleanType(const Type& type, const Token& context);
-    void declareBuiltinFunctions(); 
+    void declareBuiltinFunctions();
+    bool isNumericBuiltin(const std::string& name) const;
+    bool isBuiltin(const std::string& name) const;  // Not replaced by a declaration of the program
     bool isConditionExpr(Expr* expr);
-    
+
+    // Compile-time evaluation
+    std::unordered_map<std::string, FunctionDecl*> constFunctions;  // 'const fn' declarations by name
+    std::unordered_set<std::string> shadowedBuiltins;  // Builtins the program declares functions for
+    bool inConstFunction = false;   // Analyzing the body of a 'const fn'
+    int constContextDepth = 0;      // Analyzing the initializer of a 'const' declaration
+    bool analyzingGlobals = false;  // Analyzing top-level declarations
+    std::shared_ptr<ConstValue> evaluateConstant(Expr* expr, const Type& type, std::string& reason,
+                                                 ConstEvalLimits limits = ConstEvalLimits());
+    void checkConstCall(CallExpr* node, FunctionSymbol* func);
+    void checkConstantAssignment(Expr* target, const Token& op);
+
+    // Generic functions, instantiated per set of concrete argument types
+    Program* currentProgram = nullptr;
+    std::unordered_map<std::string, FunctionDecl*> genericFunctions;  // Templates by name
+    std::unordered_map<std::string, FunctionDecl*> genericInstances;  // Instances by mangled name
+    bool instantiateGenericCall(CallExpr* node, FunctionDecl* generic);
+    FunctionDecl* instantiateGeneric(FunctionDecl* generic, const std::vector<Type>& typeArguments,
+                                     const std::string& mangledName);
+
+    // Parallel loops
+    size_t parallelScopeBase = 0;               // Scopes below this index are shared between iterations
+    std::vector<std::string> parallelReductions;  // Reduction variables of the innermost parallel loop
+    std::vector<std::pair<size_t, std::string>> parallelVariables;  // Scope and name of each enclosing loop variable
+    int scopeIndexOf(const std::string& name) const;
+    void checkParallelAssignment(Expr* target, const Token& op);
+
+    // Fork-join calls
+    FunctionDecl* currentFunctionDecl = nullptr;
+    bool spawnAllowed = false;  // The expression being visited may be a 'spawn'
+    void visitAllowingSpawn(Expr* expr);
+    bool isUserFunction(const std::string& name) const;
+
+    // Channels
+    bool isChannelBuiltin(const std::string& name) const;
+    void checkChannelCall(CallExpr* node);
+
+    // Packed bool arrays
+    bool isBitsBuiltin(const std::string& name) const;
+    void checkBitsCall(CallExpr* node);
+
+    // Atomics
+    bool atomicOperand = false;  // Visiting the atomic argument of an atomic builtin
+    bool isAtomicBuiltin(const std::string& name) const;
+    void checkAtomicCall(CallExpr* node);
+
+    // Generators
+    std::unordered_set<std::string> generatorFunctions;  // 'fn gen' declarations by name
+    bool generatorSource = false;  // Visiting the source of a 'for ... in' loop
+    void checkGenerator(FunctionDecl* func);
+
+    // Benchmarks
+    int benchDepth = 0;  // Nesting depth of 'bench' blocks around the current statement
+
+    // Editor support
+    const std::unordered_set<std::string>* bodyFilter = nullptr;
+    std::vector<SymbolBinding>* bindings = nullptr;
+    void recordBinding(const Token& name, Symbol* symbol);
+    void markDeclared(const Token& name);
+
+    // Function attributes
+    void checkAttributes(FunctionDecl* func);
+    void checkMemoAttribute(FunctionDecl* func, const Attribute& memo);
+
 };
 
 #endif // SEMANTIC_VISITOR_H
\ No newline at end of file
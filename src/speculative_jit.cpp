@@ -0,0 +1,210 @@
+#include "speculative_jit.h"
+#include "jit_memory.h"
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutorProcessControl.h>
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/ErrorHandling.h>
+
+namespace Lei {
+
+namespace {
+
+// Resolves symbols in the process, including the runtime functions registered
+// with DynamicLibrary::AddSymbol, which the stock process generator misses
+class ProcessSymbols : public llvm::orc::DefinitionGenerator {
+public:
+    llvm::Error tryToGenerate(llvm::orc::LookupState&, llvm::orc::LookupKind, llvm::orc::JITDylib& dylib,
+                              llvm::orc::JITDylibLookupFlags,
+                              const llvm::orc::SymbolLookupSet& symbols) override {
+        llvm::orc::SymbolMap found;
+        for (const auto& symbol : symbols) {
+            if (void* address = llvm::sys::DynamicLibrary::SearchForAddressOfSymbol((*symbol.first).str())) {
+                found[symbol.first] = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(address),
+                                                               llvm::JITSymbolFlags::Exported);
+            }
+        }
+        if (found.empty()) return llvm::Error::success();
+        return dylib.define(llvm::orc::absoluteSymbols(std::move(found)));
+    }
+};
+
+// Called through a stub whose function failed to compile; the session has
+// already reported why
+void lazyCompileFailed() {
+    llvm::report_fatal_error("JIT compilation of a called function failed");
+}
+
+} // namespace
+
+llvm::Expected<std::unique_ptr<SpeculativeJit>> SpeculativeJit::create(unsigned compileThreads) {
+    auto processControl = llvm::orc::SelfExecutorProcessControl::Create();
+    if (!processControl) return processControl.takeError();
+    auto session = std::make_unique<llvm::orc::ExecutionSession>(std::move(*processControl));
+    auto fail = [&](llvm::Error error) {
+        llvm::consumeError(session->endSession());
+        return error;
+    };
+
+    auto targetBuilder = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!targetBuilder) return fail(targetBuilder.takeError());
+    auto layout = targetBuilder->getDefaultDataLayoutForTarget();
+    if (!layout) return fail(layout.takeError());
+    auto callThroughs = llvm::orc::createLocalLazyCallThroughManager(
+        targetBuilder->getTargetTriple(), *session, llvm::pointerToJITTargetAddress(&lazyCompileFailed));
+    if (!callThroughs) return fail(callThroughs.takeError());
+
+    std::unique_ptr<SpeculativeJit> jit(new SpeculativeJit(std::move(session), std::move(*targetBuilder),
+                                                           std::move(*layout), std::move(*callThroughs),
+                                                           compileThreads));
+    llvm::orc::SymbolMap runtime;
+    runtime[jit->mangle("lei_speculate")] = llvm::JITEvaluatedSymbol(
+        llvm::pointerToJITTargetAddress(&SpeculativeJit::speculate),
+        llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+    if (auto error = jit->mainDylib.define(llvm::orc::absoluteSymbols(std::move(runtime)))) {
+        return error;
+    }
+    return jit;
+}
+
+SpeculativeJit::SpeculativeJit(std::unique_ptr<llvm::orc::ExecutionSession> executionSession,
+                               llvm::orc::JITTargetMachineBuilder targetBuilder, llvm::DataLayout dataLayout,
+                               std::unique_ptr<llvm::orc::LazyCallThroughManager> lazyCallThroughs,
+                               unsigned compileThreads)
+    : session(std::move(executionSession)),
+      layout(std::move(dataLayout)),
+      mangle(*session, layout),
+      mainDylib(session->createBareJITDylib("<main>")),
+      callThroughs(std::move(lazyCallThroughs)),
+      compilePool(llvm::hardware_concurrency(compileThreads)),
+      objectLayer(*session, []() { return std::make_unique<JitMemoryManager>(); }),
+      compileLayer(*session, objectLayer, std::make_unique<llvm::orc::ConcurrentIRCompiler>(targetBuilder)),
+      speculationLayer(*session, compileLayer,
+                       [this](llvm::orc::ThreadSafeModule module,
+                              llvm::orc::MaterializationResponsibility& responsibility) {
+                           return instrument(std::move(module), responsibility);
+                       }),
+      lazyLayer(*session, speculationLayer, *callThroughs,
+                llvm::orc::createLocalIndirectStubsManagerBuilder(targetBuilder.getTargetTriple())) {
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    mainDylib.addGenerator(std::make_unique<ProcessSymbols>());
+
+    // Materialization, whether for a call or for speculation, runs on the pool
+    session->setDispatchTask([this](std::unique_ptr<llvm::orc::Task> task) {
+        compilePool.async([owned = task.release()]() {
+            std::unique_ptr<llvm::orc::Task>(owned)->run();
+        });
+    });
+}
+
+SpeculativeJit::~SpeculativeJit() {
+    compilePool.wait();
+    if (auto error = session->endSession()) {
+        session->reportError(std::move(error));
+    }
+}
+
+llvm::Error SpeculativeJit::addModule(llvm::orc::ThreadSafeModule module) {
+    module.withModuleDo([this](llvm::Module& m) {
+        m.setDataLayout(layout);
+        std::lock_guard<std::mutex> lock(definedMutex);
+        for (llvm::Function& function : m) {
+            if (!function.isDeclaration()) defined.insert(function.getName().str());
+        }
+    });
+    return lazyLayer.add(mainDylib, std::move(module));
+}
+
+// The static call graph is the speculation: when a function first runs,
+// the program's functions it calls directly are likely to run soon. Runtime
+// and C library functions are resolved already and left out.
+llvm::orc::SymbolLookupSet SpeculativeJit::likelyCallees(llvm::Function& function) {
+    llvm::orc::SymbolLookupSet callees;
+    std::lock_guard<std::mutex> lock(definedMutex);
+    for (llvm::Instruction& instruction : llvm::instructions(function)) {
+        auto* call = llvm::dyn_cast<llvm::CallBase>(&instruction);
+        llvm::Function* callee = call ? call->getCalledFunction() : nullptr;
+        if (callee && callee != &function && defined.count(callee->getName())) {
+            // A callee whose module has not been split into stub and body yet
+            // has no body to look up; it is left to its first call
+            callees.add(mangle(callee->getName()), llvm::orc::SymbolLookupFlags::WeaklyReferencedSymbol);
+        }
+    }
+    callees.removeDuplicates();
+    return callees;
+}
+
+// Each function with likely callees gets a guard byte and, in front of its
+// entry block, a call to lei_speculate that runs while the guard is clear.
+// The callees are recorded here, before the function can run, so its first
+// run always finds them.
+llvm::Expected<llvm::orc::ThreadSafeModule> SpeculativeJit::instrument(
+    llvm::orc::ThreadSafeModule module, llvm::orc::MaterializationResponsibility& responsibility) {
+    module.withModuleDo([&](llvm::Module& m) {
+        llvm::LLVMContext& context = m.getContext();
+        llvm::Type* int64 = llvm::Type::getInt64Ty(context);
+        llvm::Type* bytePointer = llvm::Type::getInt8PtrTy(context);
+        llvm::FunctionCallee entry = m.getOrInsertFunction(
+            "lei_speculate", llvm::FunctionType::get(llvm::Type::getVoidTy(context), { bytePointer, int64 }, false));
+        llvm::Constant* self = llvm::ConstantExpr::getIntToPtr(
+            llvm::ConstantInt::get(int64, reinterpret_cast<uintptr_t>(this)), bytePointer);
+
+        for (llvm::Function& function : m) {
+            if (function.isDeclaration()) continue;
+            llvm::orc::SymbolLookupSet callees = likelyCallees(function);
+            if (callees.empty()) continue;
+
+            uint64_t index;
+            {
+                std::lock_guard<std::mutex> lock(speculationsMutex);
+                index = speculations.size();
+                speculations.push_back({ &responsibility.getTargetJITDylib(), std::move(callees) });
+            }
+
+            llvm::Type* byte = llvm::Type::getInt8Ty(context);
+            auto* guard = new llvm::GlobalVariable(m, byte, false, llvm::GlobalValue::InternalLinkage,
+                                                   llvm::ConstantInt::get(byte, 0),
+                                                   function.getName() + ".speculated");
+            llvm::BasicBlock* body = &function.getEntryBlock();
+            auto* check = llvm::BasicBlock::Create(context, "speculate.check", &function, body);
+            auto* call = llvm::BasicBlock::Create(context, "speculate", &function, body);
+
+            llvm::IRBuilder<> builder(check);
+            llvm::Value* first = builder.CreateICmpEQ(builder.CreateLoad(byte, guard), llvm::ConstantInt::get(byte, 0));
+            builder.CreateCondBr(first, call, body);
+            builder.SetInsertPoint(call);
+            builder.CreateStore(llvm::ConstantInt::get(byte, 1), guard);
+            builder.CreateCall(entry, { self, llvm::ConstantInt::get(int64, index) });
+            builder.CreateBr(body);
+        }
+    });
+    return module;
+}
+
+// Looking up the bodies materializes them, which dispatches their
+// compilation to the pool; the program does not wait for the result
+void SpeculativeJit::speculate(SpeculativeJit* jit, uint64_t index) {
+    Speculation speculation{};
+    {
+        std::lock_guard<std::mutex> lock(jit->speculationsMutex);
+        speculation = jit->speculations[index];
+    }
+    jit->session->lookup(
+        llvm::orc::LookupKind::Static,
+        llvm::orc::makeJITDylibSearchOrder(speculation.dylib, llvm::orc::JITDylibLookupFlags::MatchAllSymbols),
+        std::move(speculation.callees), llvm::orc::SymbolState::Ready,
+        [jit](llvm::Expected<llvm::orc::SymbolMap> result) {
+            if (!result) jit->session->reportError(result.takeError());
+        },
+        llvm::orc::NoDependenciesToRegister);
+}
+
+llvm::Expected<llvm::JITEvaluatedSymbol> SpeculativeJit::lookup(llvm::StringRef name) {
+    return session->lookup({ &mainDylib }, mangle(name));
+}
+
+} // namespace Lei
@@ -0,0 +1,83 @@
+#ifndef SPECULATIVE_JIT_H
+#define SPECULATIVE_JIT_H
+
+#include <llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h>
+#include <llvm/ExecutionEngine/Orc/Core.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/IRTransformLayer.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LazyReexports.h>
+#include <llvm/ExecutionEngine/Orc/Mangling.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/Support/ThreadPool.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Lei {
+
+// Lazy ORC JIT that compiles on a pool of threads and compiles ahead.
+//
+// Every function starts out as a stub and is compiled the first time it is
+// called. Compilation runs on the pool rather than on the program's thread,
+// and the first time a function runs it queues all of its direct callees on
+// the pool too, so by the time the program reaches them they are usually
+// ready and the call no longer waits for the compiler.
+class SpeculativeJit {
+public:
+    static llvm::Expected<std::unique_ptr<SpeculativeJit>> create(unsigned compileThreads);
+    ~SpeculativeJit();
+
+    const llvm::DataLayout& getDataLayout() const { return layout; }
+
+    // Adds a module; nothing is compiled until one of its functions is looked up
+    llvm::Error addModule(llvm::orc::ThreadSafeModule module);
+
+    // Address of a function's stub, which compiles the function on first call
+    llvm::Expected<llvm::JITEvaluatedSymbol> lookup(llvm::StringRef name);
+
+private:
+    SpeculativeJit(std::unique_ptr<llvm::orc::ExecutionSession> executionSession,
+                   llvm::orc::JITTargetMachineBuilder targetBuilder, llvm::DataLayout dataLayout,
+                   std::unique_ptr<llvm::orc::LazyCallThroughManager> lazyCallThroughs, unsigned compileThreads);
+
+    // Functions of the program that 'function' calls directly
+    llvm::orc::SymbolLookupSet likelyCallees(llvm::Function& function);
+
+    // Makes each function queue its likely callees the first time it runs
+    llvm::Expected<llvm::orc::ThreadSafeModule> instrument(llvm::orc::ThreadSafeModule module,
+                                                           llvm::orc::MaterializationResponsibility& responsibility);
+
+    // Called from instrumented code with the index of the function's entry in 'speculations'
+    static void speculate(SpeculativeJit* jit, uint64_t index);
+
+    std::unique_ptr<llvm::orc::ExecutionSession> session;
+    llvm::DataLayout layout;
+    llvm::orc::MangleAndInterner mangle;
+    llvm::orc::JITDylib& mainDylib;
+    std::unique_ptr<llvm::orc::LazyCallThroughManager> callThroughs;
+    llvm::ThreadPool compilePool;
+
+    llvm::orc::RTDyldObjectLinkingLayer objectLayer;
+    llvm::orc::IRCompileLayer compileLayer;
+    llvm::orc::IRTransformLayer speculationLayer;
+    llvm::orc::CompileOnDemandLayer lazyLayer;
+
+    std::mutex definedMutex;
+    llvm::StringSet<> defined;  // Functions with a body in some added module
+
+    // Likely callees of each instrumented function, and the dylib holding their bodies
+    struct Speculation {
+        llvm::orc::JITDylib* dylib;
+        llvm::orc::SymbolLookupSet callees;
+    };
+    std::mutex speculationsMutex;
+    std::vector<Speculation> speculations;
+};
+
+} // namespace Lei
+
+#endif // SPECULATIVE_JIT_H
@@ -37,9 +37,18 @@ void SymbolTable::print() const {
 
 
 
+// A builtin function does not reserve its name: a declaration of the
+// program's own replaces it
+bool Scope::isTaken(const std::string& name) const {
+    auto it = symbols.find(name);
+    if (it == symbols.end()) return false;
+    const Symbol* symbol = it->second.get();
+    return symbol->kind != Symbol::Kind::FUNCTION || !static_cast<const FunctionSymbol*>(symbol)->isBuiltin;
+}
+
 bool Scope::declare(const std::string& name, const Type& type) {
     // Check if symbol already exists in current scope
-    if (symbols.find(name) != symbols.end()) {
+    if (isTaken(name)) {
         return false;
     }
 
@@ -50,7 +59,7 @@ bool Scope::declare(const std::string& name, const Type& type) {
 bool Scope::declareFunction(const std::string& name, const Type& returnType,
                           const std::vector<Parameter>& params) {
     // Check if function already exists in current scope
-    if (symbols.find(name) != symbols.end()) {
+    if (isTaken(name)) {
         return false;
     }
 
@@ -101,16 +110,8 @@ bool SymbolTable::declareFunction(const std::string& name, const Type& returnTyp
         return false;
     }
 
-    if (!currentScope()->declareFunction(name, returnType, params)) {
-        ErrorHandler::instance().error(
-            ErrorLevel::SEMANTIC,
-            0, 0,
-            "Function '" + name + "' already declared in current scope"
-        );
-        return false;
-    }
-
-    return true;
+    // The caller reports a duplicate at the declaration
+    return currentScope()->declareFunction(name, returnType, params);
 }
 
 Symbol* SymbolTable::resolve(const std::string& name) {
@@ -118,6 +119,13 @@ Symbol* SymbolTable::resolve(const std::string& name) {
     return currentScope()->resolve(name);
 }
 
+Symbol* SymbolTable::resolveGlobal(const std::string& name) {
+    if (scopes.empty()) return nullptr;
+    const auto& globals = scopes.front()->getSymbols();
+    auto it = globals.find(name);
+    return it != globals.end() ? it->second.get() : nullptr;
+}
+
 FunctionSymbol* SymbolTable::resolveFunction(const std::string& name) {
     Symbol* symbol = resolve(name);
     if (!symbol || symbol->kind != Symbol::Kind::FUNCTION) {
@@ -28,6 +28,10 @@ public:
     Kind kind;
     llvm::Value* llvmValue;     // For variables: alloca or global value
     bool isAlloca = false;      // Track if the value is an alloca instruction
+    bool isConstant = false;    // Declared with 'const'; llvmValue holds the constant itself
+    int line = 0;               // Declaration site, 0 for builtins
+    int column = 0;
+    std::shared_ptr<ConstValue> constValue;  // Compile-time value of a constant
 };
 
 // Function-specific symbol information
@@ -40,6 +44,8 @@ public:
 
     std::vector<Parameter> parameters;
     llvm::Function* llvmFunction;  // LLVM Function representation
+    bool isConst = false;          // 'const fn', evaluable at compile time
+    bool isBuiltin = false;        // Declared by the compiler; the program may reuse the name
 };
 
 // Represents a single scope level
@@ -60,6 +66,8 @@ public:
     Scope* getParent() const { return parent; }
 
 private:
+    bool isTaken(const std::string& name) const;
+
     std::unordered_map<std::string, std::unique_ptr<Symbol>> symbols;
     Scope* parent;
 };
@@ -89,6 +97,7 @@ public:
     bool declareFunction(const std::string& name, const Type& returnType,
                         const std::vector<Parameter>& params);
     Symbol* resolve(const std::string& name);
+    Symbol* resolveGlobal(const std::string& name);
     FunctionSymbol* resolveFunction(const std::string& name);
 
     // Type checking helpers
@@ -99,6 +108,13 @@ public:
     const std::vector<std::unique_ptr<Scope>>& getScopes() const { return scopes; }
     void print() const;
 
+    // Drops every symbol and starts over with an empty global scope, so one
+    // process can analyze several programs
+    void reset() {
+        scopes.clear();
+        enterScope();
+    }
+
 private:
     SymbolTable() { enterScope(); }  // Create initial global scope
     std::vector<std::unique_ptr<Scope>> scopes;
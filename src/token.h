@@ -16,6 +16,21 @@ enum TokenType {
     IF,             ///< If statement 'if'
     ELSE,           ///< Else statement 'else'
     WHILE,          ///< While loop 'while'
+    CONST,          ///< Compile-time constant 'const'
+    THREADLOCAL,    ///< Thread-local global 'threadlocal'
+    PARALLEL,       ///< Parallel loop 'parallel'
+    FOR,            ///< Loop over a range 'for'
+    IN,             ///< Range introducer 'in'
+    REDUCE,         ///< Reduction clause 'reduce'
+    SPAWN,          ///< Asynchronous call 'spawn'
+    SYNC,           ///< Wait for spawned calls 'sync'
+    CHAN,           ///< Channel type 'chan'
+    GO,             ///< Thread launch 'go'
+    ATOMIC,         ///< Atomic type 'atomic'
+    MATCH,          ///< Multi-way branch 'match'
+    GEN,            ///< Generator function 'gen'
+    YIELD,          ///< Generator output 'yield'
+    BENCH,          ///< Benchmark block 'bench'
     
     // Literals
     IDENTIFIER,     ///< Variable/function names
@@ -55,6 +70,9 @@ enum TokenType {
     SEMICOLON,      ///< Semicolon ';'
     COLON,          ///< Colon ':'
     COMMA,          ///< Comma ','
+    AT,             ///< Attribute marker '@'
+    DOT_DOT,        ///< Half-open range '..'
+    FAT_ARROW,      ///< Match arm separator '=>'
     
     // Special
     END,            ///< End of file marker
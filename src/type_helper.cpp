@@ -6,6 +6,12 @@ llvm::Type* TypeHelper::getLLVMType(const Type& type) {
     llvm::Type* baseType = nullptr;
 
     // Map our type system to LLVM types
+    if (type.isBits()) {
+        // bits[N] is stored as ceil(N / 64) words
+        llvm::Type* word = llvm::Type::getInt64Ty(*context);
+        return type.isArray ? llvm::ArrayType::get(word, bitWords(type.arraySize)) : word;
+    }
+
     if (type.name == "int") {
         baseType = llvm::Type::getInt32Ty(*context);
     } else if (type.name == "float") {
@@ -16,6 +22,16 @@ llvm::Type* TypeHelper::getLLVMType(const Type& type) {
         baseType = llvm::Type::getVoidTy(*context);
     } else if (type.name == "str") {
         baseType = llvm::Type::getInt8PtrTy(*context);
+    } else if (type.isAtomic()) {
+        // Atomics are plain storage accessed with atomic instructions
+        baseType = getLLVMType(type.atomicValue());
+    } else if (type.isChannel()) {
+        // Channels are runtime handles; the opaque struct's name keeps the element type
+        llvm::StructType* handle = llvm::StructType::getTypeByName(*context, type.name);
+        if (!handle) {
+            handle = llvm::StructType::create(*context, type.name);
+        }
+        baseType = handle->getPointerTo();
     }
 
     if (!baseType) {
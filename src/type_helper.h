@@ -14,7 +14,8 @@ public:
     static TypeHelper& instance(llvm::LLVMContext* context = nullptr, 
                                 llvm::IRBuilder<>* builder = nullptr) {
         static TypeHelper instance;
-        if (context && builder && !instance.isInitialized()) {
+        // Rebinds on every codegen setup, since a compiler may outlive its first context
+        if (context && builder) {
             instance.context = context;
             instance.builder = builder;
             instance.initialized = true;
@@ -33,6 +34,7 @@ public:
     // Core type operations
     llvm::Value* convert(llvm::Value* value, llvm::Type* targetType);
     llvm::Type* getLLVMType(const Type& type);
+    static uint64_t bitWords(int bitCount) { return (static_cast<uint64_t>(bitCount) + 63) / 64; }
     bool areTypesCompatible(llvm::Type* source, llvm::Type* target);
 
     // Type promotion for operations
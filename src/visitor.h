@@ -15,12 +15,21 @@ class AssignExpr;
 class CallExpr;
 class ArrayInitExpr;
 class ArrayAllocExpr;
+class SpawnExpr;
+class ChannelExpr;
 class TypeExpr;
 class ExprStmt;
 class VarDeclStmt;
 class BlockStmt;
 class IfStmt;
 class WhileStmt;
+class ParallelForStmt;
+class SyncStmt;
+class GoStmt;
+class ForInStmt;
+class MatchStmt;
+class YieldStmt;
+class BenchStmt;
 class ReturnStmt;
 
 class Visitor {
@@ -40,12 +49,21 @@ public:
     virtual void visit(CallExpr* node) = 0;
     virtual void visit(ArrayInitExpr* node) = 0;
     virtual void visit(ArrayAllocExpr* node) = 0;
+    virtual void visit(SpawnExpr* node) = 0;
+    virtual void visit(ChannelExpr* node) = 0;
     virtual void visit(TypeExpr* node) = 0;
     virtual void visit(ExprStmt* node) = 0;
     virtual void visit(VarDeclStmt* node) = 0;
     virtual void visit(BlockStmt* node) = 0;
     virtual void visit(IfStmt* node) = 0;
     virtual void visit(WhileStmt* node) = 0;
+    virtual void visit(ParallelForStmt* node) = 0;
+    virtual void visit(SyncStmt* node) = 0;
+    virtual void visit(GoStmt* node) = 0;
+    virtual void visit(ForInStmt* node) = 0;
+    virtual void visit(MatchStmt* node) = 0;
+    virtual void visit(YieldStmt* node) = 0;
+    virtual void visit(BenchStmt* node) = 0;
     virtual void visit(ReturnStmt* node) = 0;
 
 };
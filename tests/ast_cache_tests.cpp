@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include "lexer.h"
+#include "parser.h"
+#include "semantic_visitor.h"
+#include "codegen_visitor.h"
+#include "error_handler.h"
+#include "ast_cache.h"
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <fstream>
+#include <sstream>
+
+class AstCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ErrorHandler::instance().clearAllErrors();
+        SymbolTable::instance().reset();
+        directory = testing::TempDir() + "lei_ast_cache_" +
+                    testing::UnitTest::GetInstance()->current_test_info()->name();
+        llvm::sys::fs::remove_directories(directory);
+    }
+
+    void TearDown() override {
+        llvm::sys::fs::remove_directories(directory);
+        SymbolTable::instance().reset();
+    }
+
+    std::unique_ptr<Program> analyze(const std::string& source) {
+        Lexer lexer(source);
+        auto tokens = lexer.tokenize();
+        Parser parser(tokens);
+        auto ast = parser.parse();
+        if (!ast || ErrorHandler::instance().hasErrors()) return nullptr;
+
+        SemanticAnalyzer analyzer(SymbolTable::instance());
+        if (!analyzer.analyze(ast.get())) return nullptr;
+        return ast;
+    }
+
+    // Each module gets a context of its own, so type names are not uniqued against an earlier one
+    static std::string generate(Program* program) {
+        llvm::LLVMContext context;
+        CodegenVisitor codegen(context);
+        auto module = codegen.generateModule(program, "test");
+        if (!module) return "";
+
+        std::string ir;
+        llvm::raw_string_ostream out(ir);
+        module->print(out, nullptr);
+        return out.str();
+    }
+
+    // Path of the single entry in the cache directory
+    std::string entry() const {
+        std::error_code ec;
+        for (llvm::sys::fs::directory_iterator it(directory, ec), end; it != end && !ec; it.increment(ec)) {
+            if (llvm::StringRef(it->path()).endswith(".leiast")) return it->path();
+        }
+        return "";
+    }
+
+    static std::string readFile(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        return contents.str();
+    }
+
+    static void writeFile(const std::string& path, const std::string& contents) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << contents;
+    }
+
+    std::string directory;
+};
+
+static const char* program = R"(
+const SQUARES: int[4] = {0, 1, 4, 9};
+var calls: int = 0;
+
+const fn int fact(n: int) {
+    var r: int = 1;
+    while (n > 1) { r *= n; n -= 1; }
+    return r;
+}
+
+fn T largest<T>(a: T, b: T) {
+    if a > b { return a; }
+    return b;
+}
+
+fn int max(a: int, b: int) {
+    return a;
+}
+
+@memo
+fn int fib(n: int) {
+    if n < 2 { return n; }
+    return fib(n - 1) + fib(n - 2);
+}
+
+fn gen int range(n: int) {
+    var i: int = 0;
+    while (i < n) { yield i; i += 1; }
+}
+
+fn int main() {
+    const F: int = fact(5);
+    var total: int = 0;
+    for i in range(4) {
+        match i {
+            0 => { total += SQUARES[i]; }
+            _ => { total += largest(i, 2); }
+        }
+    }
+    calls += 1;
+    var f: float = largest(1.5, 2.5) + sqrt(2.0);
+    return total + F + fib(10) + max(1, 2);
+}
+)";
+
+// A loaded program generates the same module as the analyzed one, and the
+// global scope comes back with it
+TEST_F(AstCacheTest, RoundTrip) {
+    Lei::AstCache cache(directory);
+    auto analyzed = analyze(program);
+    ASSERT_TRUE(analyzed);
+    cache.store(program, *analyzed, SymbolTable::instance());
+    ASSERT_FALSE(entry().empty());
+    std::string expected = generate(analyzed.get());
+    ASSERT_FALSE(expected.empty());
+
+    SymbolTable::instance().reset();
+    auto loaded = cache.load(program, SymbolTable::instance());
+    ASSERT_TRUE(loaded);
+    EXPECT_EQ(loaded->functions.size(), analyzed->functions.size());
+    EXPECT_EQ(loaded->globals.size(), analyzed->globals.size());
+
+    FunctionSymbol* max = SymbolTable::instance().resolveFunction("max");
+    ASSERT_TRUE(max);
+    EXPECT_FALSE(max->isBuiltin);
+    FunctionSymbol* sqrt = SymbolTable::instance().resolveFunction("sqrt");
+    ASSERT_TRUE(sqrt);
+    EXPECT_TRUE(sqrt->isBuiltin);
+    EXPECT_TRUE(SymbolTable::instance().resolveGlobal("calls"));
+
+    EXPECT_EQ(generate(loaded.get()), expected);
+}
+
+// Entries for other source, or damaged in any way, are misses
+TEST_F(AstCacheTest, CorruptEntriesMiss) {
+    Lei::AstCache cache(directory);
+    auto analyzed = analyze(program);
+    ASSERT_TRUE(analyzed);
+    cache.store(program, *analyzed, SymbolTable::instance());
+    std::string path = entry();
+    ASSERT_FALSE(path.empty());
+    const std::string original = readFile(path);
+
+    EXPECT_FALSE(cache.load(std::string(program) + " ", SymbolTable::instance()));
+
+    // A flipped bit in the payload fails the checksum
+    std::string damaged = original;
+    damaged[damaged.size() - 5] ^= 0x10;
+    writeFile(path, damaged);
+    EXPECT_FALSE(cache.load(program, SymbolTable::instance()));
+
+    // Truncated entries and ones with a foreign header
+    writeFile(path, original.substr(0, original.size() / 2));
+    EXPECT_FALSE(cache.load(program, SymbolTable::instance()));
+    writeFile(path, original.substr(0, 4));
+    EXPECT_FALSE(cache.load(program, SymbolTable::instance()));
+    damaged = original;
+    damaged[0] = 'X';
+    writeFile(path, damaged);
+    EXPECT_FALSE(cache.load(program, SymbolTable::instance()));
+
+    // Restored, the entry loads again
+    writeFile(path, original);
+    EXPECT_TRUE(cache.load(program, SymbolTable::instance()));
+}
+
+TEST_F(AstCacheTest, MissingDirectoryMisses) {
+    Lei::AstCache cache(directory + "/absent");
+    EXPECT_FALSE(cache.load(program, SymbolTable::instance()));
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
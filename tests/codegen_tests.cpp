@@ -0,0 +1,360 @@
+#include <gtest/gtest.h>
+#include "lexer.h"
+#include "parser.h"
+#include "semantic_visitor.h"
+#include "codegen_visitor.h"
+#include "error_handler.h"
+#include "compiler.h"
+#include <llvm/Support/raw_ostream.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+class CodegenTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ErrorHandler::instance().clearAllErrors();
+    }
+
+    // IR of the program, or an empty string if any phase failed
+    std::string generate(const std::string& source) {
+        Lexer lexer(source);
+        auto tokens = lexer.tokenize();
+        if (ErrorHandler::instance().hasErrors()) return "";
+
+        Parser parser(tokens);
+        auto ast = parser.parse();
+        if (!ast || ErrorHandler::instance().hasErrors()) return "";
+
+        SemanticAnalyzer analyzer;
+        if (!analyzer.analyze(ast.get())) return "";
+
+        CodegenVisitor codegen(context);
+        auto module = codegen.generateModule(ast.get(), "test");
+        if (!module) return "";
+
+        std::string ir;
+        llvm::raw_string_ostream out(ir);
+        module->print(out, nullptr);
+        return out.str();
+    }
+
+    // Body of the function 'name' in the IR
+    static std::string functionBody(const std::string& ir, const std::string& name) {
+        std::istringstream lines(ir);
+        std::string line, body;
+        bool inside = false;
+        while (std::getline(lines, line)) {
+            if (!inside && line.rfind("define ", 0) == 0 && line.find(" @" + name + "(") != std::string::npos) {
+                inside = true;
+            }
+            if (!inside) continue;
+            body += line + "\n";
+            if (line == "}") break;
+        }
+        return body;
+    }
+
+    llvm::LLVMContext context;
+};
+
+// Constant arrays are read-only globals, so callees receive a writable copy
+TEST_F(CodegenTest, ConstantArrayArgumentsAreCopied) {
+    std::string ir = generate(R"(
+        const T: int[3] = {1, 2, 3};
+
+        fn void clobber(a: int[]) {
+            a[0] = 99;
+        }
+
+        fn int main() {
+            const L: int[3] = {4, 5, 6};
+            clobber(T);
+            clobber(L);
+            return 0;
+        }
+    )");
+    ASSERT_FALSE(ir.empty());
+
+    std::string main = functionBody(ir, "main");
+    EXPECT_NE(main.find("%T.copy = alloca [3 x i32]"), std::string::npos);
+    EXPECT_NE(main.find("%main.L.copy = alloca [3 x i32]"), std::string::npos);
+    EXPECT_EQ(main.find("@clobber(i32* getelementptr"), std::string::npos);
+}
+
+// --stream splits the source at top-level declarations; an attribute on its
+// own line stays with the function after it
+TEST_F(CodegenTest, StreamingKeepsAttributesWithTheirFunction) {
+    std::string output = testing::TempDir() + "streamed_attributes.ll";
+    Compiler compiler;
+    ASSERT_TRUE(compiler.compileStreaming(R"(
+// Memoized
+@memo
+fn int fib(n: int) {
+    if n < 2 { return n; }
+    return fib(n - 1) + fib(n - 2);
+}
+
+@memo(64) fn int square(n: int) { return n * n; }
+var seed: int = 3;
+
+fn int main() {
+    return fib(20) + square(seed);
+}
+)", output));
+
+    std::ifstream in(output);
+    std::stringstream ir;
+    ir << in.rdbuf();
+    EXPECT_NE(ir.str().find("@fib.impl"), std::string::npos);
+    EXPECT_NE(ir.str().find("@square.impl"), std::string::npos);
+    std::remove(output.c_str());
+}
+
+// Files written with -o or --stream are not linked against the runtime, so
+// programs that call into it are rejected rather than written
+TEST_F(CodegenTest, OutputFilesRejectRuntimeCalls) {
+    const char* source = R"(
+        fn int main() {
+            var total: int = 0;
+            parallel for i in 0..10 reduce(+: total) {
+                total += i;
+            }
+            return total;
+        }
+    )";
+    std::string output = testing::TempDir() + "runtime_calls.ll";
+    std::remove(output.c_str());
+
+    Compiler compiler;
+    EXPECT_FALSE(compiler.compile(source, output, false, false, false));
+    auto errors = ErrorHandler::instance().getErrors(ErrorLevel::CODEGEN);
+    ASSERT_EQ(errors.size(), 1u);
+    EXPECT_NE(errors[0].message.find("(lei_parallel_workers)"), std::string::npos);
+    EXPECT_FALSE(std::ifstream(output).good());
+
+    ErrorHandler::instance().clearAllErrors();
+    SymbolTable::instance().reset();
+    EXPECT_FALSE(compiler.compileStreaming(source, output));
+    EXPECT_TRUE(ErrorHandler::instance().hasErrors(ErrorLevel::CODEGEN));
+    EXPECT_FALSE(std::ifstream(output).good());
+
+    ErrorHandler::instance().clearAllErrors();
+    SymbolTable::instance().reset();
+    EXPECT_TRUE(compiler.compile("fn int main() { return 0; }", output, false, false, false));
+    std::remove(output.c_str());
+}
+
+// abs/min/max lower to the integer or floating-point intrinsic by operand type
+TEST_F(CodegenTest, NumericBuiltinsLowerByOperandType) {
+    std::string ir = generate(R"(
+        fn int ints(a: int, b: int) {
+            return abs(a) + min(a, b) + max(a, b);
+        }
+
+        fn float floats(x: float, y: float) {
+            return abs(x) + min(x, y) + max(x, y);
+        }
+
+        fn float mixed(a: int, y: float) {
+            return max(a, y);
+        }
+
+        fn float math(x: float) {
+            return sqrt(x) + floor(x) + pow(x, 2.0) + fma(x, x, x);
+        }
+
+        fn int counts(a: int) {
+            return popcount(a) + clz(a) + ctz(a);
+        }
+
+        fn int main() {
+            return 0;
+        }
+    )");
+    ASSERT_FALSE(ir.empty());
+
+    std::string ints = functionBody(ir, "ints");
+    EXPECT_NE(ints.find("@llvm.abs.i32("), std::string::npos);
+    EXPECT_NE(ints.find("@llvm.smin.i32("), std::string::npos);
+    EXPECT_NE(ints.find("@llvm.smax.i32("), std::string::npos);
+    EXPECT_EQ(ints.find("f64"), std::string::npos);
+
+    std::string floats = functionBody(ir, "floats");
+    EXPECT_NE(floats.find("@llvm.fabs.f64("), std::string::npos);
+    EXPECT_NE(floats.find("@llvm.minnum.f64("), std::string::npos);
+    EXPECT_NE(floats.find("@llvm.maxnum.f64("), std::string::npos);
+
+    std::string mixed = functionBody(ir, "mixed");
+    EXPECT_NE(mixed.find("sitofp i32"), std::string::npos);
+    EXPECT_NE(mixed.find("@llvm.maxnum.f64("), std::string::npos);
+
+    std::string math = functionBody(ir, "math");
+    EXPECT_NE(math.find("@llvm.sqrt.f64("), std::string::npos);
+    EXPECT_NE(math.find("@llvm.floor.f64("), std::string::npos);
+    EXPECT_NE(math.find("@llvm.pow.f64("), std::string::npos);
+    EXPECT_NE(math.find("@llvm.fma.f64("), std::string::npos);
+
+    std::string counts = functionBody(ir, "counts");
+    EXPECT_NE(counts.find("@llvm.ctpop.i32("), std::string::npos);
+    EXPECT_NE(counts.find("@llvm.ctlz.i32("), std::string::npos);
+    EXPECT_NE(counts.find("@llvm.cttz.i32("), std::string::npos);
+}
+
+// A function of the program named like a builtin is called, not lowered,
+// and the optimizer may not treat a sqrt of its own as the C library one
+TEST_F(CodegenTest, ProgramFunctionsShadowBuiltins) {
+    std::string ir = generate(R"(
+        fn int max(a: int, b: int) {
+            return a;
+        }
+
+        fn float sqrt(x: float) {
+            return x;
+        }
+
+        fn float total() {
+            return max(1, 2) + sqrt(16.0);
+        }
+
+        fn int main() {
+            return 0;
+        }
+    )");
+    ASSERT_FALSE(ir.empty());
+
+    std::string total = functionBody(ir, "total");
+    EXPECT_NE(total.find("call i32 @max(i32 1, i32 2)"), std::string::npos);
+    EXPECT_NE(total.find("call double @sqrt(double 1.600000e+01) #"), std::string::npos);
+    EXPECT_EQ(total.find("@llvm."), std::string::npos);
+    EXPECT_NE(ir.find("nobuiltin"), std::string::npos);
+}
+
+// Each atomic operation is one instruction carrying the requested ordering
+TEST_F(CodegenTest, AtomicOperationsKeepTheirOrdering) {
+    std::string ir = generate(R"(
+        var hits: atomic<int>;
+
+        fn int ops(slots: atomic<int>[], seen: int) {
+            fetch_add(hits, 1, relaxed);
+            fetch_sub(slots[1], 2, release);
+            store(hits, 3, release);
+            var v: int = load(slots[0], acquire);
+            if (compare_exchange(hits, seen, v, acq_rel)) {
+                return 1;
+            }
+            return load(hits);
+        }
+
+        fn int main() {
+            return 0;
+        }
+    )");
+    ASSERT_FALSE(ir.empty());
+
+    std::string ops = functionBody(ir, "ops");
+    EXPECT_NE(ops.find("atomicrmw add i32* @hits, i32 1 monotonic"), std::string::npos);
+    EXPECT_NE(ops.find("atomicrmw sub i32* "), std::string::npos);
+    EXPECT_NE(ops.find("i32 2 release"), std::string::npos);
+    EXPECT_NE(ops.find("store atomic i32 3, i32* @hits release"), std::string::npos);
+    EXPECT_NE(ops.find("acquire, align 4"), std::string::npos);
+    EXPECT_NE(ops.find("cmpxchg i32* @hits, i32 %"), std::string::npos);
+    EXPECT_NE(ops.find(" acq_rel acquire"), std::string::npos);
+    EXPECT_NE(ops.find("load atomic i32, i32* @hits seq_cst"), std::string::npos);
+}
+
+// The right operand of '&&' and '||' runs only when the left one leaves the result open
+TEST_F(CodegenTest, LogicalOperatorsShortCircuit) {
+    std::string ir = generate(R"(
+        var hits: atomic<int>;
+
+        fn bool both(seen: int, i: int) {
+            return seen < i && compare_exchange(hits, seen, i);
+        }
+
+        fn bool either(seen: int, i: int) {
+            return seen >= i || compare_exchange(hits, seen, i);
+        }
+
+        fn int main() {
+            return 0;
+        }
+    )");
+    ASSERT_FALSE(ir.empty());
+
+    std::string both = functionBody(ir, "both");
+    EXPECT_NE(both.find("br i1 %lttmp, label %and.rhs, label %and.end"), std::string::npos);
+    EXPECT_LT(both.find("and.rhs:"), both.find("cmpxchg"));
+    EXPECT_NE(both.find("phi i1 [ false, %entry ]"), std::string::npos);
+    EXPECT_EQ(both.find(" and i1 "), std::string::npos);
+
+    std::string either = functionBody(ir, "either");
+    EXPECT_NE(either.find("br i1 %cmpgetmp, label %or.end, label %or.rhs"), std::string::npos);
+    EXPECT_LT(either.find("or.rhs:"), either.find("cmpxchg"));
+    EXPECT_NE(either.find("phi i1 [ true, %entry ]"), std::string::npos);
+    EXPECT_EQ(either.find(" or i1 "), std::string::npos);
+}
+
+// A match is one switch on the subject, with a case per value, ranges expanded
+TEST_F(CodegenTest, MatchLowersToOneSwitch) {
+    std::string ir = generate(R"(
+        const LIMIT: int = 14;
+
+        fn int classify(code: int) {
+            match code {
+                0 => { return 10; }
+                1, 2, 3 => { return 11; }
+                10..LIMIT => { return 12; }
+                _ => { return 13; }
+            }
+            return 0;
+        }
+
+        fn int main() {
+            return classify(2);
+        }
+    )");
+    ASSERT_FALSE(ir.empty());
+
+    std::string classify = functionBody(ir, "classify");
+    size_t at = classify.find("switch i32 ");
+    ASSERT_NE(at, std::string::npos);
+    EXPECT_EQ(classify.find("switch ", at + 1), std::string::npos);
+    EXPECT_EQ(classify.find("icmp"), std::string::npos);
+
+    // Cases follow the default label, inside the brackets
+    size_t cases = 0;
+    for (size_t next = classify.find(", label %", classify.find('[', at)); next != std::string::npos;
+         next = classify.find(", label %", next + 1)) {
+        cases++;
+    }
+    EXPECT_EQ(cases, 8u);
+    for (int value : { 0, 1, 2, 3, 10, 11, 12, 13 }) {
+        EXPECT_NE(classify.find("i32 " + std::to_string(value) + ", label %"), std::string::npos) << value;
+    }
+    EXPECT_EQ(classify.find("i32 14, label %"), std::string::npos);
+}
+
+// recv on a closed, drained chan<str> gives "" rather than a null pointer
+TEST_F(CodegenTest, ClosedStringChannelYieldsEmptyString) {
+    std::string ir = generate(R"(
+        fn str take(c: chan<str>) {
+            return recv(c);
+        }
+
+        fn int main() {
+            return 0;
+        }
+    )");
+    ASSERT_FALSE(ir.empty());
+
+    std::string take = functionBody(ir, "take");
+    EXPECT_NE(take.find("%chan.closed = icmp eq i64"), std::string::npos);
+    EXPECT_NE(take.find("%chan.str = select i1 %chan.closed, i8* getelementptr"), std::string::npos);
+    EXPECT_NE(ir.find("@chan.empty = private unnamed_addr constant [1 x i8] zeroinitializer"), std::string::npos);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
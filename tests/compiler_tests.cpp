@@ -0,0 +1,305 @@
+#include <gtest/gtest.h>
+#include "lexer.h"
+#include "parser.h"
+#include "semantic_visitor.h"
+#include "codegen_visitor.h"
+#include "error_handler.h"
+#include "compiler.h"
+#include <llvm/Support/FileSystem.h>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+class CompilerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ErrorHandler::instance().clearAllErrors();
+        SymbolTable::instance().reset();
+    }
+
+    // Text of each unit splitTopLevel finds
+    static std::vector<std::string> units(const std::string& source) {
+        std::vector<std::string> texts;
+        for (const Lei::SourceUnit& unit : Lei::splitTopLevel(source)) {
+            texts.push_back(source.substr(unit.begin, unit.end - unit.begin));
+        }
+        return texts;
+    }
+
+    // The program's module split by function, or nothing if any phase failed
+    std::vector<std::unique_ptr<llvm::Module>> split(const std::string& source) {
+        Lexer lexer(source);
+        auto tokens = lexer.tokenize();
+        Parser parser(tokens);
+        auto ast = parser.parse();
+        if (!ast || ErrorHandler::instance().hasErrors()) return {};
+
+        SemanticAnalyzer analyzer;
+        if (!analyzer.analyze(ast.get())) return {};
+
+        CodegenVisitor codegen(context);
+        auto module = codegen.generateModule(ast.get(), "test");
+        if (!module) return {};
+        return Lei::splitByFunction(std::move(module));
+    }
+
+    // Module identifier of each function split off, by function name
+    static std::map<std::string, std::string> identifiers(const std::vector<std::unique_ptr<llvm::Module>>& modules) {
+        std::map<std::string, std::string> names;
+        for (size_t i = 1; i < modules.size(); i++) {
+            for (llvm::Function& function : *modules[i]) {
+                if (!function.isDeclaration()) names[function.getName().str()] = modules[i]->getModuleIdentifier();
+            }
+        }
+        return names;
+    }
+
+    llvm::LLVMContext context;
+};
+
+// Declarations split where they start a line at depth zero; attribute lines
+// and comments between them go with the declaration they precede or follow
+TEST_F(CompilerTest, SplitTopLevelDeclarations) {
+    std::vector<std::string> texts = units(
+        "// Fibonacci numbers\n"
+        "var limit: int = 20;\n"
+        "const scale: int = 2;\n"
+        "\n"
+        "@memo\n"
+        "// Cached, so linear\n"
+        "fn int fib(n: int) {\n"
+        "    if n < 2 { return n; }\n"
+        "    return fib(n - 1) + fib(n - 2);\n"
+        "}\n"
+        "\n"
+        "// Between functions\n"
+        "fn int main() {\n"
+        "var count: int = 0;\n"
+        "    print(\"\n"
+        "fn not a declaration\");\n"
+        "    return fib(limit) * scale + count;\n"
+        "}\n");
+
+    ASSERT_EQ(texts.size(), 5u);
+    EXPECT_EQ(texts[0], "// Fibonacci numbers\n");
+    EXPECT_EQ(texts[1], "var limit: int = 20;\n");
+    EXPECT_EQ(texts[2], "const scale: int = 2;\n\n");
+    EXPECT_EQ(texts[3].rfind("@memo\n// Cached, so linear\nfn int fib", 0), 0u) << texts[3];
+    EXPECT_NE(texts[3].find("}\n\n// Between functions\n"), std::string::npos) << texts[3];
+    EXPECT_EQ(texts[4].rfind("fn int main()", 0), 0u) << texts[4];
+    EXPECT_NE(texts[4].find("fn not a declaration"), std::string::npos) << texts[4];
+
+    // Units carry the line they start on, for the lexer's positions
+    const std::string source = "var a: int = 1;\n\n@memo(16)\n@memo\nfn int f() { return a; }\n";
+    std::vector<Lei::SourceUnit> split = Lei::splitTopLevel(source);
+    ASSERT_EQ(split.size(), 2u);
+    EXPECT_EQ(split[0].line, 1);
+    EXPECT_EQ(split[1].line, 3);
+    EXPECT_EQ(split[1].begin, source.find('@'));
+    EXPECT_EQ(split[1].end, source.size());
+}
+
+// Globals stay behind; each function gets a module named after its IR, so
+// edits elsewhere in the file leave its name, and cached object, unchanged
+TEST_F(CompilerTest, SplitByFunctionNamesModulesByContent) {
+    const std::string helpers =
+        "var limit: int = 3;\n"
+        "threadlocal var scratch: int;\n"
+        "\n"
+        "fn int twice(x: int) { return x * 2; }\n"
+        "fn int keep(x: int) { scratch = x; return scratch; }\n";
+
+    auto modules = split(helpers + "fn int main() { return twice(limit); }\n");
+    ASSERT_EQ(modules.size(), 3u);
+    EXPECT_TRUE(modules[0]->getGlobalVariable("limit"));
+    ASSERT_TRUE(modules[0]->getFunction("keep"));
+    EXPECT_FALSE(modules[0]->getFunction("keep")->isDeclaration());
+    ASSERT_TRUE(modules[0]->getFunction("main"));
+    EXPECT_TRUE(modules[0]->getFunction("main")->isDeclaration());
+
+    auto before = identifiers(modules);
+    ASSERT_EQ(before.size(), 2u);
+    EXPECT_EQ(before["twice"].rfind("twice#", 0), 0u);
+    EXPECT_EQ(before["main"].rfind("main#", 0), 0u);
+
+    modules = split(helpers + "\n// Now adds one\nfn int main() { return twice(limit) + 1; }\n");
+    auto after = identifiers(modules);
+    EXPECT_EQ(after["twice"], before["twice"]);
+    EXPECT_NE(after["main"], before["main"]);
+}
+
+// Runs --watch on a file in a child process and reads what it prints
+class WatchSession {
+public:
+    explicit WatchSession(const std::string& path) : path(path) {
+        int output[2];
+        if (pipe(output) != 0) return;
+        child = fork();
+        if (child == 0) {
+            dup2(output[1], STDOUT_FILENO);
+            dup2(output[1], STDERR_FILENO);
+            Compiler compiler;
+            compiler.watch(path, DiagnosticFormat::TEXT);
+            _exit(1);
+        }
+        close(output[1]);
+        reader = output[0];
+    }
+
+    ~WatchSession() {
+        if (child > 0) {
+            kill(child, SIGKILL);
+            waitpid(child, nullptr, 0);
+        }
+        if (reader >= 0) close(reader);
+    }
+
+    // Replaces the file the way editors save it
+    void save(const std::string& source) {
+        std::ofstream(path + ".tmp") << source;
+        std::rename((path + ".tmp").c_str(), path.c_str());
+    }
+
+    // Everything printed after the previous call, up to and including the
+    // line containing 'marker', or up to the timeout
+    std::string readUntil(const std::string& marker) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        size_t found;
+        while ((found = pending.find(marker)) == std::string::npos) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            pollfd ready = { reader, POLLIN, 0 };
+            if (left.count() <= 0 || poll(&ready, 1, static_cast<int>(left.count())) <= 0) break;
+            char buffer[4096];
+            ssize_t length = read(reader, buffer, sizeof(buffer));
+            if (length <= 0) break;
+            pending.append(buffer, length);
+        }
+        size_t end = found == std::string::npos ? pending.size() : pending.find('\n', found);
+        end = end == std::string::npos ? pending.size() : end + 1;
+        std::string text = pending.substr(0, end);
+        pending.erase(0, end);
+        return text;
+    }
+
+private:
+    std::string path;
+    pid_t child = -1;
+    int reader = -1;
+    std::string pending;
+};
+
+// Each rebuild analyzes the file on its own: functions and globals of the
+// previous build are neither visible nor in the way
+TEST_F(CompilerTest, WatchRebuildsStartWithoutPreviousSymbols) {
+    llvm::SmallString<128> path;
+    ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("watch", "lei", path));
+    std::ofstream(path.str().str()) <<
+        "var limit: int = 2;\n"
+        "fn int helper() { return limit; }\n"
+        "fn int main() { return helper(); }\n";
+
+    {
+        WatchSession session(path.str().str());
+        std::string first = session.readUntil("Watching");
+        EXPECT_NE(first.find("Execution Result: 2\n"), std::string::npos) << first;
+
+        // helper is gone; a leftover symbol would let main still find it
+        session.save(
+            "var limit: int = 5;\n"
+            "fn int main() { return helper(); }\n");
+        std::string second = session.readUntil("Undefined function: helper");
+        EXPECT_NE(second.find("Undefined function: helper"), std::string::npos) << second;
+        EXPECT_EQ(second.find("already declared"), std::string::npos) << second;
+
+        // limit is declared again, as in every build
+        session.save(
+            "var limit: int = 5;\n"
+            "fn int main() { return limit; }\n");
+        std::string third = session.readUntil("Execution Result");
+        EXPECT_NE(third.find("Execution Result: 5\n"), std::string::npos) << third;
+        EXPECT_EQ(third.find("Error"), std::string::npos) << third;
+    }
+    llvm::sys::fs::remove(path);
+}
+
+// What the program prints, followed by its result, when run on the MCJIT
+// path or, with compile threads, on the speculative ORC JIT
+static std::string execute(const std::string& source, unsigned compileThreads) {
+    ErrorHandler::instance().clearAllErrors();
+    Compiler compiler;
+    compiler.compileThreads = compileThreads;
+    testing::internal::CaptureStdout();
+    bool succeeded = compiler.execute(source, false, false, false);
+    std::fflush(stdout);
+    std::string output = testing::internal::GetCapturedStdout();
+    return succeeded ? output : "";
+}
+
+// Compiling lazily, per function and ahead of the calls, changes nothing
+// the program can observe
+TEST_F(CompilerTest, LazyJitMatchesExecute) {
+    const std::vector<std::string> programs = {
+        // Recursion, mutual recursion and calls through many small functions
+        R"(
+            fn int even(n: int) { if n == 0 { return 1; } return odd(n - 1); }
+            fn int odd(n: int) { if n == 0 { return 0; } return even(n - 1); }
+            fn int ackermann(m: int, n: int) {
+                if m == 0 { return n + 1; }
+                if n == 0 { return ackermann(m - 1, 1); }
+                return ackermann(m - 1, ackermann(m, n - 1));
+            }
+            fn int main() {
+                print(even(101)); print(" ");
+                print(ackermann(2, 3)); print(" ");
+                return odd(7) + ackermann(1, 2);
+            }
+        )",
+        // Globals, thread-locals and string constants used from several functions
+        R"(
+            var total: int = 10;
+            threadlocal var scratch: int;
+            const greeting: str = "hello";
+            fn void add(x: int) { total = total + x; }
+            fn int keep(x: int) { scratch = scratch + x; return scratch; }
+            fn void greet() { print(greeting); print(" "); }
+            fn int main() {
+                greet(); greet();
+                add(5); add(keep(3)); add(keep(4));
+                print(total);
+                return total;
+            }
+        )",
+        // Generic instances, plus @memo functions and generators, which the
+        // lazy JIT keeps in the main module
+        R"(
+            fn T largest<T>(a: T, b: T) { if (a > b) { return a; } return b; }
+            @memo
+            fn int fib(n: int) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }
+            fn gen int squares(n: int) { var i: int = 0; while i < n { yield i * i; i += 1; } }
+            fn int main() {
+                var sum: int = 0;
+                for s in squares(100) { sum += s; }
+                print(largest(2.5, 1.0)); print(" ");
+                print(fib(40)); print(" ");
+                return largest(sum, 7) - 328000;
+            }
+        )",
+    };
+
+    for (const std::string& program : programs) {
+        std::string eager = execute(program, 0);
+        ASSERT_NE(eager, "") << program;
+        EXPECT_EQ(execute(program, 2), eager) << program;
+        EXPECT_EQ(execute(program, 1), eager) << program;
+    }
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include "error_handler.h"
+#include <sstream>
+
+class ErrorHandlerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ErrorHandler::instance().clearAllErrors();
+        ErrorHandler::instance().setSource("", "");
+    }
+
+    void TearDown() override {
+        ErrorHandler::instance().clearAllErrors();
+        ErrorHandler::instance().setSource("", "");
+        ErrorHandler::instance().setMaxErrorsPerLevel(100);
+    }
+
+    static std::string render(DiagnosticFormat format) {
+        std::ostringstream out;
+        ErrorHandler::instance().report(out, format);
+        return out.str();
+    }
+};
+
+// Text diagnostics name the file as 'path:line:column' and show the source line
+TEST_F(ErrorHandlerTest, TextNamesTheFile) {
+    auto& handler = ErrorHandler::instance();
+    handler.setSource("main.lei", "fn int main() {\n    return x;\n}\n");
+    handler.error(ErrorLevel::SEMANTIC, 2, 12, "Undefined variable: x");
+    handler.error(ErrorLevel::SEMANTIC, 0, 0, "No valid main function found");
+
+    std::string text = render(DiagnosticFormat::TEXT);
+    EXPECT_NE(text.find("main.lei:2:12: \033[1;31mSemantic Error\033[0m: Undefined variable: x\n"
+                        "        return x;\n"
+                        "               ^\n"), std::string::npos);
+    EXPECT_NE(text.find("main.lei: \033[1;31mSemantic Error\033[0m: No valid main function found\n"),
+              std::string::npos);
+
+    // Without a file the location is spelled out
+    handler.setSource("", "");
+    text = render(DiagnosticFormat::TEXT);
+    EXPECT_NE(text.find("Semantic Error\033[0m at line 2, column 12: Undefined variable: x\n"), std::string::npos);
+}
+
+// JSON lists each diagnostic with its level, position and source line
+TEST_F(ErrorHandlerTest, JsonReport) {
+    auto& handler = ErrorHandler::instance();
+    handler.setSource("dir/a \"b\".lei", "var s: str = \"tab\there\";\n");
+    handler.error(ErrorLevel::SYNTAX, 1, 5, "Expected ';'\nafter \"s\"");
+
+    EXPECT_EQ(render(DiagnosticFormat::JSON),
+              "{\"file\":\"dir/a \\\"b\\\".lei\",\"diagnostics\":[{\"level\":\"syntax\",\"line\":1,\"column\":5,"
+              "\"message\":\"Expected ';'\\nafter \\\"s\\\"\","
+              "\"source\":\"var s: str = \\\"tab\\there\\\";\"}],\"suppressed\":{}}\n");
+
+    EXPECT_EQ(ErrorHandler::quoteJson(std::string("\x01") + "\\"), "\"\\u0001\\\\\"");
+}
+
+// SARIF results carry a region only for diagnostics with a position
+TEST_F(ErrorHandlerTest, SarifReport) {
+    auto& handler = ErrorHandler::instance();
+    handler.setSource("a.lei", "fn int main() { return y; }\n");
+    handler.error(ErrorLevel::SEMANTIC, 1, 24, "Undefined variable: y");
+    handler.error(ErrorLevel::CODEGEN, 0, 0, "Module verification failed");
+
+    std::string sarif = render(DiagnosticFormat::SARIF);
+    EXPECT_EQ(sarif.rfind("{\"version\":\"2.1.0\",", 0), 0u);
+    EXPECT_NE(sarif.find("{\"id\":\"semantic\",\"shortDescription\":{\"text\":\"Semantic Error\"}}"),
+              std::string::npos);
+    EXPECT_NE(sarif.find("{\"ruleId\":\"semantic\",\"level\":\"error\","
+                         "\"message\":{\"text\":\"Undefined variable: y\"},"
+                         "\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":\"a.lei\"},"
+                         "\"region\":{\"startLine\":1,\"startColumn\":24,"
+                         "\"snippet\":{\"text\":\"fn int main() { return y; }\"}}}}]}"), std::string::npos);
+    EXPECT_NE(sarif.find("{\"ruleId\":\"codegen\",\"level\":\"error\","
+                         "\"message\":{\"text\":\"Module verification failed\"},"
+                         "\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":\"a.lei\"}}}]}"),
+              std::string::npos);
+}
+
+// Past the per-level cap errors are counted but not kept
+TEST_F(ErrorHandlerTest, PerLevelCaps) {
+    auto& handler = ErrorHandler::instance();
+    handler.setMaxErrorsPerLevel(2);
+    for (int i = 1; i <= 5; i++) {
+        handler.error(ErrorLevel::SEMANTIC, i, 1, "error " + std::to_string(i));
+    }
+    handler.error(ErrorLevel::SYNTAX, 1, 1, "syntax");
+
+    EXPECT_EQ(handler.getErrors(ErrorLevel::SEMANTIC).size(), 2u);
+    EXPECT_EQ(handler.getErrorCount(ErrorLevel::SEMANTIC), 5u);
+    EXPECT_EQ(handler.getSuppressedCount(ErrorLevel::SEMANTIC), 3u);
+    EXPECT_EQ(handler.getSuppressedCount(ErrorLevel::SYNTAX), 0u);
+    EXPECT_EQ(handler.getTotalErrorCount(), 3u);
+
+    EXPECT_NE(render(DiagnosticFormat::TEXT).find("3 more semantic errors not shown\n"), std::string::npos);
+    EXPECT_NE(render(DiagnosticFormat::JSON).find("\"suppressed\":{\"semantic\":3}"), std::string::npos);
+
+    // Clearing a level resets its count
+    handler.clearErrors(ErrorLevel::SEMANTIC);
+    EXPECT_FALSE(handler.hasErrors(ErrorLevel::SEMANTIC));
+    EXPECT_EQ(handler.getSuppressedCount(ErrorLevel::SEMANTIC), 0u);
+
+    // A limit of 0 keeps every error
+    handler.setMaxErrorsPerLevel(0);
+    for (int i = 0; i < 150; i++) {
+        handler.error(ErrorLevel::CODEGEN, 1, 1, "codegen");
+    }
+    EXPECT_EQ(handler.getErrors(ErrorLevel::CODEGEN).size(), 150u);
+}
+
+TEST_F(ErrorHandlerTest, ParseFormat) {
+    DiagnosticFormat format = DiagnosticFormat::TEXT;
+    EXPECT_TRUE(ErrorHandler::parseFormat("sarif", format));
+    EXPECT_EQ(format, DiagnosticFormat::SARIF);
+    EXPECT_TRUE(ErrorHandler::parseFormat("json", format));
+    EXPECT_EQ(format, DiagnosticFormat::JSON);
+    EXPECT_FALSE(ErrorHandler::parseFormat("xml", format));
+    EXPECT_EQ(format, DiagnosticFormat::JSON);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
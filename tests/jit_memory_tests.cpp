@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include "jit_memory.h"
+#include <cstring>
+
+using Lei::JitMemoryPool;
+
+class JitMemoryTest : public ::testing::Test {
+protected:
+    // Each test gets a pool of its own, so spans left by others do not move its allocations
+    JitMemoryPool pool;
+    const uint64_t page = pool.pageSize();
+};
+
+TEST_F(JitMemoryTest, AllocatesWritablePages) {
+    uint8_t* code = pool.allocate(JitMemoryPool::Zone::Code, 3 * page);
+    uint8_t* data = pool.allocate(JitMemoryPool::Zone::Data, page);
+    ASSERT_TRUE(code);
+    ASSERT_TRUE(data);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(code) % page, 0u);
+    std::memset(code, 0xC3, 3 * page);
+    std::memset(data, 0, page);
+
+    // Consecutive allocations are packed into the same region
+    uint8_t* next = pool.allocate(JitMemoryPool::Zone::Code, page);
+    EXPECT_EQ(next, code + 3 * page);
+
+    Lei::JitMemoryStats stats = pool.stats();
+    EXPECT_EQ(stats.code.liveBytes, 4 * page);
+    EXPECT_EQ(stats.code.peakBytes, 4 * page);
+    EXPECT_EQ(stats.data.liveBytes, page);
+    EXPECT_EQ(stats.code.freeSpans, 0u);
+
+    pool.release(JitMemoryPool::Zone::Code, code, 3 * page);
+    pool.release(JitMemoryPool::Zone::Code, next, page);
+    stats = pool.stats();
+    EXPECT_EQ(stats.code.liveBytes, 0u);
+    EXPECT_EQ(stats.code.peakBytes, 4 * page);
+    EXPECT_EQ(stats.code.freeBytes, 4 * page);
+}
+
+// Regions start small and grow as the zone needs more
+TEST_F(JitMemoryTest, RegionsGrowOnDemand) {
+    ASSERT_TRUE(pool.allocate(JitMemoryPool::Zone::Code, page));
+    uint64_t first = pool.stats().reservedBytes;
+    EXPECT_GT(first, 0u);
+    EXPECT_LE(first, 2u * 1024 * 1024);
+
+    // A request larger than the rest of the region maps a bigger one, and
+    // the old region's unused end becomes free space
+    ASSERT_TRUE(pool.allocate(JitMemoryPool::Zone::Code, first));
+    Lei::JitMemoryStats stats = pool.stats();
+    EXPECT_GE(stats.reservedBytes, 2 * first);
+    EXPECT_EQ(stats.code.freeBytes, first - page);
+}
+
+// Released spans are reused lowest address first, before the region's end
+TEST_F(JitMemoryTest, ReusesFirstFit) {
+    uint8_t* a = pool.allocate(JitMemoryPool::Zone::Code, 2 * page);
+    uint8_t* b = pool.allocate(JitMemoryPool::Zone::Code, page);
+    uint8_t* c = pool.allocate(JitMemoryPool::Zone::Code, 2 * page);
+    uint8_t* d = pool.allocate(JitMemoryPool::Zone::Code, page);
+    ASSERT_TRUE(a && b && c && d);
+
+    pool.release(JitMemoryPool::Zone::Code, c, 2 * page);
+    pool.release(JitMemoryPool::Zone::Code, a, 2 * page);
+    EXPECT_EQ(pool.allocate(JitMemoryPool::Zone::Code, page), a);
+    EXPECT_EQ(pool.allocate(JitMemoryPool::Zone::Code, 2 * page), c);
+    EXPECT_EQ(pool.allocate(JitMemoryPool::Zone::Code, page), a + page);
+    EXPECT_EQ(pool.stats().reusedBytes, 4 * page);
+
+    // Nothing free is large enough, so the next span comes from the region's end
+    EXPECT_EQ(pool.allocate(JitMemoryPool::Zone::Code, page), d + page);
+
+    // Zones do not share free spans
+    pool.release(JitMemoryPool::Zone::Code, b, page);
+    uint8_t* data = pool.allocate(JitMemoryPool::Zone::Data, page);
+    EXPECT_NE(data, b);
+}
+
+// Adjacent free spans merge into one, so a later large request fits
+TEST_F(JitMemoryTest, CoalescesNeighbours) {
+    uint8_t* spans[4];
+    for (auto& span : spans) {
+        span = pool.allocate(JitMemoryPool::Zone::Data, page);
+        ASSERT_TRUE(span);
+    }
+
+    pool.release(JitMemoryPool::Zone::Data, spans[0], page);
+    pool.release(JitMemoryPool::Zone::Data, spans[2], page);
+    Lei::JitMemoryStats stats = pool.stats();
+    EXPECT_EQ(stats.data.freeSpans, 2u);
+    EXPECT_EQ(stats.data.largestFreeBytes, page);
+    EXPECT_DOUBLE_EQ(stats.data.fragmentation(), 0.5);
+
+    // Joins the span before and the one after it
+    pool.release(JitMemoryPool::Zone::Data, spans[1], page);
+    stats = pool.stats();
+    EXPECT_EQ(stats.data.freeSpans, 1u);
+    EXPECT_EQ(stats.data.largestFreeBytes, 3 * page);
+    EXPECT_DOUBLE_EQ(stats.data.fragmentation(), 0.0);
+
+    EXPECT_EQ(pool.allocate(JitMemoryPool::Zone::Data, 3 * page), spans[0]);
+    EXPECT_EQ(pool.stats().data.freeSpans, 0u);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include "language_server.h"
+#include "error_handler.h"
+#include <sstream>
+
+class LanguageServerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ErrorHandler::instance().clearAllErrors();
+        SymbolTable::instance().reset();
+    }
+
+    static std::string frame(const std::string& body) {
+        return "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    static std::string request(int id, const std::string& method, const std::string& params) {
+        return frame("{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id) + ",\"method\":\"" + method +
+                     "\",\"params\":" + params + "}");
+    }
+
+    static std::string notification(const std::string& method, const std::string& params) {
+        return frame("{\"jsonrpc\":\"2.0\",\"method\":\"" + method + "\",\"params\":" + params + "}");
+    }
+
+    static std::string position(int line, int character) {
+        return "{\"textDocument\":{\"uri\":\"file:///test.lei\"},\"position\":{\"line\":" + std::to_string(line) +
+               ",\"character\":" + std::to_string(character) + "}}";
+    }
+
+    // Replaces the text between two positions
+    static std::string change(int startLine, int startCharacter, int endLine, int endCharacter,
+                              const std::string& text) {
+        return notification("textDocument/didChange",
+            "{\"textDocument\":{\"uri\":\"file:///test.lei\",\"version\":2},\"contentChanges\":[{\"range\":"
+            "{\"start\":{\"line\":" + std::to_string(startLine) + ",\"character\":" + std::to_string(startCharacter) +
+            "},\"end\":{\"line\":" + std::to_string(endLine) + ",\"character\":" + std::to_string(endCharacter) +
+            "}},\"text\":" + ErrorHandler::quoteJson(text) + "}]}");
+    }
+
+    // Runs the server over the messages, followed by shutdown and exit, and
+    // returns the bodies it sent
+    std::vector<std::string> serve(const std::string& messages) {
+        std::istringstream in(messages + request(99, "shutdown", "null") + notification("exit", "null"));
+        std::ostringstream out;
+        Lei::LanguageServer server;
+        exitCode = server.run(in, out);
+
+        std::vector<std::string> bodies;
+        const std::string sent = out.str();
+        for (size_t at = sent.find("Content-Length: "); at != std::string::npos;
+             at = sent.find("Content-Length: ", at)) {
+            size_t length = std::stoul(sent.substr(at + 16));
+            size_t start = sent.find("\r\n\r\n", at) + 4;
+            bodies.push_back(sent.substr(start, length));
+            at = start + length;
+        }
+        return bodies;
+    }
+
+    int exitCode = -1;
+};
+
+static const char* document =
+    "fn int square(x: int) {\n"
+    "    return x * x;\n"
+    "}\n"
+    "\n"
+    "fn int main() {\n"
+    "    var total: int = square(3);\n"
+    "    return total;\n"
+    "}\n";
+
+// Diagnostics, hover and definition follow incremental edits, including
+// edits that move every function below them
+TEST_F(LanguageServerTest, IncrementalEdits) {
+    std::string messages =
+        request(1, "initialize", "{\"capabilities\":{}}") +
+        notification("initialized", "{}") +
+        notification("textDocument/didOpen",
+            "{\"textDocument\":{\"uri\":\"file:///test.lei\",\"languageId\":\"lei\",\"version\":1,\"text\":" +
+            ErrorHandler::quoteJson(document) + "}}") +
+        // Two lines above everything, then a type error in main and its fix
+        change(0, 0, 0, 0, "var scale: int = 2;\n\n") +
+        change(7, 28, 7, 29, "true") +
+        change(7, 28, 7, 32, "scale") +
+        request(2, "textDocument/hover", position(8, 11)) +
+        request(3, "textDocument/hover", position(7, 21)) +
+        request(4, "textDocument/definition", position(7, 21)) +
+        request(5, "textDocument/definition", position(7, 30)) +
+        request(6, "textDocument/definition", position(8, 11)) +
+        request(7, "textDocument/hover", position(3, 0));
+
+    std::vector<std::string> bodies = serve(messages);
+    EXPECT_EQ(exitCode, 0);
+    ASSERT_EQ(bodies.size(), 12u);
+
+    EXPECT_NE(bodies[0].find("\"id\":1"), std::string::npos);
+    EXPECT_NE(bodies[0].find("\"change\":2"), std::string::npos);
+    EXPECT_NE(bodies[0].find("\"hoverProvider\":true"), std::string::npos);
+
+    // didOpen, then one publication per change
+    for (size_t i = 1; i <= 4; i++) {
+        EXPECT_NE(bodies[i].find("\"method\":\"textDocument/publishDiagnostics\""), std::string::npos);
+        EXPECT_NE(bodies[i].find("\"uri\":\"file:///test.lei\""), std::string::npos);
+    }
+    EXPECT_NE(bodies[1].find("\"diagnostics\":[]"), std::string::npos) << bodies[1];
+    EXPECT_NE(bodies[2].find("\"diagnostics\":[]"), std::string::npos) << bodies[2];
+    EXPECT_NE(bodies[3].find("\"range\":{\"start\":{\"line\":7,"), std::string::npos) << bodies[3];
+    EXPECT_NE(bodies[3].find("Semantic Error: "), std::string::npos) << bodies[3];
+    EXPECT_NE(bodies[4].find("\"diagnostics\":[]"), std::string::npos) << bodies[4];
+
+    EXPECT_NE(bodies[5].find("\"id\":2"), std::string::npos);
+    EXPECT_NE(bodies[5].find("total: int"), std::string::npos) << bodies[5];
+    EXPECT_NE(bodies[6].find("fn int square(x: int)"), std::string::npos) << bodies[6];
+
+    // square moved down two lines; scale is the new global; total is local to main
+    EXPECT_NE(bodies[7].find("\"range\":{\"start\":{\"line\":2,\"character\":7}"), std::string::npos) << bodies[7];
+    EXPECT_NE(bodies[8].find("\"range\":{\"start\":{\"line\":0,\"character\":4}"), std::string::npos) << bodies[8];
+    EXPECT_NE(bodies[9].find("\"range\":{\"start\":{\"line\":7,\"character\":8}"), std::string::npos) << bodies[9];
+    EXPECT_NE(bodies[10].find("\"result\":null"), std::string::npos) << bodies[10];
+
+    EXPECT_NE(bodies[11].find("\"id\":99"), std::string::npos);
+}
+
+// Syntax errors are reported per function, and the rest of the file keeps its answers
+TEST_F(LanguageServerTest, SyntaxErrorStaysInItsFunction) {
+    std::string messages =
+        request(1, "initialize", "{\"capabilities\":{}}") +
+        notification("textDocument/didOpen",
+            "{\"textDocument\":{\"uri\":\"file:///test.lei\",\"languageId\":\"lei\",\"version\":1,\"text\":" +
+            ErrorHandler::quoteJson(document) + "}}") +
+        change(1, 16, 1, 17, "") +
+        request(2, "textDocument/hover", position(5, 21)) +
+        change(1, 16, 1, 16, ";") +
+        notification("textDocument/didClose", "{\"textDocument\":{\"uri\":\"file:///test.lei\"}}") +
+        request(3, "textDocument/hover", position(5, 21));
+
+    std::vector<std::string> bodies = serve(messages);
+    ASSERT_EQ(bodies.size(), 8u);
+    // The missing ';' is reported at the '}' after it
+    EXPECT_NE(bodies[2].find("Syntax Error: Expected ';'"), std::string::npos) << bodies[2];
+    EXPECT_NE(bodies[2].find("\"range\":{\"start\":{\"line\":2,"), std::string::npos) << bodies[2];
+    EXPECT_NE(bodies[3].find("fn int square(x: int)"), std::string::npos) << bodies[3];
+    EXPECT_NE(bodies[4].find("\"diagnostics\":[]"), std::string::npos) << bodies[4];
+    EXPECT_NE(bodies[5].find("\"diagnostics\":[]"), std::string::npos) << bodies[5];
+    EXPECT_NE(bodies[6].find("\"id\":3,\"result\":null"), std::string::npos) << bodies[6];
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
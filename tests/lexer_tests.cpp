@@ -96,7 +96,7 @@ TEST_F(LexerTest, InvalidCharacters) {
 
 // Test error recovery
 TEST_F(LexerTest, ErrorRecovery) {
-    std::string input = "var x: int = 3..; var y: int = 42;";
+    std::string input = "var x: int = 3.; var y: int = 42;";
     Lexer lexer(input);
     auto tokens = lexer.tokenize();
     
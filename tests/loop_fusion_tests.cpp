@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include "lexer.h"
+#include "parser.h"
+#include "semantic_visitor.h"
+#include "error_handler.h"
+#include "loop_fusion.h"
+
+class LoopFusionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ErrorHandler::instance().clearAllErrors();
+        SymbolTable::instance().reset();
+    }
+
+    // Loops merged away in 'kernel', or -1 if the program does not analyze
+    int fuse(const std::string& source) {
+        ErrorHandler::instance().clearAllErrors();
+        SymbolTable::instance().reset();
+
+        Lexer lexer(source);
+        auto tokens = lexer.tokenize();
+        Parser parser(tokens);
+        program = parser.parse();
+        if (!program || ErrorHandler::instance().hasErrors()) return -1;
+
+        SemanticAnalyzer analyzer(SymbolTable::instance());
+        if (!analyzer.analyze(program.get())) return -1;
+
+        functions.clear();
+        for (const auto& function : program->functions) {
+            functions[function->name.value] = function.get();
+        }
+        Lei::LoopFusion fusion(functions, SymbolTable::instance());
+        return fusion.run(functions.at("kernel"));
+    }
+
+    // Two loops over 0..n with the given bodies, in a function taking arrays a, b and c
+    static std::string loops(const std::string& first, const std::string& second,
+                             const std::string& prelude = "") {
+        return prelude + R"(
+            fn int kernel(a: int[], b: int[], c: int[], n: int, k: int) {
+                var s: int = 0;
+                var i: int = 0;
+                while i < n { )" + first + R"( i = i + 1; }
+                i = 0;
+                while i < n { )" + second + R"( i = i + 1; }
+                return s;
+            }
+
+            fn int main() { return 0; }
+        )";
+    }
+
+    std::unique_ptr<Program> program;
+    std::unordered_map<std::string, FunctionDecl*> functions;
+};
+
+// Loops whose bodies only meet at the same or earlier elements are merged
+TEST_F(LoopFusionTest, IndependentAndForwardDependencesFuse) {
+    EXPECT_EQ(fuse(loops("a[i] = i;", "b[i] = i * 2;")), 1);
+    EXPECT_EQ(fuse(loops("a[i] = i;", "b[i] = a[i] + 1;")), 1);
+    EXPECT_EQ(fuse(loops("a[i + 1] = i;", "b[i] = a[i];")), 1);
+    EXPECT_EQ(fuse(loops("a[k + i] = i;", "b[k + i] = a[k + i];")), 1);
+    EXPECT_EQ(fuse(loops("a[i] = abs(i);", "print(a[i]);")), 1);
+
+    // A third loop over the same range joins the fused one
+    EXPECT_EQ(fuse(R"(
+        fn int kernel(a: int[], b: int[], c: int[], n: int, k: int) {
+            var i: int = 0;
+            while i < n { a[i] = i; i = i + 1; }
+            i = 0;
+            while i < n { b[i] = a[i]; i += 1; }
+            i = 0;
+            while i < n { c[i] = b[i]; i = 1 + i; }
+            return 0;
+        }
+
+        fn int main() { return 0; }
+    )"), 2);
+}
+
+// Fusing must not let the second body see an element the first has not written yet
+TEST_F(LoopFusionTest, BackwardDependencesBlock) {
+    EXPECT_EQ(fuse(loops("a[i] = i;", "b[i] = a[i + 1];")), 0);
+    EXPECT_EQ(fuse(loops("a[i] = i;", "a[i + 1] = 0;")), 0);
+    EXPECT_EQ(fuse(loops("a[i] = i;", "b[i] = a[n - i];")), 0);
+    EXPECT_EQ(fuse(loops("a[2 * i] = i;", "b[i] = a[i];")), 0);
+    EXPECT_EQ(fuse(loops("a[i] = i;", "b[i] = a[0];")), 0);
+
+    // Dynamic arrays may share storage, so their indices are compared too
+    EXPECT_EQ(fuse(loops("a[k + i] = i;", "b[i] = a[k + i];")), 0);
+
+    // Loop-invariant terms must stay invariant
+    EXPECT_EQ(fuse(loops("a[k + i] = i; k = 1;", "b[i] = a[k + i];")), 0);
+}
+
+// Scalars written in one body may not be used by the other
+TEST_F(LoopFusionTest, ScalarDependencesBlock) {
+    EXPECT_EQ(fuse(loops("s = s + a[i];", "b[i] = s;")), 0);
+    EXPECT_EQ(fuse(loops("b[i] = s;", "s += a[i];")), 0);
+    EXPECT_EQ(fuse(loops("s += a[i];", "s += b[i];")), 0);
+
+    // Locals of one iteration are private to it
+    EXPECT_EQ(fuse(loops("var t: int = a[i]; b[i] = t;", "var t: int = b[i]; c[i] = t;")), 1);
+}
+
+// Side effects that cannot be reordered keep the loops apart
+TEST_F(LoopFusionTest, SideEffectsBlock) {
+    EXPECT_EQ(fuse(loops("print(a[i]);", "print(b[i]);")), 0);
+    EXPECT_EQ(fuse(loops("a[i] = i;", "b[i] = bump(i);", R"(
+        var calls: int = 0;
+
+        fn int bump(x: int) {
+            calls = calls + 1;
+            return x;
+        }
+    )")), 0);
+    EXPECT_EQ(fuse(loops("a[i] = i;", "b[i] = twice(i);", R"(
+        fn int twice(x: int) {
+            return x * 2;
+        }
+    )")), 1);
+    EXPECT_EQ(fuse(loops("a[i] = i;", "if i == k { return 1; }")), 0);
+}
+
+// Only loops over the same range with the same induction variable qualify
+TEST_F(LoopFusionTest, DifferentRangesDoNotFuse) {
+    EXPECT_EQ(fuse(R"(
+        fn int kernel(a: int[], b: int[], c: int[], n: int, k: int) {
+            var i: int = 0;
+            while i < n { a[i] = i; i = i + 1; }
+            i = 0;
+            while i < k { b[i] = i; i = i + 1; }
+            return 0;
+        }
+
+        fn int main() { return 0; }
+    )"), 0);
+
+    EXPECT_EQ(fuse(R"(
+        fn int kernel(a: int[], b: int[], c: int[], n: int, k: int) {
+            var i: int = 0;
+            while i < n { a[i] = i; i = i + 1; }
+            i = 1;
+            while i < n { b[i] = i; i = i + 1; }
+            return 0;
+        }
+
+        fn int main() { return 0; }
+    )"), 0);
+
+    // The bound may not change between or inside the loops
+    EXPECT_EQ(fuse(R"(
+        fn int kernel(a: int[], b: int[], c: int[], n: int, k: int) {
+            var i: int = 0;
+            while i < n { a[i] = i; n = k; i = i + 1; }
+            i = 0;
+            while i < n { b[i] = i; i = i + 1; }
+            return 0;
+        }
+
+        fn int main() { return 0; }
+    )"), 0);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include "metrics.h"
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace Lei;
+
+// The segment as 'leic --stats-attach' sees it, mapped read-only
+class PublishedSegment {
+public:
+    PublishedSegment() {
+        int fd = shm_open(("/lei-stats." + std::to_string(getpid())).c_str(), O_RDONLY, 0);
+        if (fd < 0) return;
+        void* memory = mmap(nullptr, sizeof(Metrics::Segment), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (memory != MAP_FAILED) segment = static_cast<const Metrics::Segment*>(memory);
+    }
+
+    ~PublishedSegment() {
+        if (segment) munmap(const_cast<Metrics::Segment*>(segment), sizeof(Metrics::Segment));
+    }
+
+    // Published slot named 'name', or null
+    const Metrics::Slot* find(const std::string& name) const {
+        for (uint32_t i = 0; i < segment->count.load(); i++) {
+            if (name == segment->slots[i].name) return &segment->slots[i];
+        }
+        return nullptr;
+    }
+
+    const Metrics::Segment* segment = nullptr;
+};
+
+class MetricsTest : public ::testing::Test {
+protected:
+    // A histogram's sum, stored as the bits of a double
+    static double sum(const Metrics::Slot* slot) {
+        uint64_t bits = slot->sum.load();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+// Histogram values land in the bucket of their power of two
+TEST_F(MetricsTest, ObserveFillsPowerOfTwoBuckets) {
+    Metrics::Slot* latency = Metrics::slot("test.latency", Metrics::HISTOGRAM);
+    for (double value : { 0.0, 0.5, 1.0, 1.5, 2.0, 3.0, 1024.0, 1e300 }) {
+        Metrics::observe(latency, value);
+    }
+
+    EXPECT_EQ(latency->value.load(), 8u);
+    EXPECT_DOUBLE_EQ(sum(latency), 1033.0 + 1e300);
+
+    EXPECT_EQ(latency->buckets[0].load(), 2u);   // Below 1
+    EXPECT_EQ(latency->buckets[1].load(), 2u);   // [1, 2)
+    EXPECT_EQ(latency->buckets[2].load(), 2u);   // [2, 4)
+    EXPECT_EQ(latency->buckets[11].load(), 1u);  // [1024, 2048)
+    EXPECT_EQ(latency->buckets[Metrics::BUCKETS - 1].load(), 1u);  // Everything larger
+
+    Metrics::observe(latency, std::numeric_limits<double>::infinity());
+    EXPECT_EQ(latency->buckets[Metrics::BUCKETS - 1].load(), 2u);
+}
+
+// Concurrent observations lose neither counts nor sums
+TEST_F(MetricsTest, ObserveFromManyThreads) {
+    Metrics::Slot* sizes = Metrics::slot("test.sizes", Metrics::HISTOGRAM);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([sizes]() {
+            for (int i = 0; i < 10000; i++) {
+                Metrics::observe(sizes, i % 2 == 0 ? 2.0 : 0.25);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    EXPECT_EQ(sizes->value.load(), 40000u);
+    EXPECT_DOUBLE_EQ(sum(sizes), 20000 * 2.0 + 20000 * 0.25);
+    EXPECT_EQ(sizes->buckets[0].load(), 20000u);
+    EXPECT_EQ(sizes->buckets[2].load(), 20000u);
+}
+
+// A name gets one slot per kind, published in the shared segment; past the
+// segment's capacity every new metric shares one private slot
+TEST_F(MetricsTest, SlotsAreAllocatedOncePerName) {
+    Metrics::Slot* requests = Metrics::slot("test.requests", Metrics::COUNTER);
+    ASSERT_TRUE(requests);
+    EXPECT_EQ(Metrics::slot("test.requests", Metrics::COUNTER), requests);
+    Metrics::Slot* gauge = Metrics::slot("test.requests", Metrics::GAUGE);
+    EXPECT_NE(gauge, requests);
+    EXPECT_EQ(gauge->kind, Metrics::GAUGE);
+
+    // Names are cut to fit the slot, and the cut name finds the same slot
+    std::string longName(100, 'x');
+    Metrics::Slot* truncated = Metrics::slot(longName, Metrics::COUNTER);
+    EXPECT_EQ(std::strlen(truncated->name), Metrics::NAME_SIZE - 1);
+    EXPECT_EQ(Metrics::slot(longName.substr(0, Metrics::NAME_SIZE - 1), Metrics::COUNTER), truncated);
+
+    requests->value.fetch_add(7);
+    PublishedSegment published;
+    ASSERT_TRUE(published.segment);
+    EXPECT_EQ(published.segment->magic, Metrics::MAGIC);
+    EXPECT_EQ(published.segment->capacity, Metrics::CAPACITY);
+    const Metrics::Slot* seen = published.find("test.requests");
+    ASSERT_TRUE(seen);
+    EXPECT_EQ(seen->kind, Metrics::COUNTER);
+    EXPECT_EQ(seen->value.load(), 7u);
+
+    uint32_t count = published.segment->count.load();
+    for (uint32_t i = count; i < Metrics::CAPACITY; i++) {
+        Metrics::slot("test.fill." + std::to_string(i), Metrics::COUNTER);
+    }
+    EXPECT_EQ(published.segment->count.load(), Metrics::CAPACITY);
+    Metrics::Slot* overflow = Metrics::slot("test.past.end", Metrics::COUNTER);
+    EXPECT_EQ(Metrics::slot("test.also.past.end", Metrics::GAUGE), overflow);
+    EXPECT_FALSE(published.find("test.past.end"));
+
+    // Existing metrics keep their slots
+    EXPECT_EQ(Metrics::slot("test.requests", Metrics::COUNTER), requests);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
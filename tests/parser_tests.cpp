@@ -318,6 +318,388 @@ TEST_F(ParserTest, OperatorAssociativity) {
     EXPECT_TRUE(ast.find("Assignment: =") != std::string::npos);
 }
 
+// Test const fn and const declarations
+TEST_F(ParserTest, ConstDeclarations) {
+    auto ast = getAstString(R"(
+        const fn int square(x: int) {
+            return x * x;
+        }
+        fn int main() {
+            const N: int = square(4);
+            const TABLE: int[3] = {1, 2, 3};
+            return N;
+        }
+    )");
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+    EXPECT_TRUE(ast.find("Const Function: square") != std::string::npos);
+    EXPECT_TRUE(ast.find("Constant Declaration: N") != std::string::npos);
+    EXPECT_TRUE(ast.find("Constant Declaration: TABLE") != std::string::npos);
+
+    // Constants must be initialized
+    EXPECT_TRUE(hasParseError(R"(
+        fn int main() {
+            const N: int;
+            return 0;
+        }
+    )", "Constant declaration requires an initializer"));
+
+    // 'const' before a type is a malformed constant, not a function
+    EXPECT_TRUE(hasParseError(R"(
+        const int main() {
+            return 0;
+        }
+    )", "Expected variable name"));
+}
+
+// Test top-level global declarations
+TEST_F(ParserTest, GlobalDeclarations) {
+    auto ast = parse(R"(
+        const LIMIT: int = 10;
+        var counter: int = 0;
+        threadlocal var scratch: int;
+        fn int main() {
+            return counter;
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+    ASSERT_EQ(ast->globals.size(), 3u);
+    EXPECT_EQ(ast->functions.size(), 1u);
+    EXPECT_TRUE(ast->globals[0]->isConst);
+    EXPECT_FALSE(ast->globals[1]->isThreadLocal);
+    EXPECT_TRUE(ast->globals[2]->isThreadLocal);
+
+    // 'threadlocal' only applies to top-level variables
+    EXPECT_TRUE(hasParseError(R"(
+        fn int main() {
+            threadlocal var x: int;
+            return 0;
+        }
+    )", "'threadlocal' is only allowed on top-level variables"));
+}
+
+// Test generic function declarations
+TEST_F(ParserTest, GenericFunctions) {
+    auto ast = parse(R"(
+        fn T largest<T>(a: T, b: T) {
+            var result: T = a;
+            if (b > a) {
+                result = b;
+            }
+            return result;
+        }
+        fn int main() {
+            return largest(1, 2);
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+    ASSERT_EQ(ast->functions.size(), 2u);
+
+    const auto& generic = ast->functions[0];
+    EXPECT_TRUE(generic->isGeneric());
+    EXPECT_EQ(generic->returnType.name, "T");
+    EXPECT_EQ(generic->parameters[1].type.name, "T");
+    EXPECT_FALSE(generic->templateTokens.empty());
+    EXPECT_FALSE(ast->functions[1]->isGeneric());
+
+    // Type parameters are only types inside their own function
+    EXPECT_TRUE(hasParseError(R"(
+        fn T first<T>(a: T) { return a; }
+        fn T second(a: T) { return a; }
+    )", "Expected type specifier"));
+}
+
+TEST_F(ParserTest, FunctionAttributes) {
+    auto ast = parse(R"(
+        @memo
+        fn int fib(n: int) {
+            if (n < 2) { return n; }
+            return fib(n - 1) + fib(n - 2);
+        }
+        @memo(256)
+        fn int paths(r: int, c: int) { return r + c; }
+        fn int main() {
+            return fib(10);
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+    ASSERT_EQ(ast->functions.size(), 3u);
+
+    const Attribute* memo = ast->functions[0]->getAttribute("memo");
+    ASSERT_NE(memo, nullptr);
+    EXPECT_TRUE(memo->arguments.empty());
+
+    memo = ast->functions[1]->getAttribute("memo");
+    ASSERT_NE(memo, nullptr);
+    ASSERT_EQ(memo->arguments.size(), 1u);
+    EXPECT_EQ(memo->arguments[0].value, "256");
+    EXPECT_EQ(ast->functions[2]->getAttribute("memo"), nullptr);
+
+    // Attributes only apply to functions
+    EXPECT_TRUE(hasParseError(R"(
+        @memo
+        var x: int = 1;
+    )", "Expected function declaration after attributes"));
+}
+
+TEST_F(ParserTest, ParallelFor) {
+    auto ast = parse(R"(
+        fn int main() {
+            var total: int = 0;
+            var best: int = 0;
+            parallel for i in 0..100 reduce(+: total, max: best) {
+                total += i;
+                best = max(best, i);
+            }
+            return total;
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+
+    auto* loop = dynamic_cast<ParallelForStmt*>(ast->functions[0]->body->statements[2].get());
+    ASSERT_NE(loop, nullptr);
+    EXPECT_EQ(loop->variable.value, "i");
+    ASSERT_EQ(loop->reductions.size(), 2u);
+    EXPECT_EQ(loop->reductions[0].op.value, "+");
+    EXPECT_EQ(loop->reductions[1].op.value, "max");
+    EXPECT_EQ(loop->reductions[1].variable.value, "best");
+
+    EXPECT_TRUE(hasParseError(R"(
+        fn int main() {
+            var t: int = 0;
+            parallel for i in 0..10 reduce(-: t) { t -= i; }
+            return t;
+        }
+    )", "Expected reduction operator"));
+}
+
+TEST_F(ParserTest, SpawnSync) {
+    auto ast = parse(R"(
+        fn int main() {
+            var a: int = spawn work(1);
+            spawn work(2);
+            sync;
+            return a;
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+
+    auto& statements = ast->functions[0]->body->statements;
+    auto* decl = dynamic_cast<VarDeclStmt*>(statements[0].get());
+    ASSERT_NE(decl, nullptr);
+    auto* spawn = dynamic_cast<SpawnExpr*>(decl->initializer.get());
+    ASSERT_NE(spawn, nullptr);
+    EXPECT_EQ(spawn->call->name.value, "work");
+    EXPECT_NE(dynamic_cast<SyncStmt*>(statements[2].get()), nullptr);
+
+    EXPECT_TRUE(hasParseError(R"(
+        fn int main() {
+            spawn 42;
+            return 0;
+        }
+    )", "Expected function call after 'spawn'"));
+}
+
+TEST_F(ParserTest, Channels) {
+    auto ast = parse(R"(
+        fn void stage(input: chan<int>, out: chan<float>) {
+            for v in input { send(out, v * 0.5); }
+            close(out);
+        }
+        fn int main() {
+            var a: chan<int> = chan<int>(16);
+            go stage(a, chan<float>(4));
+            return 0;
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+
+    const auto& stage = ast->functions[0];
+    EXPECT_EQ(stage->parameters[0].type.name, "chan<int>");
+    EXPECT_TRUE(stage->parameters[1].type.isChannel());
+    EXPECT_EQ(stage->parameters[1].type.channelElement().name, "float");
+    auto* loop = dynamic_cast<ForInStmt*>(stage->body->statements[0].get());
+    ASSERT_NE(loop, nullptr);
+    EXPECT_EQ(loop->variable.value, "v");
+
+    auto& statements = ast->functions[1]->body->statements;
+    auto* decl = dynamic_cast<VarDeclStmt*>(statements[0].get());
+    ASSERT_NE(decl, nullptr);
+    EXPECT_NE(dynamic_cast<ChannelExpr*>(decl->initializer.get()), nullptr);
+    auto* go = dynamic_cast<GoStmt*>(statements[1].get());
+    ASSERT_NE(go, nullptr);
+    EXPECT_EQ(go->call->name.value, "stage");
+
+    EXPECT_TRUE(hasParseError(R"(
+        fn int main() {
+            var c: chan<int[]> = chan<int[]>(1);
+            return 0;
+        }
+    )", "Channel element type must be int, float, bool or str"));
+}
+
+TEST_F(ParserTest, AtomicTypes) {
+    auto ast = parse(R"(
+        var total: atomic<int>;
+        fn void count(hits: atomic<int>[]) {
+            fetch_add(hits[0], 1, relaxed);
+        }
+        fn int main() {
+            var flags: atomic<int>[4];
+            return load(total, acquire);
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+
+    EXPECT_TRUE(ast->globals[0]->type.isAtomic());
+    EXPECT_EQ(ast->globals[0]->type.atomicValue().name, "int");
+    const Type& hits = ast->functions[0]->parameters[0].type;
+    EXPECT_EQ(hits.name, "atomic<int>");
+    EXPECT_TRUE(hits.isDynamicArray());
+    auto* flags = dynamic_cast<VarDeclStmt*>(ast->functions[1]->body->statements[0].get());
+    ASSERT_NE(flags, nullptr);
+    EXPECT_EQ(flags->type.arraySize, 4);
+
+    EXPECT_TRUE(hasParseError(R"(
+        fn int main() {
+            var f: atomic<float>;
+            return 0;
+        }
+    )", "Atomic value type must be int"));
+}
+
+TEST_F(ParserTest, Generators) {
+    auto ast = parse(R"(
+        fn gen int range(n: int) {
+            var i: int = 0;
+            while (i < n) {
+                yield i;
+                i += 1;
+            }
+        }
+        fn int main() {
+            for x in range(10) { print(x); }
+            return 0;
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+
+    EXPECT_TRUE(ast->functions[0]->isGenerator);
+    EXPECT_EQ(ast->functions[0]->returnType.name, "int");
+    EXPECT_FALSE(ast->functions[1]->isGenerator);
+    auto* loop = dynamic_cast<WhileStmt*>(ast->functions[0]->body->statements[1].get());
+    ASSERT_NE(loop, nullptr);
+    auto* body = dynamic_cast<BlockStmt*>(loop->body.get());
+    ASSERT_NE(body, nullptr);
+    EXPECT_NE(dynamic_cast<YieldStmt*>(body->statements[0].get()), nullptr);
+
+    EXPECT_TRUE(hasParseError(R"(
+        fn gen int g() {
+            yield 1
+        }
+    )", "Expected ';' after yield value"));
+}
+
+TEST_F(ParserTest, BitsType) {
+    auto ast = parse(R"(
+        var seen: bits[1000];
+        fn int main() {
+            seen[3] = true;
+            return popcount(seen);
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+
+    const Type& type = ast->globals[0]->type;
+    EXPECT_TRUE(type.isBits());
+    EXPECT_TRUE(type.isArray);
+    EXPECT_EQ(type.arraySize, 1000);
+
+    EXPECT_TRUE(hasParseError(R"(
+        fn int main() {
+            var s: bits[];
+            return 0;
+        }
+    )", "bits requires a fixed positive size"));
+
+    // 'bits' only names the type where a type is expected
+    ErrorHandler::instance().clearAllErrors();
+    ast = parse(R"(
+        fn int main() {
+            var bits: int = popcount(255) + clz(1) + ctz(8);
+            var set: bits[64];
+            set[bits] = true;
+            return bits;
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+}
+
+TEST_F(ParserTest, BenchStmt) {
+    auto ast = parse(R"(
+        fn int main() {
+            bench "loop" {
+                black_box(now_ns());
+            }
+            return 0;
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+
+    auto* bench = dynamic_cast<BenchStmt*>(ast->functions[0]->body->statements[0].get());
+    ASSERT_NE(bench, nullptr);
+    EXPECT_EQ(bench->name.value, "loop");
+    EXPECT_EQ(bench->body->statements.size(), 1u);
+
+    EXPECT_TRUE(hasParseError(R"(
+        fn int main() {
+            bench { }
+            return 0;
+        }
+    )", "Expected benchmark name string"));
+}
+
+TEST_F(ParserTest, Match) {
+    auto ast = parse(R"(
+        fn int main() {
+            var x: int = 2;
+            match x {
+                0 => { return 1; }
+                1, 2 => { return 2; }
+                3..10 => { return 3; }
+                _ => { }
+            }
+            return 0;
+        }
+    )");
+    ASSERT_NE(ast, nullptr);
+    EXPECT_FALSE(ErrorHandler::instance().hasErrors(ErrorLevel::SYNTAX));
+
+    auto* stmt = dynamic_cast<MatchStmt*>(ast->functions[0]->body->statements[1].get());
+    ASSERT_NE(stmt, nullptr);
+    ASSERT_EQ(stmt->arms.size(), 4u);
+    EXPECT_EQ(stmt->arms[1].patterns.size(), 2u);
+    EXPECT_NE(stmt->arms[2].patterns[0].end, nullptr);
+    EXPECT_TRUE(stmt->arms[3].isWildcard());
+
+    EXPECT_TRUE(hasParseError(R"(
+        fn int main() {
+            match 1 { 1 { } }
+            return 0;
+        }
+    )", "Expected '=>' after match pattern"));
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
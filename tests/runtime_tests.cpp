@@ -0,0 +1,379 @@
+#include <gtest/gtest.h>
+#include "runtime.h"
+#include "compiler.h"
+#include <llvm/Support/FileSystem.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// The pool reads LEI_THREADS when it is first used; main sets it to this, so
+// the work-stealing paths run even on a single-core machine
+constexpr int Workers = 4;
+
+class RuntimeTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ErrorHandler::instance().clearAllErrors();
+        SymbolTable::instance().reset();
+    }
+
+    // What a Lei program prints, followed by its result
+    static std::string run(const std::string& source) {
+        Compiler compiler;
+        testing::internal::CaptureStdout();
+        bool succeeded = compiler.execute(source, false, false, false);
+        std::fflush(stdout);
+        std::string output = testing::internal::GetCapturedStdout();
+        return succeeded ? output : "";
+    }
+};
+
+struct Coverage {
+    std::vector<std::atomic<int>> hits;
+    std::atomic<uint32_t> workers{0};  // Bit per worker that ran a chunk
+
+    explicit Coverage(size_t n) : hits(n) {}
+};
+
+// Every iteration runs exactly once, and the workers share the range
+TEST_F(RuntimeTest, ParallelForCoversTheRange) {
+    ASSERT_EQ(lei_parallel_workers(), Workers);
+
+    const int32_t begin = 100, end = 2100;
+    Coverage coverage(end);
+    lei_parallel_for(begin, end, [](void* context, int32_t lo, int32_t hi, int32_t worker) {
+        auto* coverage = static_cast<Coverage*>(context);
+        coverage->workers.fetch_or(1u << worker);
+        for (int32_t i = lo; i < hi; i++) {
+            coverage->hits[i].fetch_add(1);
+        }
+        // Slow chunks leave time for the other workers to start and steal
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }, &coverage);
+
+    for (int32_t i = 0; i < end; i++) {
+        ASSERT_EQ(coverage.hits[i].load(), i < begin ? 0 : 1) << "iteration " << i;
+    }
+    EXPECT_NE(coverage.workers.load() & ~1u, 0u);
+    EXPECT_LT(coverage.workers.load(), 1u << Workers);
+
+    // Empty and single-iteration ranges
+    Coverage small(4);
+    lei_parallel_for(3, 3, [](void* context, int32_t lo, int32_t hi, int32_t) {
+        static_cast<Coverage*>(context)->hits[0].fetch_add(hi - lo + 1);
+    }, &small);
+    EXPECT_EQ(small.hits[0].load(), 0);
+    lei_parallel_for(2, 3, [](void* context, int32_t lo, int32_t hi, int32_t) {
+        for (int32_t i = lo; i < hi; i++) static_cast<Coverage*>(context)->hits[i].fetch_add(1);
+    }, &small);
+    EXPECT_EQ(small.hits[2].load(), 1);
+}
+
+// Per-worker accumulators combine into the same results as a sequential loop
+TEST_F(RuntimeTest, ParallelReductions) {
+    EXPECT_EQ(run(R"(
+        fn int main() {
+            var n: int = 10000;
+            var data: int[] = malloc(n * sizeof(int));
+            parallel for i in 0..n {
+                data[i] = i * (10000 - i);
+            }
+
+            var total: int = 0;
+            var largest: int = 0;
+            var smallest: int = 0;
+            var product: int = 1;
+            var sum: float = 0.0;
+            parallel for i in 0..n reduce(+: total, max: largest, min: smallest, *: product, +: sum) {
+                total += i;
+                largest = max(largest, data[i]);
+                smallest = min(smallest, data[i] - 3 * i);
+                if (i == 7 || i == 700 || i == 7000) {
+                    product *= 2;
+                }
+                sum += 0.5;
+            }
+            free(data);
+            print(total); print(" ");
+            print(largest); print(" ");
+            print(smallest); print(" ");
+            print(product); print(" ");
+            print(sum); print(" ");
+            return 0;
+        }
+    )"), "49995000 25000000 -19998 8 5000.000000 Execution Result: 0\n");
+}
+
+// Where a spawned call ran: inline inside lei_spawn, popped by the spawner
+// while syncing, or stolen by another thread
+struct SpawnLog {
+    std::thread::id spawner = std::this_thread::get_id();
+    std::vector<std::atomic<bool>> returned;  // lei_spawn has returned for the call
+    std::atomic<int> inlined{0};
+    std::atomic<int> popped{0};
+    std::atomic<int> stolen{0};
+
+    explicit SpawnLog(size_t calls) : returned(calls) {}
+    int total() const { return inlined + popped + stolen; }
+};
+
+struct LoggedCall {
+    SpawnLog* log;
+    size_t index;
+    int sleepMicroseconds;
+};
+
+void runLoggedCall(void* frame) {
+    auto* call = static_cast<LoggedCall*>(frame);
+    SpawnLog& log = *call->log;
+    if (std::this_thread::get_id() != log.spawner) {
+        log.stolen++;
+    } else if (log.returned[call->index]) {
+        log.popped++;
+    } else {
+        log.inlined++;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(call->sleepMicroseconds));
+}
+
+void spawnLogged(SpawnLog& log, int64_t* group, size_t index, int sleepMicroseconds) {
+    LoggedCall call{ &log, index, sleepMicroseconds };
+    lei_spawn(group, runLoggedCall, &call, sizeof(call));
+    log.returned[index] = true;
+}
+
+// Queued calls are popped by the spawner, newest first, and stolen by idle
+// pool threads from the other end
+TEST_F(RuntimeTest, SpawnedCallsArePoppedAndStolen) {
+    const size_t calls = 24;  // Below the spawn cutoff, so every call is queued
+    SpawnLog log(calls);
+    int64_t group = 0;
+    for (size_t i = 0; i < calls; i++) {
+        spawnLogged(log, &group, i, 1000);
+    }
+    lei_sync(&group);
+
+    EXPECT_EQ(group, 0);
+    EXPECT_EQ(log.total(), static_cast<int>(calls));
+    EXPECT_EQ(log.inlined, 0);
+    EXPECT_GT(log.popped, 0);
+    EXPECT_GT(log.stolen, 0);
+}
+
+struct FibCall {
+    int n;
+    int64_t* result;
+};
+
+void fib(void* frame) {
+    auto* call = static_cast<FibCall*>(frame);
+    if (call->n < 2) {
+        *call->result = call->n;
+        return;
+    }
+    int64_t group = 0, a = 0, b = 0;
+    FibCall first{ call->n - 1, &a };
+    lei_spawn(&group, fib, &first, sizeof(first));
+    FibCall second{ call->n - 2, &b };
+    fib(&second);
+    lei_sync(&group);
+    *call->result = a + b;
+}
+
+// Tasks spawning tasks: thieves push to deques of their own, which others steal from
+TEST_F(RuntimeTest, NestedSpawnsAcrossThreads) {
+    int64_t result = 0;
+    FibCall call{ 22, &result };
+    fib(&call);
+    EXPECT_EQ(result, 17711);
+
+    SpawnLog log(1);
+    int64_t group = 0;
+    FibCall deep{ 18, &result };
+    lei_spawn(&group, fib, &deep, sizeof(deep));
+    spawnLogged(log, &group, 0, 0);
+    lei_sync(&group);
+    EXPECT_EQ(result, 2584);
+    EXPECT_EQ(log.total(), 1);
+}
+
+// Deque slots of exited threads go to new ones; without reuse, threads past
+// the 256th would find no slot and run every call inline
+TEST_F(RuntimeTest, DequeSlotsOfExitedThreadsAreReused) {
+    const size_t threads = 300;
+    int inlined = 0;
+    for (size_t i = 0; i < threads; i++) {
+        std::thread([&] {
+            SpawnLog log(1);
+            int64_t group = 0;
+            spawnLogged(log, &group, 0, 0);
+            lei_sync(&group);
+            EXPECT_EQ(log.total(), 1);
+            inlined += log.inlined;
+        }).join();
+    }
+    EXPECT_EQ(inlined, 0);
+}
+
+// After close, receivers get the values still queued and then 0
+TEST_F(RuntimeTest, ClosedChannelsDrain) {
+    void* channel = lei_chan_new(3);
+    lei_chan_send(channel, 1);
+    lei_chan_send(channel, 2);
+    lei_chan_send(channel, 3);
+    lei_chan_close(channel);
+
+    EXPECT_EQ(lei_chan_recv(channel), 1);
+    int64_t values[8] = {};
+    ASSERT_EQ(lei_chan_recv_batch(channel, values, 8), 2);
+    EXPECT_EQ(values[0], 2);
+    EXPECT_EQ(values[1], 3);
+    EXPECT_EQ(lei_chan_recv(channel), 0);
+    EXPECT_EQ(lei_chan_recv_batch(channel, values, 8), 0);
+
+    // A receiver parked on an empty channel is woken by close
+    void* empty = lei_chan_new(1);
+    std::atomic<bool> returned{false};
+    std::thread receiver([&] {
+        EXPECT_EQ(lei_chan_recv(empty), 0);
+        returned = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(returned);
+    lei_chan_close(empty);
+    receiver.join();
+    EXPECT_TRUE(returned);
+}
+
+// A small ring makes producers and consumers park on the futexes in turn;
+// every value still arrives exactly once
+TEST_F(RuntimeTest, ChannelProducersAndConsumers) {
+    const int producers = 4, consumers = 3;
+    const int64_t perProducer = 5000;
+    void* channel = lei_chan_new(2);
+
+    std::atomic<int64_t> sum{0};
+    std::atomic<int64_t> received{0};
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&, c] {
+            int64_t values[16];
+            while (true) {
+                // One consumer takes batches, the others single values
+                int32_t count = 0;
+                if (c == 0) {
+                    count = lei_chan_recv_batch(channel, values, 16);
+                } else {
+                    values[0] = lei_chan_recv(channel);
+                    count = values[0] != 0;
+                }
+                if (count == 0) return;
+                for (int32_t i = 0; i < count; i++) sum += values[i];
+                received += count;
+            }
+        });
+    }
+
+    std::vector<std::thread> senders;
+    for (int p = 0; p < producers; p++) {
+        senders.emplace_back([&, p] {
+            for (int64_t i = 1; i <= perProducer; i++) {
+                lei_chan_send(channel, p * perProducer + i);
+            }
+        });
+    }
+    for (auto& sender : senders) sender.join();
+    lei_chan_close(channel);
+    for (auto& thread : threads) thread.join();
+
+    const int64_t total = producers * perProducer;
+    EXPECT_EQ(received.load(), total);
+    EXPECT_EQ(sum.load(), total * (total + 1) / 2);
+}
+
+// for-in receives every value and leaves the loop once the channel is closed and drained
+TEST_F(RuntimeTest, ForInEndsWhenTheChannelCloses) {
+    EXPECT_EQ(run(R"(
+        fn void produce(out: chan<int>, n: int) {
+            var i: int = 1;
+            while (i <= n) {
+                send(out, i);
+                i += 1;
+            }
+            close(out);
+        }
+
+        fn int main() {
+            var numbers: chan<int> = chan<int>(4);
+            go produce(numbers, 1000);
+            var total: int = 0;
+            var count: int = 0;
+            for v in numbers {
+                total += v;
+                count += 1;
+            }
+
+            var none: chan<int> = chan<int>(1);
+            close(none);
+            for v in none {
+                count += 100;
+            }
+            print(total); print(" ");
+            print(count); print(" ");
+            return 0;
+        }
+    )"), "500500 1000 Execution Result: 0\n");
+}
+
+// Every run of --run-many reads its own input file, writes its own output
+// file and starts with fresh globals
+TEST_F(RuntimeTest, RunManySessions) {
+    std::string directory = testing::TempDir() + "lei_run_many";
+    llvm::sys::fs::remove_directories(directory);
+    ASSERT_FALSE(llvm::sys::fs::create_directories(directory + "/inputs"));
+    ASSERT_FALSE(llvm::sys::fs::create_directories(directory + "/outputs"));
+
+    std::vector<std::string> inputs;
+    for (const char* name : { "alpha", "beta", "gamma", "delta" }) {
+        inputs.push_back(directory + "/inputs/" + name);
+        std::ofstream(inputs.back()) << name << "\n";
+    }
+
+    Compiler compiler;
+    testing::internal::CaptureStdout();
+    bool succeeded = compiler.runMany(R"(
+        var runs: int = 0;
+
+        fn int main() {
+            runs += 1;
+            var line: str = input("");
+            print(line);
+            print(" ");
+            print(runs);
+            return runs - 1;
+        }
+    )", inputs, directory + "/outputs", 2);
+    std::string summary = testing::internal::GetCapturedStdout();
+    EXPECT_TRUE(succeeded);
+    EXPECT_NE(summary.find("4 runs on 2 threads"), std::string::npos) << summary;
+    EXPECT_NE(summary.find(", 0 failed"), std::string::npos) << summary;
+
+    for (const char* name : { "alpha", "beta", "gamma", "delta" }) {
+        std::ifstream in(directory + "/outputs/" + name + ".out");
+        std::stringstream output;
+        output << in.rdbuf();
+        EXPECT_EQ(output.str(), std::string(name) + " 1");
+    }
+    llvm::sys::fs::remove_directories(directory);
+}
+
+int main(int argc, char **argv) {
+    setenv("LEI_THREADS", std::to_string(Workers).c_str(), 1);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "sample_profiler.h"
+#include "compiler.h"
+#include <llvm/Support/FileSystem.h>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
+
+class SampleProfilerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ErrorHandler::instance().clearAllErrors();
+        SymbolTable::instance().reset();
+        ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("profile", "folded", path));
+    }
+
+    void TearDown() override {
+        llvm::sys::fs::remove(path);
+    }
+
+    // Count of every folded stack the file holds
+    std::map<std::string, uint64_t> readFolded() {
+        std::map<std::string, uint64_t> stacks;
+        std::ifstream in(path.str().str());
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t space = line.rfind(' ');
+            EXPECT_NE(space, std::string::npos) << line;
+            if (space == std::string::npos) continue;
+            EXPECT_TRUE(stacks.emplace(line.substr(0, space), std::stoull(line.substr(space + 1))).second) << line;
+        }
+        return stacks;
+    }
+
+    llvm::SmallString<128> path;
+};
+
+// Spends its time in spin's loop, called from line 15 of main
+static const char* spinning = R"(fn int spin(n: int) {
+    var total: int = 0;
+    var i: int = 0;
+    while i < n {
+        total = total * 31 + i;
+        i = i + 1;
+    }
+    return total;
+}
+
+fn int main() {
+    var sum: int = 0;
+    var round: int = 0;
+    while round < 300 {
+        sum = sum + spin(1000000);
+        round = round + 1;
+    }
+    return 0;
+}
+)";
+
+// One 'outer;...;inner count' line per distinct stack, each frame of
+// generated code named 'function:line', and nothing of the compiler below main
+TEST_F(SampleProfilerTest, WritesFoldedStacks) {
+    Compiler compiler;
+    compiler.sampleFrequency = 997;
+    compiler.sampleOutput = path.str().str();
+    compiler.errorHandler.setSource("spin.lei", spinning);
+    testing::internal::CaptureStdout();
+    testing::internal::CaptureStderr();
+    bool succeeded = compiler.execute(spinning, false, false, false);
+    testing::internal::GetCapturedStdout();
+    std::string report = testing::internal::GetCapturedStderr();
+    ASSERT_TRUE(succeeded) << report;
+
+    std::smatch counts;
+    ASSERT_TRUE(std::regex_search(report, counts, std::regex("Profile: (\\d+) samples, (\\d+) dropped"))) << report;
+    uint64_t samples = std::stoull(counts[1]);
+    EXPECT_GT(samples, 0u);
+
+    std::map<std::string, uint64_t> stacks = readFolded();
+    uint64_t total = 0, inSpin = 0;
+    const std::regex frame("[A-Za-z_][A-Za-z_0-9]*:[0-9]+");
+    for (const auto& [stack, count] : stacks) {
+        EXPECT_GT(count, 0u) << stack;
+        total += count;
+        if (stack.rfind("main:", 0) != 0) continue;
+
+        std::stringstream frames(stack);
+        std::string name;
+        while (std::getline(frames, name, ';')) {
+            EXPECT_TRUE(std::regex_match(name, frame)) << stack;
+        }
+        if (std::regex_match(stack, std::regex("main:15;spin:[4-8]"))) inSpin += count;
+    }
+    EXPECT_EQ(total, samples);
+    // A sample may land outside generated code, in the runtime after main returns
+    EXPECT_GE(inSpin * 10, samples * 9) << report;
+}
+
+// A profile with no samples is an empty file; an unwritable path fails
+TEST_F(SampleProfilerTest, EmptyAndUnwritableProfiles) {
+    Lei::SampleProfiler profiler(997);
+    EXPECT_EQ(profiler.samples(), 0u);
+    ASSERT_TRUE(profiler.writeFolded(path.str().str()));
+    EXPECT_TRUE(readFolded().empty());
+    EXPECT_FALSE(profiler.writeFolded(path.str().str() + "/not-a-directory/profile.folded"));
+
+    Lei::SampleProfiler off(0);
+    EXPECT_FALSE(off.start());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -3,6 +3,7 @@
 #include "parser.h"
 #include "semantic_visitor.h"
 #include "error_handler.h"
+#include "const_evaluator.h"
 
 class SemanticAnalyzerTest : public ::testing::Test {
 protected:
@@ -340,7 +341,684 @@ TEST_F(SemanticAnalyzerTest, ScopeRules) {
     ));
 }
 
+// Converting a named constant array to another element type must not change the constant
+TEST_F(SemanticAnalyzerTest, ConstantArrayConversionCopies) {
+    ConstValue table = ConstValue::makeArray({ConstValue::makeInt(1), ConstValue::makeInt(2)});
+    table.array->frozen = true;
+    std::unordered_map<std::string, FunctionDecl*> functions;
+    ConstEvaluator evaluator(functions, [&](const std::string& name, bool) -> const ConstValue* {
+        return name == "T" ? &table : nullptr;
+    });
+
+    VariableExpr reference(Token(IDENTIFIER, "T", 1, 1));
+    auto converted = evaluator.evaluate(&reference, Type("float", true, 2));
+    ASSERT_TRUE(converted);
+    EXPECT_EQ(converted->array->elements[0].kind, ConstValue::Kind::FLOAT);
+    EXPECT_NE(converted->array, table.array);
+    EXPECT_EQ(table.array->elements[0].kind, ConstValue::Kind::INT);
+    EXPECT_EQ(table.array->elements[1].kind, ConstValue::Kind::INT);
+}
+
+// Const arrays may be passed to functions; codegen hands them a writable copy
+TEST_F(SemanticAnalyzerTest, ConstantArrayArguments) {
+    EXPECT_TRUE(analyze(R"(
+        const T: int[3] = {1, 2, 3};
+
+        fn void clobber(a: int[]) {
+            a[0] = 99;
+        }
+
+        fn int main() {
+            const L: int[3] = {4, 5, 6};
+            clobber(T);
+            clobber(L);
+            return 0;
+        }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        const T: int[3] = {1, 2, 3};
+
+        fn int main() {
+            T[0] = 99;
+            return 0;
+        }
+    )", "Cannot assign to constant: T"));
+}
+
+// Generic functions are instantiated per set of argument types
+TEST_F(SemanticAnalyzerTest, GenericInstantiation) {
+    EXPECT_TRUE(analyze(R"(
+        fn T largest<T>(a: T, b: T) {
+            if a > b { return a; }
+            return b;
+        }
+
+        fn void forward<T>(c: T, v: int) {
+            send(c, v);
+        }
+
+        fn int main() {
+            var i: int = largest(3, 7);
+            var f: float = largest(2.5, 1.0);
+            var c: chan<int> = chan<int>(1);
+            forward(c, 7);
+            return 0;
+        }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn T largest<T>(a: T, b: T) {
+            if a > b { return a; }
+            return b;
+        }
+
+        fn int main() {
+            var x: int = largest(1, true);
+            return 0;
+        }
+    )", "Conflicting types for type parameter T"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int count<T>(s: T[]) {
+            return 0;
+        }
+
+        fn int main() {
+            var b: bits[64];
+            return count(b);
+        }
+    )", "Type bits cannot be used for type parameter T"));
+}
+
+// Parallel loop bodies may only write their own locals, reductions and array elements
+TEST_F(SemanticAnalyzerTest, ParallelLoopWrites) {
+    EXPECT_TRUE(analyze(R"(
+        threadlocal var scratch: int;
+
+        fn int main() {
+            var total: int = 0;
+            var data: int[] = malloc(100 * sizeof(int));
+            parallel for i in 0..100 reduce(+: total) {
+                var square: int = i * i;
+                data[i] = square;
+                scratch = scratch + 1;
+                total += square;
+            }
+            free(data);
+            return 0;
+        }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            var total: int = 0;
+            parallel for i in 0..100 {
+                total = total + i;
+            }
+            return 0;
+        }
+    )", "Assignment to 'total' inside a parallel loop races between iterations"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        var hits: int = 0;
+
+        fn int main() {
+            parallel for i in 0..100 {
+                hits = hits + 1;
+            }
+            return 0;
+        }
+    )", "Assignment to 'hits' inside a parallel loop races between iterations; use an atomic<int>"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            var s: int = 0;
+            parallel for i in 0..100 reduce(+: s) {
+                s = s + 1;
+                i = 5;
+            }
+            return 0;
+        }
+    )", "Cannot assign to parallel loop variable 'i'"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            var s: float = 0.0;
+            parallel for i in 0..100 reduce(+: s, +: s) {
+                s += 1.0;
+            }
+            return 0;
+        }
+    )", "Duplicate reduction variable: s"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            parallel for i in 0..100 {
+                return 1;
+            }
+            return 0;
+        }
+    )", "Cannot return from inside a parallel loop"));
+}
+
+// abs/min/max take the type of their operands
+TEST_F(SemanticAnalyzerTest, NumericBuiltinOverloads) {
+    EXPECT_TRUE(analyze(R"(
+        fn int main() {
+            var i: int = abs(-3) + min(1, 2) + max(3, 4);
+            var f: float = abs(-2.5) + min(1.5, 2.0) + max(1, 2.5);
+            var r: float = sqrt(2) + pow(2.0, 3) + popcount(255);
+            return i;
+        }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            var i: int = max(1, 2.5);
+            return i;
+        }
+    )", "Type mismatch"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            return abs("three");
+        }
+    )", "Function abs requires numeric arguments but got str"));
+}
+
+// Functions of the program replace the builtins they are named after
+TEST_F(SemanticAnalyzerTest, ProgramDeclarationsShadowBuiltins) {
+    EXPECT_TRUE(analyze(R"(
+        var calls: int = 0;
+
+        fn int max(a: int, b: int) {
+            if a > b { return a; }
+            return b;
+        }
+
+        fn str abs(s: str) {
+            return s;
+        }
+
+        fn int main() {
+            calls = calls + 1;
+            var s: str = abs("text");
+            gauge("depth", 1.0);
+            return max(calls, 2);
+        }
+    )"));
+
+    analyze(R"(
+        fn int max(a: int, b: int) { return a; }
+        fn int max(a: int, b: int) { return b; }
+        fn int main() { return max(1, 2); }
+    )");
+    auto errors = ErrorHandler::instance().getErrors(ErrorLevel::SEMANTIC);
+    ASSERT_EQ(errors.size(), 1u);
+    EXPECT_EQ(errors[0].message, "Duplicate function declaration: max");
+    EXPECT_EQ(errors[0].line, 3);
+
+    // A non-const function of the program is not evaluated as the builtin
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int min(a: int, b: int) { return a; }
+        const M: int = min(1, 2);
+        fn int main() { return M; }
+    )", "call to non-const function 'min'"));
+}
+
+// The metric builtins do not reserve their names
+TEST_F(SemanticAnalyzerTest, MetricNamesAreNotReserved) {
+    EXPECT_TRUE(analyze(R"(
+        const LIMIT: int = 10;
+        var counter: int = 0;
+        threadlocal var scratch: int;
+        fn int main() {
+            var gauge: float = 1.5;
+            counter = counter + LIMIT;
+            histogram("latency", gauge);
+            return counter;
+        }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        var counter: int = 0;
+        fn int main() {
+            counter("hits");
+            return 0;
+        }
+    )", "Undefined function: counter"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            var name: str = "hits";
+            counter(name);
+            return 0;
+        }
+    )", "The name of metric counter must be a string literal"));
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
+// Constant evaluation stops at its step, depth and size limits with a reason
+TEST_F(SemanticAnalyzerTest, ConstEvaluationLimits) {
+    EXPECT_TRUE(analyze(R"(
+        const fn int fact(n: int) {
+            var r: int = 1;
+            while (n > 1) { r *= n; n -= 1; }
+            return r;
+        }
+
+        fn int main() {
+            const F10: int = fact(10);
+            return F10;
+        }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        const fn int spin(n: int) {
+            while (true) { n += 1; }
+            return n;
+        }
+
+        const S: int = spin(0);
+        fn int main() { return S; }
+    )", "Constant 'S' is not a compile-time constant: evaluation exceeded 1000000 steps"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        const fn int depth(n: int) {
+            return depth(n + 1);
+        }
+
+        const D: int = depth(0);
+        fn int main() { return D; }
+    )", "const fn call depth exceeded 256"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        const BIG: int[2000000] = {};
+        fn int main() { return 0; }
+    )", "array exceeds 1048576 elements"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        const Q: int = 1 / 0;
+        fn int main() { return Q; }
+    )", "division by zero"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        const T: int[2] = {1, 2};
+        const E: int = T[2];
+        fn int main() { return E; }
+    )", "array index 2 out of bounds for size 2"));
+}
+
+// @memo needs a pure function of scalar arguments
+TEST_F(SemanticAnalyzerTest, MemoRequiresPureFunctions) {
+    EXPECT_TRUE(analyze(R"(
+        @memo
+        fn int fib(n: int) {
+            if n < 2 { return n; }
+            return fib(n - 1) + fib(n - 2);
+        }
+
+        @memo(64)
+        fn float hypot(x: float, y: float) {
+            return sqrt(x * x + y * y);
+        }
+
+        fn int main() {
+            return fib(20);
+        }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        var calls: int = 0;
+
+        @memo
+        fn int counted(n: int) {
+            calls = calls + 1;
+            return n;
+        }
+
+        fn int main() { return counted(1); }
+    )", "Function 'counted' cannot be memoized: it is not pure (reads global variable 'calls')"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int noisy(n: int) {
+            print(n);
+            return n;
+        }
+
+        @memo
+        fn int wrapped(n: int) {
+            return noisy(n);
+        }
+
+        fn int main() { return wrapped(1); }
+    )", "calls impure function 'noisy'"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        @memo
+        fn int first(a: int[]) {
+            return a[0];
+        }
+
+        fn int main() { return 0; }
+    )", "parameter 'a' is not an int, float or bool"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        @memo(100000)
+        fn int id(n: int) {
+            return n;
+        }
+
+        fn int main() { return id(1); }
+    )", "capacity must be an integer between 1 and 65536"));
+}
+
+// Generators yield scalars and are only consumed by for-in loops
+TEST_F(SemanticAnalyzerTest, AtomicMisuse) {
+    EXPECT_TRUE(analyze(R"(
+        var hits: atomic<int>;
+
+        fn int main() {
+            var slots: atomic<int>[4];
+            fetch_add(hits, 1, relaxed);
+            store(slots[2], 5, release);
+            var seen: int = load(hits, acquire);
+            if (seen < 10 && compare_exchange(hits, seen, 10, acq_rel)) {
+                return fetch_sub(slots[2], 1);
+            }
+            return load(slots[0]);
+        }
+    )"));
+
+    // Loads cannot release and stores cannot acquire
+    EXPECT_TRUE(hasSemanticError(R"(
+        var hits: atomic<int>;
+        fn int main() { return load(hits, release); }
+    )", "Memory ordering 'release' is not valid for load"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        var hits: atomic<int>;
+        fn int main() { return load(hits, acq_rel); }
+    )", "Memory ordering 'acq_rel' is not valid for load"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        var hits: atomic<int>;
+        fn int main() {
+            store(hits, 1, acquire);
+            return 0;
+        }
+    )", "Memory ordering 'acquire' is not valid for store"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        var hits: atomic<int>;
+        fn int main() { return load(hits, sequential); }
+    )", "Expected memory ordering relaxed, acquire, release, acq_rel or seq_cst"));
+
+    // Atomics are never read or written directly
+    EXPECT_TRUE(hasSemanticError(R"(
+        var hits: atomic<int>;
+        fn int main() { return hits + 1; }
+    )", "Atomic variable 'hits' can only be used through atomic operations"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            var total: atomic<int> = 0;
+            total = 2;
+            return 0;
+        }
+    )", "Atomic variable 'total' can only be used through atomic operations"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            var slots: atomic<int>[4];
+            slots[1] = 3;
+            return 0;
+        }
+    )", "Atomic array elements can only be used through atomic operations"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            var plain: int = 0;
+            return fetch_add(plain, 1);
+        }
+    )", "Function fetch_add expects an atomic variable but got int"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        var hits: atomic<int>;
+        fn int main() { return fetch_add(hits, 1.5); }
+    )", "Argument type mismatch. Expected int but got float"));
+}
+
+TEST_F(SemanticAnalyzerTest, MatchPatterns) {
+    EXPECT_TRUE(analyze(R"(
+        const LIMIT: int = 100;
+
+        fn int classify(code: int, flag: bool) {
+            match flag {
+                true => { code += 1; }
+                false => { code -= 1; }
+            }
+            match code {
+                0 => { return 0; }
+                1, 2, 3 => { return 1; }
+                10..LIMIT => { return 2; }
+                LIMIT..LIMIT + 1024 => { return 3; }
+                _ => { return 4; }
+            }
+            return 5;
+        }
+
+        fn int main() { return classify(3, true); }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match 2 {
+                0..4 => { return 0; }
+                3 => { return 1; }
+                _ => { return 2; }
+            }
+            return 0;
+        }
+    )", "Duplicate match pattern 3"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match true {
+                true => { return 0; }
+                true => { return 1; }
+                _ => { return 2; }
+            }
+            return 0;
+        }
+    )", "Duplicate match pattern true"));
+
+    // Matches must be exhaustive
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match 2 {
+                0 => { return 0; }
+                1..1000 => { return 1; }
+            }
+            return 0;
+        }
+    )", "Match on int must end with a wildcard '_' arm"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match false {
+                true => { return 0; }
+            }
+            return 0;
+        }
+    )", "Match on bool must cover true and false or end with '_'"));
+
+    // Ranges are non-empty and bounded
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match 2 {
+                5..5 => { return 0; }
+                _ => { return 1; }
+            }
+            return 0;
+        }
+    )", "Match range 5..5 must be non-empty and cover at most 1024 values"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match 2 {
+                0..1025 => { return 0; }
+                _ => { return 1; }
+            }
+            return 0;
+        }
+    )", "Match range 0..1025 must be non-empty and cover at most 1024 values"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match true {
+                false..true => { return 0; }
+                _ => { return 1; }
+            }
+            return 0;
+        }
+    )", "Range patterns require an int subject"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match 2 {
+                _ => { return 0; }
+                1 => { return 1; }
+            }
+            return 0;
+        }
+    )", "Wildcard '_' must be the last match arm"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match 2.5 {
+                1 => { return 0; }
+                _ => { return 1; }
+            }
+            return 0;
+        }
+    )", "Can only match on int or bool, got float"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            match 2 {
+                true => { return 0; }
+                _ => { return 1; }
+            }
+            return 0;
+        }
+    )", "Match pattern of type bool does not match subject of type int"));
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            var limit: int = 4;
+            match 2 {
+                limit => { return 0; }
+                _ => { return 1; }
+            }
+            return 0;
+        }
+    )", "Match pattern must be a compile-time constant"));
+}
+
+TEST_F(SemanticAnalyzerTest, GeneratorMisuse) {
+    EXPECT_TRUE(analyze(R"(
+        fn gen int range(lo: int, hi: int) {
+            var i: int = lo;
+            while (i < hi) {
+                yield i;
+                i += 1;
+            }
+        }
+
+        fn int main() {
+            var total: int = 0;
+            for i in range(0, 10) {
+                total += i;
+            }
+            return total;
+        }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn gen int range(lo: int, hi: int) {
+            yield lo;
+        }
+
+        fn int main() {
+            var r: int = range(0, 10);
+            return r;
+        }
+    )", "Generator 'range' can only be iterated with 'for ... in'"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn gen int once() {
+            yield 1;
+            return 2;
+        }
+
+        fn int main() { return 0; }
+    )", "Generator functions cannot return a value; use 'yield'"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            yield 1;
+            return 0;
+        }
+    )", "'yield' can only be used inside a generator function"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn gen int words() {
+            yield "one";
+        }
+
+        fn int main() { return 0; }
+    )", "Cannot yield str from a generator of int"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        @memo
+        fn gen int cached(n: int) {
+            yield n;
+        }
+
+        fn int main() { return 0; }
+    )", "Generator 'cached' cannot be memoized"));
+}
+
+// Bench blocks must be named and cannot leave the function
+TEST_F(SemanticAnalyzerTest, BenchRestrictions) {
+    EXPECT_TRUE(analyze(R"(
+        fn int main() {
+            var hits: int = 0;
+            bench "sum" {
+                hits += black_box(hits + 1);
+            }
+            var start: float = now_ns();
+            var ticks: float = cycles();
+            return 0;
+        }
+    )"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            bench "early" {
+                return 1;
+            }
+            return 0;
+        }
+    )", "Cannot return from inside a bench block"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            bench "" {
+                var x: int = 1;
+            }
+            return 0;
+        }
+    )", "Benchmark name cannot be empty"));
+
+    EXPECT_TRUE(hasSemanticError(R"(
+        fn int main() {
+            bench "strings" {
+                var s: str = black_box("text");
+            }
+            return 0;
+        }
+    )", "black_box requires an int, float or bool argument but got str"));
+}